@@ -22,24 +22,16 @@
 #include <stdlib.h>
 #include <sal.h>
 
-SQLHENV     hEnv;
-
 BOOL APIENTRY DllMain( HMODULE hModule,
                        DWORD  ul_reason_for_call,
                        LPVOID lpReserved
                      )
 {
+    // ODBC environment is allocated on first use by _GetEnvironment, calling
+    // into the driver manager while the loader lock is held is not safe
     switch (ul_reason_for_call)
     {
-        case DLL_PROCESS_ATTACH: {
-            // Allocate an environment
-            if (SQLAllocHandle(SQL_HANDLE_ENV, SQL_NULL_HANDLE, &hEnv) == SQL_ERROR)
-            {
-                fwprintf(stderr, L"Unable to allocate an environment handle\n");
-                exit(104);
-            }
-            break;
-        }
+        case DLL_PROCESS_ATTACH:
         case DLL_THREAD_ATTACH:
         case DLL_THREAD_DETACH:
         case DLL_PROCESS_DETACH:
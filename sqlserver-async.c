@@ -0,0 +1,214 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+#include "sqlserver-direct.h"
+#include "sqlserver-bound.h"
+#include "sqlserver-async.h"
+
+
+/*	Ends the pending operation unless the driver is still working on it */
+SQLSERVER_ASYNC_STATUS
+_AsyncComplete(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	RETCODE RetCode
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	if (RetCode == SQL_STILL_EXECUTING) {
+		return SQLSERVER_ASYNC_PENDING;
+	}
+	state->asyncOperation = SQLSERVER_ASYNC_IDLE;
+
+	if (RetCode == SQL_SUCCESS_WITH_INFO) {
+		_HandleDiagnosticRecord(state->hStmt, SQL_HANDLE_STMT, RetCode, stm);
+	}
+	if (RetCode == SQL_ERROR) {
+		_HandleDiagnosticRecord(state->hStmt, SQL_HANDLE_STMT, RetCode, stm);
+		_SetError(conn, stm);
+		return SQLSERVER_ASYNC_ERROR;
+	}
+	return SQLSERVER_ASYNC_DONE;
+}
+
+/*	A handle with a pending call cannot be freed */
+void
+_AsyncFreeStatement(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	if (SQLSERVER_STATEMENT_OF(stm)->asyncOperation != SQLSERVER_ASYNC_IDLE) {
+		sqlserverAsyncClose(conn, stm);
+	}
+}
+
+SQLSERVER_INTERFACE_API
+SQLSERVER_ASYNC_STATUS
+sqlserverAsyncExecute(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	_ResetError(conn, stm);
+
+	if (state->asyncOperation != SQLSERVER_ASYNC_IDLE) {
+		_SetErrorText(conn, stm, "Asynchronous operation in progress");
+		return SQLSERVER_ASYNC_ERROR;
+	}
+	stm->statement.sqlserver.cRowCount = -1;
+	stm->statement.sqlserver.isEof = TRUE;
+	state->boundRowsFetched = 0;
+
+	if (!_EnsurePrepared(conn, stm, sql)) {
+		return SQLSERVER_ASYNC_ERROR;
+	}
+
+	// the result set goes to the caller's block, see sqlserverAsyncBind
+	_FreeResultSet(conn, stm);
+	stm->statement.sqlserver.cColCount = 0;
+
+	// drivers without asynchronous execution make this a plain synchronous execution
+	SQLSetStmtAttr(state->hStmt, SQL_ATTR_ASYNC_ENABLE, (SQLPOINTER)SQL_ASYNC_ENABLE_ON, 0);
+
+	state->asyncOperation = SQLSERVER_ASYNC_EXECUTE;
+	return _AsyncComplete(conn, stm, _BeginExecute(conn, stm));
+}
+
+SQLSERVER_INTERFACE_API
+SQLSERVER_ASYNC_STATUS
+sqlserverAsyncPollExecute(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	_ResetError(conn, stm);
+
+	if (state->asyncOperation != SQLSERVER_ASYNC_EXECUTE) {
+		_SetErrorText(conn, stm, "No asynchronous execution in progress");
+		return SQLSERVER_ASYNC_ERROR;
+	}
+	// calling the execute function again with the same arguments polls the pending execution
+	return _AsyncComplete(conn, stm, _PollExecute(conn, stm));
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverAsyncBind(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const SQLSERVER_BOUND_COLUMN * columns,
+	SQLSMALLINT columnCount,
+	size_t rowSize,
+	SQLULEN blockRows
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+	BOOL				  bound;
+
+	_ResetError(conn, stm);
+
+	if (state->asyncOperation != SQLSERVER_ASYNC_IDLE) {
+		_SetErrorText(conn, stm, "Asynchronous operation in progress");
+		return FALSE;
+	}
+	if (blockRows == 0) {
+		blockRows = 1;
+	}
+
+	// describing the result set is quick, only the fetches are polled
+	SQLSetStmtAttr(state->hStmt, SQL_ATTR_ASYNC_ENABLE, (SQLPOINTER)SQL_ASYNC_ENABLE_OFF, 0);
+	bound = _BoundAttach(conn, stm, columns, columnCount, rowSize, blockRows);
+	SQLSetStmtAttr(state->hStmt, SQL_ATTR_ASYNC_ENABLE, (SQLPOINTER)SQL_ASYNC_ENABLE_ON, 0);
+
+	return bound;
+}
+
+SQLSERVER_INTERFACE_API
+SQLSERVER_ASYNC_STATUS
+sqlserverAsyncFetch(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	long long * rowCount
+)
+{
+	SQLSERVER_STATEMENT	  * state = SQLSERVER_STATEMENT_OF(stm);
+	SQLSERVER_ASYNC_STATUS	status;
+	RETCODE					RetCode;
+
+	_ResetError(conn, stm);
+	*rowCount = 0;
+
+	if (state->asyncOperation == SQLSERVER_ASYNC_EXECUTE) {
+		_SetErrorText(conn, stm, "Asynchronous execution in progress");
+		return SQLSERVER_ASYNC_ERROR;
+	}
+	if (stm->statement.sqlserver.isEof) {
+		return SQLSERVER_ASYNC_DONE;
+	}
+
+	state->asyncOperation = SQLSERVER_ASYNC_FETCH;
+	RetCode = SQLFetch(state->hStmt);
+
+	status = _AsyncComplete(conn, stm, RetCode);
+	if (status == SQLSERVER_ASYNC_DONE) {
+		if (RetCode == SQL_NO_DATA_FOUND || state->boundRowsFetched == 0) {
+			stm->statement.sqlserver.isEof = TRUE;
+		}
+		else {
+			*rowCount = (long long)state->boundRowsFetched;
+		}
+	}
+	return status;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverAsyncClose(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+	SQLHSTMT			  hStmt = state->hStmt;
+
+	if (state->asyncOperation != SQLSERVER_ASYNC_IDLE) {
+		if (state->asyncOperation == SQLSERVER_ASYNC_EXECUTE) {
+			_CancelExecute(conn, stm);
+		}
+		else {
+			SQLCancel(hStmt);
+			// the canceled call still has to be polled to its end before the handle accepts other calls
+			while (SQLFetch(hStmt) == SQL_STILL_EXECUTING) {
+				Sleep(1);
+			}
+		}
+		state->asyncOperation = SQLSERVER_ASYNC_IDLE;
+	}
+	SQLSetStmtAttr(hStmt, SQL_ATTR_ASYNC_ENABLE, (SQLPOINTER)SQL_ASYNC_ENABLE_OFF, 0);
+
+	sqlserverCloseBound(conn, stm);
+}
@@ -0,0 +1,67 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+#include "sqlserver-interface.h"
+#include "sqlserver-bound.h"
+
+/*	Polling passes of an event loop that yield with Sleep(0) before it starts sleeping 1ms between passes */
+#define SQLSERVER_ASYNC_SPIN_COUNT			64
+
+typedef enum _SQLSERVER_ASYNC_STATUS {
+	/*	details are in sqlserverGetStatementError */
+	SQLSERVER_ASYNC_ERROR = -1,
+	/*	the driver returned SQL_STILL_EXECUTING, poll again */
+	SQLSERVER_ASYNC_PENDING = 0,
+	SQLSERVER_ASYNC_DONE
+} SQLSERVER_ASYNC_STATUS;
+
+/*	SQLSERVER_STATEMENT.asyncOperation */
+typedef enum _SQLSERVER_ASYNC_OPERATION {
+	SQLSERVER_ASYNC_IDLE = 0,
+	SQLSERVER_ASYNC_EXECUTE,
+	SQLSERVER_ASYNC_FETCH
+} SQLSERVER_ASYNC_OPERATION;
+
+/* DDL's PRIVATE FUNCTIONS  */
+SQLSERVER_ASYNC_STATUS	_AsyncComplete(DBInt_Connection* conn, DBInt_Statement* stm, RETCODE RetCode);
+void					_AsyncFreeStatement(DBInt_Connection* conn, DBInt_Statement* stm);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Starts executing the statement with SQL_ATTR_ASYNC_ENABLE, preparing "sql" first if needed. PENDING means
+	the execution runs on the server: call sqlserverAsyncPollExecute until it returns something else. Drivers
+	without asynchronous execution run it to completion here. Executions are not retried and are left out of the
+	latency profile */
+SQLSERVER_INTERFACE_API SQLSERVER_ASYNC_STATUS	sqlserverAsyncExecute(DBInt_Connection* conn, DBInt_Statement* stm, const char* sql);
+SQLSERVER_INTERFACE_API SQLSERVER_ASYNC_STATUS	sqlserverAsyncPollExecute(DBInt_Connection* conn, DBInt_Statement* stm);
+
+/*	Binds the caller's block to the first result set once the execution is done, as in sqlserverExecuteBound */
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverAsyncBind(
+	DBInt_Connection* conn,
+	DBInt_Statement* stm,
+	const SQLSERVER_BOUND_COLUMN* columns,
+	SQLSMALLINT columnCount,
+	size_t rowSize,
+	SQLULEN blockRows);
+
+/*	Starts or polls the fetch of the next block into the bound buffers: call it again with the same arguments while
+	it returns PENDING. On DONE "rowCount" receives the rows in the block, 0 at end of result set */
+SQLSERVER_INTERFACE_API SQLSERVER_ASYNC_STATUS	sqlserverAsyncFetch(DBInt_Connection* conn, DBInt_Statement* stm, long long* rowCount);
+
+/*	Cancels a pending execution or fetch, closes the cursor and switches the statement back to synchronous calls */
+SQLSERVER_INTERFACE_API void					sqlserverAsyncClose(DBInt_Connection* conn, DBInt_Statement* stm);
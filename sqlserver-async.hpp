@@ -0,0 +1,472 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+/*	Coroutines for C++20 callers. co_await on an execution or on the next block of rows suspends the coroutine
+	while the driver returns SQL_STILL_EXECUTING, and an event_loop on one thread polls every suspended statement,
+	so a single thread can keep hundreds of queries in flight. Rows are decoded as in sqlserver-typed.hpp.
+
+		sqlserver::task<> report(sqlserver::event_loop& loop, DBInt_Connection* conn) {
+			sqlserver::async_query<Order> orders(loop, conn, "SELECT id, customer, total, shipped FROM orders WHERE total > ?");
+			auto rows = co_await orders.execute(100.0);
+			while (auto block = co_await rows.next()) {
+				for (const Order& order : block) {
+					...
+				}
+			}
+		}
+
+		sqlserver::event_loop loop;
+		loop.spawn(report(loop, conn));
+		loop.run();
+
+	Statements polled concurrently need their own connection, or one connection with MARS enabled. Preparing and
+	binding parameters stay synchronous, and so do drivers without asynchronous execution. Every awaitable belongs
+	to the loop's thread */
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "sqlserver-typed.hpp"
+
+extern "C" {
+#include "sqlserver-async.h"
+}
+
+namespace sqlserver {
+
+	template <typename T = void>
+	class task;
+
+	namespace detail {
+
+		template <typename T>
+		class task_promise;
+
+		/*	Resumes the awaiting coroutine when a task finishes */
+		struct task_final {
+			bool await_ready() const noexcept { return false; }
+
+			template <typename Promise>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> finished) noexcept {
+				std::coroutine_handle<> continuation = finished.promise().continuation;
+				return continuation ? continuation : std::noop_coroutine();
+			}
+
+			void await_resume() const noexcept {}
+		};
+
+		class task_promise_base {
+		public:
+			std::suspend_always initial_suspend() const noexcept { return {}; }
+			task_final final_suspend() const noexcept { return {}; }
+			void unhandled_exception() noexcept { exception = std::current_exception(); }
+
+			std::coroutine_handle<>		continuation;
+
+		protected:
+			void rethrow() const {
+				if (exception) {
+					std::rethrow_exception(exception);
+				}
+			}
+
+			std::exception_ptr			exception;
+		};
+
+		template <typename T>
+		class task_promise : public task_promise_base {
+		public:
+			task<T> get_return_object() noexcept;
+
+			template <typename Value>
+			void return_value(Value&& result) { value.emplace(std::forward<Value>(result)); }
+
+			T result() {
+				rethrow();
+				return std::move(*value);
+			}
+
+		private:
+			std::optional<T>			value;
+		};
+
+		template <>
+		class task_promise<void> : public task_promise_base {
+		public:
+			task<void> get_return_object() noexcept;
+
+			void return_void() const noexcept {}
+
+			void result() const { rethrow(); }
+		};
+
+	}
+
+	/*	Lazily started coroutine returning T. Runs when awaited or when spawned on an event_loop */
+	template <typename T>
+	class task {
+	public:
+		using promise_type = detail::task_promise<T>;
+
+		task(task&& other) noexcept : coroutine(std::exchange(other.coroutine, nullptr)) {}
+
+		task(const task&) = delete;
+		task& operator=(const task&) = delete;
+
+		~task() {
+			if (coroutine) {
+				coroutine.destroy();
+			}
+		}
+
+		bool done() const noexcept { return !coroutine || coroutine.done(); }
+
+		bool await_ready() const noexcept { return false; }
+
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+			coroutine.promise().continuation = awaiting;
+			return coroutine;
+		}
+
+		T await_resume() { return coroutine.promise().result(); }
+
+	private:
+		friend class detail::task_promise<T>;
+		friend class event_loop;
+
+		explicit task(std::coroutine_handle<promise_type> coroutine) noexcept : coroutine(coroutine) {}
+
+		std::coroutine_handle<promise_type>	coroutine;
+	};
+
+	namespace detail {
+
+		template <typename T>
+		task<T> task_promise<T>::get_return_object() noexcept {
+			return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+		}
+
+		inline task<void> task_promise<void>::get_return_object() noexcept {
+			return task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+		}
+
+	}
+
+	/*	Call the driver is still working on. poll() repeats it and returns true once it has finished */
+	class pending_operation {
+	public:
+		virtual ~pending_operation() = default;
+		virtual bool poll() = 0;
+	};
+
+	/*	Single threaded scheduler: resumes ready coroutines, then polls the suspended operations */
+	class event_loop {
+	public:
+		event_loop() = default;
+
+		event_loop(const event_loop&) = delete;
+		event_loop& operator=(const event_loop&) = delete;
+
+		/*	Starts "work" on the next pass. The loop keeps it until run returns */
+		void spawn(task<void> work) {
+			ready.push_back(work.coroutine);
+			spawned.push_back(std::move(work));
+		}
+
+		/*	Parks "awaiting" until "operation" reports it has finished */
+		void suspend(pending_operation* operation, std::coroutine_handle<> awaiting) {
+			waiting.push_back({ operation, awaiting });
+		}
+
+		/*	Runs until every spawned task has finished, then rethrows the first exception one of them ended with */
+		void run() {
+			unsigned int idlePasses = 0;
+
+			while (!ready.empty() || !waiting.empty()) {
+				while (!ready.empty()) {
+					std::coroutine_handle<> next = ready.front();
+					ready.pop_front();
+					next.resume();
+				}
+
+				// finished operations resume in the order they were suspended
+				std::size_t kept = 0;
+				for (std::size_t i = 0; i < waiting.size(); i++) {
+					if (waiting[i].operation->poll()) {
+						ready.push_back(waiting[i].awaiting);
+					}
+					else {
+						waiting[kept++] = waiting[i];
+					}
+				}
+				waiting.resize(kept);
+
+				if (!ready.empty()) {
+					idlePasses = 0;
+				}
+				else if (!waiting.empty()) {
+					Sleep(idlePasses++ < SQLSERVER_ASYNC_SPIN_COUNT ? 0 : 1);
+				}
+			}
+
+			std::vector<task<void>> finished = std::move(spawned);
+			spawned.clear();
+			for (task<void>& work : finished) {
+				work.coroutine.promise().result();
+			}
+		}
+
+		/*	Runs "work" and everything already spawned, and returns the result of "work" */
+		template <typename T>
+		T run(task<T> work) {
+			ready.push_back(work.coroutine);
+			run();
+			return work.coroutine.promise().result();
+		}
+
+	private:
+		struct waiter {
+			pending_operation		  * operation;
+			std::coroutine_handle<>		awaiting;
+		};
+
+		std::deque<std::coroutine_handle<>>	ready;
+		std::vector<waiter>					waiting;
+		std::vector<task<void>>				spawned;
+	};
+
+	/*	co_await execute(loop, conn, stm, sql) runs a prepared and bound statement. The result set, if any, is
+		then bound with sqlserverAsyncBind and read with fetch */
+	class execute_operation : public pending_operation {
+	public:
+		execute_operation(event_loop& loop, DBInt_Connection* conn, DBInt_Statement* stm, const char* sql) noexcept
+			: loop(loop), conn(conn), stm(stm), sql(sql), status(SQLSERVER_ASYNC_PENDING) {}
+
+		bool await_ready() {
+			status = sqlserverAsyncExecute(conn, stm, sql);
+			return status != SQLSERVER_ASYNC_PENDING;
+		}
+
+		void await_suspend(std::coroutine_handle<> awaiting) { loop.suspend(this, awaiting); }
+
+		void await_resume() const {
+			if (status == SQLSERVER_ASYNC_ERROR) {
+				throw error::of(stm);
+			}
+		}
+
+		bool poll() override {
+			status = sqlserverAsyncPollExecute(conn, stm);
+			return status != SQLSERVER_ASYNC_PENDING;
+		}
+
+	private:
+		event_loop			  & loop;
+		DBInt_Connection	  * conn;
+		DBInt_Statement		  * stm;
+		const char			  * sql;
+		SQLSERVER_ASYNC_STATUS	status;
+	};
+
+	/*	co_await fetch(loop, conn, stm) reads the next block into the bound buffers and returns its row count,
+		0 at end of result set */
+	class fetch_operation : public pending_operation {
+	public:
+		fetch_operation(event_loop& loop, DBInt_Connection* conn, DBInt_Statement* stm) noexcept
+			: loop(loop), conn(conn), stm(stm), status(SQLSERVER_ASYNC_PENDING), rowCount(0) {}
+
+		bool await_ready() { return poll(); }
+
+		void await_suspend(std::coroutine_handle<> awaiting) { loop.suspend(this, awaiting); }
+
+		long long await_resume() const {
+			if (status == SQLSERVER_ASYNC_ERROR) {
+				throw error::of(stm);
+			}
+			return rowCount;
+		}
+
+		// the same call starts the fetch and polls it
+		bool poll() override {
+			status = sqlserverAsyncFetch(conn, stm, &rowCount);
+			return status != SQLSERVER_ASYNC_PENDING;
+		}
+
+	private:
+		event_loop			  & loop;
+		DBInt_Connection	  * conn;
+		DBInt_Statement		  * stm;
+		SQLSERVER_ASYNC_STATUS	status;
+		long long				rowCount;
+	};
+
+	inline execute_operation execute(event_loop& loop, DBInt_Connection* conn, DBInt_Statement* stm, const char* sql) noexcept {
+		return execute_operation(loop, conn, stm, sql);
+	}
+
+	inline fetch_operation fetch(event_loop& loop, DBInt_Connection* conn, DBInt_Statement* stm) noexcept {
+		return fetch_operation(loop, conn, stm);
+	}
+
+	template <typename Row, std::size_t BlockRows>
+	class async_query;
+
+	/*	Rows of one fetched block, decoded when dereferenced. Valid until the next block is awaited */
+	template <typename Row, std::size_t BlockRows>
+	class row_block {
+	public:
+		class iterator {
+		public:
+			using iterator_category = std::input_iterator_tag;
+			using value_type = Row;
+			using difference_type = std::ptrdiff_t;
+			using pointer = void;
+			using reference = Row;
+
+			iterator(const detail::fetch_block<Row, BlockRows>* block, std::size_t row) noexcept : block(block), row(row) {}
+
+			Row operator*() const { return block->decode(row); }
+
+			iterator& operator++() noexcept {
+				row++;
+				return *this;
+			}
+
+			void operator++(int) noexcept { row++; }
+
+			bool operator==(const iterator& other) const noexcept { return row == other.row; }
+			bool operator!=(const iterator& other) const noexcept { return row != other.row; }
+
+		private:
+			const detail::fetch_block<Row, BlockRows>  * block;
+			std::size_t									row;
+		};
+
+		row_block(const detail::fetch_block<Row, BlockRows>* block, std::size_t count) noexcept : block(block), count(count) {}
+
+		/*	false at end of result set */
+		explicit operator bool() const noexcept { return count > 0; }
+
+		std::size_t size() const noexcept { return count; }
+
+		Row operator[](std::size_t row) const { return block->decode(row); }
+
+		iterator begin() const noexcept { return iterator(block, 0); }
+		iterator end() const noexcept { return iterator(block, count); }
+
+	private:
+		const detail::fetch_block<Row, BlockRows>  * block;
+		std::size_t									count;
+	};
+
+	/*	Result set of one execution of an async_query, read a block at a time */
+	template <typename Row, std::size_t BlockRows = SQLSERVER_TYPED_BLOCK_ROWS>
+	class async_result {
+	public:
+		class next_operation : public fetch_operation {
+		public:
+			explicit next_operation(async_query<Row, BlockRows>* owner) noexcept
+				: fetch_operation(owner->loop, owner->conn, owner->stm), owner(owner) {}
+
+			row_block<Row, BlockRows> await_resume() const {
+				long long count = fetch_operation::await_resume();
+				return row_block<Row, BlockRows>(&owner->block, static_cast<std::size_t>(count));
+			}
+
+		private:
+			async_query<Row, BlockRows>	  * owner;
+		};
+
+		async_result(async_result&& other) noexcept : owner(std::exchange(other.owner, nullptr)) {}
+
+		async_result(const async_result&) = delete;
+		async_result& operator=(const async_result&) = delete;
+
+		~async_result() {
+			if (owner) {
+				sqlserverAsyncClose(owner->conn, owner->stm);
+			}
+		}
+
+		/*	co_await next() fetches the next block, an empty one at end of result set */
+		next_operation next() noexcept { return next_operation(owner); }
+
+	private:
+		friend class async_query<Row, BlockRows>;
+
+		explicit async_result(async_query<Row, BlockRows>* owner) noexcept : owner(owner) {}
+
+		async_query<Row, BlockRows>	  * owner;
+	};
+
+	/*	Prepared statement with a typed result, executed and fetched with co_await. Owns its DBInt_Statement and
+		fetch block, one result may be open at a time. The loop and the connection must outlive the query */
+	template <typename Row, std::size_t BlockRows = SQLSERVER_TYPED_BLOCK_ROWS>
+	class async_query {
+	public:
+		class execute_operation : public sqlserver::execute_operation {
+		public:
+			explicit execute_operation(async_query* owner) noexcept
+				: sqlserver::execute_operation(owner->loop, owner->conn, owner->stm, owner->sql.c_str()), owner(owner) {}
+
+			async_result<Row, BlockRows> await_resume() const {
+				sqlserver::execute_operation::await_resume();
+				if (!sqlserverAsyncBind(owner->conn, owner->stm, owner->block.columns(), static_cast<SQLSMALLINT>(owner->block.column_count),
+					sizeof(typename detail::fetch_block<Row, BlockRows>::row_type), BlockRows)) {
+					throw error::of(owner->stm);
+				}
+				return async_result<Row, BlockRows>(owner);
+			}
+
+		private:
+			async_query	  * owner;
+		};
+
+		async_query(event_loop& loop, DBInt_Connection* conn, const char* sql)
+			: loop(loop), conn(conn), stm(detail::prepare(conn, sql)), sql(sql) {}
+
+		async_query(const async_query&) = delete;
+		async_query& operator=(const async_query&) = delete;
+
+		~async_query() {
+			sqlserverFreeStatement(conn, stm);
+		}
+
+		/*	Binds "args" to parameters 1 to sizeof...(args) now, co_await on the result executes. The previous
+			result must be gone */
+		template <typename... Args>
+		execute_operation execute(const Args&... args) {
+			detail::bind_all(conn, stm, std::index_sequence_for<Args...>(), args...);
+			return execute_operation(this);
+		}
+
+		DBInt_Statement* statement() const noexcept { return stm; }
+
+	private:
+		friend class async_result<Row, BlockRows>;
+
+		event_loop							  & loop;
+		DBInt_Connection					  * conn;
+		DBInt_Statement						  * stm;
+		std::string								sql;
+		detail::fetch_block<Row, BlockRows>		block;
+	};
+
+}
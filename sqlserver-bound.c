@@ -0,0 +1,195 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+#include "sqlserver-direct.h"
+#include "sqlserver-retry.h"
+#include "sqlserver-profile.h"
+#include "sqlserver-capture.h"
+#include "sqlserver-bound.h"
+
+
+/*	Moves to the first result set once the statement has been executed and binds the caller's block to it */
+BOOL
+_BoundAttach(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const SQLSERVER_BOUND_COLUMN * columns,
+	SQLSMALLINT columnCount,
+	size_t rowSize,
+	SQLULEN blockRows
+)
+{
+	SQLSERVER_STATEMENT	  * state = SQLSERVER_STATEMENT_OF(stm);
+	SQLHSTMT				hStmt = state->hStmt;
+	SQLSMALLINT				colCount = 0;
+	RETCODE					RetCode;
+
+	// statements returning no result set come first in the batch
+	for (;;) {
+		TRYODBC_STM(stm,
+			SQLNumResultCols(hStmt, &colCount));
+		if (colCount > 0) {
+			break;
+		}
+		TRYODBC_STM(stm,
+			RetCode = SQLMoreResults(hStmt));
+		if (RetCode == SQL_NO_DATA) {
+			_SetErrorText(conn, stm, "Statement returned no result set");
+			goto Exit;
+		}
+	}
+	if (colCount < columnCount) {
+		_SetErrorText(conn, stm, "Result set has fewer columns than bound");
+		goto Exit;
+	}
+
+	TRYODBC_STM(stm,
+		SQLSetStmtAttr(hStmt, SQL_ATTR_ROW_BIND_TYPE, (SQLPOINTER)rowSize, 0));
+
+	TRYODBC_STM(stm,
+		SQLSetStmtAttr(hStmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER)blockRows, 0));
+
+	TRYODBC_STM(stm,
+		SQLSetStmtAttr(hStmt, SQL_ATTR_ROWS_FETCHED_PTR, &state->boundRowsFetched, 0));
+
+	for (SQLSMALLINT iCol = 0; iCol < columnCount; iCol++) {
+		TRYODBC_STM(stm,
+			SQLBindCol(hStmt, iCol + 1, columns[iCol].cType, columns[iCol].value, columns[iCol].valueLength, columns[iCol].indicator));
+	}
+	stm->statement.sqlserver.isEof = FALSE;
+
+Exit:
+	return !state->lastError.hasError;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverExecuteBound(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql,
+	const SQLSERVER_BOUND_COLUMN * columns,
+	SQLSMALLINT columnCount,
+	size_t rowSize,
+	SQLULEN blockRows
+)
+{
+	SQLSERVER_STATEMENT	  * state = SQLSERVER_STATEMENT_OF(stm);
+	RETCODE					RetCode;
+
+	_ResetError(conn, stm);
+	stm->statement.sqlserver.cRowCount = -1;
+	stm->statement.sqlserver.isEof = TRUE;
+	state->boundRowsFetched = 0;
+
+	if (blockRows == 0) {
+		blockRows = 1;
+	}
+
+	if (!_EnsurePrepared(conn, stm, sql)) {
+		return FALSE;
+	}
+
+	// the library's own column buffers are not used while the caller's block is bound
+	_FreeResultSet(conn, stm);
+	stm->statement.sqlserver.cColCount = 0;
+
+	for (int attempt = 1; ; attempt++) {
+		RetCode = _BeginExecute(conn, stm);
+
+		if (RetCode == SQL_SUCCESS_WITH_INFO) {
+			_HandleDiagnosticRecord(state->hStmt, SQL_HANDLE_STMT, RetCode, stm);
+		}
+		if (RetCode == SQL_ERROR) {
+			_HandleDiagnosticRecord(state->hStmt, SQL_HANDLE_STMT, RetCode, stm);
+			_SetError(conn, stm);
+		}
+		else if (RetCode == SQL_NO_DATA) {
+			_SetErrorText(conn, stm, "Statement returned no result set");
+		}
+		else {
+			_BoundAttach(conn, stm, columns, columnCount, rowSize, blockRows);
+		}
+
+		if (!_RetryBeforeNextAttempt(conn, stm, attempt)) {
+			break;
+		}
+	}
+
+	if (state->lastError.hasError) {
+		sqlserverCloseBound(conn, stm);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+SQLSERVER_INTERFACE_API
+long long
+sqlserverFetchBound(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_STATEMENT	  * state = SQLSERVER_STATEMENT_OF(stm);
+	long long				retval = -1;
+	RETCODE					RetCode;
+
+	_ResetError(conn, stm);
+
+	if (stm->statement.sqlserver.isEof) {
+		return 0;
+	}
+
+	LONGLONG started = _ProfileStart(stm);
+	TRYODBC_STM(stm,
+		RetCode = SQLFetch(state->hStmt));
+	_ProfileRecord(stm, SQLSERVER_PROFILE_FETCH, started);
+	_CaptureFetch(conn, stm, RetCode, started);
+
+	if (RetCode == SQL_NO_DATA_FOUND || state->boundRowsFetched == 0) {
+		stm->statement.sqlserver.isEof = TRUE;
+		retval = 0;
+		goto Exit;
+	}
+	retval = (long long)state->boundRowsFetched;
+
+Exit:
+	return retval;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverCloseBound(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+	SQLHSTMT			  hStmt = state->hStmt;
+
+	SQLSetStmtAttr(hStmt, SQL_ATTR_ROWS_FETCHED_PTR, NULL, 0);
+	SQLSetStmtAttr(hStmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER)1, 0);
+	SQLSetStmtAttr(hStmt, SQL_ATTR_ROW_BIND_TYPE, (SQLPOINTER)SQL_BIND_BY_COLUMN, 0);
+	SQLFreeStmt(hStmt, SQL_UNBIND);
+	SQLFreeStmt(hStmt, SQL_CLOSE);
+
+	stm->statement.sqlserver.isEof = TRUE;
+	state->boundRowsFetched = 0;
+}
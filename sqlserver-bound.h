@@ -0,0 +1,57 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+#include "sqlserver-interface.h"
+
+/*	Result column fetched straight into caller memory. "value" and "indicator" point into the first row of the
+	caller's block, the other rows are found "rowSize" bytes apart (row-wise binding) */
+typedef struct _SQLSERVER_BOUND_COLUMN {
+	/*	SQL_C_xxx the driver converts the column to */
+	SQLSMALLINT		cType;
+	SQLPOINTER		value;
+	/*	bytes at "value", including the terminator of SQL_C_CHAR and SQL_C_WCHAR. Ignored for fixed size types */
+	SQLLEN			valueLength;
+	/*	receives the byte length or SQL_NULL_DATA. Required */
+	SQLLEN		  * indicator;
+} SQLSERVER_BOUND_COLUMN;
+
+/* DDL's PRIVATE FUNCTIONS  */
+BOOL			_BoundAttach(DBInt_Connection* conn, DBInt_Statement* stm, const SQLSERVER_BOUND_COLUMN* columns, SQLSMALLINT columnCount, size_t rowSize, SQLULEN blockRows);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Executes the statement, preparing "sql" first if needed, and binds result columns 1 to "columnCount" to
+	"columns" instead of the library's text buffers. Nothing is decoded by the library: values reach the caller's
+	block as converted by the driver and sqlserverGetColumnValueByColumnName must not be used on "stm".
+	Row counts of statements before the first result set are skipped, result columns after "columnCount" are
+	ignored. Read blocks of up to "blockRows" rows with sqlserverFetchBound, then call sqlserverCloseBound */
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverExecuteBound(
+	DBInt_Connection* conn,
+	DBInt_Statement* stm,
+	const char* sql,
+	const SQLSERVER_BOUND_COLUMN* columns,
+	SQLSMALLINT columnCount,
+	size_t rowSize,
+	SQLULEN blockRows);
+
+/*	Fetches the next block into the caller's buffers. Returns the row count, 0 at end of result set and -1 on error.
+	Truncated text keeps the full length in its indicator */
+SQLSERVER_INTERFACE_API long long				sqlserverFetchBound(DBInt_Connection* conn, DBInt_Statement* stm);
+
+/*	Closes the cursor, unbinds the caller's buffers and restores single row fetching */
+SQLSERVER_INTERFACE_API void					sqlserverCloseBound(DBInt_Connection* conn, DBInt_Statement* stm);
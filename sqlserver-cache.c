@@ -0,0 +1,725 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+#include "sqlserver-cache.h"
+
+
+/*	Entries outlive the connections that filled them, so they get a heap of their own */
+HANDLE					cacheHeap = NULL;
+INIT_ONCE				cacheInitOnce = INIT_ONCE_STATIC_INIT;
+
+/*	Guards everything below. Entry contents are immutable after publishing and are read without it */
+SRWLOCK					cacheLock = SRWLOCK_INIT;
+SQLSERVER_CACHE_ENTRY * cacheBuckets[SQLSERVER_CACHE_BUCKET_COUNT];
+/*	most recently used first */
+SQLSERVER_CACHE_ENTRY * cacheLruHead = NULL;
+SQLSERVER_CACHE_ENTRY * cacheLruTail = NULL;
+size_t					cacheMaxBytes = SQLSERVER_CACHE_DEFAULT_MAX_BYTES;
+size_t					cacheMaxEntryBytes = SQLSERVER_CACHE_DEFAULT_MAX_ENTRY_BYTES;
+SQLSERVER_CACHE_STATS	cacheStats;
+/*	bumped by sqlserverInvalidateResultCache, fills started before that are not published */
+unsigned long long		cacheGeneration = 0;
+
+
+BOOL CALLBACK
+_CacheInit(
+	PINIT_ONCE initOnce,
+	PVOID parameter,
+	PVOID * context
+)
+{
+	cacheHeap = HeapCreate(0, 0, 0);
+	return cacheHeap != NULL;
+}
+
+BOOL
+_CacheAppend(
+	char ** buffer,
+	size_t * length,
+	size_t * capacity,
+	const void * data,
+	size_t size
+)
+{
+	if (*length + size > *capacity) {
+		size_t newCapacity = max(max(*capacity * 2, *length + size), 256);
+		char * newBuffer = mkMalloc(cacheHeap, newCapacity, __FILE__, __LINE__);
+		if (newBuffer == NULL) {
+			return FALSE;
+		}
+		if (*buffer) {
+			memcpy(newBuffer, *buffer, *length);
+			mkFree(cacheHeap, *buffer);
+		}
+		*buffer = newBuffer;
+		*capacity = newCapacity;
+	}
+	memcpy(*buffer + *length, data, size);
+	*length += size;
+	return TRUE;
+}
+
+/*	Key is the connection string, the prepared SQL text and the value of every bound parameter. Allocated on
+	cacheHeap. Returns NULL for statements that cannot be cached */
+char *
+_CacheBuildKey(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	size_t * keyLength,
+	unsigned long long * hash
+)
+{
+	const char * sql = SQLSERVER_STATEMENT_OF(stm)->preparedSql;
+	char	   * key = NULL;
+	size_t		 capacity = 0;
+	BOOL		 ok;
+
+	*keyLength = 0;
+	if (sql == NULL) {
+		return NULL;
+	}
+	ok = _CacheAppend(&key, keyLength, &capacity, conn->connection_string, (wcslen(conn->connection_string) + 1) * sizeof(SQLWCHAR));
+	ok = ok && _CacheAppend(&key, keyLength, &capacity, sql, strlen(sql) + 1);
+
+	for (SQLSMALLINT iParam = 0; ok && iParam < stm->statement.sqlserver.ParameterCount; iParam++) {
+		ODBC_BINDING  * binding = &stm->statement.sqlserver.bindVariables[iParam];
+		SQLLEN			length;
+
+		if (binding->fCType == SQL_C_DEFAULT) {
+			// table-valued parameter, rows live in caller memory
+			ok = FALSE;
+			break;
+		}
+		if (binding->pcbValue == SQL_NULL_DATA) {
+			length = -1;
+		}
+		else if (binding->fCType == SQL_C_WCHAR) {
+			length = wcsnlen((WCHAR*)binding->buffer, binding->buffer_length / sizeof(WCHAR)) * sizeof(WCHAR);
+		}
+		else if (binding->pcbValue >= 0) {
+			length = min(binding->pcbValue, binding->buffer_length);
+		}
+		else {
+			length = binding->buffer_length;
+		}
+		ok = _CacheAppend(&key, keyLength, &capacity, &binding->fCType, sizeof(binding->fCType));
+		ok = ok && _CacheAppend(&key, keyLength, &capacity, &length, sizeof(length));
+		if (length > 0) {
+			ok = ok && _CacheAppend(&key, keyLength, &capacity, binding->buffer, length);
+		}
+	}
+
+	if (!ok) {
+		if (key) {
+			mkFree(cacheHeap, key);
+		}
+		return NULL;
+	}
+
+	// FNV-1a
+	*hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < *keyLength; i++) {
+		*hash ^= (unsigned char)key[i];
+		*hash *= 1099511628211ULL;
+	}
+	return key;
+}
+
+/*	Called with cacheLock held. Returns the live entry with an extra reference, or NULL */
+SQLSERVER_CACHE_ENTRY *
+_CacheLookup(
+	unsigned long long hash,
+	const char * key,
+	size_t keyLength
+)
+{
+	SQLSERVER_CACHE_ENTRY * entry = cacheBuckets[hash % SQLSERVER_CACHE_BUCKET_COUNT];
+
+	while (entry && !(entry->hash == hash && entry->keyLength == keyLength && memcmp(entry->key, key, keyLength) == 0)) {
+		entry = entry->nextInBucket;
+	}
+
+	if (entry && entry->expiresAt <= GetTickCount64()) {
+		cacheStats.expirations++;
+		_CacheUnlink(entry);
+		entry = NULL;
+	}
+
+	if (entry == NULL) {
+		cacheStats.misses++;
+		return NULL;
+	}
+
+	cacheStats.hits++;
+	if (entry != cacheLruHead) {
+		// move to the front
+		entry->lruPrevious->lruNext = entry->lruNext;
+		if (entry->lruNext) {
+			entry->lruNext->lruPrevious = entry->lruPrevious;
+		}
+		else {
+			cacheLruTail = entry->lruPrevious;
+		}
+		entry->lruPrevious = NULL;
+		entry->lruNext = cacheLruHead;
+		cacheLruHead->lruPrevious = entry;
+		cacheLruHead = entry;
+	}
+	InterlockedIncrement(&entry->refCount);
+	return entry;
+}
+
+/*	Called with cacheLock held. The cache's reference to "entry" is handed over */
+void
+_CachePublish(
+	SQLSERVER_CACHE_ENTRY * entry
+)
+{
+	SQLSERVER_CACHE_ENTRY ** bucket = &cacheBuckets[entry->hash % SQLSERVER_CACHE_BUCKET_COUNT];
+
+	if (entry->generation != cacheGeneration) {
+		// the query ran before an invalidation, its rows may predate the change
+		_CacheRelease(entry);
+		return;
+	}
+
+	// another statement may have filled the same result set meanwhile
+	for (SQLSERVER_CACHE_ENTRY * existing = *bucket; existing; existing = existing->nextInBucket) {
+		if (existing->hash == entry->hash && existing->keyLength == entry->keyLength && memcmp(existing->key, entry->key, entry->keyLength) == 0) {
+			_CacheUnlink(existing);
+			break;
+		}
+	}
+
+	entry->nextInBucket = *bucket;
+	*bucket = entry;
+
+	entry->lruPrevious = NULL;
+	entry->lruNext = cacheLruHead;
+	if (cacheLruHead) {
+		cacheLruHead->lruPrevious = entry;
+	}
+	else {
+		cacheLruTail = entry;
+	}
+	cacheLruHead = entry;
+
+	cacheStats.entryCount++;
+	cacheStats.byteCount += entry->byteCount;
+
+	_CacheEvict();
+}
+
+/*	Called with cacheLock held */
+void
+_CacheEvict(
+	void
+)
+{
+	while (cacheStats.byteCount > cacheMaxBytes && cacheLruTail) {
+		cacheStats.evictions++;
+		_CacheUnlink(cacheLruTail);
+	}
+}
+
+/*	Called with cacheLock held. Removes "entry" from the cache and drops the cache's reference */
+void
+_CacheUnlink(
+	SQLSERVER_CACHE_ENTRY * entry
+)
+{
+	SQLSERVER_CACHE_ENTRY ** link = &cacheBuckets[entry->hash % SQLSERVER_CACHE_BUCKET_COUNT];
+
+	while (*link != entry) {
+		link = &(*link)->nextInBucket;
+	}
+	*link = entry->nextInBucket;
+
+	if (entry->lruPrevious) {
+		entry->lruPrevious->lruNext = entry->lruNext;
+	}
+	else {
+		cacheLruHead = entry->lruNext;
+	}
+	if (entry->lruNext) {
+		entry->lruNext->lruPrevious = entry->lruPrevious;
+	}
+	else {
+		cacheLruTail = entry->lruPrevious;
+	}
+
+	cacheStats.entryCount--;
+	cacheStats.byteCount -= entry->byteCount;
+
+	_CacheRelease(entry);
+}
+
+void
+_CacheRelease(
+	SQLSERVER_CACHE_ENTRY * entry
+)
+{
+	if (InterlockedDecrement(&entry->refCount) > 0) {
+		return;
+	}
+	if (entry->columns) {
+		for (SQLSMALLINT iCol = 0; iCol < entry->colCount; iCol++) {
+			if (entry->columns[iCol].columnName) {
+				mkFree(cacheHeap, entry->columns[iCol].columnName);
+			}
+		}
+		mkFree(cacheHeap, entry->columns);
+	}
+	if (entry->rows) {
+		mkFree(cacheHeap, entry->rows);
+	}
+	if (entry->tags) {
+		mkFree(cacheHeap, entry->tags);
+	}
+	mkFree(cacheHeap, entry->key);
+	mkFree(cacheHeap, entry);
+}
+
+BOOL
+_CacheHasTag(
+	SQLSERVER_CACHE_ENTRY * entry,
+	const char * tag
+)
+{
+	size_t		tagLength = strlen(tag);
+	const char *token = entry->tags;
+
+	while (token && *token) {
+		while (*token == ' ' || *token == ',') {
+			token++;
+		}
+		const char * end = token;
+		while (*end && *end != ',') {
+			end++;
+		}
+		size_t length = end - token;
+		while (length > 0 && token[length - 1] == ' ') {
+			length--;
+		}
+		if (length == tagLength && length > 0 && _strnicmp(token, tag, length) == 0) {
+			return TRUE;
+		}
+		token = end;
+	}
+	return FALSE;
+}
+
+void
+_CacheResetStatement(
+	SQLSERVER_CACHE_CURSOR * cursor
+)
+{
+	if (cursor->entry) {
+		_CacheRelease(cursor->entry);
+		cursor->entry = NULL;
+	}
+	if (cursor->fill) {
+		// result set was not fetched to the end
+		_CacheRelease(cursor->fill);
+		cursor->fill = NULL;
+	}
+}
+
+/*	Gives the statement a result set layout matching "entry", reusing the current one when it is the same */
+void
+_CacheBindColumns(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLSERVER_CACHE_ENTRY * entry
+)
+{
+	BOOL reuse = (stm->statement.sqlserver.resultSet != NULL && stm->statement.sqlserver.cColCount == entry->colCount);
+
+	// the bindings may be left by another query of the same shape, names and types are served from them
+	for (SQLSMALLINT iCol = 0; reuse && iCol < entry->colCount; iCol++) {
+		const BINDING * bind = &stm->statement.sqlserver.resultSet[iCol];
+		reuse = (bind->rowDataCharacterCount == entry->columns[iCol].rowDataCharacterCount &&
+			bind->dataType == entry->columns[iCol].dataType &&
+			bind->columnName != NULL &&
+			strcmp(bind->columnName, entry->columns[iCol].columnName) == 0);
+	}
+	if (reuse) {
+		return;
+	}
+
+	stm->statement.sqlserver.cColCount = entry->colCount;
+	_AllocateResultSet(conn, stm, entry->colCount);
+
+	for (SQLSMALLINT iCol = 0; iCol < entry->colCount; iCol++) {
+		BINDING * bind = &stm->statement.sqlserver.resultSet[iCol];
+		bind->rowDataCharacterCount = entry->columns[iCol].rowDataCharacterCount;
+		bind->dataType = entry->columns[iCol].dataType;
+		size_t nameSize = strlen(entry->columns[iCol].columnName) + 1;
+		bind->wRowData = _StatementMalloc(conn, stm, (bind->rowDataCharacterCount + 1) * sizeof(WCHAR), __FILE__, __LINE__);
+		bind->chRowData = _StatementMalloc(conn, stm, (bind->rowDataCharacterCount + 1) * sizeof(char), __FILE__, __LINE__);
+		bind->columnName = _StatementMalloc(conn, stm, nameSize, __FILE__, __LINE__);
+		memcpy(bind->columnName, entry->columns[iCol].columnName, nameSize);
+	}
+}
+
+/*	Copies the row at the cursor into the column buffers, the way SQLFetch would */
+void
+_CacheLoadRow(
+	DBInt_Statement * stm,
+	SQLSERVER_CACHE_CURSOR * cursor
+)
+{
+	SQLSERVER_CACHE_ENTRY * entry = cursor->entry;
+
+	if (cursor->row >= entry->rowCount) {
+		stm->statement.sqlserver.isEof = TRUE;
+		return;
+	}
+
+	for (SQLSMALLINT iCol = 0; iCol < entry->colCount; iCol++) {
+		BINDING   * bind = &stm->statement.sqlserver.resultSet[iCol];
+		INT32		length;
+
+		memcpy(&length, entry->rows + cursor->offset, sizeof(INT32));
+		cursor->offset += sizeof(INT32);
+
+		if (length < 0) {
+			bind->indPtr = SQL_NULL_DATA;
+			bind->wRowData[0] = L'\0';
+		}
+		else {
+			bind->indPtr = length * sizeof(WCHAR);
+			memcpy(bind->wRowData, entry->rows + cursor->offset, length * sizeof(WCHAR));
+			bind->wRowData[length] = L'\0';
+			cursor->offset += length * sizeof(WCHAR);
+		}
+	}
+	cursor->row++;
+	stm->statement.sqlserver.isEof = FALSE;
+}
+
+/*	Appends the row just fetched by the driver to the entry being filled */
+void
+_CacheRecordRow(
+	DBInt_Statement * stm,
+	SQLSERVER_CACHE_CURSOR * cursor
+)
+{
+	SQLSERVER_CACHE_ENTRY * fill = cursor->fill;
+	size_t					before = fill->rowsCapacity;
+	BOOL					ok = TRUE;
+
+	for (SQLSMALLINT iCol = 0; ok && iCol < fill->colCount; iCol++) {
+		BINDING   * bind = &stm->statement.sqlserver.resultSet[iCol];
+		INT32		length = (INT32)_GetBoundValueLength(bind);
+
+		ok = _CacheAppend(&fill->rows, &fill->rowsLength, &fill->rowsCapacity, &length, sizeof(INT32));
+		if (length > 0) {
+			ok = ok && _CacheAppend(&fill->rows, &fill->rowsLength, &fill->rowsCapacity, bind->wRowData, length * sizeof(WCHAR));
+		}
+	}
+	fill->byteCount += fill->rowsCapacity - before;
+	fill->rowCount++;
+
+	if (!ok || fill->byteCount > cacheMaxEntryBytes) {
+		AcquireSRWLockExclusive(&cacheLock);
+		cacheStats.oversized++;
+		ReleaseSRWLockExclusive(&cacheLock);
+
+		_CacheRelease(fill);
+		cursor->fill = NULL;
+	}
+}
+
+/*	Called by sqlserverExecuteSelectStatement before executing. Returns TRUE if the result set was served from
+	the cache, otherwise prepares to record the result set the driver is about to return. */
+BOOL
+_CacheExecute(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_CACHE_CURSOR * cursor = SQLSERVER_STATEMENT_OF(stm)->cache;
+	SQLSERVER_CACHE_ENTRY  * entry;
+	unsigned long long		 hash;
+	unsigned long long		 generation;
+	size_t					 keyLength;
+	char					*key;
+
+	if (cursor == NULL) {
+		return FALSE;
+	}
+	_CacheResetStatement(cursor);
+
+	key = _CacheBuildKey(conn, stm, &keyLength, &hash);
+	if (key == NULL) {
+		return FALSE;
+	}
+
+	AcquireSRWLockExclusive(&cacheLock);
+	entry = _CacheLookup(hash, key, keyLength);
+	generation = cacheGeneration;
+	ReleaseSRWLockExclusive(&cacheLock);
+
+	if (entry) {
+		mkFree(cacheHeap, key);
+		// a result set left open by an earlier execution would block the next SQLExecute
+		SQLFreeStmt(*stm->statement.sqlserver.hStmt, SQL_CLOSE);
+		cursor->entry = entry;
+		cursor->row = 0;
+		cursor->offset = 0;
+		_CacheBindColumns(conn, stm, entry);
+		_CacheLoadRow(stm, cursor);
+		return TRUE;
+	}
+
+	SQLSERVER_CACHE_ENTRY * fill = mkMalloc(cacheHeap, sizeof(SQLSERVER_CACHE_ENTRY), __FILE__, __LINE__);
+	if (fill == NULL) {
+		mkFree(cacheHeap, key);
+		return FALSE;
+	}
+	memset(fill, 0, sizeof(SQLSERVER_CACHE_ENTRY));
+	fill->hash = hash;
+	fill->key = key;
+	fill->keyLength = keyLength;
+	fill->generation = generation;
+	fill->tags = cursor->tags ? mkStrdup(cacheHeap, cursor->tags, __FILE__, __LINE__) : NULL;
+	// staleness is measured from the time the query ran
+	fill->expiresAt = GetTickCount64() + cursor->ttlMs;
+	fill->byteCount = sizeof(SQLSERVER_CACHE_ENTRY) + keyLength + (cursor->tags ? strlen(cursor->tags) + 1 : 0);
+	fill->refCount = 1;
+	cursor->fill = fill;
+
+	return FALSE;
+}
+
+/*	Called after every SQLFetch on the statement. Records the row, or publishes the result set at its end */
+void
+_CacheFetched(
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_CACHE_CURSOR * cursor = SQLSERVER_STATEMENT_OF(stm)->cache;
+
+	if (cursor == NULL || cursor->fill == NULL) {
+		return;
+	}
+
+	SQLSERVER_CACHE_ENTRY * fill = cursor->fill;
+
+	if (fill->columns == NULL) {
+		// first fetch, layout is known now
+		fill->colCount = stm->statement.sqlserver.cColCount;
+		fill->columns = mkMalloc(cacheHeap, fill->colCount * sizeof(SQLSERVER_CACHE_COLUMN), __FILE__, __LINE__);
+		if (fill->columns == NULL) {
+			_CacheRelease(fill);
+			cursor->fill = NULL;
+			return;
+		}
+		fill->byteCount += fill->colCount * sizeof(SQLSERVER_CACHE_COLUMN);
+		for (SQLSMALLINT iCol = 0; iCol < fill->colCount; iCol++) {
+			BINDING * bind = &stm->statement.sqlserver.resultSet[iCol];
+			fill->columns[iCol].rowDataCharacterCount = bind->rowDataCharacterCount;
+			fill->columns[iCol].dataType = bind->dataType;
+			fill->columns[iCol].columnName = mkStrdup(cacheHeap, bind->columnName ? bind->columnName : "", __FILE__, __LINE__);
+			fill->byteCount += strlen(fill->columns[iCol].columnName) + 1;
+		}
+	}
+
+	if (!stm->statement.sqlserver.isEof) {
+		_CacheRecordRow(stm, cursor);
+		return;
+	}
+
+	cursor->fill = NULL;
+	AcquireSRWLockExclusive(&cacheLock);
+	_CachePublish(fill);
+	ReleaseSRWLockExclusive(&cacheLock);
+}
+
+/*	Returns TRUE if the statement is served from the cache and the next row was loaded */
+BOOL
+_CacheNext(
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_CACHE_CURSOR * cursor = SQLSERVER_STATEMENT_OF(stm)->cache;
+
+	if (cursor == NULL || cursor->entry == NULL) {
+		return FALSE;
+	}
+	_CacheLoadRow(stm, cursor);
+	return TRUE;
+}
+
+/*	Same as _CacheNext for sqlserverSeek. "rowNum" is 1 based as in SQL_FETCH_ABSOLUTE */
+BOOL
+_CacheSeek(
+	DBInt_Statement * stm,
+	int rowNum
+)
+{
+	SQLSERVER_CACHE_CURSOR * cursor = SQLSERVER_STATEMENT_OF(stm)->cache;
+
+	if (cursor == NULL) {
+		return FALSE;
+	}
+	if (cursor->fill) {
+		// rows are recorded in fetch order only
+		_CacheRelease(cursor->fill);
+		cursor->fill = NULL;
+	}
+	if (cursor->entry == NULL) {
+		return FALSE;
+	}
+
+	SQLSERVER_CACHE_ENTRY * entry = cursor->entry;
+	if (rowNum < 1 || rowNum > entry->rowCount) {
+		stm->statement.sqlserver.isEof = TRUE;
+		return TRUE;
+	}
+
+	cursor->row = 0;
+	cursor->offset = 0;
+	while (cursor->row < rowNum - 1) {
+		for (SQLSMALLINT iCol = 0; iCol < entry->colCount; iCol++) {
+			INT32 length;
+			memcpy(&length, entry->rows + cursor->offset, sizeof(INT32));
+			cursor->offset += sizeof(INT32) + (length > 0 ? length * sizeof(WCHAR) : 0);
+		}
+		cursor->row++;
+	}
+	_CacheLoadRow(stm, cursor);
+	return TRUE;
+}
+
+void
+_CacheCloseStatement(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_STATEMENT		* state = SQLSERVER_STATEMENT_OF(stm);
+	SQLSERVER_CACHE_CURSOR	* cursor = state->cache;
+
+	if (cursor == NULL) {
+		return;
+	}
+	_CacheResetStatement(cursor);
+	_StatementFree(conn, stm, cursor->tags);
+	_StatementFree(conn, stm, cursor);
+	state->cache = NULL;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverConfigureResultCache(
+	size_t maxBytes,
+	size_t maxEntryBytes
+)
+{
+	AcquireSRWLockExclusive(&cacheLock);
+	cacheMaxBytes = maxBytes;
+	cacheMaxEntryBytes = maxEntryBytes;
+	_CacheEvict();
+	ReleaseSRWLockExclusive(&cacheLock);
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverEnableResultCache(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	DWORD ttlMs,
+	const char * tags
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	_ResetError(conn, stm);
+
+	if (ttlMs == 0) {
+		_CacheCloseStatement(conn, stm);
+		return;
+	}
+	if (!InitOnceExecuteOnce(&cacheInitOnce, _CacheInit, NULL, NULL)) {
+		_SetErrorText(conn, stm, "Unable to create the result cache heap");
+		return;
+	}
+
+	if (state->cache == NULL) {
+		state->cache = _StatementMalloc(conn, stm, sizeof(SQLSERVER_CACHE_CURSOR), __FILE__, __LINE__);
+		memset(state->cache, 0, sizeof(SQLSERVER_CACHE_CURSOR));
+	}
+	state->cache->ttlMs = ttlMs;
+	_StatementFree(conn, stm, state->cache->tags);
+	state->cache->tags = NULL;
+	if (tags) {
+		size_t length = strlen(tags) + 1;
+		state->cache->tags = _StatementMalloc(conn, stm, length, __FILE__, __LINE__);
+		memcpy(state->cache->tags, tags, length);
+	}
+}
+
+SQLSERVER_INTERFACE_API
+int
+sqlserverInvalidateResultCache(
+	const char * tag
+)
+{
+	int count = 0;
+
+	AcquireSRWLockExclusive(&cacheLock);
+	SQLSERVER_CACHE_ENTRY * entry = cacheLruHead;
+	while (entry) {
+		SQLSERVER_CACHE_ENTRY * next = entry->lruNext;
+		if (tag == NULL || _CacheHasTag(entry, tag)) {
+			_CacheUnlink(entry);
+			count++;
+		}
+		entry = next;
+	}
+	cacheStats.invalidations += count;
+	cacheGeneration++;
+	ReleaseSRWLockExclusive(&cacheLock);
+
+	return count;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverIsResultFromCache(
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_CACHE_CURSOR * cursor = SQLSERVER_STATEMENT_OF(stm)->cache;
+	return (cursor != NULL && cursor->entry != NULL);
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverGetResultCacheStats(
+	SQLSERVER_CACHE_STATS * stats
+)
+{
+	AcquireSRWLockShared(&cacheLock);
+	*stats = cacheStats;
+	ReleaseSRWLockShared(&cacheLock);
+}
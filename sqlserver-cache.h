@@ -0,0 +1,121 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+#include "sqlserver-interface.h"
+
+#define SQLSERVER_CACHE_BUCKET_COUNT				1024
+#define SQLSERVER_CACHE_DEFAULT_MAX_BYTES			(64 * 1024 * 1024)
+/*	Result sets growing past this size while being fetched are not cached */
+#define SQLSERVER_CACHE_DEFAULT_MAX_ENTRY_BYTES		(1024 * 1024)
+
+typedef struct _SQLSERVER_CACHE_COLUMN {
+	char						  * columnName;
+	SQLLEN							rowDataCharacterCount;
+	SODIUM_DATABASE_COLUMN_TYPE		dataType;
+} SQLSERVER_CACHE_COLUMN;
+
+/*	A complete result set. Immutable once published, released when the last statement reading it lets go */
+typedef struct _SQLSERVER_CACHE_ENTRY {
+	struct _SQLSERVER_CACHE_ENTRY * nextInBucket;
+	struct _SQLSERVER_CACHE_ENTRY * lruPrevious;
+	struct _SQLSERVER_CACHE_ENTRY * lruNext;
+	unsigned long long				hash;
+	/*	connection string, SQL text and parameter values */
+	char						  * key;
+	size_t							keyLength;
+	/*	comma separated, as given to sqlserverEnableResultCache */
+	char						  * tags;
+	ULONGLONG						expiresAt;
+	/*	cacheGeneration when the fill started */
+	unsigned long long				generation;
+	SQLSMALLINT						colCount;
+	SQLSERVER_CACHE_COLUMN		  * columns;
+	/*	per row, per column: INT32 character count (-1 for NULL) followed by the characters */
+	char						  * rows;
+	size_t							rowsLength;
+	size_t							rowsCapacity;
+	SQLLEN							rowCount;
+	size_t							byteCount;
+	volatile LONG					refCount;
+} SQLSERVER_CACHE_ENTRY;
+
+/*	Per statement cache state */
+typedef struct _SQLSERVER_CACHE_CURSOR {
+	DWORD							ttlMs;
+	char						  * tags;
+	/*	entry being served by sqlserverNext, NULL when rows come from the driver */
+	SQLSERVER_CACHE_ENTRY		  * entry;
+	SQLLEN							row;
+	size_t							offset;
+	/*	entry being recorded while a missed result set is fetched */
+	SQLSERVER_CACHE_ENTRY		  * fill;
+} SQLSERVER_CACHE_CURSOR;
+
+typedef struct _SQLSERVER_CACHE_STATS {
+	unsigned long long	hits;
+	unsigned long long	misses;
+	unsigned long long	expirations;
+	unsigned long long	evictions;
+	unsigned long long	invalidations;
+	/*	result sets abandoned because they exceeded the entry size limit */
+	unsigned long long	oversized;
+	unsigned long long	entryCount;
+	unsigned long long	byteCount;
+} SQLSERVER_CACHE_STATS;
+
+/* DDL's PRIVATE FUNCTIONS  */
+BOOL					_CacheExecute(DBInt_Connection* conn, DBInt_Statement* stm);
+void					_CacheFetched(DBInt_Statement* stm);
+BOOL					_CacheNext(DBInt_Statement* stm);
+BOOL					_CacheSeek(DBInt_Statement* stm, int rowNum);
+void					_CacheCloseStatement(DBInt_Connection* conn, DBInt_Statement* stm);
+void					_CacheResetStatement(SQLSERVER_CACHE_CURSOR* cursor);
+char				  * _CacheBuildKey(DBInt_Connection* conn, DBInt_Statement* stm, size_t* keyLength, unsigned long long* hash);
+BOOL					_CacheAppend(char** buffer, size_t* length, size_t* capacity, const void* data, size_t size);
+SQLSERVER_CACHE_ENTRY * _CacheLookup(unsigned long long hash, const char* key, size_t keyLength);
+void					_CachePublish(SQLSERVER_CACHE_ENTRY* entry);
+void					_CacheUnlink(SQLSERVER_CACHE_ENTRY* entry);
+void					_CacheEvict(void);
+void					_CacheRelease(SQLSERVER_CACHE_ENTRY* entry);
+BOOL					_CacheHasTag(SQLSERVER_CACHE_ENTRY* entry, const char* tag);
+void					_CacheBindColumns(DBInt_Connection* conn, DBInt_Statement* stm, SQLSERVER_CACHE_ENTRY* entry);
+void					_CacheLoadRow(DBInt_Statement* stm, SQLSERVER_CACHE_CURSOR* cursor);
+void					_CacheRecordRow(DBInt_Statement* stm, SQLSERVER_CACHE_CURSOR* cursor);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Sets the process wide limits. Entries over the new total limit are evicted, least recently used first */
+SQLSERVER_INTERFACE_API void					sqlserverConfigureResultCache(size_t maxBytes, size_t maxEntryBytes);
+
+/*	Opts the statement into the result cache. sqlserverExecuteSelectStatement then serves results of the same
+	SQL text, parameter values and connection string from the cache for "ttlMs" milliseconds. "tags" is a comma
+	separated list of names (typically tables) used by sqlserverInvalidateResultCache. A ttlMs of 0 opts out. */
+SQLSERVER_INTERFACE_API
+void
+sqlserverEnableResultCache(
+	DBInt_Connection* conn,
+	DBInt_Statement* stm,
+	DWORD ttlMs,
+	const char* tags);
+
+/*	Removes entries tagged with "tag" (case insensitive), or every entry when "tag" is NULL. Returns the count removed.
+	Statements already reading a removed entry finish it. Result sets being fetched while it runs are not cached. */
+SQLSERVER_INTERFACE_API int						sqlserverInvalidateResultCache(const char* tag);
+
+/*	TRUE if the current result set of the statement is served from the cache */
+SQLSERVER_INTERFACE_API BOOL					sqlserverIsResultFromCache(DBInt_Statement* stm);
+
+SQLSERVER_INTERFACE_API void					sqlserverGetResultCacheStats(SQLSERVER_CACHE_STATS* stats);
@@ -0,0 +1,743 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+#include "sqlserver-direct.h"
+#include "sqlserver-profile.h"
+#include "sqlserver-capture.h"
+
+
+volatile LONG						captureActive;
+/*	Guards the trace file, records of different threads are written whole */
+SRWLOCK								captureLock = SRWLOCK_INIT;
+FILE							  * captureFile;
+LONGLONG							captureStartedAt;
+LONGLONG							captureFrequency;
+unsigned long long					captureRecordCount;
+/*	a write failed and the capture was stopped, reported by sqlserverStopCapture */
+BOOL								captureFailed;
+volatile LONG						captureNextConnectionId;
+volatile LONG						captureNextStatementId;
+
+
+UINT32
+_CaptureConnectionId(
+	DBInt_Connection * conn
+)
+{
+	SQLSERVER_CONNECTION * state = conn ? SQLSERVER_CONNECTION_OF(conn) : NULL;
+
+	if (state == NULL) {
+		return 0;
+	}
+	if (state->captureId == 0) {
+		// statements of other threads may share the connection
+		InterlockedCompareExchange(&state->captureId, InterlockedIncrement(&captureNextConnectionId), 0);
+	}
+	return (UINT32)state->captureId;
+}
+
+UINT32
+_CaptureStatementId(
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	if (state->captureId == 0) {
+		state->captureId = InterlockedIncrement(&captureNextStatementId);
+	}
+	return (UINT32)state->captureId;
+}
+
+LONG64
+_CaptureMicroseconds(
+	LONGLONG ticks
+)
+{
+	return (ticks / captureFrequency) * 1000000 + (ticks % captureFrequency) * 1000000 / captureFrequency;
+}
+
+/*	Appends a record followed by "payload" and "data". "started" is 0 for calls that were not timed */
+void
+_CaptureWrite(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLSERVER_CAPTURE_RECORD_TYPE type,
+	LONGLONG started,
+	LONG64 duration,
+	const void * payload,
+	size_t payloadLength,
+	const void * data,
+	size_t dataLength
+)
+{
+	SQLSERVER_CAPTURE_RECORD	record;
+	LARGE_INTEGER				now;
+
+	if (started == 0) {
+		QueryPerformanceCounter(&now);
+		started = now.QuadPart;
+	}
+	record.type = (UINT8)type;
+	record.connectionId = _CaptureConnectionId(conn);
+	record.statementId = _CaptureStatementId(stm);
+	record.duration = (UINT32)min(duration, (LONG64)0xFFFFFFFF);
+	record.payloadLength = (UINT32)(payloadLength + dataLength);
+
+	AcquireSRWLockExclusive(&captureLock);
+	if (captureFile) {
+		record.timestamp = (started > captureStartedAt) ? _CaptureMicroseconds(started - captureStartedAt) : 0;
+		if (fwrite(&record, sizeof(record), 1, captureFile) == 1
+			&& (payloadLength == 0 || fwrite(payload, payloadLength, 1, captureFile) == 1)
+			&& (dataLength == 0 || fwrite(data, dataLength, 1, captureFile) == 1)) {
+			captureRecordCount++;
+		}
+		else {
+			// disk full or the file went away. The replay drops the partial record at the end
+			mkCoreDebug(__FILE__, __LINE__, "\nDBInt_SqlServer.dll says: Unable to write the capture trace, capture stopped", NULL);
+			InterlockedExchange(&captureActive, 0);
+			fclose(captureFile);
+			captureFile = NULL;
+			captureFailed = TRUE;
+		}
+	}
+	ReleaseSRWLockExclusive(&captureLock);
+}
+
+void
+_CapturePrepare(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql,
+	LONGLONG started
+)
+{
+	LARGE_INTEGER now;
+
+	if (!captureActive) {
+		return;
+	}
+	QueryPerformanceCounter(&now);
+	_CaptureFlushFetches(conn, stm, SQL_SUCCESS);
+	_CaptureWrite(conn, stm, SQLSERVER_CAPTURE_RECORD_PREPARE, started, started ? _CaptureMicroseconds(now.QuadPart - started) : 0,
+		sql, strlen(sql), NULL, 0);
+}
+
+void
+_CaptureBind(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex,
+	SQLSMALLINT cType,
+	const void * value,
+	SQLLEN length
+)
+{
+	SQLSERVER_CAPTURE_BIND bind;
+
+	if (!captureActive) {
+		return;
+	}
+	bind.paramIndex = paramIndex;
+	bind.cType = cType;
+	bind.length = (length == SQL_NULL_DATA) ? SQL_NULL_DATA : length;
+	_CaptureWrite(conn, stm, SQLSERVER_CAPTURE_RECORD_BIND, 0, 0, &bind, sizeof(bind), value, (length > 0) ? length : 0);
+}
+
+void
+_CaptureExecute(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	RETCODE RetCode,
+	LONGLONG started
+)
+{
+	SQLSERVER_CAPTURE_EXECUTE	execute;
+	SQLLEN						rowCount = -1;
+	LARGE_INTEGER				now;
+
+	if (!captureActive) {
+		return;
+	}
+	QueryPerformanceCounter(&now);
+	_CaptureFlushFetches(conn, stm, SQL_SUCCESS);
+
+	if (RetCode == SQL_SUCCESS || RetCode == SQL_SUCCESS_WITH_INFO || RetCode == SQL_NO_DATA) {
+		// no round trip, the count came with the execution
+		SQLRowCount(*stm->statement.sqlserver.hStmt, &rowCount);
+	}
+	execute.retCode = RetCode;
+	execute.rowCount = rowCount;
+	_CaptureWrite(conn, stm, SQLSERVER_CAPTURE_RECORD_EXECUTE, started, started ? _CaptureMicroseconds(now.QuadPart - started) : 0,
+		&execute, sizeof(execute), NULL, 0);
+}
+
+/*	Fetches are summed per result set, the record is written when the result set ends */
+void
+_CaptureFetch(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	RETCODE RetCode,
+	LONGLONG started
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+	LARGE_INTEGER		  now;
+
+	if (!captureActive) {
+		return;
+	}
+	if (started) {
+		QueryPerformanceCounter(&now);
+		state->captureFetchMicroseconds += _CaptureMicroseconds(now.QuadPart - started);
+	}
+	state->captureFetches++;
+
+	if (RetCode != SQL_SUCCESS && RetCode != SQL_SUCCESS_WITH_INFO) {
+		_CaptureFlushFetches(conn, stm, RetCode);
+	}
+}
+
+/*	Writes the fetches summed since the last execution. "RetCode" is SQL_SUCCESS when the result set was left unfinished */
+void
+_CaptureFlushFetches(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	RETCODE RetCode
+)
+{
+	SQLSERVER_STATEMENT		  * state = SQLSERVER_STATEMENT_OF(stm);
+	SQLSERVER_CAPTURE_FETCH		fetch;
+
+	if (state->captureFetches == 0) {
+		return;
+	}
+	fetch.fetchCount = state->captureFetches;
+	fetch.lastRetCode = RetCode;
+	_CaptureWrite(conn, stm, SQLSERVER_CAPTURE_RECORD_FETCH, 0, state->captureFetchMicroseconds, &fetch, sizeof(fetch), NULL, 0);
+
+	state->captureFetches = 0;
+	state->captureFetchMicroseconds = 0;
+}
+
+void
+_CaptureClose(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	if (!captureActive || SQLSERVER_STATEMENT_OF(stm)->captureId == 0) {
+		// never recorded
+		return;
+	}
+	_CaptureFlushFetches(conn, stm, SQL_SUCCESS);
+	_CaptureWrite(conn, stm, SQLSERVER_CAPTURE_RECORD_CLOSE, 0, 0, NULL, 0, NULL, 0);
+}
+
+LONG64
+_ReplayElapsed(
+	SQLSERVER_REPLAY * replay,
+	LONGLONG started
+)
+{
+	LARGE_INTEGER	now;
+	LONGLONG		ticks;
+
+	QueryPerformanceCounter(&now);
+	ticks = now.QuadPart - started;
+	return (ticks / replay->frequency) * 1000000 + (ticks % replay->frequency) * 1000000 / replay->frequency;
+}
+
+/*	Sleeps until the captured "timestamp" is due at the configured speed */
+void
+_ReplayWait(
+	SQLSERVER_REPLAY * replay,
+	UINT64 timestamp
+)
+{
+	if (replay->options->speed <= 0 || timestamp <= replay->firstTimestamp) {
+		return;
+	}
+	LONG64 due = (LONG64)((timestamp - replay->firstTimestamp) / replay->options->speed);
+	LONG64 elapsed = _ReplayElapsed(replay, replay->startedAt);
+
+	if (due - elapsed >= 1000) {
+		Sleep((DWORD)((due - elapsed) / 1000));
+	}
+}
+
+/*	Connection replaying "connectionId", opened on first use. NULL if it could not be opened */
+DBInt_Connection *
+_ReplayConnection(
+	SQLSERVER_REPLAY_WORKER * worker,
+	UINT32 connectionId
+)
+{
+	SQLSERVER_REPLAY		  * replay = worker->replay;
+	const SQLSERVER_REPLAY_OPTIONS * options = replay->options;
+
+	for (int i = 0; i < worker->connectionCount; i++) {
+		if (worker->connections[i].connectionId == connectionId) {
+			return worker->connections[i].conn;
+		}
+	}
+
+	if (worker->connectionCount == worker->connectionCapacity) {
+		int capacity = max(worker->connectionCapacity * 2, 4);
+		SQLSERVER_REPLAY_CONNECTION * connections = mkMalloc(replay->heapHandle, capacity * sizeof(SQLSERVER_REPLAY_CONNECTION), __FILE__, __LINE__);
+		if (connections == NULL) {
+			return NULL;
+		}
+		if (worker->connectionCount > 0) {
+			memcpy(connections, worker->connections, worker->connectionCount * sizeof(SQLSERVER_REPLAY_CONNECTION));
+			mkFree(replay->heapHandle, worker->connections);
+		}
+		worker->connections = connections;
+		worker->connectionCapacity = capacity;
+	}
+
+	DBInt_Connection * conn = sqlserverCreateConnectionEx(replay->heapHandle, options->dbType,
+		options->hostName, options->instanceName, options->databaseName, options->userName, options->password,
+		&options->connectionOptions);
+	if (conn && conn->err) {
+		sqlserverDestroyConnection(conn);
+		mkFree(replay->heapHandle, conn);
+		conn = NULL;
+	}
+
+	// kept when NULL too, so that a failed connection is not retried for every record
+	worker->connections[worker->connectionCount].connectionId = connectionId;
+	worker->connections[worker->connectionCount].conn = conn;
+	worker->connectionCount++;
+	return conn;
+}
+
+/*	Statement replaying "statementId". Created on "conn" when it does not exist yet and "conn" is not NULL */
+SQLSERVER_REPLAY_STATEMENT *
+_ReplayStatement(
+	SQLSERVER_REPLAY_WORKER * worker,
+	UINT32 statementId,
+	DBInt_Connection * conn
+)
+{
+	SQLSERVER_REPLAY * replay = worker->replay;
+
+	for (int i = 0; i < worker->statementCount; i++) {
+		if (worker->statements[i].statementId == statementId) {
+			return &worker->statements[i];
+		}
+	}
+	if (conn == NULL) {
+		return NULL;
+	}
+
+	if (worker->statementCount == worker->statementCapacity) {
+		int capacity = max(worker->statementCapacity * 2, 16);
+		SQLSERVER_REPLAY_STATEMENT * statements = mkMalloc(replay->heapHandle, capacity * sizeof(SQLSERVER_REPLAY_STATEMENT), __FILE__, __LINE__);
+		if (statements == NULL) {
+			return NULL;
+		}
+		if (worker->statementCount > 0) {
+			memcpy(statements, worker->statements, worker->statementCount * sizeof(SQLSERVER_REPLAY_STATEMENT));
+			mkFree(replay->heapHandle, worker->statements);
+		}
+		worker->statements = statements;
+		worker->statementCapacity = capacity;
+	}
+
+	SQLSERVER_REPLAY_STATEMENT * entry = &worker->statements[worker->statementCount];
+	entry->statementId = statementId;
+	entry->conn = conn;
+	entry->stm = sqlserverCreateStatement(conn);
+	if (entry->stm == NULL) {
+		return NULL;
+	}
+	worker->statementCount++;
+	return entry;
+}
+
+void
+_ReplayRecord(
+	SQLSERVER_REPLAY_WORKER * worker,
+	const SQLSERVER_CAPTURE_RECORD * record,
+	const char * payload
+)
+{
+	SQLSERVER_REPLAY		  * replay = worker->replay;
+	LARGE_INTEGER				started;
+
+	InterlockedIncrement64(&replay->records);
+
+	DBInt_Connection * conn = _ReplayConnection(worker, record->connectionId);
+	SQLSERVER_REPLAY_STATEMENT * entry = NULL;
+	if (conn) {
+		// statements are only created by their prepare, the ones prepared before the capture are skipped
+		entry = _ReplayStatement(worker, record->statementId, (record->type == SQLSERVER_CAPTURE_RECORD_PREPARE) ? conn : NULL);
+	}
+	if (entry == NULL) {
+		InterlockedIncrement64(&replay->skipped);
+		return;
+	}
+	DBInt_Statement		* stm = entry->stm;
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	switch (record->type) {
+		case SQLSERVER_CAPTURE_RECORD_PREPARE: {
+			char * sql = mkMalloc(replay->heapHandle, record->payloadLength + 1, __FILE__, __LINE__);
+			if (sql == NULL) {
+				return;
+			}
+			memcpy(sql, payload, record->payloadLength);
+			sql[record->payloadLength] = '\0';
+
+			_ReplayWait(replay, record->timestamp);
+			QueryPerformanceCounter(&started);
+			sqlserverPrepare(conn, stm, sql);
+			_ProfileAdd(replay->replayed, SQLSERVER_PROFILE_PREPARE, _ReplayElapsed(replay, started.QuadPart), 1);
+			_ProfileAdd(replay->captured, SQLSERVER_PROFILE_PREPARE, record->duration, 1);
+
+			mkFree(replay->heapHandle, sql);
+			break;
+		}
+		case SQLSERVER_CAPTURE_RECORD_BIND: {
+			SQLSERVER_CAPTURE_BIND bind;
+			memcpy(&bind, payload, sizeof(bind));
+
+			_ResetError(conn, stm);
+			_BindParameterValue(conn, stm, bind.paramIndex, bind.cType,
+				(bind.length == SQL_NULL_DATA) ? NULL : payload + sizeof(bind), (SQLLEN)bind.length);
+			break;
+		}
+		case SQLSERVER_CAPTURE_RECORD_EXECUTE: {
+			_ReplayWait(replay, record->timestamp);
+			_ResetError(conn, stm);
+			// a result set the captured application left unfinished would block the execution
+			SQLFreeStmt(state->hStmt, SQL_CLOSE);
+			stm->statement.sqlserver.cRowCount = -1;
+
+			QueryPerformanceCounter(&started);
+			RETCODE RetCode = _BeginExecute(conn, stm);
+			_ProfileAdd(replay->replayed, SQLSERVER_PROFILE_EXECUTE, _ReplayElapsed(replay, started.QuadPart), 1);
+			_ProfileAdd(replay->captured, SQLSERVER_PROFILE_EXECUTE, record->duration, 1);
+			InterlockedIncrement64(&replay->executions);
+
+			_CompleteExecute(conn, stm, RetCode);
+			break;
+		}
+		case SQLSERVER_CAPTURE_RECORD_FETCH: {
+			SQLSERVER_CAPTURE_FETCH fetch;
+			memcpy(&fetch, payload, sizeof(fetch));
+
+			_ResetError(conn, stm);
+			// the first fetch was made by _CompleteExecute
+			for (UINT64 i = 1; i < fetch.fetchCount && !stm->statement.sqlserver.isEof && !state->lastError.hasError; i++) {
+				QueryPerformanceCounter(&started);
+				sqlserverNext(conn, stm);
+				_ProfileAdd(replay->replayed, SQLSERVER_PROFILE_FETCH, _ReplayElapsed(replay, started.QuadPart), 1);
+			}
+			if (fetch.fetchCount > 0) {
+				_ProfileAdd(replay->captured, SQLSERVER_PROFILE_FETCH, record->duration / fetch.fetchCount, fetch.fetchCount);
+			}
+			break;
+		}
+		case SQLSERVER_CAPTURE_RECORD_CLOSE: {
+			sqlserverFreeStatement(conn, stm);
+			*entry = worker->statements[--worker->statementCount];
+			return;
+		}
+	}
+
+	if (state->lastError.hasError) {
+		InterlockedIncrement64(&replay->errors);
+	}
+}
+
+void
+_ReplayCloseWorker(
+	SQLSERVER_REPLAY_WORKER * worker
+)
+{
+	HANDLE heapHandle = worker->replay->heapHandle;
+
+	for (int i = 0; i < worker->statementCount; i++) {
+		sqlserverFreeStatement(worker->statements[i].conn, worker->statements[i].stm);
+	}
+	for (int i = 0; i < worker->connectionCount; i++) {
+		if (worker->connections[i].conn) {
+			sqlserverDestroyConnection(worker->connections[i].conn);
+			mkFree(heapHandle, worker->connections[i].conn);
+		}
+	}
+	if (worker->statements) {
+		mkFree(heapHandle, worker->statements);
+	}
+	if (worker->connections) {
+		mkFree(heapHandle, worker->connections);
+	}
+	if (worker->payload) {
+		mkFree(heapHandle, worker->payload);
+	}
+	worker->payload = NULL;
+	worker->payloadCapacity = 0;
+	worker->statementCount = 0;
+	worker->connectionCount = 0;
+}
+
+/*	Reads the payload of the record at the file position into worker->payload. Payloads are read rather than
+	skipped with _fseeki64, which would throw the stream's buffer away for every record of another session */
+BOOL
+_ReplayReadPayload(
+	SQLSERVER_REPLAY_WORKER * worker,
+	FILE * file,
+	UINT32 payloadLength
+)
+{
+	HANDLE heapHandle = worker->replay->heapHandle;
+
+	if (payloadLength > worker->payloadCapacity) {
+		size_t capacity = max((size_t)payloadLength, worker->payloadCapacity * 2);
+		char * payload = mkMalloc(heapHandle, capacity, __FILE__, __LINE__);
+		if (payload == NULL) {
+			return FALSE;
+		}
+		if (worker->payload) {
+			mkFree(heapHandle, worker->payload);
+		}
+		worker->payload = payload;
+		worker->payloadCapacity = capacity;
+	}
+	return payloadLength == 0 || fread(worker->payload, payloadLength, 1, file) == 1;
+}
+
+DWORD WINAPI
+_ReplayThread(
+	LPVOID parameter
+)
+{
+	SQLSERVER_REPLAY_WORKER   * worker = (SQLSERVER_REPLAY_WORKER*)parameter;
+	SQLSERVER_REPLAY		  * replay = worker->replay;
+	SQLSERVER_CAPTURE_RECORD	record;
+	FILE					  * file = NULL;
+
+	// every worker streams the whole trace and replays its own sessions
+	if (fopen_s(&file, replay->path, "rb") == 0 && file) {
+		setvbuf(file, NULL, _IOFBF, SQLSERVER_CAPTURE_BUFFER_SIZE);
+
+		INT64 offset = sizeof(SQLSERVER_CAPTURE_HEADER);
+		if (_fseeki64(file, offset, SEEK_SET) == 0) {
+			while (offset < replay->traceLength && fread(&record, sizeof(record), 1, file) == 1) {
+				if (!_ReplayReadPayload(worker, file, record.payloadLength)) {
+					break;
+				}
+				offset += sizeof(record) + record.payloadLength;
+				if (record.connectionId % replay->concurrency == (UINT32)worker->index) {
+					_ReplayRecord(worker, &record, worker->payload);
+				}
+			}
+		}
+		fclose(file);
+	}
+	_ReplayCloseWorker(worker);
+	return 0;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverStartCapture(
+	const char * path
+)
+{
+	SQLSERVER_CAPTURE_HEADER	header;
+	LARGE_INTEGER				frequency, now;
+	FILE					  * file = NULL;
+	BOOL						started = FALSE;
+
+	AcquireSRWLockExclusive(&captureLock);
+	if (captureFile == NULL && fopen_s(&file, path, "wb") == 0 && file) {
+		setvbuf(file, NULL, _IOFBF, SQLSERVER_CAPTURE_BUFFER_SIZE);
+
+		memcpy(header.magic, SQLSERVER_CAPTURE_MAGIC, sizeof(header.magic));
+		header.version = SQLSERVER_CAPTURE_VERSION;
+		header.reserved = 0;
+		if (fwrite(&header, sizeof(header), 1, file) != 1) {
+			fclose(file);
+			ReleaseSRWLockExclusive(&captureLock);
+			return FALSE;
+		}
+
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&now);
+		captureFrequency = frequency.QuadPart;
+		captureStartedAt = now.QuadPart;
+		captureRecordCount = 0;
+		captureFailed = FALSE;
+		captureFile = file;
+		InterlockedExchange(&captureActive, 1);
+		started = TRUE;
+	}
+	ReleaseSRWLockExclusive(&captureLock);
+
+	return started;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverStopCapture(
+	unsigned long long * recordCount
+)
+{
+	BOOL succeeded;
+
+	AcquireSRWLockExclusive(&captureLock);
+	InterlockedExchange(&captureActive, 0);
+	if (captureFile) {
+		// the buffered tail is written here
+		if (fclose(captureFile) != 0) {
+			captureFailed = TRUE;
+		}
+		captureFile = NULL;
+	}
+	if (recordCount) {
+		*recordCount = captureRecordCount;
+	}
+	succeeded = !captureFailed;
+	ReleaseSRWLockExclusive(&captureLock);
+
+	return succeeded;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverReplayTrace(
+	const char * path,
+	const SQLSERVER_REPLAY_OPTIONS * options,
+	SQLSERVER_REPLAY_STATS * stats
+)
+{
+	SQLSERVER_REPLAY			replay;
+	SQLSERVER_REPLAY_WORKER	  * workers = NULL;
+	SQLSERVER_CAPTURE_HEADER	header;
+	SQLSERVER_CAPTURE_RECORD	record;
+	LARGE_INTEGER				frequency, now;
+	FILE					  * file = NULL;
+	BOOL						succeeded = FALSE;
+	BOOL						timed = FALSE;
+
+	memset(&replay, 0, sizeof(replay));
+	memset(stats, 0, sizeof(SQLSERVER_REPLAY_STATS));
+
+	if (fopen_s(&file, path, "rb") != 0 || file == NULL) {
+		return FALSE;
+	}
+	setvbuf(file, NULL, _IOFBF, SQLSERVER_CAPTURE_BUFFER_SIZE);
+	replay.heapHandle = HeapCreate(0, 0, 0);
+	if (replay.heapHandle == NULL) {
+		goto Exit;
+	}
+
+	replay.options = options;
+	replay.concurrency = max(options->concurrency, 1);
+	replay.path = path;
+
+	replay.captured = mkMalloc(replay.heapHandle, sizeof(SQLSERVER_PROFILE_ENTRY), __FILE__, __LINE__);
+	replay.replayed = mkMalloc(replay.heapHandle, sizeof(SQLSERVER_PROFILE_ENTRY), __FILE__, __LINE__);
+	workers = mkMalloc(replay.heapHandle, replay.concurrency * sizeof(SQLSERVER_REPLAY_WORKER), __FILE__, __LINE__);
+	if (replay.captured == NULL || replay.replayed == NULL || workers == NULL) {
+		goto Exit;
+	}
+	memset(replay.captured, 0, sizeof(SQLSERVER_PROFILE_ENTRY));
+	memset(replay.replayed, 0, sizeof(SQLSERVER_PROFILE_ENTRY));
+	memset(workers, 0, replay.concurrency * sizeof(SQLSERVER_REPLAY_WORKER));
+	for (int i = 0; i < replay.concurrency; i++) {
+		workers[i].replay = &replay;
+		workers[i].index = i;
+	}
+
+	// traces go past 2 GB, positions are 64 bit
+	if (_fseeki64(file, 0, SEEK_END) != 0) {
+		goto Exit;
+	}
+	INT64 size = _ftelli64(file);
+	if (size < (INT64)sizeof(header) || _fseeki64(file, 0, SEEK_SET) != 0) {
+		goto Exit;
+	}
+	if (fread(&header, sizeof(header), 1, file) != 1
+		|| memcmp(header.magic, SQLSERVER_CAPTURE_MAGIC, sizeof(header.magic)) != 0 || header.version != SQLSERVER_CAPTURE_VERSION) {
+		goto Exit;
+	}
+
+	// timing pass. The tail of a trace whose capture was not stopped may be cut off
+	INT64 offset = sizeof(header);
+	while (offset + (INT64)sizeof(record) <= size && fread(&record, sizeof(record), 1, file) == 1) {
+		if (offset + (INT64)sizeof(record) + record.payloadLength > size || !_ReplayReadPayload(&workers[0], file, record.payloadLength)) {
+			break;
+		}
+		if (record.type == SQLSERVER_CAPTURE_RECORD_PREPARE || record.type == SQLSERVER_CAPTURE_RECORD_EXECUTE) {
+			if (!timed || record.timestamp < replay.firstTimestamp) {
+				replay.firstTimestamp = record.timestamp;
+			}
+			replay.lastTimestamp = max(replay.lastTimestamp, record.timestamp + record.duration);
+			timed = TRUE;
+		}
+		offset += sizeof(record) + record.payloadLength;
+	}
+	replay.traceLength = offset;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&now);
+	replay.frequency = frequency.QuadPart;
+	replay.startedAt = now.QuadPart;
+
+	for (int i = 0; i < replay.concurrency; i++) {
+		workers[i].thread = CreateThread(NULL, 0, _ReplayThread, &workers[i], 0, NULL);
+	}
+	for (int i = 0; i < replay.concurrency; i++) {
+		if (workers[i].thread) {
+			WaitForSingleObject(workers[i].thread, INFINITE);
+			CloseHandle(workers[i].thread);
+		}
+		else {
+			// no thread to spare, its sessions run here after the others
+			_ReplayThread(&workers[i]);
+		}
+	}
+
+	stats->records = replay.records;
+	stats->executions = replay.executions;
+	stats->errors = replay.errors;
+	stats->skipped = replay.skipped;
+	stats->capturedSeconds = (replay.lastTimestamp - replay.firstTimestamp) / 1000000.0;
+	stats->replayedSeconds = _ReplayElapsed(&replay, replay.startedAt) / 1000000.0;
+	stats->capturedExecutionsPerSecond = (stats->capturedSeconds > 0) ? stats->executions / stats->capturedSeconds : 0;
+	stats->replayedExecutionsPerSecond = (stats->replayedSeconds > 0) ? stats->executions / stats->replayedSeconds : 0;
+	for (int operation = 0; operation < SQLSERVER_PROFILE_OPERATION_COUNT; operation++) {
+		_ProfileMerge(replay.captured, (SQLSERVER_PROFILE_OPERATION)operation, &stats->captured[operation]);
+		_ProfileMerge(replay.replayed, (SQLSERVER_PROFILE_OPERATION)operation, &stats->replayed[operation]);
+	}
+	succeeded = TRUE;
+
+Exit:
+	fclose(file);
+	if (replay.heapHandle) {
+		// payload buffers, workers and the replay connections
+		HeapDestroy(replay.heapHandle);
+	}
+	return succeeded;
+}
@@ -0,0 +1,201 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+#pragma once
+
+#include "sqlserver-interface.h"
+#include "sqlserver-profile.h"
+
+/*	Trace file layout: SQLSERVER_CAPTURE_HEADER, then records in the order they were written. Little endian */
+#define SQLSERVER_CAPTURE_MAGIC				"SQTR"
+#define SQLSERVER_CAPTURE_VERSION			1
+#define SQLSERVER_CAPTURE_BUFFER_SIZE		(64 * 1024)
+
+typedef enum _SQLSERVER_CAPTURE_RECORD_TYPE {
+	/*	payload: SQL text, not terminated */
+	SQLSERVER_CAPTURE_RECORD_PREPARE = 1,
+	/*	payload: SQLSERVER_CAPTURE_BIND followed by "length" value bytes */
+	SQLSERVER_CAPTURE_RECORD_BIND,
+	/*	payload: SQLSERVER_CAPTURE_EXECUTE */
+	SQLSERVER_CAPTURE_RECORD_EXECUTE,
+	/*	payload: SQLSERVER_CAPTURE_FETCH. One record per result set, "duration" is the total of its fetches */
+	SQLSERVER_CAPTURE_RECORD_FETCH,
+	/*	statement freed, no payload */
+	SQLSERVER_CAPTURE_RECORD_CLOSE
+} SQLSERVER_CAPTURE_RECORD_TYPE;
+
+#pragma pack(push, 1)
+
+typedef struct _SQLSERVER_CAPTURE_HEADER {
+	char		magic[4];
+	UINT16		version;
+	UINT16		reserved;
+} SQLSERVER_CAPTURE_HEADER;
+
+typedef struct _SQLSERVER_CAPTURE_RECORD {
+	UINT8		type;
+	/*	process wide numbers given on first capture, 0 if the connection has no driver state */
+	UINT32		connectionId;
+	UINT32		statementId;
+	/*	microseconds since the capture started, taken when the call began */
+	UINT64		timestamp;
+	UINT32		duration;
+	UINT32		payloadLength;
+} SQLSERVER_CAPTURE_RECORD;
+
+typedef struct _SQLSERVER_CAPTURE_BIND {
+	UINT16		paramIndex;
+	INT16		cType;
+	/*	SQL_NULL_DATA for NULL */
+	INT64		length;
+} SQLSERVER_CAPTURE_BIND;
+
+typedef struct _SQLSERVER_CAPTURE_EXECUTE {
+	INT16		retCode;
+	/*	SQLRowCount right after the execution, -1 if unknown */
+	INT64		rowCount;
+} SQLSERVER_CAPTURE_EXECUTE;
+
+typedef struct _SQLSERVER_CAPTURE_FETCH {
+	/*	SQLFetch calls, including the one reporting SQL_NO_DATA */
+	UINT64		fetchCount;
+	INT16		lastRetCode;
+} SQLSERVER_CAPTURE_FETCH;
+
+#pragma pack(pop)
+
+/*	Settings of sqlserverReplayTrace */
+typedef struct _SQLSERVER_REPLAY_OPTIONS {
+	/*	one connection is opened per captured connection, see sqlserverCreateConnectionEx. A connectionString
+		in connectionOptions can point to a DSN or a stub driver */
+	DBInt_SupportedDatabaseType		dbType;
+	const char					  * hostName;
+	const char					  * instanceName;
+	const char					  * databaseName;
+	const char					  * userName;
+	const char					  * password;
+	SQLSERVER_CONNECTION_OPTIONS	connectionOptions;
+	/*	worker threads, captured connections are spread over them. 0 means 1 */
+	int								concurrency;
+	/*	1.0 keeps the captured pace, 2.0 runs twice as fast, 0 runs as fast as possible */
+	double							speed;
+} SQLSERVER_REPLAY_OPTIONS;
+
+typedef struct _SQLSERVER_REPLAY_STATS {
+	unsigned long long			records;
+	unsigned long long			executions;
+	/*	calls that failed during the replay */
+	unsigned long long			errors;
+	/*	records of statements prepared before the capture started, or whose connection could not be opened */
+	unsigned long long			skipped;
+	double						capturedSeconds;
+	double						replayedSeconds;
+	double						capturedExecutionsPerSecond;
+	double						replayedExecutionsPerSecond;
+	/*	per SQLSERVER_PROFILE_OPERATION. Captured fetches are known per result set only, each of them
+		counts as the mean of its result set */
+	SQLSERVER_PROFILE_LATENCY	captured[SQLSERVER_PROFILE_OPERATION_COUNT];
+	SQLSERVER_PROFILE_LATENCY	replayed[SQLSERVER_PROFILE_OPERATION_COUNT];
+} SQLSERVER_REPLAY_STATS;
+
+typedef struct _SQLSERVER_REPLAY_STATEMENT {
+	UINT32							statementId;
+	DBInt_Connection			  * conn;
+	DBInt_Statement				  * stm;
+} SQLSERVER_REPLAY_STATEMENT;
+
+typedef struct _SQLSERVER_REPLAY_CONNECTION {
+	UINT32							connectionId;
+	/*	NULL if it could not be opened */
+	DBInt_Connection			  * conn;
+} SQLSERVER_REPLAY_CONNECTION;
+
+/*	State shared by the replay workers */
+typedef struct _SQLSERVER_REPLAY {
+	HANDLE							heapHandle;
+	const SQLSERVER_REPLAY_OPTIONS * options;
+	int								concurrency;
+	/*	opened by every worker, records are streamed */
+	const char					  * path;
+	/*	end of the last complete record */
+	INT64							traceLength;
+	UINT64							firstTimestamp;
+	UINT64							lastTimestamp;
+	LONGLONG						frequency;
+	LONGLONG						startedAt;
+	SQLSERVER_PROFILE_ENTRY		  * captured;
+	SQLSERVER_PROFILE_ENTRY		  * replayed;
+	volatile LONG64					records;
+	volatile LONG64					executions;
+	volatile LONG64					errors;
+	volatile LONG64					skipped;
+} SQLSERVER_REPLAY;
+
+/*	Sessions of the captured connections with "connectionId % concurrency == index" */
+typedef struct _SQLSERVER_REPLAY_WORKER {
+	SQLSERVER_REPLAY			  * replay;
+	int								index;
+	HANDLE							thread;
+	SQLSERVER_REPLAY_CONNECTION	  * connections;
+	int								connectionCount;
+	int								connectionCapacity;
+	SQLSERVER_REPLAY_STATEMENT	  * statements;
+	int								statementCount;
+	int								statementCapacity;
+	/*	payload of the record being read */
+	char						  * payload;
+	size_t							payloadCapacity;
+} SQLSERVER_REPLAY_WORKER;
+
+/*	Non zero while a capture is running, checked before anything else by the capture functions */
+extern volatile LONG				captureActive;
+
+/* DDL's PRIVATE FUNCTIONS  */
+UINT32			_CaptureConnectionId(DBInt_Connection* conn);
+UINT32			_CaptureStatementId(DBInt_Statement* stm);
+void			_CaptureWrite(DBInt_Connection* conn, DBInt_Statement* stm, SQLSERVER_CAPTURE_RECORD_TYPE type, LONGLONG started, LONG64 duration, const void* payload, size_t payloadLength, const void* data, size_t dataLength);
+LONG64			_CaptureMicroseconds(LONGLONG ticks);
+void			_CapturePrepare(DBInt_Connection* conn, DBInt_Statement* stm, const char* sql, LONGLONG started);
+void			_CaptureBind(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT paramIndex, SQLSMALLINT cType, const void* value, SQLLEN length);
+void			_CaptureExecute(DBInt_Connection* conn, DBInt_Statement* stm, RETCODE RetCode, LONGLONG started);
+void			_CaptureFetch(DBInt_Connection* conn, DBInt_Statement* stm, RETCODE RetCode, LONGLONG started);
+void			_CaptureFlushFetches(DBInt_Connection* conn, DBInt_Statement* stm, RETCODE RetCode);
+void			_CaptureClose(DBInt_Connection* conn, DBInt_Statement* stm);
+DWORD WINAPI	_ReplayThread(LPVOID parameter);
+void			_ReplayRecord(SQLSERVER_REPLAY_WORKER* worker, const SQLSERVER_CAPTURE_RECORD* record, const char* payload);
+void			_ReplayWait(SQLSERVER_REPLAY* replay, UINT64 timestamp);
+LONG64			_ReplayElapsed(SQLSERVER_REPLAY* replay, LONGLONG started);
+DBInt_Connection * _ReplayConnection(SQLSERVER_REPLAY_WORKER* worker, UINT32 connectionId);
+SQLSERVER_REPLAY_STATEMENT * _ReplayStatement(SQLSERVER_REPLAY_WORKER* worker, UINT32 statementId, DBInt_Connection* conn);
+void			_ReplayCloseWorker(SQLSERVER_REPLAY_WORKER* worker);
+BOOL			_ReplayReadPayload(SQLSERVER_REPLAY_WORKER* worker, FILE* file, UINT32 payloadLength);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Starts writing every prepare, bind, execute and fetch of the process into the trace file at "path",
+	which is overwritten. Rows served from the result cache or read ahead are not recorded. The capture
+	stops by itself when a write fails */
+SQLSERVER_INTERFACE_API BOOL					sqlserverStartCapture(const char* path);
+
+/*	Finishes the trace file. "recordCount" (may be NULL) receives the records written. Returns FALSE if the
+	trace could not be written completely, its records up to the failure can still be replayed */
+SQLSERVER_INTERFACE_API BOOL					sqlserverStopCapture(unsigned long long* recordCount);
+
+/*	Re-drives the workload of a trace file. Sessions keep their captured order, calls are paced by their
+	captured timestamps divided by options->speed. Returns FALSE if the trace cannot be read */
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverReplayTrace(
+	const char* path,
+	const SQLSERVER_REPLAY_OPTIONS* options,
+	SQLSERVER_REPLAY_STATS* stats);
@@ -0,0 +1,682 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+#include "sqlserver-direct.h"
+#include "sqlserver-columnar.h"
+
+
+/*	Days since 1970-01-01 for a proleptic Gregorian date */
+int32_t
+_ColumnarDaysFromCivil(
+	int year,
+	unsigned month,
+	unsigned day
+)
+{
+	year -= month <= 2;
+	const int		era = (year >= 0 ? year : year - 399) / 400;
+	const unsigned	yoe = (unsigned)(year - era * 400);
+	const unsigned	doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	const unsigned	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (int32_t)doe - 719468;
+}
+
+BOOL
+_ColumnarDescribe(
+	SQLSERVER_COLUMNAR_READER * reader
+)
+{
+	DBInt_Connection  * conn = reader->conn;
+	DBInt_Statement	  * stm = reader->stm;
+
+	reader->columns = _StatementMalloc(conn, stm, reader->colCount * sizeof(SQLSERVER_COLUMNAR_COLUMN), __FILE__, __LINE__);
+	memset(reader->columns, 0, reader->colCount * sizeof(SQLSERVER_COLUMNAR_COLUMN));
+
+	for (SQLSMALLINT iCol = 0; iCol < reader->colCount; iCol++) {
+		SQLSERVER_COLUMNAR_COLUMN * column = &reader->columns[iCol];
+		SQLWCHAR					wColumnName[200] = L"";
+		SQLSMALLINT					cchColumnNameLength = 0;
+
+		TRYODBC_STM(stm,
+			SQLDescribeCol(*stm->statement.sqlserver.hStmt,
+				iCol + 1,
+				wColumnName,
+				200,
+				&cchColumnNameLength,
+				&column->sqlType,
+				&column->columnSize,
+				&column->decimalDigits,
+				&column->nullable));
+
+		int nameSize = WideCharToMultiByte(CP_UTF8, 0, wColumnName, -1, NULL, 0, NULL, NULL);
+		column->name = _StatementMalloc(conn, stm, nameSize, __FILE__, __LINE__);
+		WideCharToMultiByte(CP_UTF8, 0, wColumnName, -1, column->name, nameSize, NULL, NULL);
+
+		SQLULEN variableLength = column->columnSize;
+		if (variableLength == 0 || variableLength > SQLSERVER_COLUMNAR_MAX_VARIABLE_LENGTH) {
+			variableLength = SQLSERVER_COLUMNAR_MAX_VARIABLE_LENGTH;
+		}
+
+		switch (column->sqlType) {
+			case SQL_BIT: {
+				column->kind = SQLSERVER_COLUMNAR_BOOLEAN;
+				column->cType = SQL_C_BIT;
+				column->elementSize = sizeof(unsigned char);
+				strcpy_s(column->format, sizeof(column->format), "b");
+				break;
+			}
+			case SQL_TINYINT: {
+				column->kind = SQLSERVER_COLUMNAR_FIXED;
+				column->cType = SQL_C_UTINYINT;
+				column->elementSize = sizeof(uint8_t);
+				strcpy_s(column->format, sizeof(column->format), "C");
+				break;
+			}
+			case SQL_SMALLINT: {
+				column->kind = SQLSERVER_COLUMNAR_FIXED;
+				column->cType = SQL_C_SSHORT;
+				column->elementSize = sizeof(int16_t);
+				strcpy_s(column->format, sizeof(column->format), "s");
+				break;
+			}
+			case SQL_INTEGER: {
+				column->kind = SQLSERVER_COLUMNAR_FIXED;
+				column->cType = SQL_C_SLONG;
+				column->elementSize = sizeof(int32_t);
+				strcpy_s(column->format, sizeof(column->format), "i");
+				break;
+			}
+			case SQL_BIGINT: {
+				column->kind = SQLSERVER_COLUMNAR_FIXED;
+				column->cType = SQL_C_SBIGINT;
+				column->elementSize = sizeof(int64_t);
+				strcpy_s(column->format, sizeof(column->format), "l");
+				break;
+			}
+			case SQL_REAL: {
+				column->kind = SQLSERVER_COLUMNAR_FIXED;
+				column->cType = SQL_C_FLOAT;
+				column->elementSize = sizeof(float);
+				strcpy_s(column->format, sizeof(column->format), "f");
+				break;
+			}
+			case SQL_FLOAT:
+			case SQL_DOUBLE: {
+				column->kind = SQLSERVER_COLUMNAR_FIXED;
+				column->cType = SQL_C_DOUBLE;
+				column->elementSize = sizeof(double);
+				strcpy_s(column->format, sizeof(column->format), "g");
+				break;
+			}
+			case SQL_DECIMAL:
+			case SQL_NUMERIC: {
+				column->kind = SQLSERVER_COLUMNAR_DECIMAL;
+				column->cType = SQL_C_NUMERIC;
+				column->elementSize = sizeof(SQL_NUMERIC_STRUCT);
+				sprintf_s(column->format, sizeof(column->format), "d:%d,%d", (int)column->columnSize, (int)column->decimalDigits);
+				break;
+			}
+			case SQL_TYPE_DATE: {
+				column->kind = SQLSERVER_COLUMNAR_DATE;
+				column->cType = SQL_C_TYPE_DATE;
+				column->elementSize = sizeof(SQL_DATE_STRUCT);
+				strcpy_s(column->format, sizeof(column->format), "tdD");
+				break;
+			}
+			case SQL_TYPE_TIMESTAMP: {
+				column->kind = SQLSERVER_COLUMNAR_TIMESTAMP;
+				column->cType = SQL_C_TYPE_TIMESTAMP;
+				column->elementSize = sizeof(SQL_TIMESTAMP_STRUCT);
+				strcpy_s(column->format, sizeof(column->format), "tsu:");
+				break;
+			}
+			case SQL_BINARY:
+			case SQL_VARBINARY:
+			case SQL_LONGVARBINARY: {
+				column->kind = SQLSERVER_COLUMNAR_BINARY;
+				column->cType = SQL_C_BINARY;
+				column->elementSize = variableLength;
+				strcpy_s(column->format, sizeof(column->format), "z");
+				break;
+			}
+			default: {
+				// character data, GUID, time, datetimeoffset etc. are delivered as UTF-8 text
+				column->kind = SQLSERVER_COLUMNAR_UTF8;
+				column->cType = SQL_C_WCHAR;
+				column->elementSize = (variableLength + 1) * sizeof(WCHAR);
+				strcpy_s(column->format, sizeof(column->format), "u");
+				break;
+			}
+		}
+
+		column->indicators = _StatementMalloc(conn, stm, reader->batchRows * sizeof(SQLLEN), __FILE__, __LINE__);
+
+		if (column->kind == SQLSERVER_COLUMNAR_FIXED) {
+			// bound per batch, see _ColumnarBindFixed
+			continue;
+		}
+
+		column->fetchBuffer = _StatementMalloc(conn, stm, reader->batchRows * column->elementSize, __FILE__, __LINE__);
+
+		TRYODBC_STM(stm,
+			SQLBindCol(*stm->statement.sqlserver.hStmt,
+				iCol + 1,
+				column->cType,
+				column->fetchBuffer,
+				column->elementSize,
+				column->indicators));
+
+		if (column->kind == SQLSERVER_COLUMNAR_DECIMAL) {
+			// without explicit precision and scale the driver uses scale 0 for SQL_C_NUMERIC
+			SQLHDESC hDesc = NULL;
+
+			TRYODBC_STM(stm,
+				SQLGetStmtAttr(*stm->statement.sqlserver.hStmt, SQL_ATTR_APP_ROW_DESC, &hDesc, 0, NULL));
+			TRYODBC(hDesc,
+				SQL_HANDLE_DESC,
+				SQLSetDescField(hDesc, iCol + 1, SQL_DESC_TYPE, (SQLPOINTER)SQL_C_NUMERIC, 0));
+			TRYODBC(hDesc,
+				SQL_HANDLE_DESC,
+				SQLSetDescField(hDesc, iCol + 1, SQL_DESC_PRECISION, (SQLPOINTER)(SQLLEN)column->columnSize, 0));
+			TRYODBC(hDesc,
+				SQL_HANDLE_DESC,
+				SQLSetDescField(hDesc, iCol + 1, SQL_DESC_SCALE, (SQLPOINTER)(SQLLEN)column->decimalDigits, 0));
+			// setting the data pointer last triggers the descriptor consistency check
+			TRYODBC(hDesc,
+				SQL_HANDLE_DESC,
+				SQLSetDescField(hDesc, iCol + 1, SQL_DESC_DATA_PTR, column->fetchBuffer, 0));
+		}
+	}
+
+	return TRUE;
+
+Exit:
+	return FALSE;
+}
+
+/*	Fixed width columns are fetched straight into a fresh Arrow values buffer for every batch */
+BOOL
+_ColumnarBindFixed(
+	SQLSERVER_COLUMNAR_READER * reader,
+	void ** values
+)
+{
+	DBInt_Connection  * conn = reader->conn;
+	DBInt_Statement	  * stm = reader->stm;
+
+	for (SQLSMALLINT iCol = 0; iCol < reader->colCount; iCol++) {
+		SQLSERVER_COLUMNAR_COLUMN * column = &reader->columns[iCol];
+
+		if (column->kind != SQLSERVER_COLUMNAR_FIXED) {
+			continue;
+		}
+
+		TRYODBC_STM(stm,
+			SQLBindCol(*stm->statement.sqlserver.hStmt,
+				iCol + 1,
+				column->cType,
+				values[iCol],
+				column->elementSize,
+				column->indicators));
+	}
+	return TRUE;
+
+Exit:
+	return FALSE;
+}
+
+void
+_ColumnarFillArray(
+	SQLSERVER_COLUMNAR_READER * reader,
+	SQLSMALLINT iCol,
+	void * values,
+	struct ArrowArray * out
+)
+{
+	SQLSERVER_COLUMNAR_COLUMN * column = &reader->columns[iCol];
+	HANDLE						heapHandle = reader->conn->heapHandle;
+	SQLULEN						rows = reader->rowsFetched;
+	int64_t						nullCount = 0;
+
+	SQLSERVER_ARROW_PRIVATE * priv = mkMalloc(heapHandle, sizeof(SQLSERVER_ARROW_PRIVATE), __FILE__, __LINE__);
+	memset(priv, 0, sizeof(SQLSERVER_ARROW_PRIVATE));
+	priv->heapHandle = heapHandle;
+
+	// validity bitmap, omitted when there is no NULL in the batch
+	uint8_t * validity = mkMalloc(heapHandle, (rows + 7) / 8, __FILE__, __LINE__);
+	memset(validity, 0, (rows + 7) / 8);
+	for (SQLULEN row = 0; row < rows; row++) {
+		if (column->indicators[row] == SQL_NULL_DATA) {
+			nullCount++;
+		}
+		else {
+			validity[row >> 3] |= (uint8_t)(1 << (row & 7));
+		}
+	}
+	if (nullCount == 0) {
+		mkFree(heapHandle, validity);
+		validity = NULL;
+	}
+	priv->buffers[0] = validity;
+
+	out->length = rows;
+	out->null_count = nullCount;
+	out->offset = 0;
+	out->n_buffers = 2;
+	out->n_children = 0;
+	out->children = NULL;
+	out->dictionary = NULL;
+	out->buffers = priv->buffers;
+	out->release = _ColumnarReleaseArray;
+	out->private_data = priv;
+
+	switch (column->kind) {
+		case SQLSERVER_COLUMNAR_FIXED: {
+			priv->buffers[1] = values;
+			break;
+		}
+		case SQLSERVER_COLUMNAR_BOOLEAN: {
+			const unsigned char * source = column->fetchBuffer;
+			uint8_t * bits = mkMalloc(heapHandle, (rows + 7) / 8, __FILE__, __LINE__);
+			memset(bits, 0, (rows + 7) / 8);
+			for (SQLULEN row = 0; row < rows; row++) {
+				if (column->indicators[row] != SQL_NULL_DATA && source[row]) {
+					bits[row >> 3] |= (uint8_t)(1 << (row & 7));
+				}
+			}
+			priv->buffers[1] = bits;
+			break;
+		}
+		case SQLSERVER_COLUMNAR_DECIMAL: {
+			// 128 bit little endian two's complement
+			const SQL_NUMERIC_STRUCT * source = column->fetchBuffer;
+			uint64_t * target = mkMalloc(heapHandle, rows * 2 * sizeof(uint64_t), __FILE__, __LINE__);
+			for (SQLULEN row = 0; row < rows; row++) {
+				uint64_t low = 0, high = 0;
+				if (column->indicators[row] != SQL_NULL_DATA) {
+					memcpy(&low, source[row].val, sizeof(uint64_t));
+					memcpy(&high, source[row].val + sizeof(uint64_t), sizeof(uint64_t));
+					if (source[row].sign == 0) {
+						// ODBC stores the magnitude, sign 0 means negative
+						low = ~low + 1;
+						high = ~high + (low == 0);
+					}
+				}
+				target[row * 2] = low;
+				target[row * 2 + 1] = high;
+			}
+			priv->buffers[1] = target;
+			break;
+		}
+		case SQLSERVER_COLUMNAR_DATE: {
+			const SQL_DATE_STRUCT * source = column->fetchBuffer;
+			int32_t * target = mkMalloc(heapHandle, rows * sizeof(int32_t), __FILE__, __LINE__);
+			for (SQLULEN row = 0; row < rows; row++) {
+				target[row] = (column->indicators[row] == SQL_NULL_DATA) ? 0 :
+					_ColumnarDaysFromCivil(source[row].year, source[row].month, source[row].day);
+			}
+			priv->buffers[1] = target;
+			break;
+		}
+		case SQLSERVER_COLUMNAR_TIMESTAMP: {
+			const SQL_TIMESTAMP_STRUCT * source = column->fetchBuffer;
+			int64_t * target = mkMalloc(heapHandle, rows * sizeof(int64_t), __FILE__, __LINE__);
+			for (SQLULEN row = 0; row < rows; row++) {
+				if (column->indicators[row] == SQL_NULL_DATA) {
+					target[row] = 0;
+					continue;
+				}
+				const SQL_TIMESTAMP_STRUCT * ts = &source[row];
+				int64_t seconds = (int64_t)_ColumnarDaysFromCivil(ts->year, ts->month, ts->day) * 86400 +
+					ts->hour * 3600 + ts->minute * 60 + ts->second;
+				// fraction is in nanoseconds
+				target[row] = seconds * 1000000 + ts->fraction / 1000;
+			}
+			priv->buffers[1] = target;
+			break;
+		}
+		case SQLSERVER_COLUMNAR_UTF8:
+		case SQLSERVER_COLUMNAR_BINARY: {
+			const char	  * source = column->fetchBuffer;
+			int32_t		  * offsets = mkMalloc(heapHandle, (rows + 1) * sizeof(int32_t), __FILE__, __LINE__);
+			SQLLEN		  * lengths = column->indicators;
+			size_t			dataSize = 0;
+			BOOL			isText = (column->kind == SQLSERVER_COLUMNAR_UTF8);
+			size_t			slotLength = isText ? (column->elementSize / sizeof(WCHAR)) - 1 : column->elementSize;
+
+			// first pass: value lengths (characters for text, bytes for binary) and the data buffer size
+			for (SQLULEN row = 0; row < rows; row++) {
+				SQLLEN length = lengths[row];
+				if (length == SQL_NULL_DATA) {
+					continue;
+				}
+				if (isText) {
+					const WCHAR * slot = (const WCHAR*)(source + row * column->elementSize);
+					length = (length >= 0 && (size_t)length / sizeof(WCHAR) <= slotLength) ? length / sizeof(WCHAR) : (SQLLEN)wcsnlen(slot, slotLength);
+					dataSize += length * 3;
+				}
+				else {
+					length = (length >= 0 && (size_t)length <= slotLength) ? length : (SQLLEN)slotLength;
+					dataSize += length;
+				}
+				lengths[row] = length;
+			}
+
+			char * data = mkMalloc(heapHandle, dataSize > 0 ? dataSize : 1, __FILE__, __LINE__);
+			int32_t offset = 0;
+			offsets[0] = 0;
+			for (SQLULEN row = 0; row < rows; row++) {
+				if (lengths[row] > 0) {
+					const char * slot = source + row * column->elementSize;
+					if (isText) {
+						offset += WideCharToMultiByte(CP_UTF8, 0, (const WCHAR*)slot, (int)lengths[row], data + offset, (int)(dataSize - offset), NULL, NULL);
+					}
+					else {
+						memcpy(data + offset, slot, lengths[row]);
+						offset += (int32_t)lengths[row];
+					}
+				}
+				offsets[row + 1] = offset;
+			}
+			priv->buffers[1] = offsets;
+			priv->buffers[2] = data;
+			out->n_buffers = 3;
+			break;
+		}
+	}
+}
+
+void
+_ColumnarReleaseArray(
+	struct ArrowArray * array
+)
+{
+	SQLSERVER_ARROW_PRIVATE * priv = array->private_data;
+
+	for (int i = 0; i < 3; i++) {
+		if (priv->buffers[i]) {
+			mkFree(priv->heapHandle, (void*)priv->buffers[i]);
+		}
+	}
+	if (priv->children) {
+		struct ArrowArray * children = priv->children;
+		for (int64_t i = 0; i < array->n_children; i++) {
+			if (children[i].release) {
+				children[i].release(&children[i]);
+			}
+		}
+		mkFree(priv->heapHandle, priv->children);
+		mkFree(priv->heapHandle, priv->childPointers);
+	}
+	mkFree(priv->heapHandle, priv);
+	array->release = NULL;
+}
+
+void
+_ColumnarReleaseSchema(
+	struct ArrowSchema * schema
+)
+{
+	SQLSERVER_ARROW_PRIVATE * priv = schema->private_data;
+
+	if (priv->children) {
+		struct ArrowSchema * children = priv->children;
+		for (int64_t i = 0; i < schema->n_children; i++) {
+			if (children[i].release) {
+				children[i].release(&children[i]);
+			}
+		}
+		mkFree(priv->heapHandle, priv->children);
+		mkFree(priv->heapHandle, priv->childPointers);
+	}
+	if (priv->name) {
+		mkFree(priv->heapHandle, priv->name);
+	}
+	mkFree(priv->heapHandle, priv);
+	schema->release = NULL;
+}
+
+SQLSERVER_INTERFACE_API
+SQLSERVER_COLUMNAR_READER *
+sqlserverColumnarOpen(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql,
+	SQLULEN batchRows
+)
+{
+	SQLSERVER_COLUMNAR_READER * reader = NULL;
+
+	_ResetError(conn, stm);
+
+	if (batchRows == 0) {
+		batchRows = 1024;
+	}
+
+	if (!_EnsurePrepared(conn, stm, sql)) {
+		return NULL;
+	}
+
+	TRYODBC_STM(stm,
+		_BeginExecute(conn, stm));
+
+	reader = _StatementMalloc(conn, stm, sizeof(SQLSERVER_COLUMNAR_READER), __FILE__, __LINE__);
+	reader->conn = conn;
+	reader->stm = stm;
+	reader->batchRows = batchRows;
+	reader->rowsFetched = 0;
+	reader->colCount = 0;
+	reader->columns = NULL;
+	reader->isEof = FALSE;
+
+	TRYODBC_STM(stm,
+		SQLNumResultCols(*stm->statement.sqlserver.hStmt, &reader->colCount));
+
+	if (!_ColumnarDescribe(reader)) {
+		goto Exit;
+	}
+
+	TRYODBC_STM(stm,
+		SQLSetStmtAttr(*stm->statement.sqlserver.hStmt, SQL_ATTR_ROW_BIND_TYPE, (SQLPOINTER)SQL_BIND_BY_COLUMN, 0));
+
+	TRYODBC_STM(stm,
+		SQLSetStmtAttr(*stm->statement.sqlserver.hStmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER)batchRows, 0));
+
+	TRYODBC_STM(stm,
+		SQLSetStmtAttr(*stm->statement.sqlserver.hStmt, SQL_ATTR_ROWS_FETCHED_PTR, &reader->rowsFetched, 0));
+
+	return reader;
+
+Exit:
+	if (reader) {
+		sqlserverColumnarClose(reader);
+	}
+	return NULL;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverColumnarGetSchema(
+	SQLSERVER_COLUMNAR_READER * reader,
+	struct ArrowSchema * out
+)
+{
+	HANDLE heapHandle = reader->conn->heapHandle;
+
+	SQLSERVER_ARROW_PRIVATE * priv = mkMalloc(heapHandle, sizeof(SQLSERVER_ARROW_PRIVATE), __FILE__, __LINE__);
+	memset(priv, 0, sizeof(SQLSERVER_ARROW_PRIVATE));
+	priv->heapHandle = heapHandle;
+
+	struct ArrowSchema	 * children = mkMalloc(heapHandle, reader->colCount * sizeof(struct ArrowSchema), __FILE__, __LINE__);
+	struct ArrowSchema	** childPointers = mkMalloc(heapHandle, reader->colCount * sizeof(struct ArrowSchema*), __FILE__, __LINE__);
+	priv->children = children;
+	priv->childPointers = childPointers;
+
+	for (SQLSMALLINT iCol = 0; iCol < reader->colCount; iCol++) {
+		SQLSERVER_COLUMNAR_COLUMN * column = &reader->columns[iCol];
+		SQLSERVER_ARROW_PRIVATE	  * childPriv = mkMalloc(heapHandle, sizeof(SQLSERVER_ARROW_PRIVATE), __FILE__, __LINE__);
+		memset(childPriv, 0, sizeof(SQLSERVER_ARROW_PRIVATE));
+		childPriv->heapHandle = heapHandle;
+
+		// format and name share one allocation so that the schema outlives the reader
+		size_t formatLength = strlen(column->format) + 1;
+		size_t nameLength = strlen(column->name) + 1;
+		childPriv->name = mkMalloc(heapHandle, formatLength + nameLength, __FILE__, __LINE__);
+		memcpy(childPriv->name, column->format, formatLength);
+		memcpy(childPriv->name + formatLength, column->name, nameLength);
+
+		children[iCol].format = childPriv->name;
+		children[iCol].name = childPriv->name + formatLength;
+		children[iCol].metadata = NULL;
+		children[iCol].flags = (column->nullable == SQL_NO_NULLS) ? 0 : ARROW_FLAG_NULLABLE;
+		children[iCol].n_children = 0;
+		children[iCol].children = NULL;
+		children[iCol].dictionary = NULL;
+		children[iCol].release = _ColumnarReleaseSchema;
+		children[iCol].private_data = childPriv;
+		childPointers[iCol] = &children[iCol];
+	}
+
+	out->format = "+s";
+	out->name = "";
+	out->metadata = NULL;
+	out->flags = 0;
+	out->n_children = reader->colCount;
+	out->children = childPointers;
+	out->dictionary = NULL;
+	out->release = _ColumnarReleaseSchema;
+	out->private_data = priv;
+
+	return TRUE;
+}
+
+SQLSERVER_INTERFACE_API
+long long
+sqlserverColumnarNextBatch(
+	SQLSERVER_COLUMNAR_READER * reader,
+	struct ArrowArray * out
+)
+{
+	DBInt_Connection  * conn = reader->conn;
+	DBInt_Statement	  * stm = reader->stm;
+	HANDLE				heapHandle = conn->heapHandle;
+	void			 ** values = NULL;
+	long long			retval = -1;
+	RETCODE				RetCode;
+
+	_ResetError(conn, stm);
+
+	memset(out, 0, sizeof(struct ArrowArray));
+
+	if (reader->isEof) {
+		return 0;
+	}
+
+	values = mkMalloc(heapHandle, reader->colCount * sizeof(void*), __FILE__, __LINE__);
+	for (SQLSMALLINT iCol = 0; iCol < reader->colCount; iCol++) {
+		SQLSERVER_COLUMNAR_COLUMN * column = &reader->columns[iCol];
+		values[iCol] = (column->kind == SQLSERVER_COLUMNAR_FIXED) ?
+			mkMalloc(heapHandle, reader->batchRows * column->elementSize, __FILE__, __LINE__) : NULL;
+	}
+
+	if (!_ColumnarBindFixed(reader, values)) {
+		goto Exit;
+	}
+
+	TRYODBC_STM(stm,
+		RetCode = SQLFetch(*stm->statement.sqlserver.hStmt));
+
+	if (RetCode == SQL_NO_DATA_FOUND || reader->rowsFetched == 0) {
+		reader->isEof = TRUE;
+		retval = 0;
+		goto Exit;
+	}
+
+	SQLSERVER_ARROW_PRIVATE * priv = mkMalloc(heapHandle, sizeof(SQLSERVER_ARROW_PRIVATE), __FILE__, __LINE__);
+	memset(priv, 0, sizeof(SQLSERVER_ARROW_PRIVATE));
+	priv->heapHandle = heapHandle;
+
+	struct ArrowArray	 * children = mkMalloc(heapHandle, reader->colCount * sizeof(struct ArrowArray), __FILE__, __LINE__);
+	struct ArrowArray	** childPointers = mkMalloc(heapHandle, reader->colCount * sizeof(struct ArrowArray*), __FILE__, __LINE__);
+	priv->children = children;
+	priv->childPointers = childPointers;
+
+	for (SQLSMALLINT iCol = 0; iCol < reader->colCount; iCol++) {
+		_ColumnarFillArray(reader, iCol, values[iCol], &children[iCol]);
+		// the values buffer now belongs to the child array
+		values[iCol] = NULL;
+		childPointers[iCol] = &children[iCol];
+	}
+
+	out->length = reader->rowsFetched;
+	out->null_count = 0;
+	out->offset = 0;
+	out->n_buffers = 1;
+	out->buffers = priv->buffers;
+	out->n_children = reader->colCount;
+	out->children = childPointers;
+	out->dictionary = NULL;
+	out->release = _ColumnarReleaseArray;
+	out->private_data = priv;
+
+	retval = reader->rowsFetched;
+
+Exit:
+	for (SQLSMALLINT iCol = 0; iCol < reader->colCount; iCol++) {
+		if (values[iCol]) {
+			mkFree(heapHandle, values[iCol]);
+		}
+	}
+	mkFree(heapHandle, values);
+
+	return retval;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverColumnarClose(
+	SQLSERVER_COLUMNAR_READER * reader
+)
+{
+	if (reader == NULL) {
+		return;
+	}
+
+	DBInt_Connection  * conn = reader->conn;
+	DBInt_Statement	  * stm = reader->stm;
+	SQLHSTMT			hStmt = *stm->statement.sqlserver.hStmt;
+
+	SQLSetStmtAttr(hStmt, SQL_ATTR_ROWS_FETCHED_PTR, NULL, 0);
+	SQLSetStmtAttr(hStmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER)1, 0);
+	SQLFreeStmt(hStmt, SQL_UNBIND);
+	SQLFreeStmt(hStmt, SQL_CLOSE);
+
+	stm->statement.sqlserver.isEof = TRUE;
+
+	if (reader->columns) {
+		for (SQLSMALLINT iCol = 0; iCol < reader->colCount; iCol++) {
+			SQLSERVER_COLUMNAR_COLUMN * column = &reader->columns[iCol];
+			_StatementFree(conn, stm, column->name);
+			_StatementFree(conn, stm, column->fetchBuffer);
+			_StatementFree(conn, stm, column->indicators);
+		}
+		_StatementFree(conn, stm, reader->columns);
+	}
+	_StatementFree(conn, stm, reader);
+}
@@ -0,0 +1,143 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "sqlserver-interface.h"
+
+/*	Text and binary columns are fetched into fixed width slots. Longer values (including (max) types) are truncated */
+#define SQLSERVER_COLUMNAR_MAX_VARIABLE_LENGTH		8000
+
+/*	Apache Arrow C data interface. Layout must stay identical to
+	https://arrow.apache.org/docs/format/CDataInterface.html */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED	1
+#define ARROW_FLAG_NULLABLE				2
+#define ARROW_FLAG_MAP_KEYS_SORTED		4
+
+struct ArrowSchema {
+	// Array type description
+	const char* format;
+	const char* name;
+	const char* metadata;
+	int64_t flags;
+	int64_t n_children;
+	struct ArrowSchema** children;
+	struct ArrowSchema* dictionary;
+
+	// Release callback
+	void (*release)(struct ArrowSchema*);
+	// Opaque producer-specific data
+	void* private_data;
+};
+
+struct ArrowArray {
+	// Array data description
+	int64_t length;
+	int64_t null_count;
+	int64_t offset;
+	int64_t n_buffers;
+	int64_t n_children;
+	const void** buffers;
+	struct ArrowArray** children;
+	struct ArrowArray* dictionary;
+
+	// Release callback
+	void (*release)(struct ArrowArray*);
+	// Opaque producer-specific data
+	void* private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+/*	How the row-array fetch buffer of a column becomes Arrow buffers */
+typedef enum _SQLSERVER_COLUMNAR_KIND {
+	/*	fixed width values are fetched straight into the Arrow values buffer */
+	SQLSERVER_COLUMNAR_FIXED,
+	SQLSERVER_COLUMNAR_BOOLEAN,
+	SQLSERVER_COLUMNAR_DECIMAL,
+	SQLSERVER_COLUMNAR_DATE,
+	SQLSERVER_COLUMNAR_TIMESTAMP,
+	SQLSERVER_COLUMNAR_UTF8,
+	SQLSERVER_COLUMNAR_BINARY
+} SQLSERVER_COLUMNAR_KIND;
+
+typedef struct _SQLSERVER_COLUMNAR_COLUMN {
+	char					  * name;
+	SQLSMALLINT					sqlType;
+	SQLULEN						columnSize;
+	SQLSMALLINT					decimalDigits;
+	SQLSMALLINT					nullable;
+	SQLSMALLINT					cType;
+	/*	bytes per row in the fetch buffer */
+	SQLLEN						elementSize;
+	char						format[16];
+	SQLSERVER_COLUMNAR_KIND		kind;
+	/*	reused across batches for every kind except SQLSERVER_COLUMNAR_FIXED */
+	void					  * fetchBuffer;
+	SQLLEN					  * indicators;
+} SQLSERVER_COLUMNAR_COLUMN;
+
+typedef struct _SQLSERVER_COLUMNAR_READER {
+	DBInt_Connection		  * conn;
+	DBInt_Statement			  * stm;
+	SQLULEN						batchRows;
+	SQLULEN						rowsFetched;
+	SQLSMALLINT					colCount;
+	SQLSERVER_COLUMNAR_COLUMN * columns;
+	BOOL						isEof;
+} SQLSERVER_COLUMNAR_READER;
+
+/*	private_data of every ArrowArray/ArrowSchema produced by this module */
+typedef struct _SQLSERVER_ARROW_PRIVATE {
+	HANDLE						heapHandle;
+	const void				  * buffers[3];
+	void					  * children;
+	void					  * childPointers;
+	char					  * name;
+} SQLSERVER_ARROW_PRIVATE;
+
+/* DDL's PRIVATE FUNCTIONS  */
+BOOL			_ColumnarDescribe(SQLSERVER_COLUMNAR_READER* reader);
+BOOL			_ColumnarBindFixed(SQLSERVER_COLUMNAR_READER* reader, void** values);
+void			_ColumnarFillArray(SQLSERVER_COLUMNAR_READER* reader, SQLSMALLINT iCol, void* values, struct ArrowArray* out);
+void			_ColumnarReleaseArray(struct ArrowArray* array);
+void			_ColumnarReleaseSchema(struct ArrowSchema* schema);
+int32_t			_ColumnarDaysFromCivil(int year, unsigned month, unsigned day);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Executes "sql", prepared first unless the statement already holds it (NULL runs the prepared text), and
+	switches it to row-array fetching of "batchRows" rows. Close the reader before freeing the statement.
+	Returns NULL on failure, conn->err is set. */
+SQLSERVER_INTERFACE_API
+SQLSERVER_COLUMNAR_READER *
+sqlserverColumnarOpen(
+	DBInt_Connection* conn,
+	DBInt_Statement* stm,
+	const char* sql,
+	SQLULEN batchRows);
+
+/*	Fills "out" with a struct schema describing one child per result column. Caller calls out->release */
+SQLSERVER_INTERFACE_API BOOL					sqlserverColumnarGetSchema(SQLSERVER_COLUMNAR_READER* reader, struct ArrowSchema* out);
+
+/*	Fetches the next batch into a struct array. Returns the row count, 0 at end of result set and -1 on error.
+	Caller calls out->release when the row count is greater than 0 */
+SQLSERVER_INTERFACE_API long long				sqlserverColumnarNextBatch(SQLSERVER_COLUMNAR_READER* reader, struct ArrowArray* out);
+
+/*	Releases the reader and restores single row fetching on the statement. Batches already handed out stay valid */
+SQLSERVER_INTERFACE_API void					sqlserverColumnarClose(SQLSERVER_COLUMNAR_READER* reader);
@@ -0,0 +1,400 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+#include "sqlserver-parameters.h"
+#include "sqlserver-prefetch.h"
+#include "sqlserver-describe.h"
+
+
+/*	Entries outlive the connections that described them, so they get a heap of their own */
+HANDLE								describeCacheHeap = NULL;
+INIT_ONCE							describeCacheInitOnce = INIT_ONCE_STATIC_INIT;
+
+SRWLOCK								describeCacheLock = SRWLOCK_INIT;
+SQLSERVER_DESCRIBE_CACHE_ENTRY	  * describeCacheBuckets[SQLSERVER_DESCRIBE_CACHE_BUCKET_COUNT];
+SQLSERVER_DESCRIBE_CACHE_STATS		describeCacheStats;
+
+
+BOOL CALLBACK
+_DescribeCacheInit(
+	PINIT_ONCE initOnce,
+	PVOID parameter,
+	PVOID * context
+)
+{
+	describeCacheHeap = HeapCreate(0, 0, 0);
+	return describeCacheHeap != NULL;
+}
+
+/*	Copies the descriptor into a block of its exact size on "heapHandle" */
+SQLSERVER_RESULT_DESCRIPTOR *
+_DescribeCopy(
+	HANDLE heapHandle,
+	const SQLSERVER_RESULT_DESCRIPTOR * descriptor
+)
+{
+	SQLSERVER_RESULT_DESCRIPTOR * copy = mkMalloc(heapHandle, descriptor->size, __FILE__, __LINE__);
+
+	if (copy == NULL) {
+		return NULL;
+	}
+	memcpy(copy, descriptor, descriptor->size);
+	copy->columns = (SQLSERVER_RESULT_COLUMN*)(copy + 1);
+	for (SQLSMALLINT iCol = 0; iCol < copy->columnCount; iCol++) {
+		// names are kept at the same offset in the block
+		copy->columns[iCol].name = (const char*)copy + (descriptor->columns[iCol].name - (const char*)descriptor);
+	}
+	return copy;
+}
+
+/*	Reads the result metadata of the prepared statement into a new descriptor on conn->heapHandle */
+SQLSERVER_RESULT_DESCRIPTOR *
+_DescribePrepared(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLHSTMT						hStmt = *stm->statement.sqlserver.hStmt;
+	SQLSERVER_RESULT_DESCRIPTOR   * descriptor = NULL;
+	SQLSERVER_RESULT_DESCRIPTOR   * retval = NULL;
+	SQLWCHAR					  * wColumnName = NULL;
+	SQLSMALLINT						colCount = 0;
+	SQLSMALLINT						longestName = 0;
+	size_t							namesCapacity = 0;
+
+	// with deferred prepare, the driver asks the server for the metadata only, the query does not run
+	TRYODBC_STM(stm,
+		SQLNumResultCols(hStmt, &colCount));
+
+	// names have no length limit here: their lengths come first and size the buffers
+	for (SQLSMALLINT iCol = 0; iCol < colCount; iCol++) {
+		SQLSMALLINT	cchColumnNameLength = 0;
+		SQLSMALLINT	sqlType, decimalDigits, nullable;
+		SQLULEN		columnSize;
+
+		TRYODBC_STM(stm,
+			SQLDescribeCol(hStmt, iCol + 1, NULL, 0, &cchColumnNameLength, &sqlType, &columnSize, &decimalDigits, &nullable));
+		longestName = max(longestName, cchColumnNameLength);
+		namesCapacity += (size_t)cchColumnNameLength * MB_CUR_MAX + 1;
+	}
+	wColumnName = mkMalloc(conn->heapHandle, (longestName + 1) * sizeof(SQLWCHAR), __FILE__, __LINE__);
+
+	// built with room for the longest encoding of the names, then copied into a block of the exact size
+	size_t capacity = sizeof(SQLSERVER_RESULT_DESCRIPTOR) + colCount * sizeof(SQLSERVER_RESULT_COLUMN) + namesCapacity;
+	descriptor = mkMalloc(conn->heapHandle, capacity, __FILE__, __LINE__);
+	if (descriptor == NULL || wColumnName == NULL) {
+		_SetErrorText(conn, stm, "Out of memory");
+		goto Exit;
+	}
+	descriptor->columnCount = colCount;
+	descriptor->columns = (SQLSERVER_RESULT_COLUMN*)(descriptor + 1);
+	descriptor->size = sizeof(SQLSERVER_RESULT_DESCRIPTOR) + colCount * sizeof(SQLSERVER_RESULT_COLUMN);
+
+	for (SQLSMALLINT iCol = 0; iCol < colCount; iCol++) {
+		SQLSERVER_RESULT_COLUMN * column = &descriptor->columns[iCol];
+		SQLSMALLINT				  cchColumnNameLength;
+		size_t					  nameLength;
+
+		TRYODBC_STM(stm,
+			SQLDescribeCol(hStmt,
+				iCol + 1,
+				wColumnName,
+				longestName + 1,
+				&cchColumnNameLength,
+				&column->sqlType,
+				&column->columnSize,
+				&column->decimalDigits,
+				&column->nullable));
+
+		TRYODBC_STM(stm,
+			SQLColAttribute(hStmt,
+				iCol + 1,
+				SQL_DESC_DISPLAY_SIZE,
+				NULL,
+				0,
+				NULL,
+				&column->displaySize));
+
+		column->dataType = _GetColumnDataType(column->sqlType);
+
+		char * name = (char*)descriptor + descriptor->size;
+		wcstombs_s(&nameLength, name, capacity - descriptor->size, wColumnName, _TRUNCATE);
+		column->name = name;
+		// nameLength counts the terminator
+		descriptor->size += nameLength ? nameLength : 1;
+		if (nameLength == 0) {
+			*name = '\0';
+		}
+	}
+
+	retval = _DescribeCopy(conn->heapHandle, descriptor);
+
+Exit:
+	if (descriptor) {
+		mkFree(conn->heapHandle, descriptor);
+	}
+	if (wColumnName) {
+		mkFree(conn->heapHandle, wColumnName);
+	}
+	return retval;
+}
+
+/*	Returns a copy on conn->heapHandle, NULL on a miss */
+SQLSERVER_RESULT_DESCRIPTOR *
+_DescribeCacheGet(
+	DBInt_Connection * conn,
+	const char * sql
+)
+{
+	SQLSERVER_RESULT_DESCRIPTOR   * retval = NULL;
+	size_t							keyLength;
+	size_t							connectionLength = (wcslen(conn->connection_string) + 1) * sizeof(SQLWCHAR);
+	unsigned long long				hash = _ParameterCacheHash(conn, sql, &keyLength);
+
+	AcquireSRWLockShared(&describeCacheLock);
+	for (SQLSERVER_DESCRIBE_CACHE_ENTRY * entry = describeCacheBuckets[hash % SQLSERVER_DESCRIBE_CACHE_BUCKET_COUNT]; entry; entry = entry->next) {
+		if (entry->hash == hash
+			&& entry->keyLength == keyLength
+			&& memcmp(entry->key, conn->connection_string, connectionLength) == 0
+			&& memcmp(entry->key + connectionLength, sql, keyLength - connectionLength) == 0) {
+			retval = _DescribeCopy(conn->heapHandle, entry->descriptor);
+			break;
+		}
+	}
+	ReleaseSRWLockShared(&describeCacheLock);
+
+	if (retval) {
+		InterlockedIncrement64((LONG64 volatile*)&describeCacheStats.hits);
+	}
+	else {
+		InterlockedIncrement64((LONG64 volatile*)&describeCacheStats.misses);
+	}
+	return retval;
+}
+
+void
+_DescribeCachePut(
+	DBInt_Connection * conn,
+	const char * sql,
+	const SQLSERVER_RESULT_DESCRIPTOR * descriptor
+)
+{
+	size_t keyLength;
+	size_t connectionLength = (wcslen(conn->connection_string) + 1) * sizeof(SQLWCHAR);
+
+	if (!InitOnceExecuteOnce(&describeCacheInitOnce, _DescribeCacheInit, NULL, NULL)) {
+		return;
+	}
+
+	unsigned long long hash = _ParameterCacheHash(conn, sql, &keyLength);
+
+	SQLSERVER_DESCRIBE_CACHE_ENTRY * entry = mkMalloc(describeCacheHeap, sizeof(SQLSERVER_DESCRIBE_CACHE_ENTRY) + keyLength, __FILE__, __LINE__);
+	if (entry == NULL) {
+		return;
+	}
+	entry->descriptor = _DescribeCopy(describeCacheHeap, descriptor);
+	if (entry->descriptor == NULL) {
+		mkFree(describeCacheHeap, entry);
+		return;
+	}
+	entry->hash = hash;
+	entry->keyLength = keyLength;
+	entry->key = (char*)(entry + 1);
+	memcpy(entry->key, conn->connection_string, connectionLength);
+	memcpy(entry->key + connectionLength, sql, keyLength - connectionLength);
+
+	AcquireSRWLockExclusive(&describeCacheLock);
+	if (describeCacheStats.entryCount >= SQLSERVER_DESCRIBE_CACHE_MAX_ENTRIES) {
+		_DescribeCacheClear();
+	}
+	// an entry described meanwhile by another thread is found first and shadows this one until the next clear
+	SQLSERVER_DESCRIBE_CACHE_ENTRY ** bucket = &describeCacheBuckets[hash % SQLSERVER_DESCRIBE_CACHE_BUCKET_COUNT];
+	entry->next = *bucket;
+	*bucket = entry;
+	describeCacheStats.entryCount++;
+	ReleaseSRWLockExclusive(&describeCacheLock);
+}
+
+/*	Called with describeCacheLock held exclusively */
+void
+_DescribeCacheClear(
+	void
+)
+{
+	for (int i = 0; i < SQLSERVER_DESCRIBE_CACHE_BUCKET_COUNT; i++) {
+		SQLSERVER_DESCRIBE_CACHE_ENTRY * entry = describeCacheBuckets[i];
+		while (entry) {
+			SQLSERVER_DESCRIBE_CACHE_ENTRY * next = entry->next;
+			mkFree(describeCacheHeap, entry->descriptor);
+			mkFree(describeCacheHeap, entry);
+			entry = next;
+		}
+		describeCacheBuckets[i] = NULL;
+	}
+	describeCacheStats.entryCount = 0;
+}
+
+/*	Descriptor of "sql" on conn->heapHandle, from the cache or by preparing the statement */
+SQLSERVER_RESULT_DESCRIPTOR *
+_DescribeGet(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql
+)
+{
+	SQLSERVER_STATEMENT			  * state = SQLSERVER_STATEMENT_OF(stm);
+	SQLSERVER_RESULT_DESCRIPTOR   * descriptor = _DescribeCacheGet(conn, sql);
+
+	// the helper thread must let go of the handle and a result set left open would block SQLPrepare
+	_PrefetchStop(conn, stm);
+	SQLFreeStmt(state->hStmt, SQL_CLOSE);
+
+	if (descriptor) {
+		// leaves the statement prepared with "sql" as a miss does. The prepare is deferred, or kept for
+		// SQLExecDirect, and makes no round trip when the parameters are cached
+		_PrepareStatement(conn, stm, sql, NULL, 0);
+		if (state->lastError.hasError) {
+			mkFree(conn->heapHandle, descriptor);
+			return NULL;
+		}
+		return descriptor;
+	}
+
+	_PrepareStatement(conn, stm, sql, NULL, 0);
+	if (state->lastError.hasError) {
+		return NULL;
+	}
+	if (state->directSql) {
+		// kept for SQLExecDirect, but only a prepared statement can be described
+		SQLSetStmtAttr(state->hStmt, SQL_SOPT_SS_DEFER_PREPARE, (SQLPOINTER)SQL_DP_ON, SQL_IS_INTEGER);
+		TRYODBC_STM(stm,
+			SQLPrepare(state->hStmt, state->directSql, SQL_NTS));
+		_StatementFree(conn, stm, state->directSql);
+		state->directSql = NULL;
+	}
+
+	descriptor = _DescribePrepared(conn, stm);
+	if (descriptor) {
+		_DescribeCachePut(conn, sql, descriptor);
+	}
+
+Exit:
+	return descriptor;
+}
+
+/*	Lays out stm->statement.sqlserver.resultSet as an execution would, with no row */
+void
+_DescribeApply(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const SQLSERVER_RESULT_DESCRIPTOR * descriptor
+)
+{
+	_AllocateResultSet(conn, stm, descriptor->columnCount);
+	stm->statement.sqlserver.cColCount = descriptor->columnCount;
+
+	for (SQLSMALLINT iCol = 0; iCol < descriptor->columnCount; iCol++) {
+		const SQLSERVER_RESULT_COLUMN * column = &descriptor->columns[iCol];
+		BINDING						  * bind = &stm->statement.sqlserver.resultSet[iCol];
+
+		// same sizes as _BindAllResultSetColumns
+		bind->rowDataCharacterCount = column->displaySize + sizeof(wchar_t);
+		bind->dataType = column->dataType;
+		bind->indPtr = SQL_NULL_DATA;
+		bind->wRowData = _StatementMalloc(conn, stm, (bind->rowDataCharacterCount + 1) * sizeof(WCHAR), __FILE__, __LINE__);
+		bind->chRowData = _StatementMalloc(conn, stm, (bind->rowDataCharacterCount + 1) * sizeof(char), __FILE__, __LINE__);
+		bind->columnName = _StatementMalloc(conn, stm, strlen(column->name) + 1, __FILE__, __LINE__);
+		if (bind->wRowData) {
+			bind->wRowData[0] = L'\0';
+		}
+		if (bind->chRowData) {
+			bind->chRowData[0] = '\0';
+		}
+		if (bind->columnName) {
+			strcpy_s(bind->columnName, strlen(column->name) + 1, column->name);
+		}
+	}
+	stm->statement.sqlserver.isEof = TRUE;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverExecuteDescribe(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql
+)
+{
+	_ResetError(conn, stm);
+	stm->statement.sqlserver.cRowCount = -1;
+
+	SQLSERVER_RESULT_DESCRIPTOR * descriptor = _DescribeGet(conn, stm, sql);
+	if (descriptor) {
+		_DescribeApply(conn, stm, descriptor);
+		mkFree(conn->heapHandle, descriptor);
+	}
+}
+
+SQLSERVER_INTERFACE_API
+SQLSERVER_RESULT_DESCRIPTOR *
+sqlserverDescribeResult(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql
+)
+{
+	_ResetError(conn, stm);
+
+	return _DescribeGet(conn, stm, sql);
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverFreeResultDescriptor(
+	DBInt_Connection * conn,
+	SQLSERVER_RESULT_DESCRIPTOR * descriptor
+)
+{
+	if (descriptor) {
+		mkFree(conn->heapHandle, descriptor);
+	}
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverClearDescribeCache(
+	void
+)
+{
+	AcquireSRWLockExclusive(&describeCacheLock);
+	_DescribeCacheClear();
+	ReleaseSRWLockExclusive(&describeCacheLock);
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverGetDescribeCacheStats(
+	SQLSERVER_DESCRIBE_CACHE_STATS * stats
+)
+{
+	AcquireSRWLockShared(&describeCacheLock);
+	*stats = describeCacheStats;
+	ReleaseSRWLockShared(&describeCacheLock);
+}
@@ -0,0 +1,85 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+#include "sqlserver-interface.h"
+
+#define SQLSERVER_DESCRIBE_CACHE_BUCKET_COUNT		256
+/*	The cache is emptied when it reaches this size */
+#define SQLSERVER_DESCRIBE_CACHE_MAX_ENTRIES		4096
+
+typedef struct _SQLSERVER_RESULT_COLUMN {
+	const char				  * name;
+	SQLSMALLINT					sqlType;
+	SQLULEN						columnSize;
+	SQLSMALLINT					decimalDigits;
+	SQLSMALLINT					nullable;
+	/*	characters needed to show any value as text, as used for the bound buffers */
+	SQLLEN						displaySize;
+	SODIUM_DATABASE_COLUMN_TYPE	dataType;
+} SQLSERVER_RESULT_COLUMN;
+
+/*	Shape of a result set in a single block: this structure, the columns, then the names.
+	Released with sqlserverFreeResultDescriptor */
+typedef struct _SQLSERVER_RESULT_DESCRIPTOR {
+	/*	bytes of the block */
+	size_t						size;
+	SQLSMALLINT					columnCount;
+	SQLSERVER_RESULT_COLUMN	  * columns;
+} SQLSERVER_RESULT_DESCRIPTOR;
+
+typedef struct _SQLSERVER_DESCRIBE_CACHE_ENTRY {
+	struct _SQLSERVER_DESCRIBE_CACHE_ENTRY * next;
+	unsigned long long				hash;
+	/*	connection string and SQL text */
+	char						  * key;
+	size_t							keyLength;
+	SQLSERVER_RESULT_DESCRIPTOR	  * descriptor;
+} SQLSERVER_DESCRIBE_CACHE_ENTRY;
+
+typedef struct _SQLSERVER_DESCRIBE_CACHE_STATS {
+	unsigned long long	hits;
+	/*	statements prepared to be described */
+	unsigned long long	misses;
+	unsigned long long	entryCount;
+} SQLSERVER_DESCRIBE_CACHE_STATS;
+
+/* DDL's PRIVATE FUNCTIONS  */
+SQLSERVER_RESULT_DESCRIPTOR   * _DescribeCopy(HANDLE heapHandle, const SQLSERVER_RESULT_DESCRIPTOR* descriptor);
+SQLSERVER_RESULT_DESCRIPTOR   * _DescribePrepared(DBInt_Connection* conn, DBInt_Statement* stm);
+SQLSERVER_RESULT_DESCRIPTOR   * _DescribeCacheGet(DBInt_Connection* conn, const char* sql);
+void							_DescribeCachePut(DBInt_Connection* conn, const char* sql, const SQLSERVER_RESULT_DESCRIPTOR* descriptor);
+void							_DescribeCacheClear(void);
+SQLSERVER_RESULT_DESCRIPTOR   * _DescribeGet(DBInt_Connection* conn, DBInt_Statement* stm, const char* sql);
+void							_DescribeApply(DBInt_Connection* conn, DBInt_Statement* stm, const SQLSERVER_RESULT_DESCRIPTOR* descriptor);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Returns the shape of the result set of "sql" without running it. Descriptors are cached per connection string
+	and SQL text, on a miss the statement is prepared and its result metadata read. Hit or miss, the statement is
+	left holding "sql", ready to execute. Returns NULL on failure */
+SQLSERVER_INTERFACE_API
+SQLSERVER_RESULT_DESCRIPTOR *
+sqlserverDescribeResult(
+	DBInt_Connection* conn,
+	DBInt_Statement* stm,
+	const char* sql);
+
+SQLSERVER_INTERFACE_API void					sqlserverFreeResultDescriptor(DBInt_Connection* conn, SQLSERVER_RESULT_DESCRIPTOR* descriptor);
+
+/*	Forgets every descriptor, e.g. after a schema change */
+SQLSERVER_INTERFACE_API void					sqlserverClearDescribeCache(void);
+
+SQLSERVER_INTERFACE_API void					sqlserverGetDescribeCacheStats(SQLSERVER_DESCRIBE_CACHE_STATS* stats);
@@ -0,0 +1,199 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-diagnostics.h"
+
+
+volatile LONG					diagnosticLevel = SQLSERVER_LOG_NONE;
+
+SRWLOCK							diagnosticLock = SRWLOCK_INIT;
+CONDITION_VARIABLE				diagnosticAvailable = CONDITION_VARIABLE_INIT;
+CONDITION_VARIABLE				diagnosticDrained = CONDITION_VARIABLE_INIT;
+SQLSERVER_DIAGNOSTIC			diagnosticQueue[SQLSERVER_DIAGNOSTIC_QUEUE_SIZE];
+unsigned int					diagnosticHead = 0;
+unsigned int					diagnosticCount = 0;
+/*	TRUE while the logger thread is inside the callback */
+BOOL							diagnosticDelivering = FALSE;
+SQLSERVER_DIAGNOSTIC_LOGGER		diagnosticLogger = NULL;
+void						  * diagnosticUserData = NULL;
+HANDLE							diagnosticThread = NULL;
+volatile LONG64					diagnosticDropped = 0;
+
+
+void
+_DiagnosticEnqueue(
+	const SQLSERVER_DIAGNOSTIC * record
+)
+{
+	AcquireSRWLockExclusive(&diagnosticLock);
+	if (diagnosticCount == SQLSERVER_DIAGNOSTIC_QUEUE_SIZE || diagnosticThread == NULL) {
+		ReleaseSRWLockExclusive(&diagnosticLock);
+		InterlockedIncrement64(&diagnosticDropped);
+		return;
+	}
+	diagnosticQueue[(diagnosticHead + diagnosticCount) % SQLSERVER_DIAGNOSTIC_QUEUE_SIZE] = *record;
+	diagnosticCount++;
+	ReleaseSRWLockExclusive(&diagnosticLock);
+
+	WakeConditionVariable(&diagnosticAvailable);
+}
+
+DWORD WINAPI
+_DiagnosticLoggerThread(
+	LPVOID parameter
+)
+{
+	SQLSERVER_DIAGNOSTIC		record;
+	SQLSERVER_DIAGNOSTIC_LOGGER	logger;
+	void					  * userData;
+
+	AcquireSRWLockExclusive(&diagnosticLock);
+	for (;;) {
+		while (diagnosticCount == 0) {
+			SleepConditionVariableSRW(&diagnosticAvailable, &diagnosticLock, INFINITE, 0);
+		}
+		record = diagnosticQueue[diagnosticHead];
+		diagnosticHead = (diagnosticHead + 1) % SQLSERVER_DIAGNOSTIC_QUEUE_SIZE;
+		diagnosticCount--;
+		logger = diagnosticLogger;
+		userData = diagnosticUserData;
+		diagnosticDelivering = TRUE;
+		ReleaseSRWLockExclusive(&diagnosticLock);
+
+		// records queued before the logger was removed are discarded
+		if (logger) {
+			logger(&record, userData);
+		}
+
+		AcquireSRWLockExclusive(&diagnosticLock);
+		diagnosticDelivering = FALSE;
+		if (diagnosticCount == 0) {
+			WakeAllConditionVariable(&diagnosticDrained);
+		}
+	}
+	return 0;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverSetDiagnosticLogger(
+	SQLSERVER_DIAGNOSTIC_LOGGER logger,
+	SQLSERVER_LOG_LEVEL level,
+	void * userData
+)
+{
+	BOOL retVal = TRUE;
+
+	if (logger == NULL) {
+		level = SQLSERVER_LOG_NONE;
+	}
+
+	AcquireSRWLockExclusive(&diagnosticLock);
+	if (level != SQLSERVER_LOG_NONE && diagnosticThread == NULL) {
+		// runs until the process exits
+		diagnosticThread = CreateThread(NULL, 0, _DiagnosticLoggerThread, NULL, 0, NULL);
+		if (diagnosticThread == NULL) {
+			level = SQLSERVER_LOG_NONE;
+			retVal = FALSE;
+		}
+	}
+	diagnosticLogger = (level == SQLSERVER_LOG_NONE) ? NULL : logger;
+	diagnosticUserData = userData;
+	InterlockedExchange(&diagnosticLevel, level);
+	ReleaseSRWLockExclusive(&diagnosticLock);
+
+	return retVal;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverFlushDiagnostics(
+	DWORD timeoutMs
+)
+{
+	BOOL retVal = TRUE;
+
+	AcquireSRWLockExclusive(&diagnosticLock);
+	while (diagnosticCount > 0 || diagnosticDelivering) {
+		if (!SleepConditionVariableSRW(&diagnosticDrained, &diagnosticLock, timeoutMs, 0)) {
+			retVal = FALSE;
+			break;
+		}
+	}
+	ReleaseSRWLockExclusive(&diagnosticLock);
+
+	return retVal;
+}
+
+SQLSERVER_INTERFACE_API
+unsigned long long
+sqlserverGetDroppedDiagnosticCount(
+	void
+)
+{
+	return (unsigned long long)diagnosticDropped;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverDiagnosticStderrLogger(
+	const SQLSERVER_DIAGNOSTIC * record,
+	void * userData
+)
+{
+	fwprintf(stderr, L"[%5.5s] %s (%d)\n", record->sqlState, record->message, record->nativeError);
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverCaptureStatementDiagnostics(
+	DBInt_Statement * stm,
+	BOOL capture
+)
+{
+	SQLSERVER_STATEMENT_OF(stm)->captureDiagnostics = capture;
+}
+
+SQLSERVER_INTERFACE_API
+int
+sqlserverGetStatementDiagnostics(
+	DBInt_Statement * stm,
+	SQLSERVER_DIAGNOSTIC * records,
+	int maxCount
+)
+{
+	SQLSERVER_DIAGNOSTIC_RING * ring = &SQLSERVER_STATEMENT_OF(stm)->diagnostics;
+	unsigned int available = min(ring->written, SQLSERVER_DIAGNOSTIC_RING_SIZE);
+	unsigned int first = ring->written - available;
+	int count = 0;
+
+	for (unsigned int i = 0; i < available && count < maxCount; i++) {
+		records[count++] = ring->records[(first + i) % SQLSERVER_DIAGNOSTIC_RING_SIZE];
+	}
+	return count;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverClearStatementDiagnostics(
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_STATEMENT_OF(stm)->diagnostics.written = 0;
+}
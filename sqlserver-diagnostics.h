@@ -0,0 +1,58 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+#include "sqlserver-interface.h"
+
+/*	Records waiting for the logger thread. Producers never wait: when the queue is full the record is dropped and counted */
+#define SQLSERVER_DIAGNOSTIC_QUEUE_SIZE		256
+
+/*	Called on the logger thread, one record at a time */
+typedef void (*SQLSERVER_DIAGNOSTIC_LOGGER)(const SQLSERVER_DIAGNOSTIC* record, void* userData);
+
+/*	Level of the installed logger, SQLSERVER_LOG_NONE when there is none. Read without locking on every diagnostic */
+extern volatile LONG diagnosticLevel;
+
+/* DDL's PRIVATE FUNCTIONS  */
+void			_DiagnosticEnqueue(const SQLSERVER_DIAGNOSTIC* record);
+DWORD WINAPI	_DiagnosticLoggerThread(LPVOID parameter);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Installs "logger" for records up to and including "level". A NULL logger or SQLSERVER_LOG_NONE turns logging off.
+	The logger thread is started on first use. Returns FALSE if it could not be started. */
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverSetDiagnosticLogger(
+	SQLSERVER_DIAGNOSTIC_LOGGER logger,
+	SQLSERVER_LOG_LEVEL level,
+	void* userData);
+
+/*	Waits until every queued record has been handed to the logger. Returns FALSE on timeout */
+SQLSERVER_INTERFACE_API BOOL					sqlserverFlushDiagnostics(DWORD timeoutMs);
+
+/*	Number of records dropped because the queue was full */
+SQLSERVER_INTERFACE_API unsigned long long		sqlserverGetDroppedDiagnosticCount(void);
+
+/*	Ready made logger writing "[state] message (native error)" lines to stderr */
+SQLSERVER_INTERFACE_API void					sqlserverDiagnosticStderrLogger(const SQLSERVER_DIAGNOSTIC* record, void* userData);
+
+/*	Keeps warning and informational records in the statement's ring as well. Error records are always kept */
+SQLSERVER_INTERFACE_API void					sqlserverCaptureStatementDiagnostics(DBInt_Statement* stm, BOOL capture);
+
+/*	Copies up to "maxCount" records of the statement's ring into "records", oldest first. Returns the count copied */
+SQLSERVER_INTERFACE_API int						sqlserverGetStatementDiagnostics(DBInt_Statement* stm, SQLSERVER_DIAGNOSTIC* records, int maxCount);
+
+SQLSERVER_INTERFACE_API void					sqlserverClearStatementDiagnostics(DBInt_Statement* stm);
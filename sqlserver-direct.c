@@ -0,0 +1,267 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+#include "sqlserver-parameters.h"
+#include "sqlserver-direct.h"
+#include "sqlserver-prefetch.h"
+#include "sqlserver-profile.h"
+#include "sqlserver-capture.h"
+
+
+SRWLOCK								usageLock = SRWLOCK_INIT;
+SQLSERVER_USAGE_ENTRY			  * usageBuckets[SQLSERVER_DIRECT_BUCKET_COUNT];
+LONG								usageEntryCount;
+volatile LONG						prepareThreshold = SQLSERVER_DIRECT_DEFAULT_THRESHOLD;
+SQLSERVER_DIRECT_STATS				directStats;
+
+/*	Entries outlive the connections that created them */
+HANDLE								usageHeap = NULL;
+INIT_ONCE							usageInitOnce = INIT_ONCE_STATIC_INIT;
+
+
+BOOL CALLBACK
+_DirectInit(
+	PINIT_ONCE initOnce,
+	PVOID parameter,
+	PVOID * context
+)
+{
+	usageHeap = HeapCreate(0, 0, 0);
+	return usageHeap != NULL;
+}
+
+/*	Frees the least used entries until SQLSERVER_DIRECT_EVICT_ENTRIES are gone, so texts prepared often keep
+	their counts. Called with usageLock held exclusively */
+void
+_DirectEvict(
+	void
+)
+{
+	LONG evicted = 0;
+
+	for (LONG64 cutoff = 1; evicted < SQLSERVER_DIRECT_EVICT_ENTRIES && usageEntryCount > 0; cutoff *= 2) {
+		for (int i = 0; i < SQLSERVER_DIRECT_BUCKET_COUNT; i++) {
+			SQLSERVER_USAGE_ENTRY ** link = &usageBuckets[i];
+			while (*link) {
+				SQLSERVER_USAGE_ENTRY * entry = *link;
+				if (entry->uses <= cutoff) {
+					*link = entry->next;
+					mkFree(usageHeap, entry);
+					usageEntryCount--;
+					evicted++;
+				}
+				else {
+					link = &entry->next;
+				}
+			}
+		}
+	}
+}
+
+/*	Counts one more prepare of "sql" and tells whether it is still rare enough to be executed directly */
+BOOL
+_DirectShouldExecute(
+	DBInt_Connection * conn,
+	const char * sql
+)
+{
+	LONG					threshold = InterlockedCompareExchange(&prepareThreshold, 0, 0);
+	size_t					keyLength;
+	size_t					connectionLength = (wcslen(conn->connection_string) + 1) * sizeof(SQLWCHAR);
+	SQLSERVER_USAGE_ENTRY * entry;
+	LONG					uses = 0;
+
+	if (threshold == 0 || !InitOnceExecuteOnce(&usageInitOnce, _DirectInit, NULL, NULL)) {
+		return FALSE;
+	}
+
+	unsigned long long hash = _ParameterCacheHash(conn, sql, &keyLength);
+	SQLSERVER_USAGE_ENTRY ** bucket = &usageBuckets[hash % SQLSERVER_DIRECT_BUCKET_COUNT];
+
+	AcquireSRWLockShared(&usageLock);
+	for (entry = *bucket; entry; entry = entry->next) {
+		if (entry->hash == hash && entry->keyLength == keyLength
+			&& memcmp(entry->key, conn->connection_string, connectionLength) == 0
+			&& memcmp(entry->key + connectionLength, sql, keyLength - connectionLength) == 0) {
+			uses = InterlockedIncrement(&entry->uses);
+			break;
+		}
+	}
+	ReleaseSRWLockShared(&usageLock);
+
+	if (uses == 0) {
+		// first prepare seen, two threads may both get here for the same text and count it once each
+		entry = mkMalloc(usageHeap, sizeof(SQLSERVER_USAGE_ENTRY) + keyLength, __FILE__, __LINE__);
+		if (entry == NULL) {
+			return FALSE;
+		}
+		entry->hash = hash;
+		entry->uses = 1;
+		entry->keyLength = keyLength;
+		entry->key = (char*)(entry + 1);
+		memcpy(entry->key, conn->connection_string, connectionLength);
+		memcpy(entry->key + connectionLength, sql, keyLength - connectionLength);
+
+		AcquireSRWLockExclusive(&usageLock);
+		if (usageEntryCount >= SQLSERVER_DIRECT_MAX_ENTRIES) {
+			_DirectEvict();
+		}
+		entry->next = *bucket;
+		*bucket = entry;
+		usageEntryCount++;
+		ReleaseSRWLockExclusive(&usageLock);
+		uses = 1;
+	}
+	return uses <= threshold;
+}
+
+/*	Counts the execution about to start as direct or prepared */
+void
+_DirectCountExecution(
+	SQLSERVER_STATEMENT * state
+)
+{
+	if (state->directSql) {
+		InterlockedIncrement64((LONG64 volatile*)&directStats.directExecutions);
+	}
+	else {
+		InterlockedIncrement64((LONG64 volatile*)&directStats.preparedExecutions);
+	}
+}
+
+/*	Ends the prepare _BeginExecute started for a directly executed statement. Bound parameters are kept by
+	SQLPrepare. On failure the statement simply stays direct */
+void
+_DirectEndPromotion(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	RETCODE prepared
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	state->promoting = FALSE;
+	if (SQL_SUCCEEDED(prepared)) {
+		_StatementFree(conn, stm, state->directSql);
+		state->directSql = NULL;
+		InterlockedIncrement64((LONG64 volatile*)&directStats.promotions);
+	}
+}
+
+/*	Starts an execution of the statement. A directly executed statement that runs a second time is prepared first */
+RETCODE
+_BeginExecute(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	// the helper thread must let go of the handle before it runs again
+	_PrefetchStop(conn, stm);
+
+	if (state->directSql && state->executionCount > 0) {
+		// deferred, the prepare makes no round trip. Asynchronous statements (sqlserverAsyncExecute, pipelines)
+		// may still report it pending, _PollExecute then polls it before it starts the execution
+		SQLSetStmtAttr(state->hStmt, SQL_SOPT_SS_DEFER_PREPARE, (SQLPOINTER)SQL_DP_ON, SQL_IS_INTEGER);
+		state->promoting = TRUE;
+	}
+	else {
+		_DirectCountExecution(state);
+	}
+	state->executionCount++;
+
+	LONGLONG started = _ProfileStart(stm);
+	RETCODE	 RetCode = _PollExecute(conn, stm);
+	if (RetCode != SQL_STILL_EXECUTING) {
+		// asynchronous executions are left out, their latency is spread over the polls
+		_ProfileRecord(stm, SQLSERVER_PROFILE_EXECUTE, started);
+		_CaptureExecute(conn, stm, RetCode, started);
+	}
+	return RetCode;
+}
+
+/*	Runs the execution, or polls it when it is asynchronous and still running */
+RETCODE
+_PollExecute(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	if (state->promoting) {
+		RETCODE prepared = SQLPrepare(state->hStmt, state->directSql, SQL_NTS);
+		if (prepared == SQL_STILL_EXECUTING) {
+			return prepared;
+		}
+		_DirectEndPromotion(conn, stm, prepared);
+		_DirectCountExecution(state);
+	}
+
+	if (state->directSql) {
+		return SQLExecDirect(state->hStmt, state->directSql, SQL_NTS);
+	}
+	return SQLExecute(state->hStmt);
+}
+
+/*	Cancels a pending execution and polls it to its end, the handle accepts no other call before. A pending
+	prepare is polled on its own, the execution after it is never started */
+void
+_CancelExecute(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	SQLCancel(state->hStmt);
+	if (state->promoting) {
+		RETCODE prepared;
+		while ((prepared = SQLPrepare(state->hStmt, state->directSql, SQL_NTS)) == SQL_STILL_EXECUTING) {
+			Sleep(1);
+		}
+		_DirectEndPromotion(conn, stm, prepared);
+		return;
+	}
+	while (_PollExecute(conn, stm) == SQL_STILL_EXECUTING) {
+		Sleep(1);
+	}
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverSetPrepareThreshold(
+	unsigned int uses
+)
+{
+	InterlockedExchange(&prepareThreshold, (LONG)uses);
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverGetDirectExecuteStats(
+	SQLSERVER_DIRECT_STATS * stats
+)
+{
+	stats->directExecutions = InterlockedCompareExchange64((LONG64 volatile*)&directStats.directExecutions, 0, 0);
+	stats->preparedExecutions = InterlockedCompareExchange64((LONG64 volatile*)&directStats.preparedExecutions, 0, 0);
+	stats->promotions = InterlockedCompareExchange64((LONG64 volatile*)&directStats.promotions, 0, 0);
+}
@@ -0,0 +1,58 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+#include "sqlserver-interface.h"
+
+#define SQLSERVER_DIRECT_BUCKET_COUNT			256
+/*	When the usage table reaches this size, its least used SQL texts are dropped and counted again from 0 */
+#define SQLSERVER_DIRECT_MAX_ENTRIES			4096
+#define SQLSERVER_DIRECT_EVICT_ENTRIES			(SQLSERVER_DIRECT_MAX_ENTRIES / 4)
+#define SQLSERVER_DIRECT_DEFAULT_THRESHOLD		1
+
+/*	How often a SQL text was prepared on a connection string */
+typedef struct _SQLSERVER_USAGE_ENTRY {
+	struct _SQLSERVER_USAGE_ENTRY * next;
+	unsigned long long		hash;
+	volatile LONG			uses;
+	/*	connection string and SQL text, follows the entry in memory */
+	char				  * key;
+	size_t					keyLength;
+} SQLSERVER_USAGE_ENTRY;
+
+typedef struct _SQLSERVER_DIRECT_STATS {
+	unsigned long long	directExecutions;
+	unsigned long long	preparedExecutions;
+	/*	statements prepared on their second execution after starting out direct */
+	unsigned long long	promotions;
+} SQLSERVER_DIRECT_STATS;
+
+/* DDL's PRIVATE FUNCTIONS  */
+void			_DirectEvict(void);
+BOOL			_DirectShouldExecute(DBInt_Connection* conn, const char* sql);
+void			_DirectEndPromotion(DBInt_Connection* conn, DBInt_Statement* stm, RETCODE prepared);
+void			_DirectCountExecution(SQLSERVER_STATEMENT* state);
+RETCODE			_BeginExecute(DBInt_Connection* conn, DBInt_Statement* stm);
+RETCODE			_PollExecute(DBInt_Connection* conn, DBInt_Statement* stm);
+void			_CancelExecute(DBInt_Connection* conn, DBInt_Statement* stm);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	A SQL text is executed with SQLExecDirect, without a server side prepare, until it has been prepared more than
+	"uses" times on the same connection string. 0 prepares every statement. A statement prepared directly is still
+	prepared when it is executed a second time. Defaults to SQLSERVER_DIRECT_DEFAULT_THRESHOLD */
+SQLSERVER_INTERFACE_API void					sqlserverSetPrepareThreshold(unsigned int uses);
+
+SQLSERVER_INTERFACE_API void					sqlserverGetDirectExecuteStats(SQLSERVER_DIRECT_STATS* stats);
@@ -0,0 +1,246 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+#include "sqlserver-direct.h"
+#include "sqlserver-dml.h"
+
+
+/*	Walks every result of the execution. Values are read with SQLGetData, the statement's column bindings are
+	neither used nor allocated */
+BOOL
+_DmlCollect(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	RETCODE RetCode,
+	SQLSERVER_DML_RESULT * result
+)
+{
+	SQLHSTMT	hStmt = *stm->statement.sqlserver.hStmt;
+	SQLSMALLINT	colCount;
+	SQLLEN		rowCount;
+
+	result->identityCount = 0;
+	result->affectedRows = 0;
+
+	_FreeResultSet(conn, stm);
+
+	while (RetCode != SQL_NO_DATA) {
+		if (RetCode == SQL_SUCCESS_WITH_INFO) {
+			_HandleDiagnosticRecord(hStmt, SQL_HANDLE_STMT, RetCode, stm);
+		}
+		else if (RetCode != SQL_SUCCESS) {
+			// with parameter arrays, the rows before the failing one are kept
+			_HandleDiagnosticRecord(hStmt, SQL_HANDLE_STMT, RetCode, stm);
+			_SetError(conn, stm);
+			break;
+		}
+
+		TRYODBC_STM(stm,
+			SQLNumResultCols(hStmt, &colCount));
+
+		if (colCount > 0) {
+			while ((RetCode = SQLFetch(hStmt)) != SQL_NO_DATA) {
+				long long	value;
+				SQLLEN		indicator;
+
+				if (RetCode == SQL_ERROR) {
+					TRYODBC_STM(stm, RetCode);
+				}
+				TRYODBC_STM(stm,
+					SQLGetData(hStmt, 1, SQL_C_SBIGINT, &value, sizeof(value), &indicator));
+
+				if (indicator != SQL_NULL_DATA && result->identities && result->identityCount < result->identityCapacity) {
+					result->identities[result->identityCount] = value;
+				}
+				result->identityCount++;
+			}
+		}
+
+		if (SQL_SUCCEEDED(SQLRowCount(hStmt, &rowCount)) && rowCount > 0) {
+			result->affectedRows += rowCount;
+		}
+
+		// output parameters are only set once this returns SQL_NO_DATA
+		RetCode = SQLMoreResults(hStmt);
+	}
+
+Exit:
+	stm->statement.sqlserver.cColCount = 0;
+	stm->statement.sqlserver.isEof = TRUE;
+	stm->statement.sqlserver.cRowCount = result->affectedRows;
+	if (RetCode != SQL_NO_DATA) {
+		// drop what is left of the batch so the statement can run again
+		SQLFreeStmt(hStmt, SQL_CLOSE);
+	}
+	return !SQLSERVER_STATEMENT_OF(stm)->lastError.hasError;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverExecuteReturning(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql,
+	SQLSERVER_DML_RESULT * result
+)
+{
+	_ResetError(conn, stm);
+
+	if (!_EnsurePrepared(conn, stm, sql)) {
+		return FALSE;
+	}
+	result->rowsProcessed = 1;
+
+	return _DmlCollect(conn, stm, _BeginExecute(conn, stm), result);
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverBindParameterArray(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex,
+	SQLSMALLINT cType,
+	void * values,
+	SQLLEN elementSize,
+	SQLLEN * indicators
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	_ResetError(conn, stm);
+
+	if (paramIndex < 1 || paramIndex > stm->statement.sqlserver.ParameterCount) {
+		_SetErrorText(conn, stm, "Invalid parameter index");
+		return FALSE;
+	}
+
+	SQLSERVER_PARAMETER * parameter = &state->parameters[paramIndex - 1];
+	SQLULEN				  columnSize = parameter->columnSize;
+
+	if (columnSize == 0) {
+		// (max) types are described with size 0
+		columnSize = (cType == SQL_C_WCHAR) ? elementSize / sizeof(WCHAR) : elementSize;
+	}
+
+	// the single row binding no longer describes what the driver reads
+	stm->statement.sqlserver.bindVariables[paramIndex - 1].fCType = 0;
+
+	TRYODBC_STM(stm,
+		SQLBindParameter(
+			*stm->statement.sqlserver.hStmt,
+			paramIndex,
+			SQL_PARAM_INPUT,
+			cType,
+			parameter->sqlType,
+			columnSize,
+			parameter->decimalDigits,
+			values,
+			elementSize,
+			indicators));
+
+Exit:
+	return !state->lastError.hasError;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverExecuteArray(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql,
+	SQLULEN rowCount,
+	SQLSERVER_DML_RESULT * result
+)
+{
+	SQLHSTMT hStmt = *stm->statement.sqlserver.hStmt;
+	BOOL	 succeeded = FALSE;
+
+	_ResetError(conn, stm);
+
+	result->rowsProcessed = 0;
+
+	// the same text keeps the arrays bound by sqlserverBindParameterArray
+	if (!_EnsurePrepared(conn, stm, sql)) {
+		return FALSE;
+	}
+
+	TRYODBC_STM(stm,
+		SQLSetStmtAttr(hStmt, SQL_ATTR_PARAMS_PROCESSED_PTR, &result->rowsProcessed, 0));
+	TRYODBC_STM(stm,
+		SQLSetStmtAttr(hStmt, SQL_ATTR_PARAMSET_SIZE, (SQLPOINTER)rowCount, 0));
+
+	succeeded = _DmlCollect(conn, stm, _BeginExecute(conn, stm), result);
+
+Exit:
+	SQLSetStmtAttr(hStmt, SQL_ATTR_PARAMSET_SIZE, (SQLPOINTER)1, 0);
+	SQLSetStmtAttr(hStmt, SQL_ATTR_PARAMS_PROCESSED_PTR, NULL, 0);
+	// the caller's arrays must not be read by a later execution
+	SQLFreeStmt(hStmt, SQL_RESET_PARAMS);
+	return succeeded;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverBindOutputInt64(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+	long long			  initial = 0;
+
+	_ResetError(conn, stm);
+
+	if (paramIndex < 1 || paramIndex > stm->statement.sqlserver.ParameterCount) {
+		_SetErrorText(conn, stm, "Invalid parameter index");
+		return FALSE;
+	}
+	state->parameters[paramIndex - 1].inputOutputType = SQL_PARAM_OUTPUT;
+	if (state->parameters[paramIndex - 1].sqlType == SQL_UNKNOWN_TYPE) {
+		// "SET ? = ..." targets are not always described
+		state->parameters[paramIndex - 1].sqlType = SQL_BIGINT;
+	}
+
+	return _BindParameterValue(conn, stm, paramIndex, SQL_C_SBIGINT, &initial, sizeof(initial));
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverGetOutputInt64(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex,
+	long long * value
+)
+{
+	if (paramIndex < 1 || paramIndex > stm->statement.sqlserver.ParameterCount) {
+		return FALSE;
+	}
+
+	ODBC_BINDING * binding = &stm->statement.sqlserver.bindVariables[paramIndex - 1];
+
+	if (binding->fCType != SQL_C_SBIGINT || binding->pcbValue == SQL_NULL_DATA) {
+		return FALSE;
+	}
+	memcpy(value, binding->buffer, sizeof(long long));
+	return TRUE;
+}
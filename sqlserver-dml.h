@@ -0,0 +1,78 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+#include "sqlserver-interface.h"
+
+/*	Outcome of sqlserverExecuteReturning and sqlserverExecuteArray, filled in by the caller's storage */
+typedef struct _SQLSERVER_DML_RESULT {
+	/*	first column of every row returned, e.g. by "OUTPUT INSERTED.id". Caller's array, may be NULL */
+	long long		  * identities;
+	size_t				identityCapacity;
+	/*	rows returned, may exceed identityCapacity */
+	size_t				identityCount;
+	/*	sum of the row counts of every statement of the batch and every parameter row */
+	SQLLEN				affectedRows;
+	/*	parameter rows processed, sqlserverExecuteArray only */
+	SQLULEN				rowsProcessed;
+} SQLSERVER_DML_RESULT;
+
+/* DDL's PRIVATE FUNCTIONS  */
+BOOL			_DmlCollect(DBInt_Connection* conn, DBInt_Statement* stm, RETCODE RetCode, SQLSERVER_DML_RESULT* result);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Executes the prepared statement and reads every result of the batch in the same round trip: rows returned by
+	OUTPUT clauses become identities, row counts are summed. Output parameters are set when it returns. */
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverExecuteReturning(
+	DBInt_Connection* conn,
+	DBInt_Statement* stm,
+	const char* sql,
+	SQLSERVER_DML_RESULT* result);
+
+/*	Binds "rowCount" values of a parameter for sqlserverExecuteArray. "values" holds one element of "elementSize"
+	bytes per row, "indicators" the byte length of each value or SQL_NULL_DATA and may be NULL for fixed size C
+	types. Both arrays belong to the caller and must stay valid until the execution returns */
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverBindParameterArray(
+	DBInt_Connection* conn,
+	DBInt_Statement* stm,
+	SQLUSMALLINT paramIndex,
+	SQLSMALLINT cType,
+	void* values,
+	SQLLEN elementSize,
+	SQLLEN* indicators);
+
+/*	Executes "sql" once for "rowCount" rows of parameter arrays in a single round trip. NULL runs the prepared
+	text. The arrays are bound against the prepared text: pass that text or NULL, other text is prepared again and
+	drops them. Identities are returned in parameter row order. Parameters must be bound again before the next
+	single row execution */
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverExecuteArray(
+	DBInt_Connection* conn,
+	DBInt_Statement* stm,
+	const char* sql,
+	SQLULEN rowCount,
+	SQLSERVER_DML_RESULT* result);
+
+/*	Binds "paramIndex" as a bigint output parameter, e.g. for "INSERT ...; SET ? = SCOPE_IDENTITY()" */
+SQLSERVER_INTERFACE_API BOOL					sqlserverBindOutputInt64(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT paramIndex);
+
+/*	Value of an output parameter after sqlserverExecuteReturning. Returns FALSE if it is NULL */
+SQLSERVER_INTERFACE_API BOOL					sqlserverGetOutputInt64(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT paramIndex, long long* value);
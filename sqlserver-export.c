@@ -0,0 +1,383 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+#include "pch.h"
+
+#include <io.h>
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-export.h"
+
+
+BOOL
+_ExportFlush(
+	SQLSERVER_EXPORT_WRITER * writer
+)
+{
+	size_t offset = 0;
+
+	while (offset < writer->used && !writer->failed) {
+		int written = _write(writer->fd, writer->buffer + offset, (unsigned int)(writer->used - offset));
+		if (written <= 0) {
+			writer->failed = TRUE;
+			break;
+		}
+		offset += written;
+	}
+	writer->byteCount += offset;
+	writer->used = 0;
+
+	return !writer->failed;
+}
+
+/*	Returns a pointer to at least "size" free bytes in the write buffer, "size" is at most
+	SQLSERVER_EXPORT_BUFFER_SIZE. Caller advances "used" */
+char *
+_ExportReserve(
+	SQLSERVER_EXPORT_WRITER * writer,
+	size_t size
+)
+{
+	if (writer->used + size > SQLSERVER_EXPORT_BUFFER_SIZE) {
+		_ExportFlush(writer);
+	}
+	if (writer->failed) {
+		return NULL;
+	}
+	return writer->buffer + writer->used;
+}
+
+void
+_ExportWriteBytes(
+	SQLSERVER_EXPORT_WRITER * writer,
+	const char * bytes,
+	size_t size
+)
+{
+	char * dest = _ExportReserve(writer, size);
+	if (dest) {
+		memcpy(dest, bytes, size);
+		writer->used += size;
+	}
+}
+
+/*	Converts "wValue" into UTF-8 at "dest" and returns the byte count. A NULL "dest" returns the byte count only */
+size_t
+_ExportUtf8(
+	const WCHAR * wValue,
+	SQLLEN length,
+	char * dest,
+	size_t destSize
+)
+{
+	if (length <= 0) {
+		return 0;
+	}
+	return WideCharToMultiByte(CP_UTF8, 0, wValue, (int)length, dest, (int)destSize, NULL, NULL);
+}
+
+/*	UTF-16 units of "wValue" from "offset" that are converted together, a surrogate pair is never split */
+SQLLEN
+_ExportChunkLength(
+	const WCHAR * wValue,
+	SQLLEN length,
+	SQLLEN offset
+)
+{
+	SQLLEN count = length - offset;
+
+	if (count > SQLSERVER_EXPORT_CHUNK_LENGTH) {
+		count = SQLSERVER_EXPORT_CHUNK_LENGTH;
+		if (IS_HIGH_SURROGATE(wValue[offset + count - 1])) {
+			count--;
+		}
+	}
+	return count;
+}
+
+/*	Escapes the "size" UTF-8 bytes at "dest" in place and returns the new byte count. "dest" has room for twice
+	as many. CSV doubles the quotes, the surrounding quotes are written by the caller */
+size_t
+_ExportEscape(
+	char * dest,
+	size_t size,
+	SQLSERVER_EXPORT_FORMAT format
+)
+{
+	size_t escapeCount = 0;
+
+	for (size_t i = 0; i < size; i++) {
+		if (format == SQLSERVER_EXPORT_CSV ? dest[i] == '"'
+			: (dest[i] == '\t' || dest[i] == '\n' || dest[i] == '\r' || dest[i] == '\\')) {
+			escapeCount++;
+		}
+	}
+	if (escapeCount == 0) {
+		return size;
+	}
+
+	// expanding from the end
+	size_t newSize = size + escapeCount;
+	size_t to = newSize;
+	for (size_t from = size; from > 0; from--) {
+		char ch = dest[from - 1];
+		if (format == SQLSERVER_EXPORT_CSV) {
+			dest[--to] = ch;
+			if (ch == '"') {
+				dest[--to] = '"';
+			}
+			continue;
+		}
+		switch (ch) {
+			case '\t': dest[--to] = 't';  dest[--to] = '\\'; break;
+			case '\n': dest[--to] = 'n';  dest[--to] = '\\'; break;
+			case '\r': dest[--to] = 'r';  dest[--to] = '\\'; break;
+			case '\\': dest[--to] = '\\'; dest[--to] = '\\'; break;
+			default:   dest[--to] = ch;   break;
+		}
+	}
+	return newSize;
+}
+
+/*	Writes a CSV or TSV field. Values longer than SQLSERVER_EXPORT_CHUNK_LENGTH are converted and escaped in
+	parts, so any value fits the write buffer */
+void
+_ExportWriteText(
+	SQLSERVER_EXPORT_WRITER * writer,
+	const WCHAR * wValue,
+	SQLLEN length,
+	SQLSERVER_EXPORT_FORMAT format
+)
+{
+	BOOL needsQuote = FALSE;
+
+	if (format == SQLSERVER_EXPORT_CSV) {
+		// empty string is quoted so that it can be told apart from NULL
+		needsQuote = (length == 0);
+		for (SQLLEN i = 0; i < length && !needsQuote; i++) {
+			needsQuote = (wValue[i] == L'"' || wValue[i] == L',' || wValue[i] == L'\r' || wValue[i] == L'\n');
+		}
+	}
+	if (needsQuote) {
+		_ExportWriteBytes(writer, "\"", 1);
+	}
+
+	for (SQLLEN offset = 0; offset < length && !writer->failed; ) {
+		SQLLEN count = _ExportChunkLength(wValue, length, offset);
+		// worst case: 3 UTF-8 bytes per UTF-16 unit, every byte escaped
+		size_t maxSize = count * 3 * 2;
+		char * dest = _ExportReserve(writer, maxSize);
+		if (dest == NULL) {
+			return;
+		}
+		size_t size = _ExportUtf8(wValue + offset, count, dest, maxSize);
+		writer->used += _ExportEscape(dest, size, format);
+		offset += count;
+	}
+
+	if (needsQuote) {
+		_ExportWriteBytes(writer, "\"", 1);
+	}
+}
+
+void
+_ExportWriteBinary(
+	SQLSERVER_EXPORT_WRITER * writer,
+	const WCHAR * wValue,
+	SQLLEN length
+)
+{
+	INT32 size = -1;
+
+	if (length >= 0) {
+		size = (INT32)_ExportUtf8(wValue, length, NULL, 0);
+	}
+	_ExportWriteBytes(writer, (const char*)&size, sizeof(INT32));
+
+	for (SQLLEN offset = 0; offset < length && !writer->failed; ) {
+		SQLLEN count = _ExportChunkLength(wValue, length, offset);
+		size_t maxSize = count * 3;
+		char * dest = _ExportReserve(writer, maxSize);
+		if (dest == NULL) {
+			return;
+		}
+		writer->used += _ExportUtf8(wValue + offset, count, dest, maxSize);
+		offset += count;
+	}
+}
+
+void
+_ExportWriteHeader(
+	DBInt_Connection * conn,
+	SQLSERVER_EXPORT_WRITER * writer,
+	DBInt_Statement * stm,
+	SQLSERVER_EXPORT_FORMAT format
+)
+{
+	SQLSMALLINT colCount = stm->statement.sqlserver.cColCount;
+
+	if (format == SQLSERVER_EXPORT_BINARY) {
+		UINT16 version = SQLSERVER_EXPORT_BINARY_VERSION;
+		UINT16 count = colCount;
+		char * dest = _ExportReserve(writer, 4 + sizeof(UINT16) * 2);
+		if (dest == NULL) {
+			return;
+		}
+		memcpy(dest, SQLSERVER_EXPORT_BINARY_MAGIC, 4);
+		memcpy(dest + 4, &version, sizeof(UINT16));
+		memcpy(dest + 4 + sizeof(UINT16), &count, sizeof(UINT16));
+		writer->used += 4 + sizeof(UINT16) * 2;
+	}
+
+	for (SQLSMALLINT iCol = 0; iCol < colCount && !writer->failed; iCol++) {
+		BINDING * bind = &stm->statement.sqlserver.resultSet[iCol];
+		const char * name = bind->columnName ? bind->columnName : "";
+		size_t nameLength = strlen(name);
+
+		if (format == SQLSERVER_EXPORT_BINARY) {
+			UINT16 length = (UINT16)nameLength;
+			char * dest = _ExportReserve(writer, 1 + sizeof(UINT16) + nameLength);
+			if (dest == NULL) {
+				return;
+			}
+			dest[0] = (char)bind->dataType;
+			memcpy(dest + 1, &length, sizeof(UINT16));
+			memcpy(dest + 1 + sizeof(UINT16), name, nameLength);
+			writer->used += 1 + sizeof(UINT16) + nameLength;
+		}
+		else {
+			if (iCol > 0) {
+				_ExportWriteBytes(writer, (format == SQLSERVER_EXPORT_CSV) ? "," : "\t", 1);
+			}
+			// names are quoted and escaped like the values, the bound name is in the multibyte code page
+			size_t wNameLength = 0;
+			WCHAR * wName = _StatementMalloc(conn, stm, (nameLength + 1) * sizeof(WCHAR), __FILE__, __LINE__);
+			mbstowcs_s(&wNameLength, wName, nameLength + 1, name, _TRUNCATE);
+			_ExportWriteText(writer, wName, (SQLLEN)wNameLength - 1, format);
+			_StatementFree(conn, stm, wName);
+		}
+	}
+
+	if (format != SQLSERVER_EXPORT_BINARY) {
+		_ExportWriteBytes(writer, "\r\n", 2);
+	}
+}
+
+void
+_ExportWriteRow(
+	SQLSERVER_EXPORT_WRITER * writer,
+	DBInt_Statement * stm,
+	SQLSERVER_EXPORT_FORMAT format
+)
+{
+	for (SQLSMALLINT iCol = 0; iCol < stm->statement.sqlserver.cColCount && !writer->failed; iCol++) {
+		BINDING * bind = &stm->statement.sqlserver.resultSet[iCol];
+		SQLLEN    length = _GetBoundValueLength(bind);
+
+		if (format == SQLSERVER_EXPORT_BINARY) {
+			_ExportWriteBinary(writer, bind->wRowData, length);
+			continue;
+		}
+
+		if (iCol > 0) {
+			char * dest = _ExportReserve(writer, 1);
+			if (dest == NULL) {
+				return;
+			}
+			*dest = (format == SQLSERVER_EXPORT_CSV) ? ',' : '\t';
+			writer->used++;
+		}
+
+		if (length >= 0) {
+			_ExportWriteText(writer, bind->wRowData, length, format);
+		}
+		else if (format == SQLSERVER_EXPORT_TSV) {
+			char * dest = _ExportReserve(writer, 2);
+			if (dest) {
+				dest[0] = '\\';
+				dest[1] = 'N';
+				writer->used += 2;
+			}
+		}
+	}
+
+	if (format != SQLSERVER_EXPORT_BINARY) {
+		char * dest = _ExportReserve(writer, 2);
+		if (dest) {
+			dest[0] = '\r';
+			dest[1] = '\n';
+			writer->used += 2;
+		}
+	}
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverExportResultSet(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql,
+	int fd,
+	SQLSERVER_EXPORT_FORMAT format,
+	SQLSERVER_EXPORT_STATS * stats
+)
+{
+	SQLSERVER_EXPORT_WRITER writer;
+	SQLSERVER_STATEMENT	  * state = SQLSERVER_STATEMENT_OF(stm);
+	unsigned long long		rowCount = 0;
+	LARGE_INTEGER			frequency, start, end;
+
+	_ResetError(conn, stm);
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&start);
+
+	writer.fd = fd;
+	writer.used = 0;
+	writer.byteCount = 0;
+	writer.failed = FALSE;
+	writer.buffer = mkMalloc(conn->heapHandle, SQLSERVER_EXPORT_BUFFER_SIZE, __FILE__, __LINE__);
+
+	sqlserverExecuteSelectStatement(conn, stm, sql);
+
+	if (!state->lastError.hasError && stm->statement.sqlserver.cColCount > 0) {
+		_ExportWriteHeader(conn, &writer, stm, format);
+
+		while (!stm->statement.sqlserver.isEof && !state->lastError.hasError && !writer.failed) {
+			_ExportWriteRow(&writer, stm, format);
+			rowCount++;
+			sqlserverNext(conn, stm);
+		}
+	}
+	_ExportFlush(&writer);
+
+	if (writer.failed && !state->lastError.hasError) {
+		_SetErrorText(conn, stm, "Unable to write export data");
+	}
+
+	QueryPerformanceCounter(&end);
+
+	if (stats) {
+		stats->rowCount = rowCount;
+		stats->byteCount = writer.byteCount;
+		stats->elapsedSeconds = (double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+		stats->rowsPerSecond = (stats->elapsedSeconds > 0) ? rowCount / stats->elapsedSeconds : 0;
+		stats->bytesPerSecond = (stats->elapsedSeconds > 0) ? writer.byteCount / stats->elapsedSeconds : 0;
+	}
+
+	mkFree(conn->heapHandle, writer.buffer);
+
+	return !state->lastError.hasError;
+}
@@ -0,0 +1,77 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+#pragma once
+
+#include "sqlserver-interface.h"
+
+/*	Size of the buffer rows are formatted into before they are written to the file descriptor */
+#define SQLSERVER_EXPORT_BUFFER_SIZE		(256 * 1024)
+/*	UTF-16 units of a value converted at once. Escaped, their UTF-8 bytes take at most 6 bytes each */
+#define SQLSERVER_EXPORT_CHUNK_LENGTH		(SQLSERVER_EXPORT_BUFFER_SIZE / 6)
+
+/*	First 4 bytes of a binary export file */
+#define SQLSERVER_EXPORT_BINARY_MAGIC		"SQLX"
+#define SQLSERVER_EXPORT_BINARY_VERSION		1
+
+typedef enum _SQLSERVER_EXPORT_FORMAT {
+	/*	RFC 4180 CSV. NULL is written as an empty field, empty string as "". The header is quoted like the values */
+	SQLSERVER_EXPORT_CSV,
+	/*	Tab separated. Tab, new line and backslash are escaped, NULL is written as \N */
+	SQLSERVER_EXPORT_TSV,
+	/*	Header: magic, uint16 version, uint16 column count, then per column uint8 type + uint16 length + name.
+		Rows: per column int32 length (-1 for NULL) followed by UTF-8 bytes. All integers are little endian. */
+	SQLSERVER_EXPORT_BINARY
+} SQLSERVER_EXPORT_FORMAT;
+
+typedef struct _SQLSERVER_EXPORT_STATS {
+	unsigned long long	rowCount;
+	unsigned long long	byteCount;
+	double				elapsedSeconds;
+	double				rowsPerSecond;
+	double				bytesPerSecond;
+} SQLSERVER_EXPORT_STATS;
+
+typedef struct _SQLSERVER_EXPORT_WRITER {
+	int					fd;
+	char			  * buffer;
+	size_t				used;
+	unsigned long long	byteCount;
+	BOOL				failed;
+} SQLSERVER_EXPORT_WRITER;
+
+/* DDL's PRIVATE FUNCTIONS  */
+BOOL			_ExportFlush(SQLSERVER_EXPORT_WRITER* writer);
+char		  * _ExportReserve(SQLSERVER_EXPORT_WRITER* writer, size_t size);
+void			_ExportWriteBytes(SQLSERVER_EXPORT_WRITER* writer, const char* bytes, size_t size);
+size_t			_ExportUtf8(const WCHAR* wValue, SQLLEN length, char* dest, size_t destSize);
+SQLLEN			_ExportChunkLength(const WCHAR* wValue, SQLLEN length, SQLLEN offset);
+size_t			_ExportEscape(char* dest, size_t size, SQLSERVER_EXPORT_FORMAT format);
+void			_ExportWriteText(SQLSERVER_EXPORT_WRITER* writer, const WCHAR* wValue, SQLLEN length, SQLSERVER_EXPORT_FORMAT format);
+void			_ExportWriteBinary(SQLSERVER_EXPORT_WRITER* writer, const WCHAR* wValue, SQLLEN length);
+void			_ExportWriteHeader(DBInt_Connection* conn, SQLSERVER_EXPORT_WRITER* writer, DBInt_Statement* stm, SQLSERVER_EXPORT_FORMAT format);
+void			_ExportWriteRow(SQLSERVER_EXPORT_WRITER* writer, DBInt_Statement* stm, SQLSERVER_EXPORT_FORMAT format);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Executes the prepared statement and streams the whole result set to "fd" straight from the bound
+	column buffers. "stats" is optional. Returns FALSE if execution, fetching or writing failed. */
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverExportResultSet(
+	DBInt_Connection* conn,
+	DBInt_Statement* stm,
+	const char* sql,
+	int fd,
+	SQLSERVER_EXPORT_FORMAT format,
+	SQLSERVER_EXPORT_STATS* stats);
@@ -16,29 +16,199 @@
 #include "..\DBInt\db-interface.h"
 
 #include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+#include "sqlserver-diagnostics.h"
+#include "sqlserver-cache.h"
+#include "sqlserver-tvp.h"
+#include "sqlserver-parameters.h"
+#include "sqlserver-retry.h"
+#include "sqlserver-direct.h"
+#include "sqlserver-prefetch.h"
+#include "sqlserver-describe.h"
+#include "sqlserver-profile.h"
+#include "sqlserver-capture.h"
+#include "sqlserver-async.h"
 
 SQLHENV     hEnv = NULL;
+INIT_ONCE   hEnvInitOnce = INIT_ONCE_STATIC_INIT;
 
-/*******************************************/
-/* Macro to call ODBC functions and        */
-/* report an error on failure.             */
-/* Takes handle, handle type, and stmt     */
-/*******************************************/
+/*	Error of the last call made by the current thread */
+__declspec(thread) SQLSERVER_ERROR threadError;
 
-#define TRYODBC(h, ht, x)   {   RETCODE rc = x;\
-                                if (rc != SQL_SUCCESS) \
-                                { \
-                                    _HandleDiagnosticRecord (h, ht, rc); \
-                                } \
-                                if (rc == SQL_ERROR) \
-                                { \
-                                    conn->err = TRUE; \
-                                    conn->errText = "error occured"; \
-                                    goto Exit;  \
-                                }  \
-                            }
+#ifdef _DEBUG
+volatile LONG		liveStatementBlocks;
 
+/*	Counts blocks owned by statements of "conn", and by "stm" itself when given */
+void
+_TrackBlocks(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	LONG delta
+)
+{
+	InterlockedExchangeAdd(&liveStatementBlocks, delta);
+	if (conn->connection.sqlserverHandle) {
+		InterlockedExchangeAdd(&SQLSERVER_CONNECTION_OF(conn)->liveBlocks, delta);
+	}
+	if (stm) {
+		SQLSERVER_STATEMENT_OF(stm)->liveBlocks += delta;
+	}
+}
+#endif
+
+/*	mkMalloc for memory owned by a statement. "stm" is NULL for the statement structures themselves */
+void *
+_StatementMalloc(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	size_t size,
+	const char * file,
+	int line
+)
+{
+	void * block = mkMalloc(conn->heapHandle, size, file, line);
+#ifdef _DEBUG
+	if (block) {
+		_TrackBlocks(conn, stm, 1);
+	}
+#endif
+	return block;
+}
 
+void
+_StatementFree(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	void * block
+)
+{
+	if (block == NULL) {
+		return;
+	}
+#ifdef _DEBUG
+	_TrackBlocks(conn, stm, -1);
+#endif
+	mkFree(conn->heapHandle, block);
+}
+
+/*	Grows the buffer of a parameter binding to at least "size" bytes */
+void
+_EnsureParameterBuffer(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	ODBC_BINDING * binding,
+	SQLLEN size
+)
+{
+	if (binding->buffer && binding->buffer_length >= size) {
+		return;
+	}
+	_StatementFree(conn, stm, binding->buffer);
+	binding->buffer_length = size;
+	binding->buffer = _StatementMalloc(conn, stm, size, __FILE__, __LINE__);
+}
+
+/*	Copies "value" into the parameter's buffer and binds it as "cType" against the SQL type described at prepare
+	time, so that the server sees the column's own type and no implicit conversion happens. "length" is the byte
+	count of the value or SQL_NULL_DATA. */
+BOOL
+_BindParameterValue(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex,
+	SQLSMALLINT cType,
+	const void * value,
+	SQLLEN length
+)
+{
+	SQLSERVER_STATEMENT	  * state = SQLSERVER_STATEMENT_OF(stm);
+
+	if (paramIndex < 1 || paramIndex > stm->statement.sqlserver.ParameterCount) {
+		_SetErrorText(conn, stm, "Invalid parameter index");
+		return FALSE;
+	}
+
+	ODBC_BINDING		  * binding = &stm->statement.sqlserver.bindVariables[paramIndex - 1];
+	SQLSERVER_PARAMETER   * parameter = &state->parameters[paramIndex - 1];
+
+	if (parameter->sqlType == SQL_SS_TABLE) {
+		_SetErrorText(conn, stm, "Table-valued parameters are bound with sqlserverBindTableParameter");
+		return FALSE;
+	}
+	_CaptureBind(conn, stm, paramIndex, cType, value, length);
+
+	if (length == SQL_NULL_DATA) {
+		_EnsureParameterBuffer(conn, stm, binding, sizeof(WCHAR));
+		binding->pcbValue = SQL_NULL_DATA;
+	}
+	else {
+		// text is kept null terminated for readers of the buffer such as the result cache
+		SQLLEN size = length + ((cType == SQL_C_WCHAR) ? sizeof(WCHAR) : 0);
+		_EnsureParameterBuffer(conn, stm, binding, size);
+		memcpy(binding->buffer, value, length);
+		if (cType == SQL_C_WCHAR) {
+			((WCHAR*)binding->buffer)[length / sizeof(WCHAR)] = L'\0';
+		}
+		binding->pcbValue = length;
+	}
+	binding->fCType = cType;
+
+	return _BindParameterBuffer(conn, stm, paramIndex);
+}
+
+/*	Binds the value already in the parameter's buffer. Also used to bind again on a new statement handle */
+BOOL
+_BindParameterBuffer(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex
+)
+{
+	SQLSERVER_STATEMENT	  * state = SQLSERVER_STATEMENT_OF(stm);
+	ODBC_BINDING		  * binding = &stm->statement.sqlserver.bindVariables[paramIndex - 1];
+	SQLSERVER_PARAMETER   * parameter = &state->parameters[paramIndex - 1];
+	SQLULEN					columnSize = parameter->columnSize;
+	SQLLEN					length = binding->pcbValue;
+	SQLHDESC				hDesc = NULL;
+
+	if (columnSize == 0) {
+		// (max) types are described with size 0
+		columnSize = (length > 0) ? ((binding->fCType == SQL_C_WCHAR) ? length / sizeof(WCHAR) : length) : 1;
+	}
+
+	TRYODBC_STM(stm,
+		SQLBindParameter(
+			*stm->statement.sqlserver.hStmt,
+			paramIndex,
+			parameter->inputOutputType ? parameter->inputOutputType : SQL_PARAM_INPUT,
+			binding->fCType,
+			parameter->sqlType,
+			columnSize,
+			parameter->decimalDigits,
+			binding->buffer,
+			binding->buffer_length,
+			&binding->pcbValue));
+
+	if (binding->fCType == SQL_C_NUMERIC && length != SQL_NULL_DATA) {
+		// SQLBindParameter leaves precision and scale of a SQL_C_NUMERIC buffer at the driver defaults (scale 0),
+		// they are set on the application parameter descriptor. Setting them unbinds the data pointer, so it goes last
+		const SQL_NUMERIC_STRUCT * value = (const SQL_NUMERIC_STRUCT*)binding->buffer;
+
+		TRYODBC_STM(stm,
+			SQLGetStmtAttr(*stm->statement.sqlserver.hStmt, SQL_ATTR_APP_PARAM_DESC, &hDesc, 0, NULL));
+		TRYODBC(hDesc, SQL_HANDLE_DESC,
+			SQLSetDescField(hDesc, paramIndex, SQL_DESC_TYPE, (SQLPOINTER)SQL_C_NUMERIC, 0));
+		TRYODBC(hDesc, SQL_HANDLE_DESC,
+			SQLSetDescField(hDesc, paramIndex, SQL_DESC_PRECISION, (SQLPOINTER)(ULONG_PTR)value->precision, 0));
+		TRYODBC(hDesc, SQL_HANDLE_DESC,
+			SQLSetDescField(hDesc, paramIndex, SQL_DESC_SCALE, (SQLPOINTER)(LONG_PTR)value->scale, 0));
+		TRYODBC(hDesc, SQL_HANDLE_DESC,
+			SQLSetDescField(hDesc, paramIndex, SQL_DESC_DATA_PTR, binding->buffer, 0));
+	}
+
+Exit:
+	return !state->lastError.hasError;
+}
 
 void 
 _SQLBindStringW(
@@ -49,52 +219,55 @@ _SQLBindStringW(
 	SQLULEN strlen
 )
 {
-	if (stm->statement.sqlserver.ParameterCount > 0) {
-
-		ODBC_BINDING * binding = &stm->statement.sqlserver.bindVariables[colIndex - 1];
+	if (colIndex < 1 || colIndex > stm->statement.sqlserver.ParameterCount) {
+		_SetErrorText(conn, stm, "Invalid parameter index");
+		return;
+	}
 
-		if (binding->fCType == SQL_C_NUMERIC)
-		{
-			*((long*)binding->buffer) = _wtol(szString);
-		
-			TRYODBC(*stm->statement.sqlserver.hStmt,
-				SQL_HANDLE_STMT,
-				SQLBindParameter(
-					*stm->statement.sqlserver.hStmt, 
-					colIndex, 
-					SQL_PARAM_INPUT, 
-					SQL_C_SSHORT, 
-					SQL_INTEGER, 
-					0, 
-					0, 
-					binding->buffer, 
-					0, 
-					&binding->pcbValue));
+	// numbers are converted here, everything else is converted by the driver to the described SQL type
+	switch (SQLSERVER_STATEMENT_OF(stm)->parameters[colIndex - 1].cType)
+	{
+		case SQL_C_BIT: {
+			unsigned char value = (_wcsicmp(szString, L"true") == 0 || _wtoi64(szString) != 0);
+			_BindParameterValue(conn, stm, colIndex, SQL_C_BIT, &value, sizeof(value));
+			break;
 		}
-		else if (stm->statement.sqlserver.bindVariables[colIndex - 1].fCType == SQL_C_WCHAR) 
-		{
-			size_t size = strlen * sizeof(WCHAR);
-			memcpy_s(binding->buffer, size, szString, size);
-			binding->pcbValue = SQL_NTS;
-
-			TRYODBC(*stm->statement.sqlserver.hStmt,
-				SQL_HANDLE_STMT,
-				SQLBindParameter(
-					*stm->statement.sqlserver.hStmt,
-					colIndex,
-					SQL_PARAM_INPUT,
-					SQL_C_WCHAR,
-					SQL_WCHAR,
-					strlen,
-					0,
-					binding->buffer,
-					size,
-					&binding->pcbValue));
+		case SQL_C_UTINYINT: {
+			unsigned char value = (unsigned char)_wtoi64(szString);
+			_BindParameterValue(conn, stm, colIndex, SQL_C_UTINYINT, &value, sizeof(value));
+			break;
+		}
+		case SQL_C_SSHORT: {
+			short value = (short)_wtoi64(szString);
+			_BindParameterValue(conn, stm, colIndex, SQL_C_SSHORT, &value, sizeof(value));
+			break;
+		}
+		case SQL_C_SLONG: {
+			long value = (long)_wtoi64(szString);
+			_BindParameterValue(conn, stm, colIndex, SQL_C_SLONG, &value, sizeof(value));
+			break;
+		}
+		case SQL_C_SBIGINT: {
+			long long value = _wtoi64(szString);
+			_BindParameterValue(conn, stm, colIndex, SQL_C_SBIGINT, &value, sizeof(value));
+			break;
+		}
+		case SQL_C_FLOAT: {
+			float value = (float)wcstod(szString, NULL);
+			_BindParameterValue(conn, stm, colIndex, SQL_C_FLOAT, &value, sizeof(value));
+			break;
+		}
+		case SQL_C_DOUBLE: {
+			double value = wcstod(szString, NULL);
+			_BindParameterValue(conn, stm, colIndex, SQL_C_DOUBLE, &value, sizeof(value));
+			break;
+		}
+		default: {
+			// decimals keep their exact value this way
+			_BindParameterValue(conn, stm, colIndex, SQL_C_WCHAR, szString, strlen * sizeof(WCHAR));
+			break;
 		}
 	}
-
-Exit:
-	return;
 }
 
 void 
@@ -106,52 +279,20 @@ _SQLBindStringA(
 	SQLULEN strlen
 )
 {
-	if (stm->statement.sqlserver.ParameterCount > 0) {
+	WCHAR	wBuffer[256];
+	WCHAR * wValue = wBuffer;
 
-		ODBC_BINDING * binding = &stm->statement.sqlserver.bindVariables[colIndex - 1];
-
-		if (binding->fCType == SQL_C_NUMERIC)
-		{
-			*((long*)binding->buffer) = atol(szString);
-		
-			TRYODBC(*stm->statement.sqlserver.hStmt,
-				SQL_HANDLE_STMT,
-				SQLBindParameter(
-					*stm->statement.sqlserver.hStmt, 
-					colIndex, 
-					SQL_PARAM_INPUT, 
-					SQL_C_SSHORT, 
-					SQL_INTEGER, 
-					0, 
-					0, 
-					binding->buffer, 
-					0, 
-					&binding->pcbValue));
-		}
-		else if (stm->statement.sqlserver.bindVariables[colIndex - 1].fCType == SQL_C_WCHAR) 
-		{
-			size_t size = strlen * sizeof(WCHAR);
-			memcpy_s(binding->buffer, size, szString, size);
-			binding->pcbValue = SQL_NTS;
-
-			TRYODBC(*stm->statement.sqlserver.hStmt,
-				SQL_HANDLE_STMT,
-				SQLBindParameter(
-					*stm->statement.sqlserver.hStmt, 
-					colIndex, 
-					SQL_PARAM_INPUT, 
-					SQL_C_WCHAR, 
-					SQL_WCHAR,
-					strlen,
-					0, 
-					binding->buffer,
-					size,
-					&binding->pcbValue));
-		}
+	if (strlen + 1 > _countof(wBuffer)) {
+		wValue = _StatementMalloc(conn, stm, (strlen + 1) * sizeof(WCHAR), __FILE__, __LINE__);
 	}
+	mbstowcs_s(NULL, wValue, strlen + 1, szString, strlen);
+	wValue[strlen] = L'\0';
 
-Exit:
-	return;
+	_SQLBindStringW(conn, stm, colIndex, wValue, wcslen(wValue));
+
+	if (wValue != wBuffer) {
+		_StatementFree(conn, stm, wValue);
+	}
 }
 
 SQLSERVER_INTERFACE_API 
@@ -167,11 +308,14 @@ sqlserverBindString(
 	SQLUSMALLINT	colIndex = atoi(bindVariableName);
 
 	size_t cCount = valueLength;
-	wchar_t* wValue = mkMalloc(conn->heapHandle, (cCount + 1) * sizeof(wchar_t), __FILE__, __LINE__);
+	wchar_t* wValue = _StatementMalloc(conn, stm, (cCount + 1) * sizeof(wchar_t), __FILE__, __LINE__);
 	mbstowcs_s(NULL, wValue, cCount + 1, bindVariableValue, cCount);
 	wValue[cCount] = L'\0';
 
+	// the value is copied into the parameter's own buffer
 	_SQLBindStringW(conn, stm, colIndex, wValue, valueLength);
+
+	_StatementFree(conn, stm, wValue);
 }
 
 
@@ -188,17 +332,151 @@ sqlserverBindNumber(
 	SQLUSMALLINT	colIndex = atoi(bindVariableName);
 
 	size_t cCount = valueLength;
-	wchar_t* wValue = mkMalloc(conn->heapHandle, (cCount + 1) * sizeof(wchar_t), __FILE__, __LINE__);
+	wchar_t* wValue = _StatementMalloc(conn, stm, (cCount + 1) * sizeof(wchar_t), __FILE__, __LINE__);
 	mbstowcs_s(NULL, wValue, cCount + 1, bindVariableValue, cCount);
 	wValue[cCount] = L'\0';
 
 	_SQLBindStringW(conn, stm, colIndex, wValue, valueLength);
 
-	mkFree(conn->heapHandle, wValue);
+	_StatementFree(conn, stm, wValue);
 
 	return;
 }
 
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverBindInt64(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex,
+	long long value
+)
+{
+	_ResetError(conn, stm);
+	return _BindParameterValue(conn, stm, paramIndex, SQL_C_SBIGINT, &value, sizeof(value));
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverBindDouble(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex,
+	double value
+)
+{
+	_ResetError(conn, stm);
+	return _BindParameterValue(conn, stm, paramIndex, SQL_C_DOUBLE, &value, sizeof(value));
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverBindDecimal(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex,
+	const SQL_NUMERIC_STRUCT * value
+)
+{
+	_ResetError(conn, stm);
+
+	return _BindParameterValue(conn, stm, paramIndex, SQL_C_NUMERIC, value, sizeof(SQL_NUMERIC_STRUCT));
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverBindTimestamp(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex,
+	const SQL_TIMESTAMP_STRUCT * value
+)
+{
+	_ResetError(conn, stm);
+	return _BindParameterValue(conn, stm, paramIndex, SQL_C_TYPE_TIMESTAMP, value, sizeof(SQL_TIMESTAMP_STRUCT));
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverBindDate(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex,
+	const SQL_DATE_STRUCT * value
+)
+{
+	_ResetError(conn, stm);
+	return _BindParameterValue(conn, stm, paramIndex, SQL_C_TYPE_DATE, value, sizeof(SQL_DATE_STRUCT));
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverBindBit(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex,
+	BOOL value
+)
+{
+	unsigned char bit = value ? 1 : 0;
+
+	_ResetError(conn, stm);
+	return _BindParameterValue(conn, stm, paramIndex, SQL_C_BIT, &bit, sizeof(bit));
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverBindBinary(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex,
+	const void * value,
+	size_t length
+)
+{
+	_ResetError(conn, stm);
+	return _BindParameterValue(conn, stm, paramIndex, SQL_C_BINARY, value, (SQLLEN)length);
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverBindText(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex,
+	const char * value,
+	size_t length
+)
+{
+	_ResetError(conn, stm);
+	return _BindParameterValue(conn, stm, paramIndex, SQL_C_CHAR, value, (SQLLEN)length);
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverBindGuid(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex,
+	const SQLGUID * value
+)
+{
+	_ResetError(conn, stm);
+	return _BindParameterValue(conn, stm, paramIndex, SQL_C_GUID, value, sizeof(SQLGUID));
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverBindNull(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex
+)
+{
+	_ResetError(conn, stm);
+	return _BindParameterValue(conn, stm, paramIndex, SQL_C_WCHAR, NULL, SQL_NULL_DATA);
+}
+
 SQLSERVER_INTERFACE_API
 char*
 sqlserverExecuteInsertStatement(
@@ -207,8 +485,7 @@ sqlserverExecuteInsertStatement(
 	const char* sql
 )
 {
-	conn->errText = NULL;
-	conn->err = FALSE;
+	_ResetError(conn, stm);
 	char* retval = mkMalloc(conn->heapHandle, 21, __FILE__, __LINE__);
 	sqlserverExecuteSelectStatement(conn, stm, sql);
 	mkItoa(stm->statement.sqlserver.cRowCount, retval);
@@ -223,8 +500,7 @@ sqlserverExecuteDeleteStatement(
 	const char * sql
 )
 {
-	conn->errText = NULL;
-	conn->err = FALSE;
+	_ResetError(conn, stm);
 	//char * retval = mkMalloc(conn->heapHandle, 21, __FILE__, __LINE__);
 	sqlserverExecuteSelectStatement(conn, stm, sql);
 	//mkItoa(stm->statement.sqlserver.cRowCount, retval);
@@ -238,108 +514,299 @@ sqlserverExecuteUpdateStatement(
 	const char* sql
 )
 {
-	conn->errText = NULL;
-	conn->err = FALSE;
+	_ResetError(conn, stm);
 	//char * retval = mkMalloc(conn->heapHandle, 21, __FILE__, __LINE__);
 	sqlserverExecuteSelectStatement(conn, stm, sql);
 	//mkItoa(stm->statement.sqlserver.cRowCount, retval);
 }
 
-SQLSERVER_INTERFACE_API
+/*	C type string values of a parameter of "sqlType" are converted to before binding */
+SQLSMALLINT
+_GetParameterCType(
+	SQLSMALLINT sqlType
+)
+{
+	switch (sqlType) {
+		case SQL_BIT:
+			return SQL_C_BIT;
+		case SQL_TINYINT:
+			return SQL_C_UTINYINT;
+		case SQL_SMALLINT:
+			return SQL_C_SSHORT;
+		case SQL_INTEGER:
+			return SQL_C_SLONG;
+		case SQL_BIGINT:
+			return SQL_C_SBIGINT;
+		case SQL_REAL:
+			return SQL_C_FLOAT;
+		case SQL_DOUBLE:
+		case SQL_FLOAT:
+			return SQL_C_DOUBLE;
+		case SQL_SS_TABLE:
+			// bound with sqlserverBindTableParameter, no scalar buffer needed
+			return SQL_C_DEFAULT;
+		default:
+			// text, decimal, date/time, binary and GUID values are converted by the driver
+			return SQL_C_WCHAR;
+	}
+}
+
+/*	Releases parameter state and bindings. Earlier parameters may outnumber ParameterCount */
 void
-sqlserverPrepare(
-	DBInt_Connection* conn,
-	DBInt_Statement* stm,
-	const char* sql
+_FreeParameters(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
 )
 {
-	conn->errText = NULL;
-	conn->err = FALSE;
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	if (stm->statement.sqlserver.bindVariables) {
+		for (SQLSMALLINT iParam = 0; iParam < state->allocatedParameterCount; iParam++) {
+			_StatementFree(conn, stm, stm->statement.sqlserver.bindVariables[iParam].buffer);
+		}
+		_StatementFree(conn, stm, stm->statement.sqlserver.bindVariables);
+		stm->statement.sqlserver.bindVariables = NULL;
+	}
+	_StatementFree(conn, stm, state->parameters);
+	state->parameters = NULL;
+	state->allocatedParameterCount = 0;
+}
+
+/*	Allocates zeroed parameter state and bindings for stm->statement.sqlserver.ParameterCount parameters,
+	releasing those of an earlier prepare */
+void
+_AllocateParameters(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+	SQLSMALLINT			  count = stm->statement.sqlserver.ParameterCount;
+
+	_FreeParameters(conn, stm);
+
+	if (count > 0) {
+		stm->statement.sqlserver.bindVariables = _StatementMalloc(conn, stm, count * sizeof(ODBC_BINDING), __FILE__, __LINE__);
+		memset(stm->statement.sqlserver.bindVariables, 0, count * sizeof(ODBC_BINDING));
+		state->parameters = _StatementMalloc(conn, stm, count * sizeof(SQLSERVER_PARAMETER), __FILE__, __LINE__);
+		memset(state->parameters, 0, count * sizeof(SQLSERVER_PARAMETER));
+		state->allocatedParameterCount = count;
+	}
+}
+
+/*	Releases the column buffers of the last result set */
+void
+_FreeResultSet(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	if (stm->statement.sqlserver.resultSet == NULL) {
+		return;
+	}
+	if (state->hStmt) {
+		// the driver must not write into the buffers any more
+		SQLFreeStmt(state->hStmt, SQL_UNBIND);
+	}
+	for (SQLSMALLINT iCol = 0; iCol < state->allocatedColumnCount; iCol++) {
+		BINDING * binding = &stm->statement.sqlserver.resultSet[iCol];
+		_StatementFree(conn, stm, binding->wRowData);
+		_StatementFree(conn, stm, binding->chRowData);
+		_StatementFree(conn, stm, binding->columnName);
+	}
+	_StatementFree(conn, stm, stm->statement.sqlserver.resultSet);
+	stm->statement.sqlserver.resultSet = NULL;
+	state->allocatedColumnCount = 0;
+}
+
+/*	Replaces the column bindings with "count" zeroed ones */
+void
+_AllocateResultSet(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLSMALLINT count
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	_FreeResultSet(conn, stm);
+
+	stm->statement.sqlserver.resultSet = _StatementMalloc(conn, stm, count * sizeof(BINDING), __FILE__, __LINE__);
+	memset(stm->statement.sqlserver.resultSet, 0, count * sizeof(BINDING));
+	state->allocatedColumnCount = count;
+}
+
+/*	Prepares "sql" on the statement. Parameter metadata comes from "parameters" when given, otherwise from the
+	parameter cache, and only as a last resort from SQLDescribeParam, which costs a server round trip.
+	Rarely seen SQL texts whose parameters are known are not prepared but kept for SQLExecDirect */
+void
+_PrepareStatement(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql,
+	const SQLSERVER_PARAMETER * parameters,
+	SQLSMALLINT parameterCount
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+	BOOL				  described = FALSE;
+
+	state->profile = _ProfileLookup(sql);
+	LONGLONG started = _ProfileStart(stm);
 
 	// convertion char sql to wchar_t sql
 	size_t sourceCharCount = strlen(sql);
 	size_t memSize = (sizeof(wchar_t) * sourceCharCount) + sizeof(wchar_t);
-	SQLWCHAR* wSql = mkMalloc(conn->heapHandle, memSize, __FILE__, __LINE__);
+	SQLWCHAR* wSql = _StatementMalloc(conn, stm, memSize, __FILE__, __LINE__);
 	mbstowcs_s(NULL, wSql, sourceCharCount + 1, sql, sourceCharCount);
 
-	// Prepare
-	TRYODBC(*stm->statement.sqlserver.hStmt,
-		SQL_HANDLE_STMT,
-		SQLPrepare(*stm->statement.sqlserver.hStmt, wSql, SQL_NTS));
+	_StatementFree(conn, stm, state->directSql);
+	state->directSql = NULL;
+	state->executionCount = 0;
+	state->promoting = FALSE;
+	// set again once everything below succeeded, _EnsurePrepared must not skip a failed prepare
+	state->prepared = FALSE;
+
+	if (parameters) {
+		stm->statement.sqlserver.ParameterCount = parameterCount;
+		_AllocateParameters(conn, stm);
+		if (parameterCount > 0) {
+			memcpy(state->parameters, parameters, parameterCount * sizeof(SQLSERVER_PARAMETER));
+		}
+		described = TRUE;
+	}
+	else {
+		described = _ParameterCacheGet(conn, stm, sql);
+	}
 
-	TRYODBC(*stm->statement.sqlserver.hStmt,
-		SQL_HANDLE_STMT,
-		SQLNumParams(
-			*stm->statement.sqlserver.hStmt,
-			&stm->statement.sqlserver.ParameterCount));
+	if (_DirectShouldExecute(conn, sql) && (described || strchr(sql, '?') == NULL)) {
+		// one-shot statement, SQLExecDirect saves the server side prepare and unprepare
+		if (!described) {
+			stm->statement.sqlserver.ParameterCount = 0;
+			_AllocateParameters(conn, stm);
+			described = TRUE;
+		}
+		state->directSql = wSql;
+		wSql = NULL;
+	}
+	else {
+		// Prepare is sent together with the first execution. Not supported by the legacy driver, which prepares anyway
+		SQLSetStmtAttr(*stm->statement.sqlserver.hStmt, SQL_SOPT_SS_DEFER_PREPARE, (SQLPOINTER)SQL_DP_ON, SQL_IS_INTEGER);
 
-	if (stm->statement.sqlserver.ParameterCount > 0) {
+		// Prepare
+		TRYODBC_STM(stm,
+			SQLPrepare(*stm->statement.sqlserver.hStmt, wSql, SQL_NTS));
+	}
+
+	if (!described) {
+		TRYODBC_STM(stm,
+			SQLNumParams(
+				*stm->statement.sqlserver.hStmt,
+				&stm->statement.sqlserver.ParameterCount));
+
+		_AllocateParameters(conn, stm);
 
-		stm->statement.sqlserver.bindVariables = mkMalloc(conn->heapHandle, stm->statement.sqlserver.ParameterCount * sizeof(ODBC_BINDING), __FILE__, __LINE__);
-		//
-		//	Binding memory for parameters
-		//	
 		for (int colIndex = 0; colIndex < stm->statement.sqlserver.ParameterCount; colIndex++) {
-			SQLSMALLINT		DataTypePtr;
-			SQLULEN			ParameterSizePtr;
-			SQLSMALLINT		DecimalDigitsPtr;
-			SQLSMALLINT		NullablePtr;
-			SQLINTEGER 		strlenOrIndPtr = SQL_NTS;
+			SQLSERVER_PARAMETER * parameter = &state->parameters[colIndex];
 
 			//	describing parameter
-			TRYODBC(*stm->statement.sqlserver.hStmt,
-				SQL_HANDLE_STMT,
+			TRYODBC_STM(stm,
 				SQLDescribeParam(
 					*stm->statement.sqlserver.hStmt, //	StatementHandle
 					(SQLUSMALLINT)colIndex + 1,
-					&DataTypePtr,
-					&ParameterSizePtr,
-					&DecimalDigitsPtr,
-					&NullablePtr));
-
-			switch (DataTypePtr) {
-				case SQL_CHAR:
-				case SQL_VARCHAR:
-				case SQL_WVARCHAR:
-				case SQL_DECIMAL: {
-					ParameterSizePtr *= 3;
-					stm->statement.sqlserver.bindVariables[colIndex].fCType = SQL_C_WCHAR;
-					break;
-				}
-				case SQL_NUMERIC: {
-					stm->statement.sqlserver.bindVariables[colIndex].fCType = SQL_C_NUMERIC;
-					break;
-				}
-				case SQL_INTEGER: {
-					stm->statement.sqlserver.bindVariables[colIndex].fCType = SQL_C_LONG;
-					break;
-				}
-				case SQL_SMALLINT: {
-					stm->statement.sqlserver.bindVariables[colIndex].fCType = SQL_C_SHORT;
-					break;
-				}
-				case SQL_REAL: {
-					stm->statement.sqlserver.bindVariables[colIndex].fCType = SQL_C_FLOAT;
-					break;
-				}
-				case SQL_DOUBLE:
-				case SQL_FLOAT: {
-					stm->statement.sqlserver.bindVariables[colIndex].fCType = SQL_C_DOUBLE;
-					break;
-				}
-			}
-
-			stm->statement.sqlserver.bindVariables[colIndex].buffer_length = ParameterSizePtr + sizeof(wchar_t);
-			stm->statement.sqlserver.bindVariables[colIndex].buffer =
-				mkMalloc(conn->heapHandle, stm->statement.sqlserver.bindVariables[colIndex].buffer_length, __FILE__, __LINE__);
+					&parameter->sqlType,
+					&parameter->columnSize,
+					&parameter->decimalDigits,
+					&parameter->nullable));
+		}
+		_ParameterCachePut(conn, stm, sql);
+	}
 
+	//
+	//	Binding memory for parameters
+	//	
+	for (int colIndex = 0; colIndex < stm->statement.sqlserver.ParameterCount; colIndex++) {
+		SQLSERVER_PARAMETER * parameter = &state->parameters[colIndex];
+		ODBC_BINDING		* binding = &stm->statement.sqlserver.bindVariables[colIndex];
+
+		parameter->cType = _GetParameterCType(parameter->sqlType);
+		binding->fCType = parameter->cType;
+		if (parameter->cType != SQL_C_DEFAULT) {
+			// grows on bind when a longer value arrives, (max) types are described with size 0
+			_EnsureParameterBuffer(conn, stm, binding, max((parameter->columnSize + 1) * sizeof(WCHAR), 32));
 		}
 	}
 
+	if (state->preparedSql != sql) {
+		_StatementFree(conn, stm, state->preparedSql);
+		state->preparedSql = _StatementMalloc(conn, stm, sourceCharCount + 1, __FILE__, __LINE__);
+		memcpy(state->preparedSql, sql, sourceCharCount + 1);
+	}
+	state->prepared = TRUE;
+
 Exit:
+	_ProfileRecord(stm, SQLSERVER_PROFILE_PREPARE, started);
+	_CapturePrepare(conn, stm, sql, started);
+	_StatementFree(conn, stm, wSql);
 	return;
 }
 
+/*	Prepares "sql" unless the statement is already prepared with the same text. NULL runs the prepared text.
+	Returns FALSE on error */
+BOOL
+_EnsurePrepared(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	if (sql == NULL) {
+		if (!state->prepared) {
+			_SetErrorText(conn, stm, "No SQL text given and the statement is not prepared");
+			return FALSE;
+		}
+		return TRUE;
+	}
+	if (state->prepared && state->preparedSql && strcmp(state->preparedSql, sql) == 0) {
+		return TRUE;
+	}
+	// the statement is reused with other text, bound parameters belong to the old text
+	_PrepareStatement(conn, stm, sql, NULL, 0);
+	return !state->lastError.hasError;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverPrepare(
+	DBInt_Connection* conn,
+	DBInt_Statement* stm,
+	const char* sql
+)
+{
+	_ResetError(conn, stm);
+
+	_PrepareStatement(conn, stm, sql, NULL, 0);
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverPrepareWithParameters(
+	DBInt_Connection* conn,
+	DBInt_Statement* stm,
+	const char* sql,
+	const SQLSERVER_PARAMETER* parameters,
+	SQLSMALLINT parameterCount
+)
+{
+	_ResetError(conn, stm);
+
+	_PrepareStatement(conn, stm, sql, parameters, parameterCount);
+}
+
 
 
 SQLSERVER_INTERFACE_API 
@@ -350,8 +817,7 @@ sqlserverExecuteAnonymousBlock(
 	const char* sql
 )
 {
-	conn->errText = NULL;
-	conn->err = FALSE;
+	_ResetError(conn, stm);
 
 	sqlserverExecuteSelectStatement(conn, stm, sql);
 }
@@ -366,48 +832,44 @@ sqlserverFreeStatement(
 	if (stm == NULL || conn == NULL) {
 		return;
 	}
-	for (SQLSMALLINT iCol = 1; iCol <= stm->statement.sqlserver.cColCount; iCol++)
-	{
-		if (stm->statement.sqlserver.resultSet) {
-			BINDING* pThisBinding = &stm->statement.sqlserver.resultSet[iCol - 1];
-			if (pThisBinding->wRowData) {
-				mkFree(conn->heapHandle, pThisBinding->wRowData);
-				pThisBinding->wRowData = NULL;
-			}		
-			if (pThisBinding->chRowData) {
-				mkFree(conn->heapHandle, pThisBinding->chRowData);
-				pThisBinding->chRowData = NULL;
-			}		
-			if (pThisBinding->columnName) {
-				mkFree(conn->heapHandle, pThisBinding->columnName);
-				pThisBinding->columnName = NULL;
-			}
-			mkFree(conn->heapHandle, stm->statement.sqlserver.resultSet);
-			stm->statement.sqlserver.resultSet = NULL;
-		}
-	}
-	
-	if (stm->statement.sqlserver.bindVariables) {
-		for (SQLSMALLINT iCol = 0; iCol < stm->statement.sqlserver.ParameterCount; iCol++)
-		{
-			ODBC_BINDING* binding = &stm->statement.sqlserver.bindVariables[iCol];
-			if (binding->buffer) {
-				mkFree(conn->heapHandle, binding->buffer);
-				binding->buffer = NULL;
-			}	
-		}
-		mkFree(conn->heapHandle, stm->statement.sqlserver.bindVariables);
-		stm->statement.sqlserver.bindVariables = NULL;
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	_CaptureClose(conn, stm);
+	_AsyncFreeStatement(conn, stm);
+	_PrefetchFreeStatement(conn, stm);
+	_CacheCloseStatement(conn, stm);
+	_TvpFreeStatement(conn, stm);
+	_FreeResultSet(conn, stm);
+	_FreeParameters(conn, stm);
+	_StatementFree(conn, stm, state->directSql);
+	state->directSql = NULL;
+	_StatementFree(conn, stm, state->preparedSql);
+	state->preparedSql = NULL;
+
+	if (state->hStmt) {
+		// pending results are discarded with the handle
+		SQLFreeHandle(SQL_HANDLE_STMT, state->hStmt);
+		state->hStmt = NULL;
 	}
 
-	TRYODBC(*stm->statement.sqlserver.hStmt,
-		SQL_HANDLE_STMT,
-		SQLFreeStmt(*stm->statement.sqlserver.hStmt, SQL_CLOSE));
-
-	SQLFreeHandle(SQL_HANDLE_STMT, *stm->statement.sqlserver.hStmt);
-Exit:
+#ifdef _DEBUG
+	// the blocks stay counted for the connection, see sqlserverGetLiveBlockCount
+	if (state->liveBlocks != 0 && diagnosticLevel >= SQLSERVER_LOG_WARNING) {
+		SQLSERVER_DIAGNOSTIC leak;
+		leak.level = SQLSERVER_LOG_WARNING;
+		leak.retCode = SQL_SUCCESS_WITH_INFO;
+		leak.handleType = SQL_HANDLE_STMT;
+		leak.threadId = GetCurrentThreadId();
+		leak.nativeError = 0;
+		wcscpy_s(leak.sqlState, SQL_SQLSTATE_SIZE + 1, L"01000");
+		swprintf_s(leak.message, SQLSERVER_DIAGNOSTIC_MESSAGE_LENGTH, L"Statement freed with %ld blocks still allocated", state->liveBlocks);
+		_DiagnosticEnqueue(&leak);
+	}
+#endif
 
-	mkFree(conn->heapHandle, stm);
+	_StatementFree(conn, NULL, state);
+	_StatementFree(conn, NULL, stm);
+	InterlockedDecrement(&SQLSERVER_CONNECTION_OF(conn)->statementCount);
 }
 
 SQLSERVER_INTERFACE_API 
@@ -474,8 +936,7 @@ sqlserverInitConnection(
 	DBInt_Connection* conn
 )
 {
-	conn->err = FALSE;
-	conn->errText = NULL;
+	_ResetError(conn, NULL);
 }
 
 
@@ -489,11 +950,23 @@ sqlserverNext(
 {
 	RETCODE     RetCode;
 
-	TRYODBC(*stm->statement.sqlserver.hStmt,
-		SQL_HANDLE_STMT, 
+	if (_CacheNext(stm)) {
+		// served from the result cache
+		goto Exit;
+	}
+	if (_PrefetchNext(conn, stm)) {
+		// served from the blocks read ahead
+		goto Exit;
+	}
+
+	LONGLONG started = _ProfileStart(stm);
+	TRYODBC_STM(stm,
 		RetCode = SQLFetch(*stm->statement.sqlserver.hStmt));
+	_ProfileRecord(stm, SQLSERVER_PROFILE_FETCH, started);
+	_CaptureFetch(conn, stm, RetCode, started);
 
 	stm->statement.sqlserver.isEof = (RetCode == SQL_NO_DATA_FOUND);
+	_CacheFetched(stm);
 
 Exit:
 
@@ -532,8 +1005,7 @@ sqlserverGetColumnType(
 )
 {
 	SODIUM_DATABASE_COLUMN_TYPE retval = HTSQL_COLUMN_TYPE_NOTSET;
-	conn->errText = NULL;
-	conn->err = FALSE;
+	_ResetError(conn, stm);
 
 	int colIndex = _GetColumnIndexByColumnName(conn, stm, columnName);
 	if (colIndex > -1) {
@@ -547,6 +1019,35 @@ sqlserverGetColumnType(
 
 
 
+SQLSERVER_INTERFACE_API
+unsigned int
+sqlserverGetColumnCount(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	return stm->statement.sqlserver.cColCount > 0 ? stm->statement.sqlserver.cColCount : 0;
+}
+
+/*	Display size in characters of the column of the current result set, 0 for an unknown column */
+SQLSERVER_INTERFACE_API
+unsigned int
+sqlserverGetColumnSize(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * columnName
+)
+{
+	_ResetError(conn, stm);
+
+	int colIndex = _GetColumnIndexByColumnName(conn, stm, columnName);
+	if (colIndex < 0) {
+		return 0;
+	}
+	// the bound buffers are one terminator larger than the display size
+	return (unsigned int)(stm->statement.sqlserver.resultSet[colIndex].rowDataCharacterCount - sizeof(wchar_t));
+}
+
 SQLSERVER_INTERFACE_API 
 BOOL	
 sqlserverIsEof(
@@ -565,14 +1066,83 @@ sqlserverSeek(
 	int rowNum
 )
 {
-	TRYODBC(*stm->statement.sqlserver.hStmt,
-		SQL_HANDLE_STMT,
+	_PrefetchStop(conn, stm);
+
+	if (_CacheSeek(stm, rowNum)) {
+		return;
+	}
+
+	TRYODBC_STM(stm,
 		SQLFetchScroll(*stm->statement.sqlserver.hStmt, SQL_FETCH_ABSOLUTE, rowNum));
 
 Exit:
 	return;
 }
 
+/*	Returns the character count of the value fetched into the bound column buffer, -1 for NULL */
+SQLLEN
+_GetBoundValueLength(
+	BINDING * bind
+)
+{
+	if (bind->indPtr == SQL_NULL_DATA) {
+		return -1;
+	}
+	if (bind->indPtr >= 0 && (size_t)bind->indPtr / sizeof(WCHAR) <= (size_t)bind->rowDataCharacterCount) {
+		return bind->indPtr / sizeof(WCHAR);
+	}
+	// SQL_NO_TOTAL or truncated value, buffer is always null terminated by the driver
+	return (SQLLEN)wcsnlen(bind->wRowData, bind->rowDataCharacterCount + 1);
+}
+
+/*	Sodium column type of an ODBC SQL type (SQL_DESC_CONCISE_TYPE) */
+SODIUM_DATABASE_COLUMN_TYPE
+_GetColumnDataType(
+	SQLLEN ssType
+)
+{
+	switch (ssType) {
+		case SQL_INTERVAL_DAY:
+		case SQL_INTERVAL_HOUR:
+		case SQL_INTERVAL_MINUTE:
+		case SQL_INTERVAL_SECOND:
+		case SQL_INTERVAL_DAY_TO_HOUR:
+		case SQL_INTERVAL_DAY_TO_MINUTE:
+		case SQL_INTERVAL_DAY_TO_SECOND:
+		case SQL_INTERVAL_HOUR_TO_MINUTE:
+		case SQL_INTERVAL_HOUR_TO_SECOND:
+		case SQL_INTERVAL_MINUTE_TO_SECOND:
+		case SQL_DECIMAL:
+		case SQL_NUMERIC:
+		case SQL_SMALLINT:
+		case SQL_INTEGER:
+		case SQL_REAL:
+		case SQL_FLOAT:
+		case SQL_DOUBLE:
+		case SQL_TINYINT:
+		case SQL_BIGINT: {
+			return HTSQL_COLUMN_TYPE_NUMBER;
+		}
+		case SQL_GUID:
+		case SQL_CHAR:
+		case SQL_VARCHAR:
+		case SQL_LONGVARCHAR: {
+			return HTSQL_COLUMN_TYPE_TEXT;
+		}
+		case SQL_WCHAR: 
+		case SQL_WVARCHAR:
+		case SQL_WLONGVARCHAR: {
+			// TODO: ??? wchar_t
+			return HTSQL_COLUMN_TYPE_TEXT;
+		}
+		case SQL_TYPE_DATE:
+		case SQL_TYPE_TIMESTAMP: {
+			return HTSQL_COLUMN_TYPE_DATE;
+		}
+	}
+	return HTSQL_COLUMN_TYPE_NOTSET;
+}
+
 void 
 _BindAllResultSetColumns(
 	DBInt_Connection * conn,
@@ -584,7 +1154,7 @@ _BindAllResultSetColumns(
 	//SQLLEN          cchDisplay;
 	SQLLEN          ssType;
 
-	stm->statement.sqlserver.resultSet = mkMalloc(conn->heapHandle, stm->statement.sqlserver.cColCount * sizeof(BINDING), __FILE__, __LINE__);
+	_AllocateResultSet(conn, stm, stm->statement.sqlserver.cColCount);
 
 	for (iCol = 1; iCol <= stm->statement.sqlserver.cColCount; iCol++)
 	{
@@ -596,8 +1166,7 @@ _BindAllResultSetColumns(
 		// you should bind to the appropriate C type if you are going
 		// to manipulate data since it is much faster...)
 
-		TRYODBC(*stm->statement.sqlserver.hStmt,
-			SQL_HANDLE_STMT,
+		TRYODBC_STM(stm,
 			SQLColAttribute(*stm->statement.sqlserver.hStmt,
 				iCol,
 				SQL_DESC_DISPLAY_SIZE,
@@ -611,8 +1180,7 @@ _BindAllResultSetColumns(
 		// Figure out data type. All types can be found at
 		//	https://docs.microsoft.com/en-us/sql/odbc/reference/appendixes/sql-data-types?view=sql-server-ver15
 		//
-		TRYODBC(*stm->statement.sqlserver.hStmt,
-			SQL_HANDLE_STMT,
+		TRYODBC_STM(stm,
 			SQLColAttribute(*stm->statement.sqlserver.hStmt,
 				iCol,
 				SQL_DESC_CONCISE_TYPE,
@@ -621,57 +1189,15 @@ _BindAllResultSetColumns(
 				NULL,
 				&ssType));
 
-		switch (ssType) {
-			case SQL_INTERVAL_DAY:
-			case SQL_INTERVAL_HOUR:
-			case SQL_INTERVAL_MINUTE:
-			case SQL_INTERVAL_SECOND:
-			case SQL_INTERVAL_DAY_TO_HOUR:
-			case SQL_INTERVAL_DAY_TO_MINUTE:
-			case SQL_INTERVAL_DAY_TO_SECOND:
-			case SQL_INTERVAL_HOUR_TO_MINUTE:
-			case SQL_INTERVAL_HOUR_TO_SECOND:
-			case SQL_INTERVAL_MINUTE_TO_SECOND:
-			case SQL_DECIMAL:
-			case SQL_NUMERIC:
-			case SQL_SMALLINT:
-			case SQL_INTEGER:
-			case SQL_REAL:
-			case SQL_FLOAT:
-			case SQL_DOUBLE:
-			case SQL_TINYINT:
-			case SQL_BIGINT: {
-				pThisBinding->dataType = HTSQL_COLUMN_TYPE_NUMBER;
-				break;
-			}
-			case SQL_GUID:
-			case SQL_CHAR:
-			case SQL_VARCHAR:
-			case SQL_LONGVARCHAR: {
-				pThisBinding->dataType = HTSQL_COLUMN_TYPE_TEXT;
-				break; 
-			}
-			case SQL_WCHAR: 
-			case SQL_WVARCHAR:
-			case SQL_WLONGVARCHAR: {
-				// TODO: ??? wchar_t
-				pThisBinding->dataType = HTSQL_COLUMN_TYPE_TEXT;
-				break; 
-			}
-			case SQL_TYPE_DATE:
-			case SQL_TYPE_TIMESTAMP: {
-				pThisBinding->dataType = HTSQL_COLUMN_TYPE_DATE;
-				break;
-			}
-		}
+		pThisBinding->dataType = _GetColumnDataType(ssType);
 
 		// Allocate a buffer big enough to hold columnd data in wchar_t format
 		size_t wMemSize = ((pThisBinding->rowDataCharacterCount + 1) * sizeof(WCHAR));
-		pThisBinding->wRowData = mkMalloc(conn->heapHandle, wMemSize, __FILE__, __LINE__);
+		pThisBinding->wRowData = _StatementMalloc(conn, stm, wMemSize, __FILE__, __LINE__);
 
 		// Allocate a buffer big enough to hold columnd data in char format
 		size_t cMemSize = ((pThisBinding->rowDataCharacterCount + 1) * sizeof(char));
-		pThisBinding->chRowData = mkMalloc(conn->heapHandle, cMemSize, __FILE__, __LINE__);
+		pThisBinding->chRowData = _StatementMalloc(conn, stm, cMemSize, __FILE__, __LINE__);
 
 		if (!(pThisBinding->wRowData))
 		{
@@ -685,8 +1211,7 @@ _BindAllResultSetColumns(
 		// SQLPOINTER use count of bytes; all functions that take only
 		// strings use count of characters.
 
-		TRYODBC(*stm->statement.sqlserver.hStmt,
-			SQL_HANDLE_STMT,
+		TRYODBC_STM(stm,
 			SQLBindCol(*stm->statement.sqlserver.hStmt,
 				iCol,
 				SQL_C_WCHAR,
@@ -700,8 +1225,7 @@ _BindAllResultSetColumns(
 
 		// Now set the display size that we will use to display
 		// the data.   Figure out the length of the column name
-		TRYODBC(*stm->statement.sqlserver.hStmt,
-			SQL_HANDLE_STMT,
+		TRYODBC_STM(stm,
 			SQLColAttribute(*stm->statement.sqlserver.hStmt,
 				iCol,
 				SQL_DESC_NAME,
@@ -711,7 +1235,7 @@ _BindAllResultSetColumns(
 				&numericAttributePtr));
 
 		size_t memSize = (cchColumnNameLength/sizeof(wchar_t)) + sizeof(char);
-		pThisBinding->columnName = mkMalloc(conn->heapHandle, memSize, __FILE__, __LINE__);
+		pThisBinding->columnName = _StatementMalloc(conn, stm, memSize, __FILE__, __LINE__);
 		wcstombs_s(NULL, pThisBinding->columnName, memSize, wColumnName, memSize-1);
 	}
 
@@ -720,27 +1244,14 @@ Exit:
 }
 
 
-SQLSERVER_INTERFACE_API
+/*	Handles the outcome of SQLExecute: binds the result set and fetches the first row, or gets the row count */
 void
-sqlserverExecuteSelectStatement(
-	DBInt_Connection * conn, 
-	DBInt_Statement * stm, 
-	const char * sql
+_CompleteExecute(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	RETCODE RetCode
 )
 {
-	RETCODE     RetCode;
-
-	conn->errText = NULL;
-	conn->err = FALSE;
-
-	// convertion char sql to wchar_t sql
-	/*size_t sourceCharCount = strlen(sql);
-	size_t memSize = (sizeof(wchar_t) * sourceCharCount) + sizeof(wchar_t);
-	SQLWCHAR * wSql = mkMalloc(conn->heapHandle, memSize, __FILE__, __LINE__);
-	mbstowcs_s(NULL, wSql, sourceCharCount+1, sql, sourceCharCount);
-	*/
-	RetCode = SQLExecute(*stm->statement.sqlserver.hStmt);
-
 	switch (RetCode)
 	{
 		case SQL_NEED_DATA:
@@ -750,32 +1261,38 @@ sqlserverExecuteSelectStatement(
 		}
 		case SQL_SUCCESS_WITH_INFO:
 		{
-			_HandleDiagnosticRecord(*stm->statement.sqlserver.hStmt, SQL_HANDLE_STMT, RetCode);
+			_HandleDiagnosticRecord(*stm->statement.sqlserver.hStmt, SQL_HANDLE_STMT, RetCode, stm);
 			// fall through
 		}
 		case SQL_SUCCESS:
 		{
 			// If this is a row-returning query, display
 			// results
-			TRYODBC(*stm->statement.sqlserver.hStmt,
-				SQL_HANDLE_STMT,
+			TRYODBC_STM(stm,
 				SQLNumResultCols(*stm->statement.sqlserver.hStmt, &stm->statement.sqlserver.cColCount));
 
 			if (stm->statement.sqlserver.cColCount > 0)
 			{
 				_BindAllResultSetColumns(conn, stm);
 
-				TRYODBC(*stm->statement.sqlserver.hStmt,
-					SQL_HANDLE_STMT,
+				LONGLONG started = _ProfileStart(stm);
+				TRYODBC_STM(stm,
 					RetCode = SQLFetch(*stm->statement.sqlserver.hStmt));
+				_ProfileRecord(stm, SQLSERVER_PROFILE_FETCH, started);
+				_CaptureFetch(conn, stm, RetCode, started);
 				
 				stm->statement.sqlserver.isEof = (RetCode == SQL_NO_DATA_FOUND);
+				_CacheFetched(stm);
+
+				// rows affected by an INSERT/UPDATE/DELETE ... OUTPUT, -1 for plain queries
+				if (!SQL_SUCCEEDED(SQLRowCount(*stm->statement.sqlserver.hStmt, &stm->statement.sqlserver.cRowCount))) {
+					stm->statement.sqlserver.cRowCount = -1;
+				}
 			}
 			else
 			{
 				// If sql is not select, getting the row count affected
-				TRYODBC(*stm->statement.sqlserver.hStmt,
-					SQL_HANDLE_STMT,
+				TRYODBC_STM(stm,
 					SQLRowCount(*stm->statement.sqlserver.hStmt, &stm->statement.sqlserver.cRowCount));
 			}
 			break;
@@ -783,7 +1300,8 @@ sqlserverExecuteSelectStatement(
 
 		case SQL_ERROR:
 		{
-			_HandleDiagnosticRecord(*stm->statement.sqlserver.hStmt, SQL_HANDLE_STMT, RetCode);
+			_HandleDiagnosticRecord(*stm->statement.sqlserver.hStmt, SQL_HANDLE_STMT, RetCode, stm);
+			_SetError(conn, stm);
 			break;
 		}
 
@@ -791,6 +1309,46 @@ sqlserverExecuteSelectStatement(
 			fwprintf(stderr, L"Unexpected return code %hd!\n", RetCode);
 
 	}
+
+Exit:
+	return;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverExecuteSelectStatement(
+	DBInt_Connection * conn, 
+	DBInt_Statement * stm, 
+	const char * sql
+)
+{
+	RETCODE     RetCode;
+
+	_ResetError(conn, stm);
+	_PrefetchStop(conn, stm);
+	stm->statement.sqlserver.cRowCount = -1;
+
+	// executed without sqlserverPrepare or with other text, the text is only converted here
+	if (!_EnsurePrepared(conn, stm, sql)) {
+		goto Exit;
+	}
+
+	if (_CacheExecute(conn, stm)) {
+		// served from the result cache
+		goto Exit;
+	}
+
+	for (int attempt = 1; ; attempt++) {
+		RetCode = _BeginExecute(conn, stm);
+
+		_CompleteExecute(conn, stm, RetCode);
+
+		if (!_RetryBeforeNextAttempt(conn, stm, attempt)) {
+			break;
+		}
+	}
+	_PrefetchStart(conn, stm);
+
 	/*
 	TRYODBC(*stm->statement.sqlserver.hStmt,
 		SQL_HANDLE_STMT,
@@ -817,22 +1375,31 @@ sqlserverCreateStatement(
 	DBInt_Connection * conn
 )
 {
-	conn->errText = NULL;
-	conn->err = FALSE;
+	_ResetError(conn, NULL);
 
-	DBInt_Statement* retObj = (DBInt_Statement*)mkMalloc(conn->heapHandle, sizeof(DBInt_Statement), __FILE__, __LINE__);
+	DBInt_Statement* retObj = (DBInt_Statement*)_StatementMalloc(conn, NULL, sizeof(DBInt_Statement), __FILE__, __LINE__);
+	memset(retObj, 0, sizeof(DBInt_Statement));
 	
-	retObj->statement.sqlserver.hStmt = mkMalloc(conn->heapHandle, sizeof(SQLHSTMT), __FILE__, __LINE__);
+	// driver state lives behind the hStmt pointer, see SQLSERVER_STATEMENT
+	SQLSERVER_STATEMENT* state = _StatementMalloc(conn, NULL, sizeof(SQLSERVER_STATEMENT), __FILE__, __LINE__);
+	memset(state, 0, sizeof(SQLSERVER_STATEMENT));
+	retObj->statement.sqlserver.hStmt = &state->hStmt;
 	retObj->statement.sqlserver.isEof = FALSE;
+	state->queryTimeout = SQLSERVER_CONNECTION_OF(conn)->queryTimeout;
+	InterlockedIncrement(&SQLSERVER_CONNECTION_OF(conn)->statementCount);
 
 	TRYODBC(*conn->connection.sqlserverHandle,
 		SQL_HANDLE_DBC,
 		SQLAllocHandle(SQL_HANDLE_STMT, *conn->connection.sqlserverHandle, retObj->statement.sqlserver.hStmt));
 	
-	TRYODBC(*conn->connection.sqlserverHandle,
-		SQL_HANDLE_STMT,
+	TRYODBC_STM(retObj,
 		SQLSetStmtAttr(*retObj->statement.sqlserver.hStmt, SQL_ATTR_CURSOR_TYPE, (SQLPOINTER)SQL_CURSOR_STATIC, 0));
 
+	if (state->queryTimeout) {
+		TRYODBC_STM(retObj,
+			SQLSetStmtAttr(*retObj->statement.sqlserver.hStmt, SQL_ATTR_QUERY_TIMEOUT, (SQLPOINTER)state->queryTimeout, 0));
+	}
+
 Exit:
 
 	return retObj;
@@ -852,59 +1419,104 @@ sqlserverCreateConnection(
 	const char * password
 )
 {
+	return sqlserverCreateConnectionEx(heapHandle, dbType, hostName, instanceName, databaseName, userName, password, NULL);
+}
+
+SQLSERVER_INTERFACE_API
+DBInt_Connection*
+sqlserverCreateConnectionEx(
+	HANDLE heapHandle,
+	DBInt_SupportedDatabaseType dbType,
+	const char * hostName,
+	const char * instanceName,
+	const char * databaseName,
+	const char * userName,
+	const char * password,
+	const SQLSERVER_CONNECTION_OPTIONS * options
+)
+{
+	SQLSERVER_CONNECTION_OPTIONS defaults;
+	if (options == NULL) {
+		memset(&defaults, 0, sizeof(SQLSERVER_CONNECTION_OPTIONS));
+		options = &defaults;
+	}
+
 	DBInt_Connection* conn = (DBInt_Connection*)mkMalloc(heapHandle, sizeof(DBInt_Connection), __FILE__, __LINE__);
+	memset(conn, 0, sizeof(DBInt_Connection));
 	conn->dbType = SODIUM_SQLSERVER_SUPPORT;
 	conn->heapHandle = heapHandle;
-	conn->errText = NULL;
-	conn->err = FALSE;
+	_ResetError(conn, NULL);
 	
-	// converting char input parameters to wchar_t
-	wchar_t wHostName[MAX_PATH] = L"";
-	strcpy_s(conn->hostName, HOST_NAME_LENGTH, hostName);
-	mbstowcs_s(NULL, wHostName, MAX_PATH, conn->hostName, strnlen_s(conn->hostName, MAX_PATH));
+	strcpy_s(conn->hostName, HOST_NAME_LENGTH, hostName ? hostName : "");
+
+	if (options->connectionString) {
+		// e.g. a DSN, taken as is
+		size_t connectionStringLength = strlen(options->connectionString);
+		conn->connection_string = mkMalloc(heapHandle, (connectionStringLength + 1) * sizeof(wchar_t), __FILE__, __LINE__);
+		mbstowcs_s(NULL, conn->connection_string, connectionStringLength + 1, options->connectionString, connectionStringLength);
+	}
+	else {
+		// converting char input parameters to wchar_t
+		wchar_t wHostName[MAX_PATH] = L"";
+		mbstowcs_s(NULL, wHostName, MAX_PATH, conn->hostName, strnlen_s(conn->hostName, MAX_PATH));
 	
-	wchar_t wInstanceName[MAX_PATH] = L"";
-	mbstowcs_s(NULL, wInstanceName, MAX_PATH, instanceName, strnlen_s(instanceName, MAX_PATH));
+		wchar_t wInstanceName[MAX_PATH] = L"";
+		mbstowcs_s(NULL, wInstanceName, MAX_PATH, instanceName, strnlen_s(instanceName, MAX_PATH));
 	
-	wchar_t wDatabaseName[MAX_PATH] = L"";
-	mbstowcs_s(NULL, wDatabaseName, MAX_PATH, databaseName, strnlen_s(databaseName, MAX_PATH));
+		wchar_t wDatabaseName[MAX_PATH] = L"";
+		mbstowcs_s(NULL, wDatabaseName, MAX_PATH, databaseName, strnlen_s(databaseName, MAX_PATH));
 	
-	wchar_t wUserName[MAX_PATH] = L"";
-	mbstowcs_s(NULL, wUserName, MAX_PATH, userName, strnlen_s(userName, MAX_PATH));
+		wchar_t wUserName[MAX_PATH] = L"";
+		mbstowcs_s(NULL, wUserName, MAX_PATH, userName, strnlen_s(userName, MAX_PATH));
 	
-	wchar_t wPassword[MAX_PATH] = L"";
-	mbstowcs_s(NULL, wPassword, MAX_PATH, password, strnlen_s(password, MAX_PATH));
-
-	conn->connection_string = mkStrcatW(heapHandle, __FILE__, __LINE__,
-		L"Driver={SQL Server};",
-		L"Server=", wHostName, L"\\", wInstanceName, 
-		L";Database=", wDatabaseName, 
-		L";User Id=", wUserName, 
-		L";Password=", wPassword, L";",
-		NULL);
+		wchar_t wPassword[MAX_PATH] = L"";
+		mbstowcs_s(NULL, wPassword, MAX_PATH, password, strnlen_s(password, MAX_PATH));
+
+		const char * driverName = options->driverName ? options->driverName : SQLSERVER_DEFAULT_DRIVER_NAME;
+		wchar_t wDriverName[MAX_PATH] = L"";
+		mbstowcs_s(NULL, wDriverName, MAX_PATH, driverName, strnlen_s(driverName, MAX_PATH));
+
+		const char * attributes = options->attributes ? options->attributes : "";
+		size_t attributesLength = strlen(attributes);
+		wchar_t * wAttributes = mkMalloc(heapHandle, (attributesLength + 1) * sizeof(wchar_t), __FILE__, __LINE__);
+		mbstowcs_s(NULL, wAttributes, attributesLength + 1, attributes, attributesLength);
+
+		conn->connection_string = mkStrcatW(heapHandle, __FILE__, __LINE__,
+			L"Driver={", wDriverName, L"};",
+			L"Server=", wHostName, L"\\", wInstanceName, 
+			L";Database=", wDatabaseName, 
+			L";User Id=", wUserName, 
+			L";Password=", wPassword, L";",
+			options->marsEnabled ? L"MARS_Connection=yes;" : L"",
+			wAttributes,
+			NULL);
+		mkFree(heapHandle, wAttributes);
+	}
 	
-	// Allocate an environment
-	if (SQLAllocHandle(SQL_HANDLE_ENV, SQL_NULL_HANDLE, &hEnv) == SQL_ERROR)
+	// Environment is shared by all connections
+	if (_GetEnvironment() == NULL)
 	{
-		conn->errText = "Unable to allocate an environment handle";
-		conn->err = TRUE;
+		_SetErrorText(conn, NULL, "Unable to allocate an environment handle");
 	}
 	else {
-		TRYODBC(hEnv,
-			SQL_HANDLE_ENV,
-			SQLSetEnvAttr(hEnv,
-				SQL_ATTR_ODBC_VERSION,
-				(SQLPOINTER)SQL_OV_ODBC3,
-				0));
-
-		// TODO: release 'conn->connection.sqlserverHandle' on disconnect
-		conn->connection.sqlserverHandle = mkMalloc(heapHandle, sizeof(SQLHANDLE), __FILE__, __LINE__);
+		// driver state lives behind the handle pointer, see SQLSERVER_CONNECTION
+		SQLSERVER_CONNECTION* state = mkMalloc(heapHandle, sizeof(SQLSERVER_CONNECTION), __FILE__, __LINE__);
+		memset(state, 0, sizeof(SQLSERVER_CONNECTION));
+		conn->connection.sqlserverHandle = &state->hDbc;
+		state->queryTimeout = options->queryTimeout;
 
 		// Allocate a connection
 		TRYODBC(hEnv,
 			SQL_HANDLE_ENV,
 			SQLAllocHandle(SQL_HANDLE_DBC, hEnv, conn->connection.sqlserverHandle));
 
+		if (options->loginTimeout) {
+			// kept by the handle, also bounds reconnects
+			TRYODBC(state->hDbc,
+				SQL_HANDLE_DBC,
+				SQLSetConnectAttr(state->hDbc, SQL_ATTR_LOGIN_TIMEOUT, (SQLPOINTER)(ULONG_PTR)options->loginTimeout, 0));
+		}
+
 		// Connect to the driver.  Use the connection string if supplied
 		// on the input, otherwise let the driver manager prompt for input.
 
@@ -918,6 +1530,14 @@ sqlserverCreateConnection(
 				0,
 				NULL,
 				SQL_DRIVER_COMPLETE | SQL_DRIVER_NOPROMPT));
+
+		if (options->marsEnabled) {
+			// drivers without MARS ignore the keyword, ask what was actually negotiated
+			SQLUINTEGER mars = SQL_MARS_ENABLED_NO;
+			if (SQL_SUCCEEDED(SQLGetConnectAttr(state->hDbc, SQL_COPT_SS_MARS_ENABLED, &mars, SQL_IS_UINTEGER, NULL))) {
+				state->marsEnabled = (mars == SQL_MARS_ENABLED_YES);
+			}
+		}
 	}
 
 Exit:
@@ -925,6 +1545,82 @@ Exit:
 	return conn;
 }
 
+/*	Disconnects and connects again with the same connection string. Statements of the old session are lost */
+BOOL
+_ReconnectConnection(
+	DBInt_Connection * conn
+)
+{
+	SQLSERVER_CONNECTION * state = SQLSERVER_CONNECTION_OF(conn);
+
+	_ResetError(conn, NULL);
+
+	// fails when the link is already gone, the handle returns to the allocated state anyway
+	SQLDisconnect(state->hDbc);
+
+	TRYODBC(state->hDbc,
+		SQL_HANDLE_DBC,
+		SQLDriverConnect(state->hDbc,
+			GetDesktopWindow(),
+			conn->connection_string,
+			SQL_NTS,
+			NULL,
+			0,
+			NULL,
+			SQL_DRIVER_COMPLETE | SQL_DRIVER_NOPROMPT));
+
+	if (state->marsEnabled) {
+		SQLUINTEGER mars = SQL_MARS_ENABLED_NO;
+		if (SQL_SUCCEEDED(SQLGetConnectAttr(state->hDbc, SQL_COPT_SS_MARS_ENABLED, &mars, SQL_IS_UINTEGER, NULL))) {
+			state->marsEnabled = (mars == SQL_MARS_ENABLED_YES);
+		}
+	}
+
+Exit:
+	return !conn->err;
+}
+
+/*	Returns TRUE unless the driver knows the link to the server is broken. No round trip is made */
+SQLSERVER_INTERFACE_API
+int
+sqlserverIsConnectionOpen(
+	DBInt_Connection * conn
+)
+{
+	SQLUINTEGER dead = SQL_CD_TRUE;
+
+	if (conn->connection.sqlserverHandle == NULL || *conn->connection.sqlserverHandle == NULL) {
+		return FALSE;
+	}
+	if (!SQL_SUCCEEDED(SQLGetConnectAttr(*conn->connection.sqlserverHandle, SQL_ATTR_CONNECTION_DEAD, &dead, SQL_IS_UINTEGER, NULL))) {
+		// never connected
+		return FALSE;
+	}
+	return dead == SQL_CD_FALSE;
+}
+
+/*	Disconnects and releases what sqlserverCreateConnectionEx allocated, except "conn" itself */
+SQLSERVER_INTERFACE_API
+void
+sqlserverDestroyConnection(
+	DBInt_Connection * conn
+)
+{
+	if (conn->connection.sqlserverHandle) {
+		SQLSERVER_CONNECTION * state = SQLSERVER_CONNECTION_OF(conn);
+		if (state->hDbc) {
+			SQLDisconnect(state->hDbc);
+			SQLFreeHandle(SQL_HANDLE_DBC, state->hDbc);
+		}
+		mkFree(conn->heapHandle, state);
+		conn->connection.sqlserverHandle = NULL;
+	}
+	if (conn->connection_string) {
+		mkFree(conn->heapHandle, conn->connection_string);
+		conn->connection_string = NULL;
+	}
+}
+
 
 SQLSERVER_INTERFACE_API
 BOOL
@@ -934,8 +1630,7 @@ sqlserverCommit(
 {
 	char* query = "commit";
 
-	conn->errText = NULL;
-	conn->err = FALSE;
+	_ResetError(conn, NULL);
 
 	DBInt_Statement* stm = sqlserverCreateStatement(conn);
 	sqlserverPrepare(conn, stm, query);
@@ -946,50 +1641,241 @@ sqlserverCommit(
 	return (conn->errText != NULL);
 }
 
+BOOL CALLBACK
+_InitEnvironment(
+	PINIT_ONCE initOnce,
+	PVOID parameter,
+	PVOID * context
+)
+{
+	if (!_OdbcLoad())
+	{
+		// driver manager not found, see sqlserverGetOdbcStatus
+		hEnv = NULL;
+		return FALSE;
+	}
+	if (SQLAllocHandle(SQL_HANDLE_ENV, SQL_NULL_HANDLE, &hEnv) == SQL_ERROR)
+	{
+		hEnv = NULL;
+		return FALSE;
+	}
+	if (SQLSetEnvAttr(hEnv, SQL_ATTR_ODBC_VERSION, (SQLPOINTER)SQL_OV_ODBC3, 0) == SQL_ERROR)
+	{
+		_HandleDiagnosticRecord(hEnv, SQL_HANDLE_ENV, SQL_ERROR, NULL);
+		SQLFreeHandle(SQL_HANDLE_ENV, hEnv);
+		hEnv = NULL;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*	Returns the process wide ODBC environment, allocating it on first call */
+SQLHENV
+_GetEnvironment(
+	void
+)
+{
+	InitOnceExecuteOnce(&hEnvInitOnce, _InitEnvironment, NULL, NULL);
+	return hEnv;
+}
+
+void
+_ResetError(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	threadError.hasError = FALSE;
+	if (stm) {
+		SQLSERVER_STATEMENT_OF(stm)->lastError.hasError = FALSE;
+	}
+	conn->errText = NULL;
+	conn->err = FALSE;
+}
+
+/*	Marks the failure captured into the thread's error by _HandleDiagnosticRecord */
+void
+_SetError(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	if (!threadError.hasError) {
+		// ODBC returned no diagnostic record
+		threadError.hasError = TRUE;
+		threadError.retCode = SQL_ERROR;
+		threadError.nativeError = 0;
+		strcpy_s(threadError.sqlState, sizeof(threadError.sqlState), "HY000");
+		strcpy_s(threadError.message, sizeof(threadError.message), "error occured");
+	}
+	if (threadError.nativeError == 0) {
+		// the driver gives these no number, callers tell them apart from other failures
+		if (strcmp(threadError.sqlState, "HYT00") == 0) {
+			threadError.nativeError = SQLSERVER_ERROR_QUERY_TIMEOUT;
+		}
+		else if (strcmp(threadError.sqlState, "HY008") == 0) {
+			threadError.nativeError = SQLSERVER_ERROR_CANCELED;
+		}
+	}
+	if (stm) {
+		SQLSERVER_STATEMENT_OF(stm)->lastError = threadError;
+	}
+	conn->err = TRUE;
+	// connections are shared between threads, the message itself is read with sqlserverGetLastErrorText
+	conn->errText = "error occured";
+}
+
+/*	Records a failure that does not come from ODBC */
+void
+_SetErrorText(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * text
+)
+{
+	threadError.hasError = TRUE;
+	threadError.retCode = SQL_ERROR;
+	threadError.nativeError = 0;
+	strcpy_s(threadError.sqlState, sizeof(threadError.sqlState), "HY000");
+	strncpy_s(threadError.message, sizeof(threadError.message), text, _TRUNCATE);
+	_SetError(conn, stm);
+}
+
+/*	Records a failure captured on another thread */
+void
+_SetErrorFrom(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const SQLSERVER_ERROR * error
+)
+{
+	threadError = *error;
+	_SetError(conn, stm);
+}
+
 /************************************************************************
-/* HandleDiagnosticRecord : display error/warning information
+/* HandleDiagnosticRecord : capture error/warning information
 /*
 /* Parameters:
 /*      hHandle     ODBC handle
 /*      hType       Type of handle (HANDLE_STMT, HANDLE_ENV, HANDLE_DBC)
 /*      RetCode     Return code of failing command
+/*      stm         Statement owning hHandle, NULL for other handle types
+/*
+/* Records are read straight into the statement's diagnostic ring and
+/* queued for the asynchronous logger. Informational records are not
+/* read at all when neither the logger nor the statement wants them.
 /************************************************************************/
 
 void 
 _HandleDiagnosticRecord(
-	SQLHANDLE      hHandle,
-	SQLSMALLINT    hType,
-	RETCODE        RetCode
+	SQLHANDLE			hHandle,
+	SQLSMALLINT			hType,
+	RETCODE				RetCode,
+	DBInt_Statement   * stm
 )
 {
-	SQLSMALLINT iRec = 0;
-	SQLINTEGER  iError;
-	WCHAR       wszMessage[1000];
-	WCHAR       wszState[SQL_SQLSTATE_SIZE + 1];
-
+	SQLSERVER_DIAGNOSTIC		local;
+	SQLSERVER_DIAGNOSTIC_RING * ring = NULL;
+	LONG						loggerLevel = diagnosticLevel;
 
 	if (RetCode == SQL_INVALID_HANDLE)
 	{
-		fwprintf(stderr, L"Invalid handle!\n");
+		if (loggerLevel >= SQLSERVER_LOG_ERROR) {
+			local.level = SQLSERVER_LOG_ERROR;
+			local.retCode = RetCode;
+			local.handleType = hType;
+			local.threadId = GetCurrentThreadId();
+			local.nativeError = 0;
+			wcscpy_s(local.sqlState, SQL_SQLSTATE_SIZE + 1, L"HY000");
+			wcscpy_s(local.message, SQLSERVER_DIAGNOSTIC_MESSAGE_LENGTH, L"Invalid handle!");
+			_DiagnosticEnqueue(&local);
+		}
+		return;
+	}
+
+	if (RetCode != SQL_ERROR && RetCode != SQL_SUCCESS_WITH_INFO)
+	{
+		// SQL_NO_DATA, SQL_NEED_DATA and SQL_STILL_EXECUTING carry no records
+		return;
+	}
+
+	if (stm)
+	{
+		SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+		if (RetCode == SQL_ERROR || state->captureDiagnostics) {
+			ring = &state->diagnostics;
+		}
+	}
+
+	if (RetCode == SQL_SUCCESS_WITH_INFO && ring == NULL && loggerLevel < SQLSERVER_LOG_WARNING)
+	{
+		// nobody is listening
 		return;
 	}
 
-	while (SQLGetDiagRec(hType,
-		hHandle,
-		++iRec,
-		wszState,
-		&iError,
-		wszMessage,
-		(SQLSMALLINT)(sizeof(wszMessage) / sizeof(WCHAR)),
-		(SQLSMALLINT*)NULL) == SQL_SUCCESS)
+	for (SQLSMALLINT iRec = 1; ; iRec++)
 	{
+		SQLSERVER_DIAGNOSTIC * record = ring ? &ring->records[ring->written % SQLSERVER_DIAGNOSTIC_RING_SIZE] : &local;
+
+		// SQL_SUCCESS_WITH_INFO means the message was truncated
+		if (!SQL_SUCCEEDED(SQLGetDiagRec(hType,
+			hHandle,
+			iRec,
+			record->sqlState,
+			&record->nativeError,
+			record->message,
+			SQLSERVER_DIAGNOSTIC_MESSAGE_LENGTH,
+			(SQLSMALLINT*)NULL)))
+		{
+			break;
+		}
+
+		record->retCode = RetCode;
+		record->handleType = hType;
+		record->threadId = GetCurrentThreadId();
+		if (RetCode == SQL_ERROR) {
+			record->level = SQLSERVER_LOG_ERROR;
+		}
+		else {
+			record->level = (wcsncmp(record->sqlState, L"01000", 5) == 0) ? SQLSERVER_LOG_INFO : SQLSERVER_LOG_WARNING;
+		}
+
+		// First record of a failure becomes the thread's error
+		if (RetCode == SQL_ERROR && iRec == 1)
+		{
+			threadError.hasError = TRUE;
+			threadError.retCode = RetCode;
+			threadError.nativeError = record->nativeError;
+			WideCharToMultiByte(CP_UTF8, 0, record->sqlState, -1, threadError.sqlState, sizeof(threadError.sqlState), NULL, NULL);
+			threadError.sqlState[SQL_SQLSTATE_SIZE] = '\0';
+			if (WideCharToMultiByte(CP_UTF8, 0, record->message, -1, threadError.message, sizeof(threadError.message), NULL, NULL) == 0) {
+				// message longer than the buffer
+				threadError.message[sizeof(threadError.message) - 1] = '\0';
+			}
+		}
+
 		// Hide data truncated..
-		if (wcsncmp(wszState, L"01004", 5))
+		if (wcsncmp(record->sqlState, L"01004", 5) == 0)
 		{
-			fwprintf(stderr, L"[%5.5s] %s (%d)\n", wszState, wszMessage, iError);
+			continue;
+		}
+
+		if ((LONG)record->level <= loggerLevel)
+		{
+			_DiagnosticEnqueue(record);
 		}
-	}
 
+		if (ring)
+		{
+			ring->written++;
+		}
+		else if (loggerLevel == SQLSERVER_LOG_NONE)
+		{
+			// only the thread's error was needed
+			break;
+		}
+	}
 }
 
 SQLSERVER_INTERFACE_API 
@@ -998,61 +1884,112 @@ sqlserverGetLastErrorText(
 	DBInt_Connection * conn
 ) 
 {
-	return conn->errText;
+	return threadError.hasError ? threadError.message : NULL;
 }
 
-/*
+SQLSERVER_INTERFACE_API
+int
+sqlserverGetLastError(
+	DBInt_Connection * conn
+)
+{
+	return threadError.hasError ? threadError.nativeError : 0;
+}
 
 SQLSERVER_INTERFACE_API
-char*
-sqlserverGetPrimaryKeyColumn(
-	DBInt_Connection* mkDBConnection,
-	const char* schemaName,
-	const char* tableName,
-	int position
+BOOL
+sqlserverGetThreadError(
+	SQLSERVER_ERROR * error
 )
 {
-	char* retval = NULL;
-	char positionStr[10];
-	mkDBConnection->errText = NULL;
-
-	mkItoa(position, positionStr);
-
-	DBInt_Statement* stm = sqlserverCreateStatement(mkDBConnection);
-
-	char* sql = mkStrcat(mkDBConnection->heapHandle, __FILE__, __LINE__,
-		"SELECT "
-		"	c.column_name, "
-		"	c.data_type, "
-		"	c.ordinal_position "
-		"FROM "
-		"	information_schema.table_constraints tc "
-		"JOIN "
-		"	information_schema.constraint_column_usage AS ccu USING(constraint_schema, constraint_name) "
-		"JOIN "
-		"	information_schema.columns AS c ON c.table_schema = tc.constraint_schema AND tc.table_name = c.table_name AND ccu.column_name = c.column_name "
-		"WHERE "
-		"		constraint_type = 'PRIMARY KEY' "
-		"	and lower(c.table_schema) = lower('", schemaName, "') "
-		"	and lower(tc.table_name) = lower('", tableName, "') "
-		"	and c.ordinal_position = ", positionStr, " ",
-		"order by "
-		"	c.ordinal_position ",
-		NULL
-	);
-
-	sqlserverPrepare(mkDBConnection, stm, sql);
-
-	sqlserverExecuteSelectStatement(mkDBConnection, stm, sql);
-
-	const char* tmp = sqlserverGetColumnValueByColumnName(mkDBConnection, stm, "COLUMN_NAME");
-
-	if (tmp) {
-		retval = mkStrdup(mkDBConnection->heapHandle, tmp, __FILE__, __LINE__);
+	*error = threadError;
+	return threadError.hasError;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverGetStatementError(
+	DBInt_Statement * stm,
+	SQLSERVER_ERROR * error
+)
+{
+	*error = SQLSERVER_STATEMENT_OF(stm)->lastError;
+	return error->hasError;
+}
+
+/*	Rows affected by the last execution on "stm", 0 when unknown */
+SQLSERVER_INTERFACE_API
+unsigned int
+sqlserverGetAffectedRows(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	return stm->statement.sqlserver.cRowCount > 0 ? (unsigned int)stm->statement.sqlserver.cRowCount : 0;
+}
+
+SQLSERVER_INTERFACE_API
+long
+sqlserverGetLiveBlockCount(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+#ifdef _DEBUG
+	if (stm) {
+		return SQLSERVER_STATEMENT_OF(stm)->liveBlocks;
 	}
-	return retval;
+	if (conn) {
+		return conn->connection.sqlserverHandle ? SQLSERVER_CONNECTION_OF(conn)->liveBlocks : 0;
+	}
+	return liveStatementBlocks;
+#else
+	return -1;
+#endif
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverSetDefaultQueryTimeout(
+	DBInt_Connection * conn,
+	DWORD seconds
+)
+{
+	SQLSERVER_CONNECTION_OF(conn)->queryTimeout = seconds;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverSetQueryTimeout(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	DWORD seconds
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	_ResetError(conn, stm);
+
+	TRYODBC_STM(stm,
+		SQLSetStmtAttr(*stm->statement.sqlserver.hStmt, SQL_ATTR_QUERY_TIMEOUT, (SQLPOINTER)(ULONG_PTR)seconds, 0));
+	state->queryTimeout = seconds;
+
+Exit:
+	return !state->lastError.hasError;
+}
+
+/*	Runs on the canceling thread, so neither the connection's nor the statement's error is touched */
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverCancel(
+	DBInt_Statement * stm
+)
+{
+	return SQL_SUCCEEDED(SQLCancel(*stm->statement.sqlserver.hStmt));
 }
 
+/*
+
 SQLSERVER_INTERFACE_API char* sqlserverGetDatabaseName(DBInt_Connection* conn) {
 	PRECHECK(conn);
 
@@ -1091,16 +2028,6 @@ SQLSERVER_INTERFACE_API BOOL sqlserverRollback(DBInt_Connection* conn) {
 
 
 
-SQLSERVER_INTERFACE_API void sqlserverDestroyConnection(DBInt_Connection* conn) {
-	PRECHECK(conn);
-
-	if (conn) {
-		// close the connection to the database and cleanup 
-		PQfinish(conn->connection.postgresqlHandle);
-		conn->connection.postgresqlHandle = NULL;
-	}
-}
-
 SQLSERVER_INTERFACE_API void postgresqlBindLob(DBInt_Connection* conn, DBInt_Statement* stm, const char* imageFileName, char* bindVariableName) {
 	PRECHECK(conn);
 
@@ -1169,54 +2096,12 @@ SQLSERVER_INTERFACE_API void* sqlserverGetLob(DBInt_Connection* conn, DBInt_Stat
 	POSTCHECK(conn);
 }
 
-SQLSERVER_INTERFACE_API unsigned int sqlserverGetColumnSize(DBInt_Connection* conn, DBInt_Statement* stm, const char* columnName) {
-	PRECHECK(conn);
-
-	conn->errText = NULL;
-	int colNum = PQfnumber(stm->statement.postgresql.resultSet, columnName);
-	unsigned int colSize = PQfsize(stm->statement.postgresql.resultSet, colNum);
-	return colSize;
-}
-
-SQLSERVER_INTERFACE_API void sqlserverExecuteDescribe(DBInt_Connection* conn, DBInt_Statement* stm, const char* sql) {
-	PRECHECK(conn);
-
-	conn->errText = NULL;
-	PGresult* res = PQdescribePrepared(conn->connection.postgresqlHandle, sql);
-	if (PQresultStatus(res) != PGRES_TUPLES_OK)
-	{
-		conn->errText = PQerrorMessage(conn->connection.postgresqlHandle);
-		PQclear(res);
-	}
-	else {
-		stm->statement.postgresql.currentRowNum = 0;
-		stm->statement.postgresql.resultSet = res;
-	}
-	POSTCHECK(conn);
-}
-
 SQLSERVER_INTERFACE_API void sqlserverRegisterString(DBInt_Connection* conn, DBInt_Statement* stm, const char* bindVariableName, int maxLength) {
 	PRECHECK(conn);
 	conn->errText = NULL;
 }
 
 
-SQLSERVER_INTERFACE_API unsigned int sqlserverGetAffectedRows(DBInt_Connection* conn, DBInt_Statement* stm) {
-	PRECHECK(conn);
-
-	return 0;
-}
-
-SQLSERVER_INTERFACE_API unsigned int sqlserverGetColumnCount(DBInt_Connection* conn, DBInt_Statement* stm) {
-	PRECHECK(conn);
-
-	unsigned int colCount = 0;
-	colCount = PQnfields(stm->statement.postgresql.resultSet);
-	return colCount;
-}
-
-
-
 SQLSERVER_INTERFACE_API int sqlserverGetLastError(DBInt_Connection* conn) {
 	return 0;
 }
@@ -1241,20 +2126,4 @@ SQLSERVER_INTERFACE_API int	sqlserverPrev(DBInt_Statement* stm) {
 	return (stm->statement.postgresql.currentRowNum == 0);
 }
 
-SQLSERVER_INTERFACE_API int sqlserverIsConnectionOpen(DBInt_Connection* conn) {
-	PRECHECK(conn);
-
-	BOOL retval = FALSE;
-	conn->errText = NULL;
-	PGresult* res = PQexec(conn->connection.postgresqlHandle, "");
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-		conn->errText = PQerrorMessage(conn->connection.postgresqlHandle);
-		retval = (conn->errText == NULL || conn->errText[0] == '\0');
-	}
-	PQclear(res);
-	POSTCHECK(conn);
-	return retval;
-}
-
-
 */
\ No newline at end of file
@@ -19,10 +19,240 @@
 
 #define SQLSERVER_INTERFACE_API __declspec(dllexport)
 
+#include "sqlserver-odbc.h"
+
+/*	THREAD SAFETY
+
+	- A DBInt_Connection may be shared by several threads as long as every thread works on its own
+	  DBInt_Statement. A single statement must not be used by two threads at the same time, except for
+	  the functions documented as callable from another thread.
+	- Without MARS only one statement per connection can have pending results at a time. The driver
+	  reports "connection is busy" instead of blocking in that case.
+	- Error details are kept per thread (sqlserverGetThreadError, sqlserverGetLastError,
+	  sqlserverGetLastErrorText) and per statement (sqlserverGetStatementError). conn->err is
+	  still maintained for existing callers but is not reliable on a shared connection. conn->errText only
+	  holds a fixed text, never the message.
+	- sqlserverCancel may be called from any thread while another thread executes or fetches on the statement.
+	- Transactions belong to the connection. sqlserverCommit and sqlserverRollback affect the work of
+	  every thread using it.
+	- The ODBC environment is created once per process on first use.
+*/
+
+#define SQLSERVER_ERROR_MESSAGE_LENGTH		1024
+
+/*	nativeError of failures the server reports no number for */
+#define SQLSERVER_ERROR_QUERY_TIMEOUT		(-1)
+#define SQLSERVER_ERROR_CANCELED			(-2)
+
+/*	Details of a failed call, taken from the first diagnostic record */
+typedef struct _SQLSERVER_ERROR {
+	BOOL			hasError;
+	RETCODE			retCode;
+	char			sqlState[SQL_SQLSTATE_SIZE + 1];
+	SQLINTEGER		nativeError;
+	char			message[SQLSERVER_ERROR_MESSAGE_LENGTH];
+} SQLSERVER_ERROR;
+
+#define SQLSERVER_DIAGNOSTIC_MESSAGE_LENGTH	512
+#define SQLSERVER_DIAGNOSTIC_RING_SIZE		8
+
+typedef enum _SQLSERVER_LOG_LEVEL {
+	SQLSERVER_LOG_NONE = 0,
+	/*	SQL_ERROR records */
+	SQLSERVER_LOG_ERROR,
+	/*	SQL_SUCCESS_WITH_INFO records other than 01000 */
+	SQLSERVER_LOG_WARNING,
+	/*	01000 records: PRINT output, low severity RAISERROR, row count messages */
+	SQLSERVER_LOG_INFO
+} SQLSERVER_LOG_LEVEL;
+
+/*	One diagnostic record as returned by SQLGetDiagRec */
+typedef struct _SQLSERVER_DIAGNOSTIC {
+	SQLSERVER_LOG_LEVEL	level;
+	RETCODE				retCode;
+	SQLSMALLINT			handleType;
+	DWORD				threadId;
+	SQLWCHAR			sqlState[SQL_SQLSTATE_SIZE + 1];
+	SQLINTEGER			nativeError;
+	SQLWCHAR			message[SQLSERVER_DIAGNOSTIC_MESSAGE_LENGTH];
+} SQLSERVER_DIAGNOSTIC;
+
+/*	Last SQLSERVER_DIAGNOSTIC_RING_SIZE records of a statement. SQLGetDiagRec writes straight into the slots */
+typedef struct _SQLSERVER_DIAGNOSTIC_RING {
+	SQLSERVER_DIAGNOSTIC	records[SQLSERVER_DIAGNOSTIC_RING_SIZE];
+	/*	number of records ever written, next slot is "written % SQLSERVER_DIAGNOSTIC_RING_SIZE" */
+	unsigned int			written;
+} SQLSERVER_DIAGNOSTIC_RING;
+
+/*	Parameter as described by SQLDescribeParam in sqlserverPrepare */
+typedef struct _SQLSERVER_PARAMETER {
+	SQLSMALLINT		sqlType;
+	SQLULEN			columnSize;
+	SQLSMALLINT		decimalDigits;
+	SQLSMALLINT		nullable;
+	/*	C type string values are converted to before binding */
+	SQLSMALLINT		cType;
+	/*	SQL_PARAM_INPUT when 0. Set by sqlserverBindOutputInt64 */
+	SQLSMALLINT		inputOutputType;
+} SQLSERVER_PARAMETER;
+
+/*	Driver state of a statement. stm->statement.sqlserver.hStmt points to this structure, so "hStmt"
+	must stay the first member: *stm->statement.sqlserver.hStmt is still the ODBC statement handle */
+typedef struct _SQLSERVER_STATEMENT {
+	SQLHSTMT					hStmt;
+	SQLSERVER_ERROR				lastError;
+	/*	error records are always kept, informational ones only when captureDiagnostics is set */
+	BOOL						captureDiagnostics;
+	SQLSERVER_DIAGNOSTIC_RING	diagnostics;
+	/*	ParameterCount entries, parallel to stm->statement.sqlserver.bindVariables */
+	SQLSERVER_PARAMETER		  * parameters;
+	/*	entries allocated in parameters and bindVariables, ParameterCount may change before they are released */
+	SQLSMALLINT					allocatedParameterCount;
+	/*	entries allocated in stm->statement.sqlserver.resultSet, cColCount is overwritten on the next execution */
+	SQLSMALLINT					allocatedColumnCount;
+	/*	blocks allocated with _StatementMalloc and not freed yet, _DEBUG builds only */
+	LONG						liveBlocks;
+	/*	result cache state, NULL unless sqlserverEnableResultCache was called. See sqlserver-cache.h */
+	struct _SQLSERVER_CACHE_CURSOR * cache;
+	/*	table-valued parameters bound with sqlserverBindTableParameter. See sqlserver-tvp.h */
+	struct _SQLSERVER_TVP_BINDING * tableParameters;
+	/*	execution may be repeated after a deadlock or a lost connection. See sqlserver-retry.h */
+	BOOL						retryable;
+	/*	seconds, 0 waits forever */
+	SQLULEN						queryTimeout;
+	/*	set by _PrepareStatement. Executions prepare the text they are given unless it is already prepared, see _EnsurePrepared */
+	BOOL						prepared;
+	/*	text given to the last _PrepareStatement, executions given other text prepare it again */
+	char					  * preparedSql;
+	/*	SQL text while the statement runs with SQLExecDirect instead of a prepared plan. See sqlserver-direct.h */
+	SQLWCHAR				  * directSql;
+	/*	executions since the last prepare */
+	int							executionCount;
+	/*	the prepare of directSql started by _BeginExecute is still pending, _PollExecute polls it */
+	BOOL						promoting;
+	/*	read-ahead state, NULL unless sqlserverEnableReadAhead was called. See sqlserver-prefetch.h */
+	struct _SQLSERVER_PREFETCH * prefetch;
+	/*	latency histograms of the SQL text prepared last, NULL while profiling is off. See sqlserver-profile.h */
+	struct _SQLSERVER_PROFILE_ENTRY * profile;
+	/*	number in the workload capture, 0 until first recorded. See sqlserver-capture.h */
+	LONG						captureId;
+	/*	SQLFetch calls since the last execution and their microseconds, written as one capture record */
+	unsigned long long			captureFetches;
+	LONG64						captureFetchMicroseconds;
+	/*	rows in the caller's block after the last sqlserverFetchBound. See sqlserver-bound.h */
+	SQLULEN						boundRowsFetched;
+	/*	SQLSERVER_ASYNC_OPERATION being polled. See sqlserver-async.h */
+	int							asyncOperation;
+} SQLSERVER_STATEMENT;
+
+#define SQLSERVER_STATEMENT_OF(stm)		((SQLSERVER_STATEMENT*)(stm)->statement.sqlserver.hStmt)
+
+/*	From msodbcsql.h */
+#ifndef SQL_COPT_SS_MARS_ENABLED
+#define SQL_COPT_SS_MARS_ENABLED		1224
+#define SQL_MARS_ENABLED_NO				0L
+#define SQL_MARS_ENABLED_YES			1L
+#endif
+
+#ifndef SQL_SOPT_SS_DEFER_PREPARE
+#define SQL_SOPT_SS_DEFER_PREPARE		1237
+#define SQL_DP_OFF						0L
+#define SQL_DP_ON						1L
+#endif
+
+#define SQLSERVER_DEFAULT_DRIVER_NAME	"SQL Server"
+
+/*	Optional settings for sqlserverCreateConnectionEx. Zero initialized members keep the defaults */
+typedef struct _SQLSERVER_CONNECTION_OPTIONS {
+	/*	ODBC driver, e.g. "ODBC Driver 18 for SQL Server". NULL selects SQLSERVER_DEFAULT_DRIVER_NAME */
+	const char	  * driverName;
+	/*	requests Multiple Active Result Sets. Only honoured by "ODBC Driver xx for SQL Server" and Native Client */
+	BOOL			marsEnabled;
+	/*	appended to the connection string as is, e.g. "Encrypt=yes;TrustServerCertificate=yes;" */
+	const char	  * attributes;
+	/*	seconds to wait for the login, 0 keeps the driver default */
+	DWORD			loginTimeout;
+	/*	default query timeout in seconds of the connection's statements, 0 waits forever */
+	DWORD			queryTimeout;
+	/*	complete ODBC connection string used as is, e.g. "DSN=reporting;UID=app;PWD=...;". The host, instance,
+		database and credential arguments and the other string options are then ignored */
+	const char	  * connectionString;
+} SQLSERVER_CONNECTION_OPTIONS;
+
+/*	Driver state of a connection. conn->connection.sqlserverHandle points to this structure, so "hDbc"
+	must stay the first member: *conn->connection.sqlserverHandle is still the ODBC connection handle */
+typedef struct _SQLSERVER_CONNECTION {
+	SQLHDBC						hDbc;
+	/*	TRUE only if the driver reports MARS as enabled after connecting */
+	BOOL						marsEnabled;
+	/*	seconds, given to statements created afterwards */
+	SQLULEN						queryTimeout;
+	/*	blocks owned by the connection's statements, _DEBUG builds only */
+	volatile LONG				liveBlocks;
+	/*	statements created and not freed yet. Reconnecting would leave all but one of them without a handle */
+	volatile LONG				statementCount;
+	/*	number in the workload capture, 0 until first recorded. See sqlserver-capture.h */
+	volatile LONG				captureId;
+} SQLSERVER_CONNECTION;
+
+#define SQLSERVER_CONNECTION_OF(conn)	((SQLSERVER_CONNECTION*)(conn)->connection.sqlserverHandle)
+
+/*******************************************/
+/* Macro to call ODBC functions and        */
+/* report an error on failure.             */
+/* Takes handle, handle type, and stmt     */
+/*******************************************/
+
+#define TRYODBC(h, ht, x)   {   RETCODE rc = x;\
+                                if (rc != SQL_SUCCESS) \
+                                { \
+                                    _HandleDiagnosticRecord (h, ht, rc, NULL); \
+                                } \
+                                if (rc == SQL_ERROR) \
+                                { \
+                                    _SetError(conn, NULL); \
+                                    goto Exit;  \
+                                }  \
+                            }
+
+/*	Same as TRYODBC for calls on a statement handle, error is also recorded on the statement */
+#define TRYODBC_STM(stm, x) {   RETCODE rc = x;\
+                                if (rc != SQL_SUCCESS) \
+                                { \
+                                    _HandleDiagnosticRecord (*(stm)->statement.sqlserver.hStmt, SQL_HANDLE_STMT, rc, (stm)); \
+                                } \
+                                if (rc == SQL_ERROR) \
+                                { \
+                                    _SetError(conn, (stm)); \
+                                    goto Exit;  \
+                                }  \
+                            }
+
 /* DDL's PRIVATE FUNCTIONS  */
-void			_HandleDiagnosticRecord(SQLHANDLE hHandle, SQLSMALLINT hType, RETCODE RetCode);
+void			_HandleDiagnosticRecord(SQLHANDLE hHandle, SQLSMALLINT hType, RETCODE RetCode, DBInt_Statement* stm);
+SQLHENV			_GetEnvironment(void);
+void			_ResetError(DBInt_Connection* conn, DBInt_Statement* stm);
+void			_SetError(DBInt_Connection* conn, DBInt_Statement* stm);
+void			_SetErrorText(DBInt_Connection* conn, DBInt_Statement* stm, const char* text);
+void			_SetErrorFrom(DBInt_Connection* conn, DBInt_Statement* stm, const SQLSERVER_ERROR* error);
 void			_BindAllResultSetColumns(DBInt_Connection* conn, DBInt_Statement* stm);
+SODIUM_DATABASE_COLUMN_TYPE	_GetColumnDataType(SQLLEN ssType);
+void			_CompleteExecute(DBInt_Connection* conn, DBInt_Statement* stm, RETCODE RetCode);
+SQLLEN			_GetBoundValueLength(BINDING* bind);
 int				_GetColumnIndexByColumnName(DBInt_Connection * conn, DBInt_Statement * stm, const char* columnName);
+void *			_StatementMalloc(DBInt_Connection* conn, DBInt_Statement* stm, size_t size, const char* file, int line);
+void			_StatementFree(DBInt_Connection* conn, DBInt_Statement* stm, void* block);
+void			_EnsureParameterBuffer(DBInt_Connection* conn, DBInt_Statement* stm, ODBC_BINDING* binding, SQLLEN size);
+BOOL			_ReconnectConnection(DBInt_Connection* conn);
+SQLSMALLINT		_GetParameterCType(SQLSMALLINT sqlType);
+void			_FreeParameters(DBInt_Connection* conn, DBInt_Statement* stm);
+void			_AllocateParameters(DBInt_Connection* conn, DBInt_Statement* stm);
+void			_FreeResultSet(DBInt_Connection* conn, DBInt_Statement* stm);
+void			_AllocateResultSet(DBInt_Connection* conn, DBInt_Statement* stm, SQLSMALLINT count);
+void			_PrepareStatement(DBInt_Connection* conn, DBInt_Statement* stm, const char* sql, const SQLSERVER_PARAMETER* parameters, SQLSMALLINT parameterCount);
+BOOL			_EnsurePrepared(DBInt_Connection* conn, DBInt_Statement* stm, const char* sql);
+BOOL			_BindParameterBuffer(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT paramIndex);
+BOOL			_BindParameterValue(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT paramIndex, SQLSMALLINT cType, const void* value, SQLLEN length);
 void			_SQLBindStringW(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT colIndex, LPCWSTR szString, SQLULEN strlen);
 void			_SQLBindStringA(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT colIndex, LPCSTR szString, SQLULEN strlen);
 
@@ -40,6 +270,19 @@ sqlserverCreateConnection(
 	const char* userName,
 	const char* password);
 
+/*	sqlserverCreateConnection with driver selection and other options. "options" may be NULL */
+SQLSERVER_INTERFACE_API 
+DBInt_Connection * 
+sqlserverCreateConnectionEx(
+	HANDLE heapHandle,
+	DBInt_SupportedDatabaseType dbType,
+	const char* hostName,
+	const char* instanceName,
+	const char* databaseName,
+	const char* userName,
+	const char* password,
+	const SQLSERVER_CONNECTION_OPTIONS* options);
+
 SQLSERVER_INTERFACE_API void					sqlserverDestroyConnection(DBInt_Connection* mkConnection);
 SQLSERVER_INTERFACE_API int						sqlserverIsConnectionOpen(DBInt_Connection* mkConnection);
 SQLSERVER_INTERFACE_API int						sqlserverIsEof(DBInt_Connection* mkConnection, DBInt_Statement* stm);
@@ -50,8 +293,32 @@ SQLSERVER_INTERFACE_API BOOL					sqlserverPrev(DBInt_Statement* stm);
 SQLSERVER_INTERFACE_API DBInt_Statement		  * sqlserverCreateStatement(DBInt_Connection* mkConnection);
 SQLSERVER_INTERFACE_API void					sqlserverFreeStatement(DBInt_Connection* mkConnection, DBInt_Statement* stm);
 SQLSERVER_INTERFACE_API void					sqlserverSeek(DBInt_Connection* mkConnection, DBInt_Statement* stm, int rowNum);
+/*	Native error number of the calling thread's last failed call, 0 if it succeeded.
+	SQLSERVER_ERROR_QUERY_TIMEOUT or SQLSERVER_ERROR_CANCELED when the call timed out or was canceled */
 SQLSERVER_INTERFACE_API int						sqlserverGetLastError(DBInt_Connection* mkConnection);
+/*	Message of the calling thread's last failed call, NULL if it succeeded. Valid until the thread's next call */
 SQLSERVER_INTERFACE_API const char			  * sqlserverGetLastErrorText(DBInt_Connection* mkConnection);
+/*	Copies the calling thread's last error into "error". Returns FALSE if the last call succeeded */
+SQLSERVER_INTERFACE_API BOOL					sqlserverGetThreadError(SQLSERVER_ERROR* error);
+/*	Copies the last error raised on "stm" into "error". Returns FALSE if there is none */
+SQLSERVER_INTERFACE_API BOOL					sqlserverGetStatementError(DBInt_Statement* stm, SQLSERVER_ERROR* error);
+
+/*	_DEBUG builds: blocks allocated for "stm", or for all statements of "conn" when "stm" is NULL (including the
+	statements themselves), or for all statements of the process when both are NULL. Blocks a freed statement
+	still held stay counted for its connection and the process, and the free sends a SQLSERVER_LOG_WARNING record
+	to the diagnostic logger. Release builds return -1 */
+SQLSERVER_INTERFACE_API long					sqlserverGetLiveBlockCount(DBInt_Connection* conn, DBInt_Statement* stm);
+
+/*	Query timeout in seconds of statements created on "conn" from now on, 0 waits forever */
+SQLSERVER_INTERFACE_API void					sqlserverSetDefaultQueryTimeout(DBInt_Connection* conn, DWORD seconds);
+
+/*	Query timeout in seconds of executions and fetches on "stm", 0 waits forever. An expired call fails with
+	SQLSERVER_ERROR_QUERY_TIMEOUT */
+SQLSERVER_INTERFACE_API BOOL					sqlserverSetQueryTimeout(DBInt_Connection* conn, DBInt_Statement* stm, DWORD seconds);
+
+/*	Cancels the execution or fetch running on "stm" in another thread, which fails with SQLSERVER_ERROR_CANCELED.
+	Does nothing if the statement is idle. "stm" must not be freed while the call is in progress */
+SQLSERVER_INTERFACE_API BOOL					sqlserverCancel(DBInt_Statement* stm);
 SQLSERVER_INTERFACE_API BOOL					sqlserverCommit(DBInt_Connection* mkConnection);
 /*	CALLER MUST RELEASE RETURN VALUE  */
 SQLSERVER_INTERFACE_API char				  * sqlserverGetPrimaryKeyColumn(DBInt_Connection* mkDBConnection, const char* schemaName, const char* tableName, int position);
@@ -60,6 +327,20 @@ SQLSERVER_INTERFACE_API void					sqlserverRegisterString(DBInt_Connection* mkCon
 SQLSERVER_INTERFACE_API unsigned int			sqlserverGetAffectedRows(DBInt_Connection* mkConnection, DBInt_Statement* stm);
 SQLSERVER_INTERFACE_API void					sqlserverBindString(DBInt_Connection* mkDBConnection, DBInt_Statement* stm, char* bindVariableName, char* bindVariableValue, size_t valueLength);
 SQLSERVER_INTERFACE_API void					sqlserverBindNumber(DBInt_Connection* mkDBConnection, DBInt_Statement* stm, char* bindVariableName, char* bindVariableValue, size_t valueLength);
+/*	Typed binds. The value is converted by the driver to the parameter type described at prepare time, so the
+	server sees the column's own type. "paramIndex" is 1 based. Return FALSE on error */
+SQLSERVER_INTERFACE_API BOOL					sqlserverBindInt64(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT paramIndex, long long value);
+SQLSERVER_INTERFACE_API BOOL					sqlserverBindDouble(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT paramIndex, double value);
+/*	Precision and scale are taken from "value" */
+SQLSERVER_INTERFACE_API BOOL					sqlserverBindDecimal(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT paramIndex, const SQL_NUMERIC_STRUCT* value);
+SQLSERVER_INTERFACE_API BOOL					sqlserverBindTimestamp(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT paramIndex, const SQL_TIMESTAMP_STRUCT* value);
+SQLSERVER_INTERFACE_API BOOL					sqlserverBindDate(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT paramIndex, const SQL_DATE_STRUCT* value);
+SQLSERVER_INTERFACE_API BOOL					sqlserverBindBit(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT paramIndex, BOOL value);
+SQLSERVER_INTERFACE_API BOOL					sqlserverBindBinary(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT paramIndex, const void* value, size_t length);
+/*	"length" bytes of text in the client code page, not null terminated */
+SQLSERVER_INTERFACE_API BOOL					sqlserverBindText(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT paramIndex, const char* value, size_t length);
+SQLSERVER_INTERFACE_API BOOL					sqlserverBindGuid(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT paramIndex, const SQLGUID* value);
+SQLSERVER_INTERFACE_API BOOL					sqlserverBindNull(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT paramIndex);
 SQLSERVER_INTERFACE_API void					sqlserverBindLob(DBInt_Connection* mkDBConnection, DBInt_Statement* stm, const char* imageFileName, char* bindVariableName);
 SQLSERVER_INTERFACE_API void					sqlserverExecuteSelectStatement(DBInt_Connection* mkConnection, DBInt_Statement* stm, const char* sql);
 SQLSERVER_INTERFACE_API void					sqlserverExecuteDescribe(DBInt_Connection* mkConnection, DBInt_Statement* stm, const char* sql);
@@ -69,6 +350,18 @@ SQLSERVER_INTERFACE_API void					sqlserverExecuteDeleteStatement(DBInt_Connectio
 SQLSERVER_INTERFACE_API void					sqlserverExecuteUpdateStatement(DBInt_Connection* mkConnection, DBInt_Statement* stm, const char* sql);
 SQLSERVER_INTERFACE_API void					sqlserverExecuteAnonymousBlock(DBInt_Connection* mkConnection, DBInt_Statement* stm, const char* sql);
 SQLSERVER_INTERFACE_API void					sqlserverPrepare(DBInt_Connection* mkConnection, DBInt_Statement* stm, const char* sql);
+
+/*	sqlserverPrepare without asking the server to describe the parameters. "parameters" gives sqlType, columnSize,
+	decimalDigits and nullable of each of the "parameterCount" markers in order, cType is ignored */
+SQLSERVER_INTERFACE_API
+void
+sqlserverPrepareWithParameters(
+	DBInt_Connection* conn,
+	DBInt_Statement* stm,
+	const char* sql,
+	const SQLSERVER_PARAMETER* parameters,
+	SQLSMALLINT parameterCount);
+
 SQLSERVER_INTERFACE_API unsigned int			sqlserverGetColumnCount(DBInt_Connection* mkConnection, DBInt_Statement* stm);
 SQLSERVER_INTERFACE_API const char			  * sqlserverGetColumnValueByColumnName(DBInt_Connection* mkConnection, DBInt_Statement* stm, const char* columnName);
 SQLSERVER_INTERFACE_API void				  * sqlserverGetLob(DBInt_Connection* mkConnection, DBInt_Statement* stm, const char* columnName, DWORD* sizeOfValue);
@@ -0,0 +1,627 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include <ctype.h>
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+#include "sqlserver-metadata.h"
+
+
+/*	Tables outlive the connections that loaded them, so they get a heap of their own */
+HANDLE								metadataHeap = NULL;
+INIT_ONCE							metadataInitOnce = INIT_ONCE_STATIC_INIT;
+
+SRWLOCK								metadataLock = SRWLOCK_INIT;
+SQLSERVER_METADATA_TABLE		  * metadataBuckets[SQLSERVER_METADATA_BUCKET_COUNT];
+SQLSERVER_METADATA_STATS			metadataStats;
+
+/*	Same layout as the result set of SQLPrimaryKeys, for all tables at once */
+const char						  * metadataKeysSql =
+	"SELECT NULL, s.name, t.name, c.name, ic.key_ordinal "
+	"FROM sys.indexes i "
+	"JOIN sys.index_columns ic ON ic.object_id = i.object_id AND ic.index_id = i.index_id "
+	"JOIN sys.columns c ON c.object_id = ic.object_id AND c.column_id = ic.column_id "
+	"JOIN sys.tables t ON t.object_id = i.object_id "
+	"JOIN sys.schemas s ON s.schema_id = t.schema_id "
+	"WHERE i.is_primary_key = 1 AND (? IS NULL OR s.name = ?) "
+	"ORDER BY s.name, t.name, ic.key_ordinal";
+
+
+BOOL CALLBACK
+_MetadataInit(
+	PINIT_ONCE initOnce,
+	PVOID parameter,
+	PVOID * context
+)
+{
+	metadataHeap = HeapCreate(0, 0, 0);
+	return metadataHeap != NULL;
+}
+
+/*	FNV-1a of the connection string and the lower case schema and table names */
+unsigned long long
+_MetadataHash(
+	const SQLWCHAR * connectionString,
+	const char * schemaName,
+	const char * tableName
+)
+{
+	unsigned long long	hash = 14695981039346656037ULL;
+	const char		  * bytes = (const char*)connectionString;
+	size_t				connectionLength = wcslen(connectionString) * sizeof(SQLWCHAR);
+
+	for (size_t i = 0; i < connectionLength; i++) {
+		hash ^= (unsigned char)bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	for (const char * name = schemaName; *name; name++) {
+		hash ^= (unsigned char)tolower((unsigned char)*name);
+		hash *= 1099511628211ULL;
+	}
+	hash ^= '.';
+	hash *= 1099511628211ULL;
+	for (const char * name = tableName; *name; name++) {
+		hash ^= (unsigned char)tolower((unsigned char)*name);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/*	Names are compared case insensitively, as with the default collations */
+BOOL
+_MetadataMatches(
+	SQLSERVER_METADATA_TABLE * table,
+	const SQLWCHAR * connectionString,
+	const char * schemaName,
+	const char * tableName
+)
+{
+	return _stricmp(table->tableName, tableName) == 0
+		&& _stricmp(table->schemaName, schemaName) == 0
+		&& wcscmp(table->connectionString, connectionString) == 0;
+}
+
+SQLSERVER_METADATA_TABLE *
+_MetadataNewTable(
+	DBInt_Connection * conn,
+	const char * schemaName,
+	const char * tableName
+)
+{
+	size_t						connectionSize = (wcslen(conn->connection_string) + 1) * sizeof(SQLWCHAR);
+	SQLSERVER_METADATA_TABLE  * table = mkMalloc(metadataHeap, sizeof(SQLSERVER_METADATA_TABLE) + connectionSize, __FILE__, __LINE__);
+
+	if (table == NULL) {
+		return NULL;
+	}
+	memset(table, 0, sizeof(SQLSERVER_METADATA_TABLE));
+	table->connectionString = (SQLWCHAR*)(table + 1);
+	memcpy(table->connectionString, conn->connection_string, connectionSize);
+	strncpy_s(table->schemaName, sizeof(table->schemaName), schemaName, _TRUNCATE);
+	strncpy_s(table->tableName, sizeof(table->tableName), tableName, _TRUNCATE);
+	table->hash = _MetadataHash(table->connectionString, table->schemaName, table->tableName);
+	return table;
+}
+
+void
+_MetadataFreeTable(
+	SQLSERVER_METADATA_TABLE * table
+)
+{
+	if (table->columns) {
+		mkFree(metadataHeap, table->columns);
+	}
+	mkFree(metadataHeap, table);
+}
+
+/*	Reads the result set of SQLColumns into "tables", one entry per table in the order returned.
+	Rows of other tables matching the "_" and "%" wildcards of a table name are skipped */
+BOOL
+_MetadataReadColumns(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * schemaName,
+	const char * tableName,
+	SQLSERVER_METADATA_TABLE ** tables
+)
+{
+	SQLHSTMT					hStmt = *stm->statement.sqlserver.hStmt;
+	SQLSERVER_METADATA_TABLE  * current = NULL;
+	SQLSERVER_METADATA_TABLE ** last = tables;
+	char						rowSchema[SQLSERVER_METADATA_NAME_LENGTH];
+	char						rowTable[SQLSERVER_METADATA_NAME_LENGTH];
+	SQLLEN						indicator;
+	RETCODE						RetCode;
+
+	while (TRUE) {
+		SQLSERVER_METADATA_COLUMN column;
+
+		TRYODBC_STM(stm,
+			RetCode = SQLFetch(hStmt));
+		if (RetCode == SQL_NO_DATA) {
+			break;
+		}
+		memset(&column, 0, sizeof(column));
+
+		TRYODBC_STM(stm,
+			SQLGetData(hStmt, 2, SQL_C_CHAR, rowSchema, sizeof(rowSchema), &indicator));
+		if (indicator == SQL_NULL_DATA) {
+			rowSchema[0] = '\0';
+		}
+		TRYODBC_STM(stm,
+			SQLGetData(hStmt, 3, SQL_C_CHAR, rowTable, sizeof(rowTable), &indicator));
+		TRYODBC_STM(stm,
+			SQLGetData(hStmt, 4, SQL_C_CHAR, column.name, sizeof(column.name), &indicator));
+		TRYODBC_STM(stm,
+			SQLGetData(hStmt, 5, SQL_C_SSHORT, &column.sqlType, 0, &indicator));
+		TRYODBC_STM(stm,
+			SQLGetData(hStmt, 7, SQL_C_SLONG, &column.columnSize, 0, &indicator));
+		TRYODBC_STM(stm,
+			SQLGetData(hStmt, 9, SQL_C_SSHORT, &column.decimalDigits, 0, &indicator));
+		if (indicator == SQL_NULL_DATA) {
+			column.decimalDigits = 0;
+		}
+		TRYODBC_STM(stm,
+			SQLGetData(hStmt, 11, SQL_C_SSHORT, &column.nullable, 0, &indicator));
+		TRYODBC_STM(stm,
+			SQLGetData(hStmt, 17, SQL_C_SLONG, &column.ordinal, 0, &indicator));
+
+		if (tableName && (_stricmp(rowTable, tableName) != 0 || _stricmp(rowSchema, schemaName) != 0)) {
+			continue;
+		}
+
+		if (current == NULL || _stricmp(current->tableName, rowTable) != 0 || _stricmp(current->schemaName, rowSchema) != 0) {
+			// rows come ordered by schema, table and ordinal position
+			current = _MetadataNewTable(conn, rowSchema, rowTable);
+			if (current == NULL) {
+				_SetErrorText(conn, stm, "Out of memory");
+				goto Exit;
+			}
+			*last = current;
+			last = &current->next;
+		}
+
+		if (current->columnCount == current->columnCapacity) {
+			int							capacity = current->columnCapacity ? current->columnCapacity * 2 : 16;
+			SQLSERVER_METADATA_COLUMN * columns = mkMalloc(metadataHeap, capacity * sizeof(SQLSERVER_METADATA_COLUMN), __FILE__, __LINE__);
+			if (columns == NULL) {
+				_SetErrorText(conn, stm, "Out of memory");
+				goto Exit;
+			}
+			if (current->columns) {
+				memcpy(columns, current->columns, current->columnCount * sizeof(SQLSERVER_METADATA_COLUMN));
+				mkFree(metadataHeap, current->columns);
+			}
+			current->columns = columns;
+			current->columnCapacity = capacity;
+		}
+		current->columns[current->columnCount++] = column;
+	}
+
+Exit:
+	SQLFreeStmt(hStmt, SQL_CLOSE);
+	return !SQLSERVER_STATEMENT_OF(stm)->lastError.hasError;
+}
+
+/*	Reads a result set laid out as the one of SQLPrimaryKeys into the key positions of "tables" */
+BOOL
+_MetadataReadKeys(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLSERVER_METADATA_TABLE * tables
+)
+{
+	SQLHSTMT					hStmt = *stm->statement.sqlserver.hStmt;
+	SQLSERVER_METADATA_TABLE  * current = tables;
+	char						rowSchema[SQLSERVER_METADATA_NAME_LENGTH];
+	char						rowTable[SQLSERVER_METADATA_NAME_LENGTH];
+	char						rowColumn[SQLSERVER_METADATA_NAME_LENGTH];
+	SQLSMALLINT					keyPosition;
+	SQLLEN						indicator;
+	RETCODE						RetCode;
+
+	while (TRUE) {
+		TRYODBC_STM(stm,
+			RetCode = SQLFetch(hStmt));
+		if (RetCode == SQL_NO_DATA) {
+			break;
+		}
+		TRYODBC_STM(stm,
+			SQLGetData(hStmt, 2, SQL_C_CHAR, rowSchema, sizeof(rowSchema), &indicator));
+		if (indicator == SQL_NULL_DATA) {
+			rowSchema[0] = '\0';
+		}
+		TRYODBC_STM(stm,
+			SQLGetData(hStmt, 3, SQL_C_CHAR, rowTable, sizeof(rowTable), &indicator));
+		TRYODBC_STM(stm,
+			SQLGetData(hStmt, 4, SQL_C_CHAR, rowColumn, sizeof(rowColumn), &indicator));
+		TRYODBC_STM(stm,
+			SQLGetData(hStmt, 5, SQL_C_SSHORT, &keyPosition, 0, &indicator));
+
+		if (current == NULL || _stricmp(current->tableName, rowTable) != 0 || _stricmp(current->schemaName, rowSchema) != 0) {
+			// key rows are grouped by table, usually in the order the columns were read
+			for (current = tables; current; current = current->next) {
+				if (_stricmp(current->tableName, rowTable) == 0 && _stricmp(current->schemaName, rowSchema) == 0) {
+					break;
+				}
+			}
+			if (current == NULL) {
+				continue;
+			}
+		}
+		for (int iCol = 0; iCol < current->columnCount; iCol++) {
+			if (_stricmp(current->columns[iCol].name, rowColumn) == 0) {
+				current->columns[iCol].keyPosition = keyPosition;
+				current->keyColumnCount++;
+				break;
+			}
+		}
+	}
+
+Exit:
+	SQLFreeStmt(hStmt, SQL_CLOSE);
+	return !SQLSERVER_STATEMENT_OF(stm)->lastError.hasError;
+}
+
+/*	Moves the loaded tables into the cache, replacing older copies. Returns their count */
+int
+_MetadataPublish(
+	SQLSERVER_METADATA_TABLE * tables
+)
+{
+	int count = 0;
+
+	AcquireSRWLockExclusive(&metadataLock);
+	while (tables) {
+		SQLSERVER_METADATA_TABLE  * table = tables;
+		SQLSERVER_METADATA_TABLE ** bucket = &metadataBuckets[table->hash % SQLSERVER_METADATA_BUCKET_COUNT];
+
+		tables = table->next;
+
+		for (SQLSERVER_METADATA_TABLE ** existing = bucket; *existing; existing = &(*existing)->next) {
+			if ((*existing)->hash == table->hash && _MetadataMatches(*existing, table->connectionString, table->schemaName, table->tableName)) {
+				SQLSERVER_METADATA_TABLE * replaced = *existing;
+				*existing = replaced->next;
+				_MetadataFreeTable(replaced);
+				metadataStats.tableCount--;
+				break;
+			}
+		}
+		if (metadataStats.tableCount >= SQLSERVER_METADATA_MAX_TABLES) {
+			_MetadataClear();
+		}
+		table->next = *bucket;
+		*bucket = table;
+		metadataStats.tableCount++;
+		count++;
+	}
+	ReleaseSRWLockExclusive(&metadataLock);
+
+	return count;
+}
+
+/*	Reads "tableName" of "schemaName" from the catalog, or every table of the schema (of every schema when
+	"schemaName" is NULL) when "tableName" is NULL. Returns the number of tables cached, -1 on failure */
+int
+_MetadataLoad(
+	DBInt_Connection * conn,
+	const char * schemaName,
+	const char * tableName
+)
+{
+	SQLSERVER_METADATA_TABLE  * tables = NULL;
+	SQLWCHAR					wSchema[SQLSERVER_METADATA_NAME_LENGTH] = L"";
+	SQLWCHAR					wTable[SQLSERVER_METADATA_NAME_LENGTH] = L"";
+	SQLLEN						schemaIndicator = SQL_NTS;
+	int							count = -1;
+
+	if (!InitOnceExecuteOnce(&metadataInitOnce, _MetadataInit, NULL, NULL)) {
+		_SetErrorText(conn, NULL, "Unable to create the metadata cache heap");
+		return -1;
+	}
+
+	DBInt_Statement * stm = sqlserverCreateStatement(conn);
+	if (stm == NULL) {
+		return -1;
+	}
+	SQLHSTMT hStmt = *stm->statement.sqlserver.hStmt;
+
+	if (schemaName) {
+		mbstowcs_s(NULL, wSchema, SQLSERVER_METADATA_NAME_LENGTH, schemaName, _TRUNCATE);
+	}
+	else {
+		schemaIndicator = SQL_NULL_DATA;
+	}
+	if (tableName) {
+		mbstowcs_s(NULL, wTable, SQLSERVER_METADATA_NAME_LENGTH, tableName, _TRUNCATE);
+	}
+
+	TRYODBC_STM(stm,
+		SQLColumns(hStmt, NULL, 0, schemaName ? wSchema : NULL, SQL_NTS, tableName ? wTable : NULL, SQL_NTS, NULL, 0));
+	if (!_MetadataReadColumns(conn, stm, schemaName, tableName, &tables)) {
+		goto Exit;
+	}
+
+	if (tableName) {
+		if (tables == NULL) {
+			// remembered as missing, so that it is not looked up on every call
+			tables = _MetadataNewTable(conn, schemaName, tableName);
+			if (tables == NULL) {
+				_SetErrorText(conn, stm, "Out of memory");
+				goto Exit;
+			}
+		}
+		TRYODBC_STM(stm,
+			SQLPrimaryKeys(hStmt, NULL, 0, wSchema, SQL_NTS, wTable, SQL_NTS));
+	}
+	else {
+		// SQLPrimaryKeys needs a table name, one query covers them all
+		SQLWCHAR wSql[1024];
+		mbstowcs_s(NULL, wSql, _countof(wSql), metadataKeysSql, _TRUNCATE);
+
+		for (SQLUSMALLINT iParam = 1; iParam <= 2; iParam++) {
+			TRYODBC_STM(stm,
+				SQLBindParameter(hStmt, iParam, SQL_PARAM_INPUT, SQL_C_WCHAR, SQL_WVARCHAR, 128, 0, wSchema, sizeof(wSchema), &schemaIndicator));
+		}
+		TRYODBC_STM(stm,
+			SQLExecDirect(hStmt, wSql, SQL_NTS));
+	}
+	if (!_MetadataReadKeys(conn, stm, tables)) {
+		goto Exit;
+	}
+
+	count = _MetadataPublish(tables);
+	tables = NULL;
+
+Exit:
+	while (tables) {
+		SQLSERVER_METADATA_TABLE * next = tables->next;
+		_MetadataFreeTable(tables);
+		tables = next;
+	}
+	sqlserverFreeStatement(conn, stm);
+
+	return count;
+}
+
+/*	Returns the cached table with metadataLock held shared, loading it on a miss. Returns NULL, without the lock,
+	if it could not be loaded. Callers release with _MetadataRelease */
+SQLSERVER_METADATA_TABLE *
+_MetadataAcquire(
+	DBInt_Connection * conn,
+	const char * schemaName,
+	const char * tableName
+)
+{
+	if (schemaName == NULL || *schemaName == '\0') {
+		schemaName = SQLSERVER_METADATA_DEFAULT_SCHEMA;
+	}
+	if (tableName == NULL) {
+		return NULL;
+	}
+
+	unsigned long long hash = _MetadataHash(conn->connection_string, schemaName, tableName);
+
+	for (int attempt = 0; attempt < 2; attempt++) {
+		AcquireSRWLockShared(&metadataLock);
+		for (SQLSERVER_METADATA_TABLE * table = metadataBuckets[hash % SQLSERVER_METADATA_BUCKET_COUNT]; table; table = table->next) {
+			if (table->hash == hash && _MetadataMatches(table, conn->connection_string, schemaName, tableName)) {
+				if (attempt == 0) {
+					InterlockedIncrement64((LONG64 volatile*)&metadataStats.hits);
+				}
+				return table;
+			}
+		}
+		ReleaseSRWLockShared(&metadataLock);
+
+		if (attempt == 0) {
+			InterlockedIncrement64((LONG64 volatile*)&metadataStats.misses);
+			if (_MetadataLoad(conn, schemaName, tableName) < 0) {
+				break;
+			}
+		}
+	}
+	return NULL;
+}
+
+void
+_MetadataRelease(
+	void
+)
+{
+	ReleaseSRWLockShared(&metadataLock);
+}
+
+/*	Called with metadataLock held exclusively */
+void
+_MetadataClear(
+	void
+)
+{
+	for (int i = 0; i < SQLSERVER_METADATA_BUCKET_COUNT; i++) {
+		SQLSERVER_METADATA_TABLE * table = metadataBuckets[i];
+		while (table) {
+			SQLSERVER_METADATA_TABLE * next = table->next;
+			_MetadataFreeTable(table);
+			table = next;
+		}
+		metadataBuckets[i] = NULL;
+	}
+	metadataStats.tableCount = 0;
+}
+
+SQLSERVER_INTERFACE_API
+char *
+sqlserverGetPrimaryKeyColumn(
+	DBInt_Connection * mkDBConnection,
+	const char * schemaName,
+	const char * tableName,
+	int position
+)
+{
+	char * retval = NULL;
+
+	_ResetError(mkDBConnection, NULL);
+
+	SQLSERVER_METADATA_TABLE * table = _MetadataAcquire(mkDBConnection, schemaName, tableName);
+	if (table == NULL) {
+		return NULL;
+	}
+	for (int iCol = 0; iCol < table->columnCount; iCol++) {
+		if (table->columns[iCol].keyPosition == position) {
+			retval = mkStrdup(mkDBConnection->heapHandle, table->columns[iCol].name, __FILE__, __LINE__);
+			break;
+		}
+	}
+	_MetadataRelease();
+
+	return retval;
+}
+
+SQLSERVER_INTERFACE_API
+int
+sqlserverGetPrimaryKeyColumnCount(
+	DBInt_Connection * conn,
+	const char * schemaName,
+	const char * tableName
+)
+{
+	int count;
+
+	_ResetError(conn, NULL);
+
+	SQLSERVER_METADATA_TABLE * table = _MetadataAcquire(conn, schemaName, tableName);
+	if (table == NULL) {
+		return -1;
+	}
+	count = table->keyColumnCount;
+	_MetadataRelease();
+
+	return count;
+}
+
+SQLSERVER_INTERFACE_API
+int
+sqlserverGetTableColumnCount(
+	DBInt_Connection * conn,
+	const char * schemaName,
+	const char * tableName
+)
+{
+	int count;
+
+	_ResetError(conn, NULL);
+
+	SQLSERVER_METADATA_TABLE * table = _MetadataAcquire(conn, schemaName, tableName);
+	if (table == NULL) {
+		return -1;
+	}
+	count = table->columnCount;
+	_MetadataRelease();
+
+	return count;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverGetTableColumn(
+	DBInt_Connection * conn,
+	const char * schemaName,
+	const char * tableName,
+	int position,
+	SQLSERVER_METADATA_COLUMN * column
+)
+{
+	BOOL found = FALSE;
+
+	_ResetError(conn, NULL);
+
+	SQLSERVER_METADATA_TABLE * table = _MetadataAcquire(conn, schemaName, tableName);
+	if (table == NULL) {
+		return FALSE;
+	}
+	if (position >= 1 && position <= table->columnCount) {
+		*column = table->columns[position - 1];
+		found = TRUE;
+	}
+	_MetadataRelease();
+
+	return found;
+}
+
+SQLSERVER_INTERFACE_API
+int
+sqlserverPreloadMetadata(
+	DBInt_Connection * conn,
+	const char * schemaName
+)
+{
+	_ResetError(conn, NULL);
+
+	return _MetadataLoad(conn, schemaName, NULL);
+}
+
+SQLSERVER_INTERFACE_API
+int
+sqlserverInvalidateMetadata(
+	DBInt_Connection * conn,
+	const char * schemaName,
+	const char * tableName
+)
+{
+	int count = 0;
+
+	if (tableName && (schemaName == NULL || *schemaName == '\0')) {
+		schemaName = SQLSERVER_METADATA_DEFAULT_SCHEMA;
+	}
+
+	AcquireSRWLockExclusive(&metadataLock);
+	for (int i = 0; i < SQLSERVER_METADATA_BUCKET_COUNT; i++) {
+		SQLSERVER_METADATA_TABLE ** link = &metadataBuckets[i];
+		while (*link) {
+			SQLSERVER_METADATA_TABLE * table = *link;
+			if ((conn == NULL || wcscmp(table->connectionString, conn->connection_string) == 0)
+				&& (schemaName == NULL || _stricmp(table->schemaName, schemaName) == 0)
+				&& (tableName == NULL || _stricmp(table->tableName, tableName) == 0)) {
+				*link = table->next;
+				_MetadataFreeTable(table);
+				metadataStats.tableCount--;
+				count++;
+			}
+			else {
+				link = &table->next;
+			}
+		}
+	}
+	metadataStats.invalidations += count;
+	ReleaseSRWLockExclusive(&metadataLock);
+
+	return count;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverGetMetadataCacheStats(
+	SQLSERVER_METADATA_STATS * stats
+)
+{
+	AcquireSRWLockShared(&metadataLock);
+	*stats = metadataStats;
+	ReleaseSRWLockShared(&metadataLock);
+}
@@ -0,0 +1,102 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+#include "sqlserver-interface.h"
+
+#define SQLSERVER_METADATA_BUCKET_COUNT			1024
+/*	The cache is emptied when it reaches this size, tables in use are loaded again once */
+#define SQLSERVER_METADATA_MAX_TABLES			16384
+/*	sysname is 128 characters, converted to the ANSI code page */
+#define SQLSERVER_METADATA_NAME_LENGTH			256
+/*	Schema of tables looked up without one */
+#define SQLSERVER_METADATA_DEFAULT_SCHEMA		"dbo"
+
+/*	One row of SQLColumns */
+typedef struct _SQLSERVER_METADATA_COLUMN {
+	char				name[SQLSERVER_METADATA_NAME_LENGTH];
+	SQLSMALLINT			sqlType;
+	SQLINTEGER			columnSize;
+	SQLSMALLINT			decimalDigits;
+	SQLSMALLINT			nullable;
+	/*	1 based position in the table */
+	SQLINTEGER			ordinal;
+	/*	1 based position in the primary key, 0 if the column is not part of it */
+	SQLSMALLINT			keyPosition;
+} SQLSERVER_METADATA_COLUMN;
+
+/*	Columns and primary key of a table. A table that does not exist is cached with no columns */
+typedef struct _SQLSERVER_METADATA_TABLE {
+	struct _SQLSERVER_METADATA_TABLE * next;
+	unsigned long long				hash;
+	/*	connection string of the connection that loaded it */
+	SQLWCHAR					  * connectionString;
+	char							schemaName[SQLSERVER_METADATA_NAME_LENGTH];
+	char							tableName[SQLSERVER_METADATA_NAME_LENGTH];
+	int								columnCount;
+	int								columnCapacity;
+	int								keyColumnCount;
+	SQLSERVER_METADATA_COLUMN	  * columns;
+} SQLSERVER_METADATA_TABLE;
+
+typedef struct _SQLSERVER_METADATA_STATS {
+	unsigned long long	hits;
+	/*	lookups that went to the server */
+	unsigned long long	misses;
+	unsigned long long	invalidations;
+	unsigned long long	tableCount;
+} SQLSERVER_METADATA_STATS;
+
+/* DDL's PRIVATE FUNCTIONS  */
+unsigned long long			_MetadataHash(const SQLWCHAR* connectionString, const char* schemaName, const char* tableName);
+BOOL						_MetadataMatches(SQLSERVER_METADATA_TABLE* table, const SQLWCHAR* connectionString, const char* schemaName, const char* tableName);
+SQLSERVER_METADATA_TABLE  * _MetadataNewTable(DBInt_Connection* conn, const char* schemaName, const char* tableName);
+void						_MetadataFreeTable(SQLSERVER_METADATA_TABLE* table);
+BOOL						_MetadataReadColumns(DBInt_Connection* conn, DBInt_Statement* stm, const char* schemaName, const char* tableName, SQLSERVER_METADATA_TABLE** tables);
+BOOL						_MetadataReadKeys(DBInt_Connection* conn, DBInt_Statement* stm, SQLSERVER_METADATA_TABLE* tables);
+int							_MetadataPublish(SQLSERVER_METADATA_TABLE* tables);
+int							_MetadataLoad(DBInt_Connection* conn, const char* schemaName, const char* tableName);
+SQLSERVER_METADATA_TABLE  * _MetadataAcquire(DBInt_Connection* conn, const char* schemaName, const char* tableName);
+void						_MetadataRelease(void);
+void						_MetadataClear(void);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Loads the columns and primary keys of every table of "schemaName" (every schema when NULL) with two round trips,
+	so that later lookups on connections with the same connection string are served from memory.
+	Returns the number of tables loaded, -1 on failure */
+SQLSERVER_INTERFACE_API int						sqlserverPreloadMetadata(DBInt_Connection* conn, const char* schemaName);
+
+/*	Forgets "tableName", every table of "schemaName" when "tableName" is NULL, or everything when both are NULL.
+	"conn" NULL applies to every connection string. Returns the number of tables removed */
+SQLSERVER_INTERFACE_API int						sqlserverInvalidateMetadata(DBInt_Connection* conn, const char* schemaName, const char* tableName);
+
+/*	Number of primary key columns, 0 if there is no key, -1 on failure */
+SQLSERVER_INTERFACE_API int						sqlserverGetPrimaryKeyColumnCount(DBInt_Connection* conn, const char* schemaName, const char* tableName);
+
+/*	Number of columns, 0 if the table does not exist, -1 on failure */
+SQLSERVER_INTERFACE_API int						sqlserverGetTableColumnCount(DBInt_Connection* conn, const char* schemaName, const char* tableName);
+
+/*	Copies the column at the 1 based "position" of the table into "column" */
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverGetTableColumn(
+	DBInt_Connection* conn,
+	const char* schemaName,
+	const char* tableName,
+	int position,
+	SQLSERVER_METADATA_COLUMN* column);
+
+SQLSERVER_INTERFACE_API void					sqlserverGetMetadataCacheStats(SQLSERVER_METADATA_STATS* stats);
@@ -0,0 +1,90 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+#pragma once
+
+#include "sqlserver-odbc.h"
+
+/*	Included by the driver's sources only, after "sqlserver-interface.h". Applications calling the ODBC API
+	themselves keep the functions of their own driver manager */
+
+/*	Resolved entry points, the stubs until _OdbcResolveAll ran */
+extern SQLSERVER_ODBC	sqlserverOdbc;
+
+/*	Calls to the ODBC API anywhere in the driver go through the table */
+#undef SQLAllocHandle
+#undef SQLBindCol
+#undef SQLBindParameter
+#undef SQLCancel
+#undef SQLColAttribute
+#undef SQLColumns
+#undef SQLDescribeCol
+#undef SQLDescribeParam
+#undef SQLDisconnect
+#undef SQLDriverConnect
+#undef SQLExecDirect
+#undef SQLExecute
+#undef SQLFetch
+#undef SQLFetchScroll
+#undef SQLFreeHandle
+#undef SQLFreeStmt
+#undef SQLGetConnectAttr
+#undef SQLGetData
+#undef SQLGetDiagRec
+#undef SQLGetStmtAttr
+#undef SQLMoreResults
+#undef SQLNumParams
+#undef SQLNumResultCols
+#undef SQLPrepare
+#undef SQLPrimaryKeys
+#undef SQLRowCount
+#undef SQLSetConnectAttr
+#undef SQLSetDescField
+#undef SQLSetEnvAttr
+#undef SQLSetStmtAttr
+
+#define SQLAllocHandle			(sqlserverOdbc.AllocHandle)
+#define SQLBindCol				(sqlserverOdbc.BindCol)
+#define SQLBindParameter		(sqlserverOdbc.BindParameter)
+#define SQLCancel				(sqlserverOdbc.Cancel)
+#define SQLColAttribute			(sqlserverOdbc.ColAttribute)
+#define SQLColumns				(sqlserverOdbc.Columns)
+#define SQLDescribeCol			(sqlserverOdbc.DescribeCol)
+#define SQLDescribeParam		(sqlserverOdbc.DescribeParam)
+#define SQLDisconnect			(sqlserverOdbc.Disconnect)
+#define SQLDriverConnect		(sqlserverOdbc.DriverConnect)
+#define SQLExecDirect			(sqlserverOdbc.ExecDirect)
+#define SQLExecute				(sqlserverOdbc.Execute)
+#define SQLFetch				(sqlserverOdbc.Fetch)
+#define SQLFetchScroll			(sqlserverOdbc.FetchScroll)
+#define SQLFreeHandle			(sqlserverOdbc.FreeHandle)
+#define SQLFreeStmt				(sqlserverOdbc.FreeStmt)
+#define SQLGetConnectAttr		(sqlserverOdbc.GetConnectAttr)
+#define SQLGetData				(sqlserverOdbc.GetData)
+#define SQLGetDiagRec			(sqlserverOdbc.GetDiagRec)
+#define SQLGetStmtAttr			(sqlserverOdbc.GetStmtAttr)
+#define SQLMoreResults			(sqlserverOdbc.MoreResults)
+#define SQLNumParams			(sqlserverOdbc.NumParams)
+#define SQLNumResultCols		(sqlserverOdbc.NumResultCols)
+#define SQLPrepare				(sqlserverOdbc.Prepare)
+#define SQLPrimaryKeys			(sqlserverOdbc.PrimaryKeys)
+#define SQLRowCount				(sqlserverOdbc.RowCount)
+#define SQLSetConnectAttr		(sqlserverOdbc.SetConnectAttr)
+#define SQLSetDescField			(sqlserverOdbc.SetDescField)
+#define SQLSetEnvAttr			(sqlserverOdbc.SetEnvAttr)
+#define SQLSetStmtAttr			(sqlserverOdbc.SetStmtAttr)
+
+/* DDL's PRIVATE FUNCTIONS  */
+void			_OdbcResolve(HMODULE module, const char* exportName, FARPROC installed, FARPROC stub, FARPROC* slot);
+BOOL CALLBACK	_OdbcResolveAll(PINIT_ONCE initOnce, PVOID parameter, PVOID* context);
+BOOL			_OdbcLoad(void);
@@ -0,0 +1,156 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+
+#define SQLSERVER_ODBC_STUB(member, exportName, parameters, missing) \
+	SQLRETURN SQL_API _OdbcMissing##member parameters { return missing; }
+#define SQLSERVER_ODBC_STUB_ENTRY(member, exportName, parameters, missing)	_OdbcMissing##member,
+#define SQLSERVER_ODBC_RESOLVE(member, exportName, parameters, missing) \
+	_OdbcResolve(module, exportName, odbcInstalled ? (FARPROC)odbcInstalledFunctions.member : NULL, (FARPROC)_OdbcMissing##member, (FARPROC*)&sqlserverOdbc.member);
+
+/*	Stand-ins for functions that could not be resolved */
+SQLSERVER_ODBC_FUNCTION_LIST(SQLSERVER_ODBC_STUB)
+
+SQLSERVER_ODBC				sqlserverOdbc = { SQLSERVER_ODBC_FUNCTION_LIST(SQLSERVER_ODBC_STUB_ENTRY) };
+INIT_ONCE					odbcInitOnce = INIT_ONCE_STATIC_INIT;
+
+/*	Guards the settings below, which are read once by _OdbcResolveAll */
+SRWLOCK						odbcLock = SRWLOCK_INIT;
+char						odbcLibrary[MAX_PATH] = SQLSERVER_ODBC_DEFAULT_LIBRARY;
+BOOL						odbcInstalled;
+SQLSERVER_ODBC				odbcInstalledFunctions;
+BOOL						odbcResolved;
+/*	kept loaded for the lifetime of the process */
+HMODULE						odbcModule;
+SQLSERVER_ODBC_STATUS		odbcStatus;
+
+
+void
+_OdbcResolve(
+	HMODULE module,
+	const char * exportName,
+	FARPROC installed,
+	FARPROC stub,
+	FARPROC * slot
+)
+{
+	FARPROC function = module ? GetProcAddress(module, exportName) : installed;
+
+	if (function == NULL) {
+		if (module) {
+			mkCoreDebug(__FILE__, __LINE__, "\nDBInt_SqlServer.dll says: Function not found : ", exportName, NULL);
+		}
+		odbcStatus.missing[odbcStatus.missingCount++] = exportName;
+		function = stub;
+	}
+	*slot = function;
+}
+
+BOOL CALLBACK
+_OdbcResolveAll(
+	PINIT_ONCE initOnce,
+	PVOID parameter,
+	PVOID * context
+)
+{
+	HMODULE module = NULL;
+
+	AcquireSRWLockExclusive(&odbcLock);
+	memset(&odbcStatus, 0, sizeof(SQLSERVER_ODBC_STATUS));
+
+	if (!odbcInstalled) {
+		strcpy_s(odbcStatus.library, MAX_PATH, odbcLibrary);
+		module = LoadLibraryA(odbcLibrary);
+		if (module == NULL) {
+			mkCoreDebug(__FILE__, __LINE__, "\nDBInt_SqlServer.dll says: DLL not found : ", odbcLibrary, NULL);
+		}
+		odbcModule = module;
+	}
+
+	SQLSERVER_ODBC_FUNCTION_LIST(SQLSERVER_ODBC_RESOLVE)
+
+	odbcStatus.resolved = odbcInstalled || module != NULL;
+	odbcResolved = TRUE;
+	ReleaseSRWLockExclusive(&odbcLock);
+
+	// never fails, a missing library leaves the stubs in place
+	return TRUE;
+}
+
+/*	Resolves the functions on first call. FALSE if the driver manager could not be loaded */
+BOOL
+_OdbcLoad(
+	void
+)
+{
+	InitOnceExecuteOnce(&odbcInitOnce, _OdbcResolveAll, NULL, NULL);
+	return odbcStatus.resolved;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverSetOdbcLibrary(
+	const char * libraryName
+)
+{
+	BOOL changed = FALSE;
+
+	AcquireSRWLockExclusive(&odbcLock);
+	if (!odbcResolved) {
+		strcpy_s(odbcLibrary, MAX_PATH, libraryName ? libraryName : SQLSERVER_ODBC_DEFAULT_LIBRARY);
+		odbcInstalled = FALSE;
+		changed = TRUE;
+	}
+	ReleaseSRWLockExclusive(&odbcLock);
+
+	return changed;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverInstallOdbcFunctions(
+	const SQLSERVER_ODBC * functions
+)
+{
+	BOOL changed = FALSE;
+
+	AcquireSRWLockExclusive(&odbcLock);
+	if (!odbcResolved) {
+		odbcInstalledFunctions = *functions;
+		odbcInstalled = TRUE;
+		changed = TRUE;
+	}
+	ReleaseSRWLockExclusive(&odbcLock);
+
+	return changed;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverGetOdbcStatus(
+	SQLSERVER_ODBC_STATUS * status
+)
+{
+	_OdbcLoad();
+
+	AcquireSRWLockShared(&odbcLock);
+	*status = odbcStatus;
+	ReleaseSRWLockShared(&odbcLock);
+}
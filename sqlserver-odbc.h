@@ -0,0 +1,89 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+#pragma once
+
+#include "..\DBInt\db-interface.h"
+
+/*	ODBC entry points are not imported. They are resolved once, before the environment is allocated, from the
+	driver manager named with sqlserverSetOdbcLibrary or taken from a table given to sqlserverInstallOdbcFunctions.
+	Functions that cannot be resolved are replaced by stubs that fail, so a missing export is reported as an
+	ordinary ODBC error instead of a crash */
+#define SQLSERVER_ODBC_DEFAULT_LIBRARY		"odbc32.dll"
+
+/*	X(member, exported name, parameters, result of the stub used when the export is missing).
+	The Unicode exports are resolved, the driver is built with UNICODE */
+#define SQLSERVER_ODBC_FUNCTION_LIST(X) \
+	X(AllocHandle,		"SQLAllocHandle",		(SQLSMALLINT HandleType, SQLHANDLE InputHandle, SQLHANDLE* OutputHandle), SQL_ERROR) \
+	X(BindCol,			"SQLBindCol",			(SQLHSTMT StatementHandle, SQLUSMALLINT ColumnNumber, SQLSMALLINT TargetType, SQLPOINTER TargetValue, SQLLEN BufferLength, SQLLEN* StrLen_or_Ind), SQL_ERROR) \
+	X(BindParameter,	"SQLBindParameter",		(SQLHSTMT StatementHandle, SQLUSMALLINT ParameterNumber, SQLSMALLINT InputOutputType, SQLSMALLINT ValueType, SQLSMALLINT ParameterType, SQLULEN ColumnSize, SQLSMALLINT DecimalDigits, SQLPOINTER ParameterValue, SQLLEN BufferLength, SQLLEN* StrLen_or_Ind), SQL_ERROR) \
+	X(Cancel,			"SQLCancel",			(SQLHSTMT StatementHandle), SQL_ERROR) \
+	X(ColAttribute,		"SQLColAttributeW",		(SQLHSTMT StatementHandle, SQLUSMALLINT ColumnNumber, SQLUSMALLINT FieldIdentifier, SQLPOINTER CharacterAttribute, SQLSMALLINT BufferLength, SQLSMALLINT* StringLength, SQLLEN* NumericAttribute), SQL_ERROR) \
+	X(Columns,			"SQLColumnsW",			(SQLHSTMT StatementHandle, SQLWCHAR* CatalogName, SQLSMALLINT NameLength1, SQLWCHAR* SchemaName, SQLSMALLINT NameLength2, SQLWCHAR* TableName, SQLSMALLINT NameLength3, SQLWCHAR* ColumnName, SQLSMALLINT NameLength4), SQL_ERROR) \
+	X(DescribeCol,		"SQLDescribeColW",		(SQLHSTMT StatementHandle, SQLUSMALLINT ColumnNumber, SQLWCHAR* ColumnName, SQLSMALLINT BufferLength, SQLSMALLINT* NameLength, SQLSMALLINT* DataType, SQLULEN* ColumnSize, SQLSMALLINT* DecimalDigits, SQLSMALLINT* Nullable), SQL_ERROR) \
+	X(DescribeParam,	"SQLDescribeParam",		(SQLHSTMT StatementHandle, SQLUSMALLINT ParameterNumber, SQLSMALLINT* DataType, SQLULEN* ParameterSize, SQLSMALLINT* DecimalDigits, SQLSMALLINT* Nullable), SQL_ERROR) \
+	X(Disconnect,		"SQLDisconnect",		(SQLHDBC ConnectionHandle), SQL_ERROR) \
+	X(DriverConnect,	"SQLDriverConnectW",	(SQLHDBC ConnectionHandle, SQLHWND WindowHandle, SQLWCHAR* InConnectionString, SQLSMALLINT StringLength1, SQLWCHAR* OutConnectionString, SQLSMALLINT BufferLength, SQLSMALLINT* StringLength2Ptr, SQLUSMALLINT DriverCompletion), SQL_ERROR) \
+	X(ExecDirect,		"SQLExecDirectW",		(SQLHSTMT StatementHandle, SQLWCHAR* StatementText, SQLINTEGER TextLength), SQL_ERROR) \
+	X(Execute,			"SQLExecute",			(SQLHSTMT StatementHandle), SQL_ERROR) \
+	X(Fetch,			"SQLFetch",				(SQLHSTMT StatementHandle), SQL_ERROR) \
+	X(FetchScroll,		"SQLFetchScroll",		(SQLHSTMT StatementHandle, SQLSMALLINT FetchOrientation, SQLLEN FetchOffset), SQL_ERROR) \
+	X(FreeHandle,		"SQLFreeHandle",		(SQLSMALLINT HandleType, SQLHANDLE Handle), SQL_ERROR) \
+	X(FreeStmt,			"SQLFreeStmt",			(SQLHSTMT StatementHandle, SQLUSMALLINT Option), SQL_ERROR) \
+	X(GetConnectAttr,	"SQLGetConnectAttrW",	(SQLHDBC ConnectionHandle, SQLINTEGER Attribute, SQLPOINTER Value, SQLINTEGER BufferLength, SQLINTEGER* StringLength), SQL_ERROR) \
+	X(GetData,			"SQLGetData",			(SQLHSTMT StatementHandle, SQLUSMALLINT ColumnNumber, SQLSMALLINT TargetType, SQLPOINTER TargetValue, SQLLEN BufferLength, SQLLEN* StrLen_or_Ind), SQL_ERROR) \
+	X(GetDiagRec,		"SQLGetDiagRecW",		(SQLSMALLINT HandleType, SQLHANDLE Handle, SQLSMALLINT RecNumber, SQLWCHAR* Sqlstate, SQLINTEGER* NativeError, SQLWCHAR* MessageText, SQLSMALLINT BufferLength, SQLSMALLINT* TextLength), SQL_NO_DATA) \
+	X(GetStmtAttr,		"SQLGetStmtAttrW",		(SQLHSTMT StatementHandle, SQLINTEGER Attribute, SQLPOINTER Value, SQLINTEGER BufferLength, SQLINTEGER* StringLength), SQL_ERROR) \
+	X(MoreResults,		"SQLMoreResults",		(SQLHSTMT StatementHandle), SQL_ERROR) \
+	X(NumParams,		"SQLNumParams",			(SQLHSTMT StatementHandle, SQLSMALLINT* ParameterCount), SQL_ERROR) \
+	X(NumResultCols,	"SQLNumResultCols",		(SQLHSTMT StatementHandle, SQLSMALLINT* ColumnCount), SQL_ERROR) \
+	X(Prepare,			"SQLPrepareW",			(SQLHSTMT StatementHandle, SQLWCHAR* StatementText, SQLINTEGER TextLength), SQL_ERROR) \
+	X(PrimaryKeys,		"SQLPrimaryKeysW",		(SQLHSTMT StatementHandle, SQLWCHAR* CatalogName, SQLSMALLINT NameLength1, SQLWCHAR* SchemaName, SQLSMALLINT NameLength2, SQLWCHAR* TableName, SQLSMALLINT NameLength3), SQL_ERROR) \
+	X(RowCount,			"SQLRowCount",			(SQLHSTMT StatementHandle, SQLLEN* RowCount), SQL_ERROR) \
+	X(SetConnectAttr,	"SQLSetConnectAttrW",	(SQLHDBC ConnectionHandle, SQLINTEGER Attribute, SQLPOINTER Value, SQLINTEGER StringLength), SQL_ERROR) \
+	X(SetDescField,		"SQLSetDescFieldW",		(SQLHDESC DescriptorHandle, SQLSMALLINT RecNumber, SQLSMALLINT FieldIdentifier, SQLPOINTER Value, SQLINTEGER BufferLength), SQL_ERROR) \
+	X(SetEnvAttr,		"SQLSetEnvAttr",		(SQLHENV EnvironmentHandle, SQLINTEGER Attribute, SQLPOINTER Value, SQLINTEGER StringLength), SQL_ERROR) \
+	X(SetStmtAttr,		"SQLSetStmtAttrW",		(SQLHSTMT StatementHandle, SQLINTEGER Attribute, SQLPOINTER Value, SQLINTEGER StringLength), SQL_ERROR)
+
+#define SQLSERVER_ODBC_MEMBER(member, exportName, parameters, missing)		SQLRETURN (SQL_API * member) parameters;
+#define SQLSERVER_ODBC_ONE(member, exportName, parameters, missing)			+ 1
+
+#define SQLSERVER_ODBC_FUNCTION_COUNT	(0 SQLSERVER_ODBC_FUNCTION_LIST(SQLSERVER_ODBC_ONE))
+
+/*	Entry points used by the driver. Also the layout of an in-process driver given to sqlserverInstallOdbcFunctions */
+typedef struct _SQLSERVER_ODBC {
+	SQLSERVER_ODBC_FUNCTION_LIST(SQLSERVER_ODBC_MEMBER)
+} SQLSERVER_ODBC;
+
+typedef struct _SQLSERVER_ODBC_STATUS {
+	/*	FALSE before the first connection and when the library could not be loaded */
+	BOOL			resolved;
+	/*	empty for functions installed with sqlserverInstallOdbcFunctions */
+	char			library[MAX_PATH];
+	int				missingCount;
+	/*	exported names of the functions replaced by stubs */
+	const char	  * missing[SQLSERVER_ODBC_FUNCTION_COUNT];
+} SQLSERVER_ODBC_STATUS;
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Driver manager to load on first use instead of SQLSERVER_ODBC_DEFAULT_LIBRARY, e.g. a unixODBC build
+	("libodbc-2.dll") or a stub driver DLL. Returns FALSE once the functions are resolved */
+SQLSERVER_INTERFACE_API BOOL					sqlserverSetOdbcLibrary(const char* libraryName);
+
+/*	Uses the functions of "functions" instead of loading a library, for in-process fake drivers in tests and
+	benchmarks. NULL members become stubs. Returns FALSE once the functions are resolved */
+SQLSERVER_INTERFACE_API BOOL					sqlserverInstallOdbcFunctions(const SQLSERVER_ODBC* functions);
+
+/*	Resolves the functions if that did not happen yet and describes the outcome */
+SQLSERVER_INTERFACE_API void					sqlserverGetOdbcStatus(SQLSERVER_ODBC_STATUS* status);
@@ -0,0 +1,212 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-parameters.h"
+
+
+/*	Entries outlive the connections that described them, so they get a heap of their own */
+HANDLE								parameterCacheHeap = NULL;
+INIT_ONCE							parameterCacheInitOnce = INIT_ONCE_STATIC_INIT;
+
+SRWLOCK								parameterCacheLock = SRWLOCK_INIT;
+SQLSERVER_PARAMETER_CACHE_ENTRY	  * parameterCacheBuckets[SQLSERVER_PARAMETER_CACHE_BUCKET_COUNT];
+SQLSERVER_PARAMETER_CACHE_STATS		parameterCacheStats;
+
+
+BOOL CALLBACK
+_ParameterCacheInit(
+	PINIT_ONCE initOnce,
+	PVOID parameter,
+	PVOID * context
+)
+{
+	parameterCacheHeap = HeapCreate(0, 0, 0);
+	return parameterCacheHeap != NULL;
+}
+
+/*	FNV-1a of the connection string followed by the SQL text */
+unsigned long long
+_ParameterCacheHash(
+	DBInt_Connection * conn,
+	const char * sql,
+	size_t * keyLength
+)
+{
+	unsigned long long	hash = 14695981039346656037ULL;
+	const char		  * bytes = (const char*)conn->connection_string;
+	size_t				connectionLength = (wcslen(conn->connection_string) + 1) * sizeof(SQLWCHAR);
+	size_t				sqlLength = strlen(sql);
+
+	for (size_t i = 0; i < connectionLength; i++) {
+		hash ^= (unsigned char)bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	for (size_t i = 0; i < sqlLength; i++) {
+		hash ^= (unsigned char)sql[i];
+		hash *= 1099511628211ULL;
+	}
+	*keyLength = connectionLength + sqlLength;
+	return hash;
+}
+
+BOOL
+_ParameterCacheMatches(
+	SQLSERVER_PARAMETER_CACHE_ENTRY * entry,
+	DBInt_Connection * conn,
+	const char * sql,
+	unsigned long long hash,
+	size_t keyLength
+)
+{
+	size_t connectionLength = (wcslen(conn->connection_string) + 1) * sizeof(SQLWCHAR);
+
+	return entry->hash == hash
+		&& entry->keyLength == keyLength
+		&& memcmp(entry->key, conn->connection_string, connectionLength) == 0
+		&& memcmp(entry->key + connectionLength, sql, keyLength - connectionLength) == 0;
+}
+
+/*	Fills the statement's parameters from the cache. Returns FALSE on a miss */
+BOOL
+_ParameterCacheGet(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql
+)
+{
+	SQLSERVER_PARAMETER_CACHE_ENTRY * entry;
+	size_t							  keyLength;
+	unsigned long long				  hash = _ParameterCacheHash(conn, sql, &keyLength);
+	BOOL							  found = FALSE;
+
+	AcquireSRWLockShared(&parameterCacheLock);
+	for (entry = parameterCacheBuckets[hash % SQLSERVER_PARAMETER_CACHE_BUCKET_COUNT]; entry; entry = entry->next) {
+		if (_ParameterCacheMatches(entry, conn, sql, hash, keyLength)) {
+			stm->statement.sqlserver.ParameterCount = entry->parameterCount;
+			_AllocateParameters(conn, stm);
+			if (entry->parameterCount > 0) {
+				memcpy(SQLSERVER_STATEMENT_OF(stm)->parameters, entry->parameters, entry->parameterCount * sizeof(SQLSERVER_PARAMETER));
+			}
+			found = TRUE;
+			break;
+		}
+	}
+	ReleaseSRWLockShared(&parameterCacheLock);
+
+	if (found) {
+		InterlockedIncrement64((LONG64 volatile*)&parameterCacheStats.hits);
+	}
+	else {
+		InterlockedIncrement64((LONG64 volatile*)&parameterCacheStats.misses);
+	}
+	return found;
+}
+
+/*	Remembers the parameters just described on the statement */
+void
+_ParameterCachePut(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql
+)
+{
+	SQLSMALLINT		count = stm->statement.sqlserver.ParameterCount;
+	size_t			keyLength;
+	size_t			connectionLength = (wcslen(conn->connection_string) + 1) * sizeof(SQLWCHAR);
+
+	if (!InitOnceExecuteOnce(&parameterCacheInitOnce, _ParameterCacheInit, NULL, NULL)) {
+		return;
+	}
+
+	unsigned long long hash = _ParameterCacheHash(conn, sql, &keyLength);
+
+	SQLSERVER_PARAMETER_CACHE_ENTRY * entry = mkMalloc(parameterCacheHeap,
+		sizeof(SQLSERVER_PARAMETER_CACHE_ENTRY) + count * sizeof(SQLSERVER_PARAMETER) + keyLength, __FILE__, __LINE__);
+	if (entry == NULL) {
+		return;
+	}
+	entry->hash = hash;
+	entry->keyLength = keyLength;
+	entry->parameterCount = count;
+	entry->parameters = (SQLSERVER_PARAMETER*)(entry + 1);
+	entry->key = (char*)(entry->parameters + count);
+	if (count > 0) {
+		memcpy(entry->parameters, SQLSERVER_STATEMENT_OF(stm)->parameters, count * sizeof(SQLSERVER_PARAMETER));
+	}
+	memcpy(entry->key, conn->connection_string, connectionLength);
+	memcpy(entry->key + connectionLength, sql, keyLength - connectionLength);
+
+	AcquireSRWLockExclusive(&parameterCacheLock);
+	SQLSERVER_PARAMETER_CACHE_ENTRY ** bucket = &parameterCacheBuckets[hash % SQLSERVER_PARAMETER_CACHE_BUCKET_COUNT];
+	for (SQLSERVER_PARAMETER_CACHE_ENTRY * existing = *bucket; existing; existing = existing->next) {
+		if (_ParameterCacheMatches(existing, conn, sql, hash, keyLength)) {
+			// described by another thread meanwhile
+			ReleaseSRWLockExclusive(&parameterCacheLock);
+			mkFree(parameterCacheHeap, entry);
+			return;
+		}
+	}
+	if (parameterCacheStats.entryCount >= SQLSERVER_PARAMETER_CACHE_MAX_ENTRIES) {
+		_ParameterCacheClear();
+	}
+	entry->next = *bucket;
+	*bucket = entry;
+	parameterCacheStats.entryCount++;
+	ReleaseSRWLockExclusive(&parameterCacheLock);
+}
+
+/*	Called with parameterCacheLock held exclusively */
+void
+_ParameterCacheClear(
+	void
+)
+{
+	for (int i = 0; i < SQLSERVER_PARAMETER_CACHE_BUCKET_COUNT; i++) {
+		SQLSERVER_PARAMETER_CACHE_ENTRY * entry = parameterCacheBuckets[i];
+		while (entry) {
+			SQLSERVER_PARAMETER_CACHE_ENTRY * next = entry->next;
+			mkFree(parameterCacheHeap, entry);
+			entry = next;
+		}
+		parameterCacheBuckets[i] = NULL;
+	}
+	parameterCacheStats.entryCount = 0;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverClearParameterCache(
+	void
+)
+{
+	AcquireSRWLockExclusive(&parameterCacheLock);
+	_ParameterCacheClear();
+	ReleaseSRWLockExclusive(&parameterCacheLock);
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverGetParameterCacheStats(
+	SQLSERVER_PARAMETER_CACHE_STATS * stats
+)
+{
+	AcquireSRWLockShared(&parameterCacheLock);
+	*stats = parameterCacheStats;
+	ReleaseSRWLockShared(&parameterCacheLock);
+}
@@ -0,0 +1,52 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+#include "sqlserver-interface.h"
+
+#define SQLSERVER_PARAMETER_CACHE_BUCKET_COUNT		256
+/*	The cache is emptied when it reaches this size, statements in use describe themselves again once */
+#define SQLSERVER_PARAMETER_CACHE_MAX_ENTRIES		4096
+
+/*	Described parameters of one SQL text, followed in memory by the key and the parameter array */
+typedef struct _SQLSERVER_PARAMETER_CACHE_ENTRY {
+	struct _SQLSERVER_PARAMETER_CACHE_ENTRY * next;
+	unsigned long long		hash;
+	/*	connection string and SQL text */
+	char				  * key;
+	size_t					keyLength;
+	SQLSMALLINT				parameterCount;
+	SQLSERVER_PARAMETER	  * parameters;
+} SQLSERVER_PARAMETER_CACHE_ENTRY;
+
+typedef struct _SQLSERVER_PARAMETER_CACHE_STATS {
+	unsigned long long	hits;
+	unsigned long long	misses;
+	unsigned long long	entryCount;
+} SQLSERVER_PARAMETER_CACHE_STATS;
+
+/* DDL's PRIVATE FUNCTIONS  */
+unsigned long long		_ParameterCacheHash(DBInt_Connection* conn, const char* sql, size_t* keyLength);
+BOOL					_ParameterCacheMatches(SQLSERVER_PARAMETER_CACHE_ENTRY* entry, DBInt_Connection* conn, const char* sql, unsigned long long hash, size_t keyLength);
+BOOL					_ParameterCacheGet(DBInt_Connection* conn, DBInt_Statement* stm, const char* sql);
+void					_ParameterCachePut(DBInt_Connection* conn, DBInt_Statement* stm, const char* sql);
+void					_ParameterCacheClear(void);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Forgets every described parameter list, e.g. after a schema change */
+SQLSERVER_INTERFACE_API void					sqlserverClearParameterCache(void);
+
+SQLSERVER_INTERFACE_API void					sqlserverGetParameterCacheStats(SQLSERVER_PARAMETER_CACHE_STATS* stats);
@@ -0,0 +1,254 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+#include "sqlserver-cache.h"
+#include "sqlserver-direct.h"
+#include "sqlserver-pipeline.h"
+
+
+void
+_PipelineStart(
+	SQLSERVER_PIPELINE * pipeline,
+	SQLSERVER_PIPELINE_ENTRY * entry
+)
+{
+	DBInt_Connection  * conn = pipeline->conn;
+	DBInt_Statement	  * stm = entry->stm;
+
+	_ResetError(conn, stm);
+
+	if (_CacheExecute(conn, stm)) {
+		// served from the result cache
+		entry->state = SQLSERVER_PIPELINE_COMPLETED;
+		return;
+	}
+
+	// drivers without asynchronous execution make this a plain synchronous execution
+	entry->async = SQL_SUCCEEDED(SQLSetStmtAttr(*stm->statement.sqlserver.hStmt, SQL_ATTR_ASYNC_ENABLE, (SQLPOINTER)SQL_ASYNC_ENABLE_ON, 0));
+	entry->state = SQLSERVER_PIPELINE_EXECUTING;
+
+	RETCODE RetCode = _BeginExecute(conn, stm);
+
+	if (RetCode != SQL_STILL_EXECUTING) {
+		_PipelineComplete(pipeline, entry, RetCode);
+	}
+}
+
+void
+_PipelinePoll(
+	SQLSERVER_PIPELINE * pipeline,
+	SQLSERVER_PIPELINE_ENTRY * entry
+)
+{
+	// calling the execute function again with the same arguments polls the pending execution
+	RETCODE RetCode = _PollExecute(pipeline->conn, entry->stm);
+
+	if (RetCode != SQL_STILL_EXECUTING) {
+		_PipelineComplete(pipeline, entry, RetCode);
+	}
+}
+
+void
+_PipelineComplete(
+	SQLSERVER_PIPELINE * pipeline,
+	SQLSERVER_PIPELINE_ENTRY * entry,
+	RETCODE RetCode
+)
+{
+	DBInt_Connection  * conn = pipeline->conn;
+	DBInt_Statement	  * stm = entry->stm;
+
+	if (entry->async) {
+		// the caller fetches synchronously
+		SQLSetStmtAttr(*stm->statement.sqlserver.hStmt, SQL_ATTR_ASYNC_ENABLE, (SQLPOINTER)SQL_ASYNC_ENABLE_OFF, 0);
+		entry->async = FALSE;
+	}
+
+	_ResetError(conn, stm);
+	_CompleteExecute(conn, stm, RetCode);
+
+	entry->state = SQLSERVER_PIPELINE_COMPLETED;
+}
+
+SQLSERVER_INTERFACE_API
+SQLSERVER_PIPELINE *
+sqlserverPipelineCreate(
+	DBInt_Connection * conn
+)
+{
+	SQLSERVER_PIPELINE * pipeline = mkMalloc(conn->heapHandle, sizeof(SQLSERVER_PIPELINE), __FILE__, __LINE__);
+
+	memset(pipeline, 0, sizeof(SQLSERVER_PIPELINE));
+	pipeline->conn = conn;
+	pipeline->concurrent = SQLSERVER_CONNECTION_OF(conn)->marsEnabled;
+
+	return pipeline;
+}
+
+SQLSERVER_INTERFACE_API
+int
+sqlserverPipelineAdd(
+	SQLSERVER_PIPELINE * pipeline,
+	DBInt_Statement * stm,
+	const char * sql
+)
+{
+	DBInt_Connection * conn = pipeline->conn;
+
+	_ResetError(conn, stm);
+
+	if (pipeline->dispatched) {
+		_SetErrorText(conn, stm, "Pipeline is already dispatched");
+		return -1;
+	}
+
+	// prepared now, executions are only started by the pipeline
+	if (!_EnsurePrepared(conn, stm, sql)) {
+		return -1;
+	}
+
+	if (pipeline->count == pipeline->capacity) {
+		int newCapacity = pipeline->capacity ? pipeline->capacity * 2 : 8;
+		SQLSERVER_PIPELINE_ENTRY * entries = mkMalloc(conn->heapHandle, newCapacity * sizeof(SQLSERVER_PIPELINE_ENTRY), __FILE__, __LINE__);
+		if (pipeline->entries) {
+			memcpy(entries, pipeline->entries, pipeline->count * sizeof(SQLSERVER_PIPELINE_ENTRY));
+			mkFree(conn->heapHandle, pipeline->entries);
+		}
+		pipeline->entries = entries;
+		pipeline->capacity = newCapacity;
+	}
+
+	SQLSERVER_PIPELINE_ENTRY * entry = &pipeline->entries[pipeline->count];
+	memset(entry, 0, sizeof(SQLSERVER_PIPELINE_ENTRY));
+	entry->stm = stm;
+	entry->state = SQLSERVER_PIPELINE_PENDING;
+
+	return pipeline->count++;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverPipelineDispatch(
+	SQLSERVER_PIPELINE * pipeline
+)
+{
+	_ResetError(pipeline->conn, NULL);
+
+	pipeline->dispatched = TRUE;
+
+	for (int i = 0; i < pipeline->count; i++) {
+		if (pipeline->entries[i].state != SQLSERVER_PIPELINE_PENDING) {
+			continue;
+		}
+		_PipelineStart(pipeline, &pipeline->entries[i]);
+		if (!pipeline->concurrent) {
+			// the rest start as results are handed out
+			break;
+		}
+	}
+	return TRUE;
+}
+
+SQLSERVER_INTERFACE_API
+DBInt_Statement *
+sqlserverPipelineNextResult(
+	SQLSERVER_PIPELINE * pipeline,
+	int * index
+)
+{
+	unsigned int idlePasses = 0;
+
+	if (!pipeline->dispatched) {
+		sqlserverPipelineDispatch(pipeline);
+	}
+
+	for (;;) {
+		BOOL executing = FALSE;
+		int  pending = -1;
+
+		for (int i = 0; i < pipeline->count; i++) {
+			SQLSERVER_PIPELINE_ENTRY * entry = &pipeline->entries[i];
+
+			if (entry->state == SQLSERVER_PIPELINE_EXECUTING) {
+				_PipelinePoll(pipeline, entry);
+			}
+			if (entry->state == SQLSERVER_PIPELINE_COMPLETED) {
+				entry->state = SQLSERVER_PIPELINE_CONSUMED;
+				if (index) {
+					*index = i;
+				}
+				// errors of the statement are reported to the caller's thread
+				if (SQLSERVER_STATEMENT_OF(entry->stm)->lastError.hasError) {
+					_SetError(pipeline->conn, entry->stm);
+				}
+				else {
+					_ResetError(pipeline->conn, NULL);
+				}
+				return entry->stm;
+			}
+			if (entry->state == SQLSERVER_PIPELINE_EXECUTING) {
+				executing = TRUE;
+			}
+			else if (entry->state == SQLSERVER_PIPELINE_PENDING && pending < 0) {
+				pending = i;
+			}
+		}
+
+		if (!executing) {
+			if (pending < 0) {
+				// everything handed out
+				if (index) {
+					*index = -1;
+				}
+				return NULL;
+			}
+			_PipelineStart(pipeline, &pipeline->entries[pending]);
+			continue;
+		}
+
+		Sleep(idlePasses++ < SQLSERVER_PIPELINE_SPIN_COUNT ? 0 : 1);
+	}
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverPipelineFree(
+	SQLSERVER_PIPELINE * pipeline
+)
+{
+	DBInt_Connection * conn = pipeline->conn;
+
+	for (int i = 0; i < pipeline->count; i++) {
+		SQLSERVER_PIPELINE_ENTRY * entry = &pipeline->entries[i];
+
+		if (entry->state == SQLSERVER_PIPELINE_EXECUTING) {
+			SQLHSTMT hStmt = *entry->stm->statement.sqlserver.hStmt;
+			_CancelExecute(conn, entry->stm);
+			SQLFreeStmt(hStmt, SQL_CLOSE);
+			if (entry->async) {
+				SQLSetStmtAttr(hStmt, SQL_ATTR_ASYNC_ENABLE, (SQLPOINTER)SQL_ASYNC_ENABLE_OFF, 0);
+			}
+		}
+	}
+	if (pipeline->entries) {
+		mkFree(conn->heapHandle, pipeline->entries);
+	}
+	mkFree(conn->heapHandle, pipeline);
+}
@@ -0,0 +1,76 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+#include "sqlserver-interface.h"
+
+/*	Polling passes that yield with Sleep(0) before the poll loop starts sleeping 1ms between passes */
+#define SQLSERVER_PIPELINE_SPIN_COUNT		64
+
+typedef enum _SQLSERVER_PIPELINE_STATE {
+	SQLSERVER_PIPELINE_PENDING,
+	SQLSERVER_PIPELINE_EXECUTING,
+	SQLSERVER_PIPELINE_COMPLETED,
+	SQLSERVER_PIPELINE_CONSUMED
+} SQLSERVER_PIPELINE_STATE;
+
+typedef struct _SQLSERVER_PIPELINE_ENTRY {
+	DBInt_Statement			  * stm;
+	SQLSERVER_PIPELINE_STATE	state;
+	/*	SQLExecute is polled, otherwise it already ran synchronously */
+	BOOL						async;
+} SQLSERVER_PIPELINE_ENTRY;
+
+typedef struct _SQLSERVER_PIPELINE {
+	DBInt_Connection		  * conn;
+	SQLSERVER_PIPELINE_ENTRY  * entries;
+	int							count;
+	int							capacity;
+	/*	all entries execute at once over MARS, otherwise one at a time */
+	BOOL						concurrent;
+	BOOL						dispatched;
+} SQLSERVER_PIPELINE;
+
+/* DDL's PRIVATE FUNCTIONS  */
+void			_PipelineStart(SQLSERVER_PIPELINE* pipeline, SQLSERVER_PIPELINE_ENTRY* entry);
+void			_PipelinePoll(SQLSERVER_PIPELINE* pipeline, SQLSERVER_PIPELINE_ENTRY* entry);
+void			_PipelineComplete(SQLSERVER_PIPELINE* pipeline, SQLSERVER_PIPELINE_ENTRY* entry, RETCODE RetCode);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Creates an empty pipeline on "conn". Statements run concurrently only when the connection has MARS enabled
+	(see sqlserverCreateConnectionEx); otherwise each one starts when sqlserverPipelineNextResult is called after
+	the previous result set was handed out. */
+SQLSERVER_INTERFACE_API SQLSERVER_PIPELINE	  * sqlserverPipelineCreate(DBInt_Connection* conn);
+
+/*	Queues "stm" to be executed as "sql", prepared here unless it already is with the same text, NULL keeps the
+	prepared text. Bind parameters after this call. Returns the position in the queue, -1 on error.
+	Statements must not be used outside of the pipeline until it hands them out. */
+SQLSERVER_INTERFACE_API int						sqlserverPipelineAdd(SQLSERVER_PIPELINE* pipeline, DBInt_Statement* stm, const char* sql);
+
+/*	Starts executing the queued statements back to back without waiting for their results */
+SQLSERVER_INTERFACE_API BOOL					sqlserverPipelineDispatch(SQLSERVER_PIPELINE* pipeline);
+
+/*	Waits for the next statement to finish executing and returns it with its first row fetched, exactly as
+	sqlserverExecuteSelectStatement leaves it. Completed statements are returned in the order they finish, the
+	queue position is stored in "index" (optional). Check sqlserverGetStatementError for the execution outcome.
+	Returns NULL when every statement has been handed out.
+	Without MARS the connection runs one result set at a time: read the previous statement's result set to its
+	end before calling this again, or its open cursor keeps the connection busy and the next statement fails
+	with "Connection is busy". */
+SQLSERVER_INTERFACE_API DBInt_Statement		  * sqlserverPipelineNextResult(SQLSERVER_PIPELINE* pipeline, int* index);
+
+/*	Cancels statements still executing and releases the pipeline. The statements themselves are not freed */
+SQLSERVER_INTERFACE_API void					sqlserverPipelineFree(SQLSERVER_PIPELINE* pipeline);
@@ -0,0 +1,441 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+#include "sqlserver-pool.h"
+
+
+char *
+_PoolCopyString(
+	SQLSERVER_POOL * pool,
+	const char * value
+)
+{
+	return value ? mkStrdup(pool->heapHandle, value, __FILE__, __LINE__) : NULL;
+}
+
+/*	Returns a connected connection or NULL. The failure stays in the thread's error */
+DBInt_Connection *
+_PoolOpen(
+	SQLSERVER_POOL * pool
+)
+{
+	DBInt_Connection * conn = sqlserverCreateConnectionEx(pool->heapHandle, pool->dbType,
+		pool->hostName, pool->instanceName, pool->databaseName, pool->userName, pool->password,
+		&pool->connectionOptions);
+
+	if (conn->err) {
+		_PoolClose(pool, conn);
+		return NULL;
+	}
+	return conn;
+}
+
+void
+_PoolClose(
+	SQLSERVER_POOL * pool,
+	DBInt_Connection * conn
+)
+{
+	sqlserverDestroyConnection(conn);
+	mkFree(pool->heapHandle, conn);
+}
+
+BOOL
+_PoolPing(
+	SQLSERVER_POOL * pool,
+	DBInt_Connection * conn
+)
+{
+	if (pool->pingQuery == NULL) {
+		return sqlserverIsConnectionOpen(conn);
+	}
+
+	SQLHSTMT	hStmt = NULL;
+	BOOL		alive = FALSE;
+
+	if (SQL_SUCCEEDED(SQLAllocHandle(SQL_HANDLE_STMT, *conn->connection.sqlserverHandle, &hStmt))) {
+		alive = SQL_SUCCEEDED(SQLExecDirect(hStmt, pool->pingQuery, SQL_NTS));
+		SQLFreeHandle(SQL_HANDLE_STMT, hStmt);
+	}
+	return alive;
+}
+
+/*	Pings every connection idle for longer than idleBeforePingMs. Broken ones are reconnected in place,
+	so the DBInt_Connection handed out later stays the same; those that cannot be reconnected are closed */
+void
+_PoolCheckIdle(
+	SQLSERVER_POOL * pool
+)
+{
+	LARGE_INTEGER frequency, start, end;
+
+	QueryPerformanceFrequency(&frequency);
+
+	for (int i = 0; i < pool->maxConnections; i++) {
+		SQLSERVER_POOL_SLOT * slot = &pool->slots[i];
+
+		if (WaitForSingleObject(pool->stopEvent, 0) == WAIT_OBJECT_0) {
+			return;
+		}
+
+		AcquireSRWLockExclusive(&pool->lock);
+		if (slot->state != SQLSERVER_POOL_SLOT_IDLE || GetTickCount64() - slot->lastUsed < pool->idleBeforePingMs) {
+			ReleaseSRWLockExclusive(&pool->lock);
+			continue;
+		}
+		slot->state = SQLSERVER_POOL_SLOT_CHECKING;
+		ReleaseSRWLockExclusive(&pool->lock);
+
+		QueryPerformanceCounter(&start);
+		BOOL alive = _PoolPing(pool, slot->conn);
+		QueryPerformanceCounter(&end);
+
+		unsigned long long elapsed = (unsigned long long)((end.QuadPart - start.QuadPart) * 1000000 / frequency.QuadPart);
+
+		BOOL reconnected = FALSE;
+		if (!alive) {
+			reconnected = _ReconnectConnection(slot->conn);
+			if (!reconnected) {
+				_PoolClose(pool, slot->conn);
+			}
+		}
+
+		AcquireSRWLockExclusive(&pool->lock);
+		pool->stats.pings++;
+		pool->stats.pingTotalTime += elapsed;
+		pool->stats.lastPingTime = elapsed;
+		if (elapsed > pool->stats.pingMaxTime) {
+			pool->stats.pingMaxTime = elapsed;
+		}
+		if (!alive) {
+			pool->stats.pingFailures++;
+			if (reconnected) {
+				pool->stats.reconnects++;
+			}
+			else {
+				pool->stats.reconnectFailures++;
+			}
+		}
+		if (alive || reconnected) {
+			slot->state = SQLSERVER_POOL_SLOT_IDLE;
+			slot->lastUsed = GetTickCount64();
+		}
+		else {
+			slot->conn = NULL;
+			slot->state = SQLSERVER_POOL_SLOT_EMPTY;
+		}
+		WakeConditionVariable(&pool->slotAvailable);
+		ReleaseSRWLockExclusive(&pool->lock);
+	}
+}
+
+/*	Opens connections until minConnections are open. Stops at the first failure, the next pass tries again */
+void
+_PoolWarmUp(
+	SQLSERVER_POOL * pool
+)
+{
+	for (;;) {
+		SQLSERVER_POOL_SLOT * empty = NULL;
+		int					  openCount = 0;
+
+		if (WaitForSingleObject(pool->stopEvent, 0) == WAIT_OBJECT_0) {
+			return;
+		}
+
+		AcquireSRWLockExclusive(&pool->lock);
+		for (int i = 0; i < pool->maxConnections; i++) {
+			if (pool->slots[i].state != SQLSERVER_POOL_SLOT_EMPTY) {
+				openCount++;
+			}
+			else if (empty == NULL) {
+				empty = &pool->slots[i];
+			}
+		}
+		if (openCount >= pool->minConnections || empty == NULL) {
+			ReleaseSRWLockExclusive(&pool->lock);
+			return;
+		}
+		empty->state = SQLSERVER_POOL_SLOT_OPENING;
+		ReleaseSRWLockExclusive(&pool->lock);
+
+		DBInt_Connection * conn = _PoolOpen(pool);
+
+		AcquireSRWLockExclusive(&pool->lock);
+		if (conn) {
+			empty->conn = conn;
+			empty->state = SQLSERVER_POOL_SLOT_IDLE;
+			empty->lastUsed = GetTickCount64();
+			pool->stats.connectionsOpened++;
+		}
+		else {
+			empty->state = SQLSERVER_POOL_SLOT_EMPTY;
+			pool->stats.connectFailures++;
+		}
+		WakeConditionVariable(&pool->slotAvailable);
+		ReleaseSRWLockExclusive(&pool->lock);
+
+		if (conn == NULL) {
+			return;
+		}
+	}
+}
+
+DWORD WINAPI
+_PoolHealthThread(
+	LPVOID parameter
+)
+{
+	SQLSERVER_POOL * pool = (SQLSERVER_POOL*)parameter;
+
+	while (WaitForSingleObject(pool->stopEvent, pool->pingIntervalMs) == WAIT_TIMEOUT) {
+		_PoolCheckIdle(pool);
+		_PoolWarmUp(pool);
+	}
+	return 0;
+}
+
+SQLSERVER_INTERFACE_API
+SQLSERVER_POOL *
+sqlserverPoolCreate(
+	HANDLE heapHandle,
+	DBInt_SupportedDatabaseType dbType,
+	const char * hostName,
+	const char * instanceName,
+	const char * databaseName,
+	const char * userName,
+	const char * password,
+	const SQLSERVER_POOL_OPTIONS * options
+)
+{
+	SQLSERVER_POOL * pool = mkMalloc(heapHandle, sizeof(SQLSERVER_POOL), __FILE__, __LINE__);
+	memset(pool, 0, sizeof(SQLSERVER_POOL));
+
+	pool->heapHandle = heapHandle;
+	pool->dbType = dbType;
+	pool->hostName = _PoolCopyString(pool, hostName);
+	pool->instanceName = _PoolCopyString(pool, instanceName);
+	pool->databaseName = _PoolCopyString(pool, databaseName);
+	pool->userName = _PoolCopyString(pool, userName);
+	pool->password = _PoolCopyString(pool, password);
+
+	if (options->connectionOptions) {
+		pool->connectionOptions = *options->connectionOptions;
+		pool->driverName = _PoolCopyString(pool, options->connectionOptions->driverName);
+		pool->attributes = _PoolCopyString(pool, options->connectionOptions->attributes);
+		pool->connectionString = _PoolCopyString(pool, options->connectionOptions->connectionString);
+	}
+	pool->connectionOptions.driverName = pool->driverName;
+	pool->connectionOptions.attributes = pool->attributes;
+	pool->connectionOptions.connectionString = pool->connectionString;
+
+	if (options->pingQuery) {
+		size_t length = strlen(options->pingQuery);
+		pool->pingQuery = mkMalloc(heapHandle, (length + 1) * sizeof(SQLWCHAR), __FILE__, __LINE__);
+		mbstowcs_s(NULL, pool->pingQuery, length + 1, options->pingQuery, length);
+	}
+
+	pool->maxConnections = options->maxConnections > 0 ? options->maxConnections : SQLSERVER_POOL_DEFAULT_MAX_CONNECTIONS;
+	pool->minConnections = min(options->minConnections, pool->maxConnections);
+	pool->pingIntervalMs = options->pingIntervalMs ? options->pingIntervalMs : SQLSERVER_POOL_DEFAULT_PING_INTERVAL;
+	pool->idleBeforePingMs = options->idleBeforePingMs ? options->idleBeforePingMs : SQLSERVER_POOL_DEFAULT_IDLE_BEFORE_PING;
+
+	pool->slots = mkMalloc(heapHandle, pool->maxConnections * sizeof(SQLSERVER_POOL_SLOT), __FILE__, __LINE__);
+	memset(pool->slots, 0, pool->maxConnections * sizeof(SQLSERVER_POOL_SLOT));
+
+	InitializeSRWLock(&pool->lock);
+	InitializeConditionVariable(&pool->slotAvailable);
+
+	pool->stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (pool->stopEvent == NULL) {
+		sqlserverPoolDestroy(pool);
+		return NULL;
+	}
+
+	// connections are opened now rather than on the first requests
+	_PoolWarmUp(pool);
+
+	pool->healthThread = CreateThread(NULL, 0, _PoolHealthThread, pool, 0, NULL);
+	if (pool->healthThread == NULL) {
+		sqlserverPoolDestroy(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+SQLSERVER_INTERFACE_API
+DBInt_Connection *
+sqlserverPoolAcquire(
+	SQLSERVER_POOL * pool,
+	DWORD timeoutMs
+)
+{
+	ULONGLONG deadline = GetTickCount64() + timeoutMs;
+
+	AcquireSRWLockExclusive(&pool->lock);
+	for (;;) {
+		SQLSERVER_POOL_SLOT * idle = NULL;
+		SQLSERVER_POOL_SLOT * empty = NULL;
+
+		for (int i = 0; i < pool->maxConnections && idle == NULL; i++) {
+			if (pool->slots[i].state == SQLSERVER_POOL_SLOT_IDLE) {
+				idle = &pool->slots[i];
+			}
+			else if (pool->slots[i].state == SQLSERVER_POOL_SLOT_EMPTY && empty == NULL) {
+				empty = &pool->slots[i];
+			}
+		}
+
+		if (idle) {
+			idle->state = SQLSERVER_POOL_SLOT_BUSY;
+			ReleaseSRWLockExclusive(&pool->lock);
+
+			if (sqlserverIsConnectionOpen(idle->conn)) {
+				return idle->conn;
+			}
+
+			// broken since the last ping, repaired here rather than failing the caller's first query
+			BOOL reconnected = _ReconnectConnection(idle->conn);
+			if (!reconnected) {
+				_PoolClose(pool, idle->conn);
+			}
+
+			AcquireSRWLockExclusive(&pool->lock);
+			if (reconnected) {
+				pool->stats.reconnects++;
+				ReleaseSRWLockExclusive(&pool->lock);
+				return idle->conn;
+			}
+			pool->stats.reconnectFailures++;
+			idle->conn = NULL;
+			idle->state = SQLSERVER_POOL_SLOT_EMPTY;
+			continue;
+		}
+
+		if (empty) {
+			empty->state = SQLSERVER_POOL_SLOT_OPENING;
+			ReleaseSRWLockExclusive(&pool->lock);
+
+			DBInt_Connection * conn = _PoolOpen(pool);
+
+			AcquireSRWLockExclusive(&pool->lock);
+			if (conn) {
+				empty->conn = conn;
+				empty->state = SQLSERVER_POOL_SLOT_BUSY;
+				pool->stats.connectionsOpened++;
+			}
+			else {
+				empty->state = SQLSERVER_POOL_SLOT_EMPTY;
+				pool->stats.connectFailures++;
+			}
+			ReleaseSRWLockExclusive(&pool->lock);
+			return conn;
+		}
+
+		ULONGLONG now = GetTickCount64();
+		if (now >= deadline) {
+			break;
+		}
+		DWORD wait = (timeoutMs == INFINITE) ? INFINITE : (DWORD)(deadline - now);
+		if (!SleepConditionVariableSRW(&pool->slotAvailable, &pool->lock, wait, 0)) {
+			break;
+		}
+	}
+	ReleaseSRWLockExclusive(&pool->lock);
+	return NULL;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverPoolRelease(
+	SQLSERVER_POOL * pool,
+	DBInt_Connection * conn
+)
+{
+	AcquireSRWLockExclusive(&pool->lock);
+	for (int i = 0; i < pool->maxConnections; i++) {
+		if (pool->slots[i].conn == conn && pool->slots[i].state == SQLSERVER_POOL_SLOT_BUSY) {
+			pool->slots[i].state = SQLSERVER_POOL_SLOT_IDLE;
+			pool->slots[i].lastUsed = GetTickCount64();
+			WakeConditionVariable(&pool->slotAvailable);
+			break;
+		}
+	}
+	ReleaseSRWLockExclusive(&pool->lock);
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverPoolGetStats(
+	SQLSERVER_POOL * pool,
+	SQLSERVER_POOL_STATS * stats
+)
+{
+	AcquireSRWLockShared(&pool->lock);
+	*stats = pool->stats;
+	stats->idleConnections = 0;
+	stats->busyConnections = 0;
+	for (int i = 0; i < pool->maxConnections; i++) {
+		switch (pool->slots[i].state) {
+			case SQLSERVER_POOL_SLOT_IDLE:
+			case SQLSERVER_POOL_SLOT_CHECKING:
+				stats->idleConnections++;
+				break;
+			case SQLSERVER_POOL_SLOT_BUSY:
+				stats->busyConnections++;
+				break;
+			default:
+				break;
+		}
+	}
+	ReleaseSRWLockShared(&pool->lock);
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverPoolDestroy(
+	SQLSERVER_POOL * pool
+)
+{
+	if (pool->healthThread) {
+		SetEvent(pool->stopEvent);
+		WaitForSingleObject(pool->healthThread, INFINITE);
+		CloseHandle(pool->healthThread);
+	}
+	if (pool->stopEvent) {
+		CloseHandle(pool->stopEvent);
+	}
+
+	for (int i = 0; i < pool->maxConnections; i++) {
+		if (pool->slots[i].conn) {
+			_PoolClose(pool, pool->slots[i].conn);
+		}
+	}
+
+	char * strings[] = { pool->hostName, pool->instanceName, pool->databaseName, pool->userName, pool->password,
+		pool->driverName, pool->attributes, pool->connectionString, (char*)pool->pingQuery };
+	for (int i = 0; i < _countof(strings); i++) {
+		if (strings[i]) {
+			mkFree(pool->heapHandle, strings[i]);
+		}
+	}
+	mkFree(pool->heapHandle, pool->slots);
+	mkFree(pool->heapHandle, pool);
+}
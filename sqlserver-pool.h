@@ -0,0 +1,133 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+#include "sqlserver-interface.h"
+
+#define SQLSERVER_POOL_DEFAULT_MAX_CONNECTIONS		64
+#define SQLSERVER_POOL_DEFAULT_PING_INTERVAL		30000
+#define SQLSERVER_POOL_DEFAULT_IDLE_BEFORE_PING		60000
+
+typedef struct _SQLSERVER_POOL_OPTIONS {
+	/*	opened by sqlserverPoolCreate and kept open by the health checker */
+	int							minConnections;
+	/*	0 means SQLSERVER_POOL_DEFAULT_MAX_CONNECTIONS */
+	int							maxConnections;
+	/*	milliseconds between health checker passes, 0 means SQLSERVER_POOL_DEFAULT_PING_INTERVAL */
+	DWORD						pingIntervalMs;
+	/*	idle connections unused for this many milliseconds are pinged, 0 means SQLSERVER_POOL_DEFAULT_IDLE_BEFORE_PING */
+	DWORD						idleBeforePingMs;
+	/*	e.g. "SELECT 1". NULL pings with SQL_ATTR_CONNECTION_DEAD, which costs no round trip but only
+		notices links the driver has already seen break */
+	const char				  * pingQuery;
+	/*	passed to sqlserverCreateConnectionEx, may be NULL */
+	const SQLSERVER_CONNECTION_OPTIONS * connectionOptions;
+} SQLSERVER_POOL_OPTIONS;
+
+typedef enum _SQLSERVER_POOL_SLOT_STATE {
+	SQLSERVER_POOL_SLOT_EMPTY,
+	SQLSERVER_POOL_SLOT_OPENING,
+	SQLSERVER_POOL_SLOT_IDLE,
+	SQLSERVER_POOL_SLOT_BUSY,
+	/*	being pinged or reconnected by the health checker */
+	SQLSERVER_POOL_SLOT_CHECKING
+} SQLSERVER_POOL_SLOT_STATE;
+
+typedef struct _SQLSERVER_POOL_SLOT {
+	DBInt_Connection		  * conn;
+	SQLSERVER_POOL_SLOT_STATE	state;
+	/*	GetTickCount64 of the last release or successful ping */
+	ULONGLONG					lastUsed;
+} SQLSERVER_POOL_SLOT;
+
+typedef struct _SQLSERVER_POOL_STATS {
+	unsigned long long	connectionsOpened;
+	unsigned long long	connectFailures;
+	unsigned long long	reconnects;
+	unsigned long long	reconnectFailures;
+	unsigned long long	pings;
+	unsigned long long	pingFailures;
+	/*	microseconds */
+	unsigned long long	pingTotalTime;
+	unsigned long long	pingMaxTime;
+	unsigned long long	lastPingTime;
+	int					idleConnections;
+	int					busyConnections;
+} SQLSERVER_POOL_STATS;
+
+typedef struct _SQLSERVER_POOL {
+	HANDLE						heapHandle;
+	/*	arguments of sqlserverCreateConnectionEx, copied */
+	DBInt_SupportedDatabaseType	dbType;
+	char					  * hostName;
+	char					  * instanceName;
+	char					  * databaseName;
+	char					  * userName;
+	char					  * password;
+	char					  * driverName;
+	char					  * attributes;
+	char					  * connectionString;
+	SQLSERVER_CONNECTION_OPTIONS connectionOptions;
+	SQLWCHAR				  * pingQuery;
+	int							minConnections;
+	int							maxConnections;
+	DWORD						pingIntervalMs;
+	DWORD						idleBeforePingMs;
+	SQLSERVER_POOL_SLOT		  * slots;
+	SRWLOCK						lock;
+	/*	signalled when a slot becomes idle or empty */
+	CONDITION_VARIABLE			slotAvailable;
+	SQLSERVER_POOL_STATS		stats;
+	HANDLE						stopEvent;
+	HANDLE						healthThread;
+} SQLSERVER_POOL;
+
+/* DDL's PRIVATE FUNCTIONS  */
+char *				_PoolCopyString(SQLSERVER_POOL* pool, const char* value);
+DBInt_Connection *	_PoolOpen(SQLSERVER_POOL* pool);
+void				_PoolClose(SQLSERVER_POOL* pool, DBInt_Connection* conn);
+BOOL				_PoolPing(SQLSERVER_POOL* pool, DBInt_Connection* conn);
+void				_PoolCheckIdle(SQLSERVER_POOL* pool);
+void				_PoolWarmUp(SQLSERVER_POOL* pool);
+DWORD WINAPI		_PoolHealthThread(LPVOID parameter);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Opens options->minConnections connections and starts the health checker thread, which pings idle
+	connections, reconnects broken ones and opens new ones when the pool falls below the minimum.
+	Returns NULL when the pool cannot be created. Connections that fail to open are retried by the health checker. */
+SQLSERVER_INTERFACE_API
+SQLSERVER_POOL *
+sqlserverPoolCreate(
+	HANDLE heapHandle,
+	DBInt_SupportedDatabaseType dbType,
+	const char* hostName,
+	const char* instanceName,
+	const char* databaseName,
+	const char* userName,
+	const char* password,
+	const SQLSERVER_POOL_OPTIONS* options);
+
+/*	Hands out an idle connection, opening a new one while the pool is below its maximum. Waits up to "timeoutMs"
+	for a connection to be released otherwise. Returns NULL on timeout or when no connection could be opened */
+SQLSERVER_INTERFACE_API DBInt_Connection	  * sqlserverPoolAcquire(SQLSERVER_POOL* pool, DWORD timeoutMs);
+
+/*	Returns "conn" to the pool. Its statements must be freed and its transaction finished */
+SQLSERVER_INTERFACE_API void					sqlserverPoolRelease(SQLSERVER_POOL* pool, DBInt_Connection* conn);
+
+SQLSERVER_INTERFACE_API void					sqlserverPoolGetStats(SQLSERVER_POOL* pool, SQLSERVER_POOL_STATS* stats);
+
+/*	Stops the health checker and closes every connection. All connections must have been released */
+SQLSERVER_INTERFACE_API void					sqlserverPoolDestroy(SQLSERVER_POOL* pool);
@@ -0,0 +1,353 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+#include "sqlserver-cache.h"
+#include "sqlserver-prefetch.h"
+
+
+/*	Helper thread. Owns the statement handle until it returns */
+DWORD WINAPI
+_PrefetchThread(
+	LPVOID parameter
+)
+{
+	SQLSERVER_PREFETCH	* prefetch = parameter;
+	SQLHSTMT			  hStmt = *prefetch->stm->statement.sqlserver.hStmt;
+	RETCODE				  RetCode;
+
+	while (!prefetch->stop) {
+		LONG produced = prefetch->produced;
+
+		if (produced - prefetch->consumed == SQLSERVER_PREFETCH_BLOCK_COUNT) {
+			// both blocks are waiting to be read
+			InterlockedIncrement64((LONG64 volatile*)&prefetch->stats.fetcherWaits);
+			WaitForSingleObject(prefetch->consumedEvent, INFINITE);
+			continue;
+		}
+
+		int block = produced % SQLSERVER_PREFETCH_BLOCK_COUNT;
+
+		prefetch->bindOffset = block * prefetch->blockBytes;
+		RetCode = SQLFetch(hStmt);
+
+		// the records are read here, the handle is not the caller's to read until this thread returns
+		prefetch->blockError[block].hasError = FALSE;
+		if (RetCode == SQL_ERROR || RetCode == SQL_SUCCESS_WITH_INFO) {
+			_HandleDiagnosticRecord(hStmt, SQL_HANDLE_STMT, RetCode, prefetch->stm);
+			if (RetCode == SQL_ERROR) {
+				sqlserverGetThreadError(&prefetch->blockError[block]);
+			}
+		}
+		prefetch->blockRetCode[block] = RetCode;
+		prefetch->blockRowCount[block] = SQL_SUCCEEDED(RetCode) ? prefetch->rowsFetched : 0;
+
+		// publishes the block contents together with the count
+		InterlockedIncrement(&prefetch->produced);
+		SetEvent(prefetch->producedEvent);
+
+		if (!SQL_SUCCEEDED(RetCode)) {
+			// end of the result set or an error, the reader takes it from the block
+			break;
+		}
+	}
+	return 0;
+}
+
+/*	Binds the statement's columns back to the single row buffers of stm->statement.sqlserver.resultSet */
+void
+_PrefetchRestoreBindings(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLHSTMT hStmt = *stm->statement.sqlserver.hStmt;
+
+	SQLSetStmtAttr(hStmt, SQL_ATTR_ROW_BIND_OFFSET_PTR, NULL, 0);
+	SQLSetStmtAttr(hStmt, SQL_ATTR_ROWS_FETCHED_PTR, NULL, 0);
+	SQLSetStmtAttr(hStmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER)1, 0);
+
+	for (SQLSMALLINT iCol = 0; iCol < stm->statement.sqlserver.cColCount; iCol++) {
+		BINDING * bind = &stm->statement.sqlserver.resultSet[iCol];
+		SQLBindCol(hStmt, iCol + 1, SQL_C_WCHAR, bind->wRowData, (bind->rowDataCharacterCount + 1) * sizeof(WCHAR), &bind->indPtr);
+	}
+}
+
+/*	Called once the first row of a result set has been fetched. Hands the rest of it to the helper thread */
+void
+_PrefetchStart(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+	SQLSERVER_PREFETCH	* prefetch = state->prefetch;
+	SQLSMALLINT			  colCount = stm->statement.sqlserver.cColCount;
+	SQLHSTMT			  hStmt = state->hStmt;
+	size_t				  rowBytes = 0;
+
+	if (prefetch == NULL || state->lastError.hasError || colCount == 0 || stm->statement.sqlserver.isEof) {
+		return;
+	}
+
+	for (SQLSMALLINT iCol = 0; iCol < colCount; iCol++) {
+		rowBytes += (stm->statement.sqlserver.resultSet[iCol].rowDataCharacterCount + 1) * sizeof(WCHAR) + sizeof(SQLLEN);
+	}
+	prefetch->rows = prefetch->blockRows;
+	if (rowBytes * prefetch->rows > SQLSERVER_PREFETCH_MAX_BLOCK_BYTES) {
+		prefetch->rows = max(1, SQLSERVER_PREFETCH_MAX_BLOCK_BYTES / rowBytes);
+	}
+	prefetch->blockBytes = rowBytes * prefetch->rows;
+
+	prefetch->buffer = _StatementMalloc(conn, stm, prefetch->blockBytes * SQLSERVER_PREFETCH_BLOCK_COUNT, __FILE__, __LINE__);
+	prefetch->valueOffsets = _StatementMalloc(conn, stm, colCount * sizeof(size_t) * 2, __FILE__, __LINE__);
+	if (prefetch->buffer == NULL || prefetch->valueOffsets == NULL) {
+		// reading goes on one row at a time
+		_StatementFree(conn, stm, prefetch->buffer);
+		_StatementFree(conn, stm, prefetch->valueOffsets);
+		prefetch->buffer = NULL;
+		prefetch->valueOffsets = NULL;
+		return;
+	}
+	prefetch->indicatorOffsets = prefetch->valueOffsets + colCount;
+
+	size_t offset = 0;
+	for (SQLSMALLINT iCol = 0; iCol < colCount; iCol++) {
+		prefetch->valueOffsets[iCol] = offset;
+		offset += (stm->statement.sqlserver.resultSet[iCol].rowDataCharacterCount + 1) * sizeof(WCHAR) * prefetch->rows;
+	}
+	for (SQLSMALLINT iCol = 0; iCol < colCount; iCol++) {
+		prefetch->indicatorOffsets[iCol] = offset;
+		offset += sizeof(SQLLEN) * prefetch->rows;
+	}
+
+	// bound once, SQL_ATTR_ROW_BIND_OFFSET_PTR moves the bindings to the block being filled
+	prefetch->bindOffset = 0;
+	TRYODBC_STM(stm,
+		SQLSetStmtAttr(hStmt, SQL_ATTR_ROW_BIND_TYPE, (SQLPOINTER)SQL_BIND_BY_COLUMN, 0));
+	TRYODBC_STM(stm,
+		SQLSetStmtAttr(hStmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER)prefetch->rows, 0));
+	TRYODBC_STM(stm,
+		SQLSetStmtAttr(hStmt, SQL_ATTR_ROWS_FETCHED_PTR, &prefetch->rowsFetched, 0));
+	TRYODBC_STM(stm,
+		SQLSetStmtAttr(hStmt, SQL_ATTR_ROW_BIND_OFFSET_PTR, &prefetch->bindOffset, 0));
+
+	for (SQLSMALLINT iCol = 0; iCol < colCount; iCol++) {
+		TRYODBC_STM(stm,
+			SQLBindCol(hStmt,
+				iCol + 1,
+				SQL_C_WCHAR,
+				prefetch->buffer + prefetch->valueOffsets[iCol],
+				(stm->statement.sqlserver.resultSet[iCol].rowDataCharacterCount + 1) * sizeof(WCHAR),
+				(SQLLEN*)(prefetch->buffer + prefetch->indicatorOffsets[iCol])));
+	}
+
+	prefetch->produced = 0;
+	prefetch->consumed = 0;
+	prefetch->stop = FALSE;
+	prefetch->row = -1;
+	ResetEvent(prefetch->producedEvent);
+	ResetEvent(prefetch->consumedEvent);
+
+	prefetch->thread = CreateThread(NULL, 0, _PrefetchThread, prefetch, 0, NULL);
+
+Exit:
+	if (prefetch->thread == NULL) {
+		_PrefetchRestoreBindings(conn, stm);
+		_StatementFree(conn, stm, prefetch->buffer);
+		_StatementFree(conn, stm, prefetch->valueOffsets);
+		prefetch->buffer = NULL;
+		prefetch->valueOffsets = NULL;
+	}
+}
+
+/*	Returns TRUE if the statement is being read ahead and the next row was loaded, or the end was reached */
+BOOL
+_PrefetchNext(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_PREFETCH * prefetch = SQLSERVER_STATEMENT_OF(stm)->prefetch;
+
+	if (prefetch == NULL || prefetch->thread == NULL) {
+		return FALSE;
+	}
+
+	int block = prefetch->consumed % SQLSERVER_PREFETCH_BLOCK_COUNT;
+
+	if (prefetch->row >= 0 && (SQLULEN)(prefetch->row + 1) >= prefetch->blockRowCount[block]) {
+		// block read, the helper thread may fill it again
+		InterlockedIncrement(&prefetch->consumed);
+		SetEvent(prefetch->consumedEvent);
+		prefetch->row = -1;
+		block = prefetch->consumed % SQLSERVER_PREFETCH_BLOCK_COUNT;
+	}
+
+	if (prefetch->row < 0) {
+		if (prefetch->produced == prefetch->consumed) {
+			InterlockedIncrement64((LONG64 volatile*)&prefetch->stats.readerWaits);
+			while (prefetch->produced == prefetch->consumed) {
+				WaitForSingleObject(prefetch->producedEvent, INFINITE);
+			}
+		}
+		MemoryBarrier();
+
+		RETCODE RetCode = prefetch->blockRetCode[block];
+		if (prefetch->blockRowCount[block] == 0) {
+			if (RetCode != SQL_NO_DATA) {
+				_SetErrorFrom(conn, stm, &prefetch->blockError[block]);
+			}
+			stm->statement.sqlserver.isEof = TRUE;
+			_PrefetchStop(conn, stm);
+			if (RetCode == SQL_NO_DATA) {
+				_CacheFetched(stm);
+			}
+			return TRUE;
+		}
+		prefetch->stats.blocks++;
+		prefetch->stats.rows += prefetch->blockRowCount[block];
+	}
+	prefetch->row++;
+
+	char * blockStart = prefetch->buffer + block * prefetch->blockBytes;
+
+	for (SQLSMALLINT iCol = 0; iCol < stm->statement.sqlserver.cColCount; iCol++) {
+		BINDING * bind = &stm->statement.sqlserver.resultSet[iCol];
+		size_t	  valueSize = (bind->rowDataCharacterCount + 1) * sizeof(WCHAR);
+		SQLLEN	  indicator = ((SQLLEN*)(blockStart + prefetch->indicatorOffsets[iCol]))[prefetch->row];
+
+		bind->indPtr = indicator;
+		if (indicator != SQL_NULL_DATA) {
+			// only the value and its terminator are copied
+			size_t size = (indicator >= 0 && (size_t)indicator < valueSize) ? indicator + sizeof(WCHAR) : valueSize;
+			memcpy(bind->wRowData, blockStart + prefetch->valueOffsets[iCol] + prefetch->row * valueSize, size);
+		}
+	}
+	stm->statement.sqlserver.isEof = FALSE;
+	_CacheFetched(stm);
+
+	return TRUE;
+}
+
+/*	Stops the helper thread and gives the statement handle back to the caller. Rows read ahead are dropped */
+void
+_PrefetchStop(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_PREFETCH * prefetch = SQLSERVER_STATEMENT_OF(stm)->prefetch;
+
+	if (prefetch == NULL || prefetch->thread == NULL) {
+		return;
+	}
+	InterlockedExchange(&prefetch->stop, TRUE);
+	SetEvent(prefetch->consumedEvent);
+	// a fetch in progress is completed, at most one block
+	WaitForSingleObject(prefetch->thread, INFINITE);
+	CloseHandle(prefetch->thread);
+	prefetch->thread = NULL;
+
+	_PrefetchRestoreBindings(conn, stm);
+	_StatementFree(conn, stm, prefetch->buffer);
+	_StatementFree(conn, stm, prefetch->valueOffsets);
+	prefetch->buffer = NULL;
+	prefetch->valueOffsets = NULL;
+	prefetch->indicatorOffsets = NULL;
+}
+
+void
+_PrefetchFreeStatement(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	if (state->prefetch == NULL) {
+		return;
+	}
+	_PrefetchStop(conn, stm);
+	CloseHandle(state->prefetch->producedEvent);
+	CloseHandle(state->prefetch->consumedEvent);
+	_StatementFree(conn, stm, state->prefetch);
+	state->prefetch = NULL;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverEnableReadAhead(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLULEN blockRows
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+
+	_ResetError(conn, stm);
+
+	if (state->prefetch == NULL) {
+		SQLSERVER_PREFETCH * prefetch = _StatementMalloc(conn, stm, sizeof(SQLSERVER_PREFETCH), __FILE__, __LINE__);
+		memset(prefetch, 0, sizeof(SQLSERVER_PREFETCH));
+		prefetch->stm = stm;
+		prefetch->producedEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+		prefetch->consumedEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+		state->prefetch = prefetch;
+
+		if (prefetch->producedEvent == NULL || prefetch->consumedEvent == NULL) {
+			_PrefetchFreeStatement(conn, stm);
+			_SetErrorText(conn, stm, "Unable to create read-ahead events");
+			return FALSE;
+		}
+	}
+	// applies from the next execution
+	state->prefetch->blockRows = blockRows ? blockRows : SQLSERVER_PREFETCH_DEFAULT_BLOCK_ROWS;
+
+	return TRUE;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverDisableReadAhead(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	_PrefetchFreeStatement(conn, stm);
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverGetReadAheadStats(
+	DBInt_Statement * stm,
+	SQLSERVER_PREFETCH_STATS * stats
+)
+{
+	SQLSERVER_PREFETCH * prefetch = SQLSERVER_STATEMENT_OF(stm)->prefetch;
+
+	if (prefetch == NULL) {
+		memset(stats, 0, sizeof(SQLSERVER_PREFETCH_STATS));
+		return;
+	}
+	stats->blocks = prefetch->stats.blocks;
+	stats->rows = prefetch->stats.rows;
+	stats->readerWaits = InterlockedCompareExchange64((LONG64 volatile*)&prefetch->stats.readerWaits, 0, 0);
+	stats->fetcherWaits = InterlockedCompareExchange64((LONG64 volatile*)&prefetch->stats.fetcherWaits, 0, 0);
+}
@@ -0,0 +1,91 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+#include "sqlserver-interface.h"
+
+/*	Blocks in flight. The helper thread fills one while the caller reads the other */
+#define SQLSERVER_PREFETCH_BLOCK_COUNT			2
+#define SQLSERVER_PREFETCH_DEFAULT_BLOCK_ROWS	256
+/*	Rows per block are reduced for wide result sets so that a block stays under this size */
+#define SQLSERVER_PREFETCH_MAX_BLOCK_BYTES		(4 * 1024 * 1024)
+
+typedef struct _SQLSERVER_PREFETCH_STATS {
+	unsigned long long	blocks;
+	unsigned long long	rows;
+	/*	sqlserverNext found no block ready and waited for the helper thread */
+	unsigned long long	readerWaits;
+	/*	the helper thread found both blocks unread and waited for the caller */
+	unsigned long long	fetcherWaits;
+} SQLSERVER_PREFETCH_STATS;
+
+/*	Per statement read-ahead state. The block ring is single producer (helper thread), single consumer
+	(sqlserverNext): "produced" is only written by the helper thread, "consumed" only by the caller */
+typedef struct _SQLSERVER_PREFETCH {
+	DBInt_Statement			  * stm;
+	SQLULEN						blockRows;
+	HANDLE						thread;
+	/*	auto reset, set after "produced" and "consumed" are advanced */
+	HANDLE						producedEvent;
+	HANDLE						consumedEvent;
+	volatile LONG				produced;
+	volatile LONG				consumed;
+	volatile LONG				stop;
+	/*	SQLSERVER_PREFETCH_BLOCK_COUNT blocks of "blockBytes". Per block and column: "rows" values of
+		the bound column size, then per column "rows" indicators */
+	char					  * buffer;
+	size_t						blockBytes;
+	SQLULEN						rows;
+	size_t					  * valueOffsets;
+	size_t					  * indicatorOffsets;
+	/*	driver writes into the block at this offset, helper thread only */
+	SQLULEN						bindOffset;
+	SQLULEN						rowsFetched;
+	SQLULEN						blockRowCount[SQLSERVER_PREFETCH_BLOCK_COUNT];
+	RETCODE						blockRetCode[SQLSERVER_PREFETCH_BLOCK_COUNT];
+	/*	first error record of the fetch, warnings are logged by the helper thread */
+	SQLSERVER_ERROR				blockError[SQLSERVER_PREFETCH_BLOCK_COUNT];
+	/*	row of the block at "consumed" loaded last, -1 before the first one */
+	SQLLEN						row;
+	SQLSERVER_PREFETCH_STATS	stats;
+} SQLSERVER_PREFETCH;
+
+/* DDL's PRIVATE FUNCTIONS  */
+void			_PrefetchStart(DBInt_Connection* conn, DBInt_Statement* stm);
+BOOL			_PrefetchNext(DBInt_Connection* conn, DBInt_Statement* stm);
+void			_PrefetchStop(DBInt_Connection* conn, DBInt_Statement* stm);
+void			_PrefetchFreeStatement(DBInt_Connection* conn, DBInt_Statement* stm);
+void			_PrefetchRestoreBindings(DBInt_Connection* conn, DBInt_Statement* stm);
+DWORD WINAPI	_PrefetchThread(LPVOID parameter);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Opts the statement into read-ahead. After the first row of every result set of
+	sqlserverExecuteSelectStatement, a helper thread fetches blocks of "blockRows" rows while the caller
+	processes the previous block through sqlserverNext. 0 rows selects SQLSERVER_PREFETCH_DEFAULT_BLOCK_ROWS.
+	The statement must not be used from the caller's side while sqlserverNext has not reached the end, apart
+	from sqlserverCancel. sqlserverSeek and a new execution discard the rows read ahead. */
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverEnableReadAhead(
+	DBInt_Connection* conn,
+	DBInt_Statement* stm,
+	SQLULEN blockRows);
+
+/*	Stops any read-ahead in progress and goes back to one SQLFetch per sqlserverNext */
+SQLSERVER_INTERFACE_API void					sqlserverDisableReadAhead(DBInt_Connection* conn, DBInt_Statement* stm);
+
+/*	Totals since sqlserverEnableReadAhead. Zeroed if read-ahead is not enabled */
+SQLSERVER_INTERFACE_API void					sqlserverGetReadAheadStats(DBInt_Statement* stm, SQLSERVER_PREFETCH_STATS* stats);
@@ -0,0 +1,496 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include <ctype.h>
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-profile.h"
+#include "sqlserver-capture.h"
+
+
+/*	Entries outlive the connections that prepared them, so they get a heap of their own */
+HANDLE								profileHeap = NULL;
+INIT_ONCE							profileInitOnce = INIT_ONCE_STATIC_INIT;
+
+volatile LONG						profileEnabled;
+LONGLONG							profileFrequency;
+/*	Pushed with InterlockedCompareExchangePointer, read without a lock */
+SQLSERVER_PROFILE_ENTRY * volatile	profileBuckets[SQLSERVER_PROFILE_BUCKET_HEADS];
+volatile LONG						profileEntryCount;
+/*	Fingerprint 0, shapes seen after SQLSERVER_PROFILE_MAX_FINGERPRINTS */
+SQLSERVER_PROFILE_ENTRY			  * profileOverflow;
+
+/*	1 based stripe of the current thread, 0 until its first recording */
+__declspec(thread) int				profileStripe;
+volatile LONG						profileNextStripe;
+
+
+BOOL CALLBACK
+_ProfileInit(
+	PINIT_ONCE initOnce,
+	PVOID parameter,
+	PVOID * context
+)
+{
+	LARGE_INTEGER frequency;
+
+	profileHeap = HeapCreate(0, 0, 0);
+	if (profileHeap == NULL) {
+		return FALSE;
+	}
+	QueryPerformanceFrequency(&frequency);
+	profileFrequency = frequency.QuadPart;
+
+	profileOverflow = mkMalloc(profileHeap, sizeof(SQLSERVER_PROFILE_ENTRY), __FILE__, __LINE__);
+	if (profileOverflow == NULL) {
+		return FALSE;
+	}
+	memset(profileOverflow, 0, sizeof(SQLSERVER_PROFILE_ENTRY));
+	strcpy_s(profileOverflow->text, SQLSERVER_PROFILE_TEXT_LENGTH, "(other)");
+	return TRUE;
+}
+
+BOOL
+_ProfileIsWordChar(
+	char ch
+)
+{
+	return isalnum((unsigned char)ch) || ch == '_' || ch == '@' || ch == '#' || ch == '$';
+}
+
+/*	Appends a ?, or folds it into the ? before it when the two are separated by a comma only */
+size_t
+_ProfileAppendPlaceholder(
+	char * normalized,
+	size_t length
+)
+{
+	size_t end = length;
+
+	if (end > 0 && normalized[end - 1] == ' ') {
+		end--;
+	}
+	if (end > 0 && normalized[end - 1] == ',') {
+		end--;
+		if (end > 0 && normalized[end - 1] == ' ') {
+			end--;
+		}
+		if (end > 0 && normalized[end - 1] == '?') {
+			return end;
+		}
+	}
+	normalized[length++] = '?';
+	return length;
+}
+
+/*	Writes the normalised form of "sql" into "normalized", which holds at least strlen(sql) + 1 bytes.
+	Returns the length written, the text is terminated */
+size_t
+_ProfileNormalize(
+	const char * sql,
+	char * normalized
+)
+{
+	size_t		length = 0;
+	BOOL		pendingSpace = FALSE;
+	const char * p = sql;
+
+	while (*p) {
+		if (isspace((unsigned char)*p)) {
+			pendingSpace = TRUE;
+			p++;
+			continue;
+		}
+		if (p[0] == '-' && p[1] == '-') {
+			while (*p && *p != '\n') {
+				p++;
+			}
+			pendingSpace = TRUE;
+			continue;
+		}
+		if (p[0] == '/' && p[1] == '*') {
+			const char * end = strstr(p + 2, "*/");
+			p = end ? end + 2 : p + strlen(p);
+			pendingSpace = TRUE;
+			continue;
+		}
+		if (pendingSpace && length > 0) {
+			normalized[length++] = ' ';
+		}
+		pendingSpace = FALSE;
+
+		BOOL afterWord = length > 0 && _ProfileIsWordChar(normalized[length - 1]);
+
+		if (*p == '\'' || ((*p == 'N' || *p == 'n') && p[1] == '\'' && !afterWord)) {
+			// string literal, '' is an escaped quote
+			p += (*p == '\'') ? 1 : 2;
+			while (*p) {
+				if (*p == '\'' && p[1] == '\'') {
+					p += 2;
+				}
+				else if (*p++ == '\'') {
+					break;
+				}
+			}
+			length = _ProfileAppendPlaceholder(normalized, length);
+		}
+		else if (!afterWord && (isdigit((unsigned char)*p) || (*p == '.' && isdigit((unsigned char)p[1])))) {
+			// numeric literal: integer, decimal, float or 0x binary
+			if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+				for (p += 2; isxdigit((unsigned char)*p); p++);
+			}
+			else {
+				for (; isdigit((unsigned char)*p) || *p == '.'; p++);
+				if ((*p == 'e' || *p == 'E')
+					&& (isdigit((unsigned char)p[1]) || ((p[1] == '+' || p[1] == '-') && isdigit((unsigned char)p[2])))) {
+					for (p += 2; isdigit((unsigned char)*p); p++);
+				}
+			}
+			length = _ProfileAppendPlaceholder(normalized, length);
+		}
+		else if (*p == '?') {
+			p++;
+			length = _ProfileAppendPlaceholder(normalized, length);
+		}
+		else if (*p == '[' || *p == '"') {
+			// quoted identifier, kept as written
+			char close = (*p == '[') ? ']' : '"';
+			normalized[length++] = *p++;
+			while (*p) {
+				normalized[length++] = *p;
+				if (*p++ == close) {
+					if (*p != close) {
+						break;
+					}
+					normalized[length++] = *p++;
+				}
+			}
+		}
+		else {
+			normalized[length++] = ((unsigned char)*p < 0x80) ? (char)tolower((unsigned char)*p) : *p;
+			p++;
+		}
+	}
+	normalized[length] = '\0';
+	return length;
+}
+
+/*	FNV-1a, 0 is reserved for the overflow entry */
+unsigned long long
+_ProfileHash(
+	const char * normalized,
+	size_t length
+)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (unsigned char)normalized[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash ? hash : 1;
+}
+
+/*	Returns the entry of the fingerprint of "sql", created on first sight. NULL while profiling is off.
+	Fingerprints are 64 bit and compared without the text, a collision merges two shapes */
+SQLSERVER_PROFILE_ENTRY *
+_ProfileLookup(
+	const char * sql
+)
+{
+	SQLSERVER_PROFILE_ENTRY * entry = NULL;
+	SQLSERVER_PROFILE_ENTRY * created = NULL;
+
+	if (!profileEnabled || !InitOnceExecuteOnce(&profileInitOnce, _ProfileInit, NULL, NULL)) {
+		return NULL;
+	}
+
+	char * normalized = mkMalloc(profileHeap, strlen(sql) + 1, __FILE__, __LINE__);
+	if (normalized == NULL) {
+		return NULL;
+	}
+	size_t				length = _ProfileNormalize(sql, normalized);
+	unsigned long long	fingerprint = _ProfileHash(normalized, length);
+	SQLSERVER_PROFILE_ENTRY * volatile * head = &profileBuckets[fingerprint % SQLSERVER_PROFILE_BUCKET_HEADS];
+
+	for (;;) {
+		SQLSERVER_PROFILE_ENTRY * first = *head;
+
+		for (entry = first; entry && entry->fingerprint != fingerprint; entry = entry->next);
+		if (entry) {
+			break;
+		}
+		if (profileEntryCount >= SQLSERVER_PROFILE_MAX_FINGERPRINTS) {
+			entry = profileOverflow;
+			break;
+		}
+		if (created == NULL) {
+			created = mkMalloc(profileHeap, sizeof(SQLSERVER_PROFILE_ENTRY), __FILE__, __LINE__);
+			if (created == NULL) {
+				break;
+			}
+			memset(created, 0, sizeof(SQLSERVER_PROFILE_ENTRY));
+			created->fingerprint = fingerprint;
+			strncpy_s(created->text, SQLSERVER_PROFILE_TEXT_LENGTH, normalized, _TRUNCATE);
+		}
+		created->next = first;
+		if (InterlockedCompareExchangePointer((PVOID volatile*)head, created, first) == first) {
+			InterlockedIncrement(&profileEntryCount);
+			entry = created;
+			created = NULL;
+			break;
+		}
+		// another thread pushed an entry meanwhile, possibly for the same fingerprint
+	}
+
+	if (created) {
+		mkFree(profileHeap, created);
+	}
+	mkFree(profileHeap, normalized);
+	return entry;
+}
+
+/*	Timestamp to pass to _ProfileRecord and the capture functions, 0 when the statement is neither
+	profiled nor captured */
+LONGLONG
+_ProfileStart(
+	DBInt_Statement * stm
+)
+{
+	LARGE_INTEGER now;
+
+	if (!captureActive && (!profileEnabled || SQLSERVER_STATEMENT_OF(stm)->profile == NULL)) {
+		return 0;
+	}
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+void
+_ProfileRecord(
+	DBInt_Statement * stm,
+	SQLSERVER_PROFILE_OPERATION operation,
+	LONGLONG started
+)
+{
+	SQLSERVER_PROFILE_ENTRY * entry = SQLSERVER_STATEMENT_OF(stm)->profile;
+	LARGE_INTEGER			  now;
+
+	if (started == 0 || entry == NULL || !profileEnabled) {
+		return;
+	}
+	QueryPerformanceCounter(&now);
+
+	LONGLONG ticks = now.QuadPart - started;
+	_ProfileAdd(entry, operation, (ticks / profileFrequency) * 1000000 + (ticks % profileFrequency) * 1000000 / profileFrequency, 1);
+}
+
+/*	Records "count" samples of "microseconds" */
+void
+_ProfileAdd(
+	SQLSERVER_PROFILE_ENTRY * entry,
+	SQLSERVER_PROFILE_OPERATION operation,
+	LONG64 microseconds,
+	LONG64 count
+)
+{
+	if (profileStripe == 0) {
+		profileStripe = (int)((unsigned long)InterlockedIncrement(&profileNextStripe) % SQLSERVER_PROFILE_STRIPE_COUNT) + 1;
+	}
+	SQLSERVER_PROFILE_HISTOGRAM * histogram = &entry->histograms[profileStripe - 1][operation];
+
+	InterlockedExchangeAdd64(&histogram->buckets[_ProfileBucketIndex(microseconds)], count);
+	InterlockedExchangeAdd64(&histogram->total, microseconds * count);
+	for (LONG64 max = histogram->max; microseconds > max; max = histogram->max) {
+		if (InterlockedCompareExchange64(&histogram->max, microseconds, max) == max) {
+			break;
+		}
+	}
+}
+
+/*	Values below 2 * SUB_BUCKET_COUNT map to themselves. Above, every power of two is split into
+	SUB_BUCKET_COUNT buckets: the value shifted down to SUB_BUCKET_BITS + 1 bits plus the shift per octave */
+int
+_ProfileBucketIndex(
+	unsigned long long microseconds
+)
+{
+	int shift = 0;
+
+	if (microseconds >> SQLSERVER_PROFILE_MAX_MAGNITUDE) {
+		return SQLSERVER_PROFILE_BUCKET_COUNT - 1;
+	}
+	while ((microseconds >> shift) >= 2 * SQLSERVER_PROFILE_SUB_BUCKET_COUNT) {
+		shift++;
+	}
+	return (int)(microseconds >> shift) + shift * SQLSERVER_PROFILE_SUB_BUCKET_COUNT;
+}
+
+unsigned long long
+_ProfileBucketUpperBound(
+	int index
+)
+{
+	int					shift = (index < SQLSERVER_PROFILE_SUB_BUCKET_COUNT) ? 0 : index / SQLSERVER_PROFILE_SUB_BUCKET_COUNT - 1;
+	unsigned long long	base = index - shift * SQLSERVER_PROFILE_SUB_BUCKET_COUNT;
+
+	return ((base + 1) << shift) - 1;
+}
+
+void
+_ProfileMerge(
+	SQLSERVER_PROFILE_ENTRY * entry,
+	SQLSERVER_PROFILE_OPERATION operation,
+	SQLSERVER_PROFILE_LATENCY * latency
+)
+{
+	unsigned long long	buckets[SQLSERVER_PROFILE_BUCKET_COUNT];
+	const int			perMille[] = { 500, 900, 990, 999 };
+	unsigned long long* percentiles[] = { &latency->p50, &latency->p90, &latency->p99, &latency->p999 };
+
+	memset(latency, 0, sizeof(SQLSERVER_PROFILE_LATENCY));
+	memset(buckets, 0, sizeof(buckets));
+
+	for (int stripe = 0; stripe < SQLSERVER_PROFILE_STRIPE_COUNT; stripe++) {
+		SQLSERVER_PROFILE_HISTOGRAM * histogram = &entry->histograms[stripe][operation];
+
+		for (int i = 0; i < SQLSERVER_PROFILE_BUCKET_COUNT; i++) {
+			buckets[i] += histogram->buckets[i];
+			latency->count += histogram->buckets[i];
+		}
+		latency->total += histogram->total;
+		latency->max = max(latency->max, (unsigned long long)histogram->max);
+	}
+
+	if (latency->count == 0) {
+		return;
+	}
+	int					index = 0;
+	unsigned long long	seen = buckets[0];
+	for (int i = 0; i < _countof(perMille); i++) {
+		unsigned long long rank = max((latency->count * perMille[i] + 999) / 1000, 1);
+
+		while (seen < rank && index < SQLSERVER_PROFILE_BUCKET_COUNT - 1) {
+			seen += buckets[++index];
+		}
+		*percentiles[i] = min(_ProfileBucketUpperBound(index), latency->max);
+	}
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverEnableProfiling(
+	BOOL enabled
+)
+{
+	if (InitOnceExecuteOnce(&profileInitOnce, _ProfileInit, NULL, NULL)) {
+		InterlockedExchange(&profileEnabled, enabled ? 1 : 0);
+	}
+}
+
+SQLSERVER_INTERFACE_API
+unsigned long long
+sqlserverGetSqlFingerprint(
+	const char * sql,
+	char * normalized,
+	size_t normalizedSize
+)
+{
+	if (!InitOnceExecuteOnce(&profileInitOnce, _ProfileInit, NULL, NULL)) {
+		return 0;
+	}
+	char * text = mkMalloc(profileHeap, strlen(sql) + 1, __FILE__, __LINE__);
+	if (text == NULL) {
+		return 0;
+	}
+	size_t				length = _ProfileNormalize(sql, text);
+	unsigned long long	fingerprint = _ProfileHash(text, length);
+
+	if (normalized && normalizedSize > 0) {
+		strncpy_s(normalized, normalizedSize, text, _TRUNCATE);
+	}
+	mkFree(profileHeap, text);
+	return fingerprint;
+}
+
+SQLSERVER_INTERFACE_API
+int
+sqlserverGetProfileSnapshot(
+	SQLSERVER_PROFILE_SNAPSHOT * snapshots,
+	int capacity
+)
+{
+	int count = 0;
+
+	if (profileHeap == NULL) {
+		// nothing profiled yet
+		return 0;
+	}
+	for (int i = 0; i <= SQLSERVER_PROFILE_BUCKET_HEADS; i++) {
+		SQLSERVER_PROFILE_ENTRY * entry;
+
+		if (i < SQLSERVER_PROFILE_BUCKET_HEADS) {
+			entry = profileBuckets[i];
+		}
+		else {
+			entry = (profileEntryCount >= SQLSERVER_PROFILE_MAX_FINGERPRINTS) ? profileOverflow : NULL;
+		}
+		for (; entry; entry = (i < SQLSERVER_PROFILE_BUCKET_HEADS) ? entry->next : NULL) {
+			if (count < capacity) {
+				SQLSERVER_PROFILE_SNAPSHOT * snapshot = &snapshots[count];
+
+				snapshot->fingerprint = entry->fingerprint;
+				strcpy_s(snapshot->text, SQLSERVER_PROFILE_TEXT_LENGTH, entry->text);
+				for (int operation = 0; operation < SQLSERVER_PROFILE_OPERATION_COUNT; operation++) {
+					_ProfileMerge(entry, (SQLSERVER_PROFILE_OPERATION)operation, &snapshot->latency[operation]);
+				}
+			}
+			count++;
+		}
+	}
+	return count;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverResetProfile(
+	void
+)
+{
+	if (profileHeap == NULL) {
+		return;
+	}
+	for (int i = 0; i <= SQLSERVER_PROFILE_BUCKET_HEADS; i++) {
+		SQLSERVER_PROFILE_ENTRY * entry = (i < SQLSERVER_PROFILE_BUCKET_HEADS) ? profileBuckets[i] : profileOverflow;
+
+		for (; entry; entry = (i < SQLSERVER_PROFILE_BUCKET_HEADS) ? entry->next : NULL) {
+			for (int stripe = 0; stripe < SQLSERVER_PROFILE_STRIPE_COUNT; stripe++) {
+				for (int operation = 0; operation < SQLSERVER_PROFILE_OPERATION_COUNT; operation++) {
+					SQLSERVER_PROFILE_HISTOGRAM * histogram = &entry->histograms[stripe][operation];
+
+					// recorders keep running, every counter is cleared on its own
+					for (int bucket = 0; bucket < SQLSERVER_PROFILE_BUCKET_COUNT; bucket++) {
+						InterlockedExchange64(&histogram->buckets[bucket], 0);
+					}
+					InterlockedExchange64(&histogram->total, 0);
+					InterlockedExchange64(&histogram->max, 0);
+				}
+			}
+		}
+	}
+}
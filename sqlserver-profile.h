@@ -0,0 +1,107 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+#pragma once
+
+#include "sqlserver-interface.h"
+
+/*	Normalised SQL text kept per fingerprint for display, longer texts are truncated */
+#define SQLSERVER_PROFILE_TEXT_LENGTH			512
+#define SQLSERVER_PROFILE_BUCKET_HEADS			1024
+/*	Query shapes seen after this many are recorded together under fingerprint 0 */
+#define SQLSERVER_PROFILE_MAX_FINGERPRINTS		512
+/*	Counters are striped by thread so that concurrent recorders rarely touch the same cache lines */
+#define SQLSERVER_PROFILE_STRIPE_COUNT			4
+/*	Linear sub-buckets per power of two, a recorded latency is within 1/16 (6.25%) of the real one */
+#define SQLSERVER_PROFILE_SUB_BUCKET_BITS		4
+#define SQLSERVER_PROFILE_SUB_BUCKET_COUNT		(1 << SQLSERVER_PROFILE_SUB_BUCKET_BITS)
+/*	Microseconds below 2^36 (about 19 hours), longer latencies go to the last bucket */
+#define SQLSERVER_PROFILE_MAX_MAGNITUDE			36
+#define SQLSERVER_PROFILE_BUCKET_COUNT			((SQLSERVER_PROFILE_MAX_MAGNITUDE - SQLSERVER_PROFILE_SUB_BUCKET_BITS + 1) * SQLSERVER_PROFILE_SUB_BUCKET_COUNT)
+
+typedef enum _SQLSERVER_PROFILE_OPERATION {
+	/*	_PrepareStatement, including parameter description */
+	SQLSERVER_PROFILE_PREPARE,
+	/*	SQLExecute or SQLExecDirect until the first result is available */
+	SQLSERVER_PROFILE_EXECUTE,
+	/*	a single SQLFetch */
+	SQLSERVER_PROFILE_FETCH,
+	SQLSERVER_PROFILE_OPERATION_COUNT
+} SQLSERVER_PROFILE_OPERATION;
+
+/*	HDR-style log-linear histogram of microseconds. Only updated with interlocked operations */
+typedef struct _SQLSERVER_PROFILE_HISTOGRAM {
+	volatile LONG64					buckets[SQLSERVER_PROFILE_BUCKET_COUNT];
+	volatile LONG64					total;
+	volatile LONG64					max;
+} SQLSERVER_PROFILE_HISTOGRAM;
+
+/*	Entries are never removed, statements keep pointers to them. sqlserverResetProfile clears the counters only */
+typedef struct _SQLSERVER_PROFILE_ENTRY {
+	struct _SQLSERVER_PROFILE_ENTRY * next;
+	unsigned long long				fingerprint;
+	char							text[SQLSERVER_PROFILE_TEXT_LENGTH];
+	SQLSERVER_PROFILE_HISTOGRAM		histograms[SQLSERVER_PROFILE_STRIPE_COUNT][SQLSERVER_PROFILE_OPERATION_COUNT];
+} SQLSERVER_PROFILE_ENTRY;
+
+/*	Microseconds. Percentiles are the upper bound of the bucket holding them */
+typedef struct _SQLSERVER_PROFILE_LATENCY {
+	unsigned long long	count;
+	unsigned long long	total;
+	unsigned long long	max;
+	unsigned long long	p50;
+	unsigned long long	p90;
+	unsigned long long	p99;
+	unsigned long long	p999;
+} SQLSERVER_PROFILE_LATENCY;
+
+typedef struct _SQLSERVER_PROFILE_SNAPSHOT {
+	unsigned long long			fingerprint;
+	char						text[SQLSERVER_PROFILE_TEXT_LENGTH];
+	SQLSERVER_PROFILE_LATENCY	latency[SQLSERVER_PROFILE_OPERATION_COUNT];
+} SQLSERVER_PROFILE_SNAPSHOT;
+
+/* DDL's PRIVATE FUNCTIONS  */
+BOOL						_ProfileIsWordChar(char ch);
+size_t						_ProfileAppendPlaceholder(char* normalized, size_t length);
+size_t						_ProfileNormalize(const char* sql, char* normalized);
+unsigned long long			_ProfileHash(const char* normalized, size_t length);
+SQLSERVER_PROFILE_ENTRY	  * _ProfileLookup(const char* sql);
+LONGLONG					_ProfileStart(DBInt_Statement* stm);
+void						_ProfileRecord(DBInt_Statement* stm, SQLSERVER_PROFILE_OPERATION operation, LONGLONG started);
+void						_ProfileAdd(SQLSERVER_PROFILE_ENTRY* entry, SQLSERVER_PROFILE_OPERATION operation, LONG64 microseconds, LONG64 count);
+int							_ProfileBucketIndex(unsigned long long microseconds);
+unsigned long long			_ProfileBucketUpperBound(int index);
+void						_ProfileMerge(SQLSERVER_PROFILE_ENTRY* entry, SQLSERVER_PROFILE_OPERATION operation, SQLSERVER_PROFILE_LATENCY* latency);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Turns latency recording on or off for the whole process. Statements prepared while it is off are not recorded */
+SQLSERVER_INTERFACE_API void					sqlserverEnableProfiling(BOOL enabled);
+
+/*	Fingerprint of "sql": comments removed, whitespace collapsed, keywords lowercased, string and numeric
+	literals replaced by ?, lists of ? collapsed to one. "normalized" receives the text, truncated to
+	"normalizedSize", and may be NULL */
+SQLSERVER_INTERFACE_API
+unsigned long long
+sqlserverGetSqlFingerprint(
+	const char* sql,
+	char* normalized,
+	size_t normalizedSize);
+
+/*	Merges the per thread counters of every fingerprint into "snapshots". Returns the fingerprint count,
+	which may be greater than "capacity"; only "capacity" entries are filled */
+SQLSERVER_INTERFACE_API int						sqlserverGetProfileSnapshot(SQLSERVER_PROFILE_SNAPSHOT* snapshots, int capacity);
+
+/*	Zeroes every histogram. Fingerprints already seen are kept */
+SQLSERVER_INTERFACE_API void					sqlserverResetProfile(void);
@@ -0,0 +1,300 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+#include "sqlserver-retry.h"
+
+
+SRWLOCK								retryPolicyLock = SRWLOCK_INIT;
+SQLSERVER_RETRY_POLICY				retryPolicy = {
+	SQLSERVER_RETRY_DEFAULT_MAX_ATTEMPTS,
+	SQLSERVER_RETRY_DEFAULT_BASE_DELAY,
+	SQLSERVER_RETRY_DEFAULT_MAX_DELAY,
+	TRUE
+};
+SQLSERVER_RETRY_STATS				retryStats;
+
+/*	jitter source, seeded on first use in each thread */
+__declspec(thread) unsigned int		retrySeed;
+
+DWORD
+_RetryDelay(
+	const SQLSERVER_RETRY_POLICY * policy,
+	int attempt
+)
+{
+	unsigned long long delay = policy->baseDelayMs;
+
+	for (int i = 1; i < attempt && delay < policy->maxDelayMs; i++) {
+		delay *= 2;
+	}
+	if (delay > policy->maxDelayMs) {
+		delay = policy->maxDelayMs;
+	}
+
+	if (retrySeed == 0) {
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		retrySeed = (unsigned int)counter.QuadPart ^ GetCurrentThreadId();
+		retrySeed |= 1;
+	}
+	// xorshift32
+	retrySeed ^= retrySeed << 13;
+	retrySeed ^= retrySeed >> 17;
+	retrySeed ^= retrySeed << 5;
+
+	unsigned long long half = delay / 2;
+	return (DWORD)(delay - (half ? retrySeed % (half + 1) : 0));
+}
+
+/*	Gives "stm" a new handle on the reconnected connection, prepares its text again and binds the parameter
+	values kept in its buffers. Parameter metadata described before is reused */
+BOOL
+_RetryRestoreStatement(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_STATEMENT * state = SQLSERVER_STATEMENT_OF(stm);
+	SQLWCHAR			* wSql = NULL;
+
+	// the lost execution's error is already classified, only failures from here on count
+	_ResetError(conn, stm);
+
+	// the old handle was released by SQLDisconnect
+	state->hStmt = NULL;
+	TRYODBC(*conn->connection.sqlserverHandle,
+		SQL_HANDLE_DBC,
+		SQLAllocHandle(SQL_HANDLE_STMT, *conn->connection.sqlserverHandle, stm->statement.sqlserver.hStmt));
+
+	TRYODBC_STM(stm,
+		SQLSetStmtAttr(*stm->statement.sqlserver.hStmt, SQL_ATTR_CURSOR_TYPE, (SQLPOINTER)SQL_CURSOR_STATIC, 0));
+
+	if (state->queryTimeout) {
+		TRYODBC_STM(stm,
+			SQLSetStmtAttr(*stm->statement.sqlserver.hStmt, SQL_ATTR_QUERY_TIMEOUT, (SQLPOINTER)state->queryTimeout, 0));
+	}
+
+	if (state->directSql == NULL) {
+		// what the failed execution ran, whatever the caller passed to it
+		size_t sourceCharCount = strlen(state->preparedSql);
+		wSql = _StatementMalloc(conn, stm, (sourceCharCount + 1) * sizeof(SQLWCHAR), __FILE__, __LINE__);
+		mbstowcs_s(NULL, wSql, sourceCharCount + 1, state->preparedSql, sourceCharCount);
+
+		SQLSetStmtAttr(*stm->statement.sqlserver.hStmt, SQL_SOPT_SS_DEFER_PREPARE, (SQLPOINTER)SQL_DP_ON, SQL_IS_INTEGER);
+
+		TRYODBC_STM(stm,
+			SQLPrepare(*stm->statement.sqlserver.hStmt, wSql, SQL_NTS));
+	}
+
+	for (SQLSMALLINT iParam = 0; iParam < stm->statement.sqlserver.ParameterCount; iParam++) {
+		if (stm->statement.sqlserver.bindVariables[iParam].buffer == NULL) {
+			// never bound
+			continue;
+		}
+		if (!_BindParameterBuffer(conn, stm, iParam + 1)) {
+			goto Exit;
+		}
+	}
+
+Exit:
+	_StatementFree(conn, stm, wSql);
+	return !state->lastError.hasError && !conn->err;
+}
+
+/*	Called after each execution. Returns TRUE when the failed execution should run again, after waiting for the
+	backoff delay and reconnecting if needed. "attempt" counts executions so far */
+BOOL
+_RetryBeforeNextAttempt(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	int attempt
+)
+{
+	SQLSERVER_STATEMENT		  * state = SQLSERVER_STATEMENT_OF(stm);
+	SQLSERVER_RETRY_POLICY		policy;
+
+	if (!state->lastError.hasError) {
+		if (attempt > 1) {
+			InterlockedIncrement64((LONG64 volatile*)&retryStats.recovered);
+		}
+		return FALSE;
+	}
+
+	SQLSERVER_ERROR_CLASS errorClass = sqlserverClassifyError(&state->lastError);
+	switch (errorClass) {
+		case SQLSERVER_ERROR_REJECTED:
+			InterlockedIncrement64((LONG64 volatile*)&retryStats.rejectedErrors);
+			break;
+		case SQLSERVER_ERROR_TRANSIENT:
+			InterlockedIncrement64((LONG64 volatile*)&retryStats.transientErrors);
+			break;
+		case SQLSERVER_ERROR_CONNECTION:
+			InterlockedIncrement64((LONG64 volatile*)&retryStats.connectionErrors);
+			break;
+		default:
+			return FALSE;
+	}
+	if (errorClass != SQLSERVER_ERROR_REJECTED && !state->retryable) {
+		return FALSE;
+	}
+
+	AcquireSRWLockShared(&retryPolicyLock);
+	policy = retryPolicy;
+	ReleaseSRWLockShared(&retryPolicyLock);
+
+	if (attempt >= policy.maxAttempts) {
+		if (policy.maxAttempts > 1) {
+			InterlockedIncrement64((LONG64 volatile*)&retryStats.exhausted);
+		}
+		return FALSE;
+	}
+
+	// throttling errors may close the connection as well
+	BOOL connectionLost = !sqlserverIsConnectionOpen(conn);
+
+	if (connectionLost) {
+		if (!policy.reconnect || state->tableParameters) {
+			return FALSE;
+		}
+		if (SQLSERVER_CONNECTION_OF(conn)->statementCount > 1) {
+			// the handles of the other statements would be released under them
+			return FALSE;
+		}
+	}
+	else {
+		SQLUINTEGER autoCommit = SQL_AUTOCOMMIT_ON;
+		SQLGetConnectAttr(*conn->connection.sqlserverHandle, SQL_ATTR_AUTOCOMMIT, &autoCommit, SQL_IS_UINTEGER, NULL);
+		if (autoCommit != SQL_AUTOCOMMIT_ON && errorClass != SQLSERVER_ERROR_REJECTED) {
+			// the rest of the transaction was rolled back with it, only the caller can run it again
+			return FALSE;
+		}
+		// a deadlock during the first fetch leaves the cursor open
+		SQLFreeStmt(*stm->statement.sqlserver.hStmt, SQL_CLOSE);
+	}
+
+	Sleep(_RetryDelay(&policy, attempt));
+
+	if (connectionLost) {
+		if (!_ReconnectConnection(conn)) {
+			return FALSE;
+		}
+		InterlockedIncrement64((LONG64 volatile*)&retryStats.reconnects);
+		if (!_RetryRestoreStatement(conn, stm)) {
+			return FALSE;
+		}
+	}
+
+	InterlockedIncrement64((LONG64 volatile*)&retryStats.retries);
+	_ResetError(conn, stm);
+	return TRUE;
+}
+
+SQLSERVER_INTERFACE_API
+SQLSERVER_ERROR_CLASS
+sqlserverClassifyError(
+	const SQLSERVER_ERROR * error
+)
+{
+	if (!error->hasError) {
+		return SQLSERVER_ERROR_PERMANENT;
+	}
+
+	switch (error->nativeError) {
+		// Azure SQL: service busy, database unavailable or being moved, resource limits of the elastic pool
+		case 40501:
+		case 40613:
+		case 40197:
+		case 49918:
+		case 49919:
+		case 49920:
+		case 4221:
+		case 10928:
+		case 10929:
+			return SQLSERVER_ERROR_REJECTED;
+
+		// deadlock victim, snapshot update conflicts
+		case 1205:
+		case 3960:
+		case 3961:
+		case 41302:
+		case 41305:
+		case 41325:
+		case 41301:
+			return SQLSERVER_ERROR_TRANSIENT;
+
+		// transport level errors
+		case 233:
+		case 64:
+		case 10053:
+		case 10054:
+		case 10060:
+			return SQLSERVER_ERROR_CONNECTION;
+	}
+
+	if (strcmp(error->sqlState, "40001") == 0) {
+		// serialization failure, reported by the driver for deadlocks too
+		return SQLSERVER_ERROR_TRANSIENT;
+	}
+	if (strcmp(error->sqlState, "08S01") == 0 || strcmp(error->sqlState, "08001") == 0 || strcmp(error->sqlState, "08003") == 0) {
+		return SQLSERVER_ERROR_CONNECTION;
+	}
+	// 08007: the link broke during a commit, its outcome is unknown
+	return SQLSERVER_ERROR_PERMANENT;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverSetRetryPolicy(
+	const SQLSERVER_RETRY_POLICY * policy
+)
+{
+	AcquireSRWLockExclusive(&retryPolicyLock);
+	retryPolicy = *policy;
+	if (retryPolicy.maxAttempts < 1) {
+		retryPolicy.maxAttempts = 1;
+	}
+	ReleaseSRWLockExclusive(&retryPolicyLock);
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverSetStatementRetryable(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	BOOL retryable
+)
+{
+	SQLSERVER_STATEMENT_OF(stm)->retryable = retryable;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverGetRetryStats(
+	SQLSERVER_RETRY_STATS * stats
+)
+{
+	stats->retries = InterlockedCompareExchange64((LONG64 volatile*)&retryStats.retries, 0, 0);
+	stats->recovered = InterlockedCompareExchange64((LONG64 volatile*)&retryStats.recovered, 0, 0);
+	stats->exhausted = InterlockedCompareExchange64((LONG64 volatile*)&retryStats.exhausted, 0, 0);
+	stats->reconnects = InterlockedCompareExchange64((LONG64 volatile*)&retryStats.reconnects, 0, 0);
+	stats->rejectedErrors = InterlockedCompareExchange64((LONG64 volatile*)&retryStats.rejectedErrors, 0, 0);
+	stats->transientErrors = InterlockedCompareExchange64((LONG64 volatile*)&retryStats.transientErrors, 0, 0);
+	stats->connectionErrors = InterlockedCompareExchange64((LONG64 volatile*)&retryStats.connectionErrors, 0, 0);
+}
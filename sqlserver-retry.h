@@ -0,0 +1,80 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+#include "sqlserver-interface.h"
+
+typedef enum _SQLSERVER_ERROR_CLASS {
+	/*	retrying gives the same result */
+	SQLSERVER_ERROR_PERMANENT,
+	/*	the server refused the request before running it (throttling, database busy or moving),
+		repeating it is safe for any statement */
+	SQLSERVER_ERROR_REJECTED,
+	/*	the statement was rolled back (deadlock victim, snapshot conflict), repeating is safe if it is idempotent */
+	SQLSERVER_ERROR_TRANSIENT,
+	/*	the link to the server is gone, the outcome is unknown */
+	SQLSERVER_ERROR_CONNECTION
+} SQLSERVER_ERROR_CLASS;
+
+typedef struct _SQLSERVER_RETRY_POLICY {
+	/*	executions including the first one, 1 disables retrying */
+	int				maxAttempts;
+	/*	delay before the first retry, doubled on each following one up to maxDelayMs. A random
+		amount of up to half of it is subtracted so that colliding transactions do not meet again */
+	DWORD			baseDelayMs;
+	DWORD			maxDelayMs;
+	/*	reconnect and prepare the statement again when the connection is lost */
+	BOOL			reconnect;
+} SQLSERVER_RETRY_POLICY;
+
+#define SQLSERVER_RETRY_DEFAULT_MAX_ATTEMPTS		1
+#define SQLSERVER_RETRY_DEFAULT_BASE_DELAY			50
+#define SQLSERVER_RETRY_DEFAULT_MAX_DELAY			2000
+
+typedef struct _SQLSERVER_RETRY_STATS {
+	unsigned long long	retries;
+	/*	executions that succeeded after at least one retry */
+	unsigned long long	recovered;
+	/*	executions that still failed with a retryable error after maxAttempts */
+	unsigned long long	exhausted;
+	unsigned long long	reconnects;
+	unsigned long long	rejectedErrors;
+	unsigned long long	transientErrors;
+	unsigned long long	connectionErrors;
+} SQLSERVER_RETRY_STATS;
+
+/* DDL's PRIVATE FUNCTIONS  */
+DWORD			_RetryDelay(const SQLSERVER_RETRY_POLICY* policy, int attempt);
+BOOL			_RetryRestoreStatement(DBInt_Connection* conn, DBInt_Statement* stm);
+BOOL			_RetryBeforeNextAttempt(DBInt_Connection* conn, DBInt_Statement* stm, int attempt);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+SQLSERVER_INTERFACE_API SQLSERVER_ERROR_CLASS	sqlserverClassifyError(const SQLSERVER_ERROR* error);
+
+/*	Sets the process wide policy. Statements are only retried after SQLSERVER_ERROR_REJECTED errors unless
+	they are marked with sqlserverSetStatementRetryable, and never inside a manual transaction.
+	Only sqlserverExecuteSelectStatement, sqlserverExecuteBound and sqlserverExecuteScalar retry. Pipelines,
+	asynchronous executions, sqlserverExecuteReturning, sqlserverExecuteArray, columnar reads and trace
+	replays run once: their results are consumed or reported as they arrive, so a failure is left to the
+	caller */
+SQLSERVER_INTERFACE_API void					sqlserverSetRetryPolicy(const SQLSERVER_RETRY_POLICY* policy);
+
+/*	Marks the statement as safe to execute more than once. After a lost connection the statement is prepared
+	again with its prepared text and its parameter values are bound again. The connection is only reconnected
+	while this is its only statement, and not for statements with table-valued parameters. */
+SQLSERVER_INTERFACE_API void					sqlserverSetStatementRetryable(DBInt_Connection* conn, DBInt_Statement* stm, BOOL retryable);
+
+SQLSERVER_INTERFACE_API void					sqlserverGetRetryStats(SQLSERVER_RETRY_STATS* stats);
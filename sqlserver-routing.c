@@ -0,0 +1,315 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-pool.h"
+#include "sqlserver-routing.h"
+
+
+SQLSERVER_ROUTING_GROUP *
+_RoutingNewGroup(
+	HANDLE heapHandle,
+	const SQLSERVER_ROUTING_OPTIONS * options
+)
+{
+	SQLSERVER_ROUTING_GROUP * group = mkMalloc(heapHandle, sizeof(SQLSERVER_ROUTING_GROUP), __FILE__, __LINE__);
+	memset(group, 0, sizeof(SQLSERVER_ROUTING_GROUP));
+
+	group->heapHandle = heapHandle;
+	group->nodeCount = 1 + max(options->replicaCount, 0);
+	group->nodes = mkMalloc(heapHandle, group->nodeCount * sizeof(SQLSERVER_ROUTING_NODE), __FILE__, __LINE__);
+	memset(group->nodes, 0, group->nodeCount * sizeof(SQLSERVER_ROUTING_NODE));
+	for (int i = 0; i < group->nodeCount; i++) {
+		group->nodes[i].healthy = TRUE;
+	}
+
+	group->balance = options->balance;
+	group->acquireTimeoutMs = options->acquireTimeoutMs ? options->acquireTimeoutMs : SQLSERVER_ROUTING_DEFAULT_ACQUIRE_TIMEOUT;
+	group->retryAfterMs = options->retryAfterMs ? options->retryAfterMs : SQLSERVER_ROUTING_DEFAULT_RETRY_AFTER;
+
+	return group;
+}
+
+/*	A failed node is given another chance once retryAfterMs has passed */
+BOOL
+_RoutingIsAvailable(
+	SQLSERVER_ROUTING_GROUP * group,
+	int node
+)
+{
+	SQLSERVER_ROUTING_NODE * routingNode = &group->nodes[node];
+
+	if (routingNode->healthy) {
+		return TRUE;
+	}
+	return GetTickCount64() - (ULONGLONG)routingNode->failedAt >= group->retryAfterMs;
+}
+
+/*	Node for the next lease. 0, the primary, for writes and when no replica is available */
+int
+_RoutingChoose(
+	SQLSERVER_ROUTING_GROUP * group,
+	BOOL readOnly
+)
+{
+	int replicaCount = group->nodeCount - 1;
+	int best = 0;
+
+	if (!readOnly || replicaCount == 0) {
+		return 0;
+	}
+
+	// the starting point rotates, so ties and round robin spread the same way
+	unsigned long start = (unsigned long)InterlockedIncrement(&group->nextReplica);
+
+	for (int i = 0; i < replicaCount; i++) {
+		int node = 1 + (int)((start + i) % replicaCount);
+
+		if (!_RoutingIsAvailable(group, node)) {
+			continue;
+		}
+		if (group->balance == SQLSERVER_ROUTING_ROUND_ROBIN) {
+			return node;
+		}
+		if (best == 0 || group->nodes[node].outstanding < group->nodes[best].outstanding) {
+			best = node;
+		}
+	}
+	return best;
+}
+
+void
+_RoutingMarkFailed(
+	SQLSERVER_ROUTING_GROUP * group,
+	int node
+)
+{
+	SQLSERVER_ROUTING_NODE * routingNode = &group->nodes[node];
+
+	InterlockedExchange64(&routingNode->failedAt, (LONG64)GetTickCount64());
+	InterlockedExchange(&routingNode->healthy, FALSE);
+	InterlockedIncrement64((LONG64 volatile*)&routingNode->stats.failures);
+}
+
+SQLSERVER_INTERFACE_API
+SQLSERVER_ROUTING_GROUP *
+sqlserverRoutingCreate(
+	HANDLE heapHandle,
+	DBInt_SupportedDatabaseType dbType,
+	const SQLSERVER_ROUTING_OPTIONS * options
+)
+{
+	SQLSERVER_ROUTING_GROUP * group = _RoutingNewGroup(heapHandle, options);
+
+	for (int i = 0; i < group->nodeCount; i++) {
+		const SQLSERVER_ROUTING_NODE_OPTIONS  * nodeOptions = (i == 0) ? &options->primary : &options->replicas[i - 1];
+		SQLSERVER_POOL_OPTIONS					poolOptions;
+		SQLSERVER_CONNECTION_OPTIONS			connectionOptions;
+		char								  * readOnly = NULL;
+
+		if (options->poolOptions) {
+			poolOptions = *options->poolOptions;
+		}
+		else {
+			memset(&poolOptions, 0, sizeof(SQLSERVER_POOL_OPTIONS));
+		}
+		if (poolOptions.connectionOptions) {
+			connectionOptions = *poolOptions.connectionOptions;
+		}
+		else {
+			memset(&connectionOptions, 0, sizeof(SQLSERVER_CONNECTION_OPTIONS));
+		}
+		connectionOptions.connectionString = nodeOptions->connectionString;
+
+		if (i > 0) {
+			// the listener or the replica itself then refuses writes and routes to a readable secondary
+			const char * base = nodeOptions->connectionString ? nodeOptions->connectionString
+				: (connectionOptions.attributes ? connectionOptions.attributes : "");
+			size_t size = strlen(base) + strlen(SQLSERVER_ROUTING_READ_ONLY_INTENT) + 2;
+
+			readOnly = mkMalloc(heapHandle, size, __FILE__, __LINE__);
+			strcpy_s(readOnly, size, base);
+			if (*base && base[strlen(base) - 1] != ';') {
+				strcat_s(readOnly, size, ";");
+			}
+			strcat_s(readOnly, size, SQLSERVER_ROUTING_READ_ONLY_INTENT);
+
+			if (nodeOptions->connectionString) {
+				connectionOptions.connectionString = readOnly;
+			}
+			else {
+				connectionOptions.attributes = readOnly;
+			}
+		}
+		poolOptions.connectionOptions = &connectionOptions;
+
+		// strings are copied by the pool
+		group->nodes[i].pool = sqlserverPoolCreate(heapHandle, dbType,
+			nodeOptions->hostName, nodeOptions->instanceName, options->databaseName, options->userName, options->password,
+			&poolOptions);
+
+		if (readOnly) {
+			mkFree(heapHandle, readOnly);
+		}
+		if (group->nodes[i].pool == NULL) {
+			sqlserverRoutingDestroy(group);
+			return NULL;
+		}
+	}
+	return group;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverRoutingAcquire(
+	SQLSERVER_ROUTING_GROUP * group,
+	BOOL readOnly,
+	SQLSERVER_ROUTING_LEASE * lease
+)
+{
+	// every failing replica is marked, so at most one try per node before the primary
+	for (int attempt = 0; attempt < group->nodeCount; attempt++) {
+		int						 node = (attempt == group->nodeCount - 1) ? 0 : _RoutingChoose(group, readOnly);
+		SQLSERVER_ROUTING_NODE * routingNode = &group->nodes[node];
+
+		if (readOnly && node == 0 && group->nodeCount > 1) {
+			InterlockedIncrement64((LONG64 volatile*)&routingNode->stats.fallbacks);
+		}
+
+		InterlockedIncrement(&routingNode->outstanding);
+		DBInt_Connection * conn = sqlserverPoolAcquire(routingNode->pool, group->acquireTimeoutMs);
+
+		if (conn) {
+			if (!routingNode->healthy) {
+				InterlockedExchange(&routingNode->healthy, TRUE);
+			}
+			InterlockedIncrement64((LONG64 volatile*)&routingNode->stats.leases);
+			lease->conn = conn;
+			lease->node = node;
+			QueryPerformanceCounter(&lease->acquiredAt);
+			return TRUE;
+		}
+
+		InterlockedDecrement(&routingNode->outstanding);
+		_RoutingMarkFailed(group, node);
+		if (node == 0) {
+			break;
+		}
+	}
+
+	memset(lease, 0, sizeof(SQLSERVER_ROUTING_LEASE));
+	return FALSE;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverRoutingRelease(
+	SQLSERVER_ROUTING_GROUP * group,
+	SQLSERVER_ROUTING_LEASE * lease,
+	BOOL failed
+)
+{
+	SQLSERVER_ROUTING_NODE * routingNode = &group->nodes[lease->node];
+	LARGE_INTEGER			 frequency, now;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&now);
+
+	LONG64 latency = (now.QuadPart - lease->acquiredAt.QuadPart) * 1000000 / frequency.QuadPart;
+	InterlockedExchangeAdd64((LONG64 volatile*)&routingNode->stats.totalLatency, latency);
+	for (LONG64 maxLatency = routingNode->stats.maxLatency; latency > maxLatency; maxLatency = routingNode->stats.maxLatency) {
+		if (InterlockedCompareExchange64((LONG64 volatile*)&routingNode->stats.maxLatency, latency, maxLatency) == maxLatency) {
+			break;
+		}
+	}
+
+	if (failed) {
+		if (lease->conn && !sqlserverIsConnectionOpen(lease->conn)) {
+			// the server went away, not just the caller's query
+			_RoutingMarkFailed(group, lease->node);
+		}
+		else {
+			InterlockedIncrement64((LONG64 volatile*)&routingNode->stats.failures);
+		}
+	}
+
+	sqlserverPoolRelease(routingNode->pool, lease->conn);
+	InterlockedDecrement(&routingNode->outstanding);
+	lease->conn = NULL;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverRoutingSetNodeHealth(
+	SQLSERVER_ROUTING_GROUP * group,
+	int node,
+	BOOL healthy
+)
+{
+	if (node < 0 || node >= group->nodeCount) {
+		return;
+	}
+	if (healthy) {
+		InterlockedExchange(&group->nodes[node].healthy, TRUE);
+	}
+	else {
+		InterlockedExchange64(&group->nodes[node].failedAt, (LONG64)GetTickCount64());
+		InterlockedExchange(&group->nodes[node].healthy, FALSE);
+	}
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverRoutingGetNodeStats(
+	SQLSERVER_ROUTING_GROUP * group,
+	int node,
+	SQLSERVER_ROUTING_NODE_STATS * stats
+)
+{
+	if (node < 0 || node >= group->nodeCount) {
+		return FALSE;
+	}
+	SQLSERVER_ROUTING_NODE * routingNode = &group->nodes[node];
+
+	stats->leases = InterlockedCompareExchange64((LONG64 volatile*)&routingNode->stats.leases, 0, 0);
+	stats->failures = InterlockedCompareExchange64((LONG64 volatile*)&routingNode->stats.failures, 0, 0);
+	stats->fallbacks = InterlockedCompareExchange64((LONG64 volatile*)&routingNode->stats.fallbacks, 0, 0);
+	stats->totalLatency = InterlockedCompareExchange64((LONG64 volatile*)&routingNode->stats.totalLatency, 0, 0);
+	stats->maxLatency = InterlockedCompareExchange64((LONG64 volatile*)&routingNode->stats.maxLatency, 0, 0);
+	stats->outstanding = routingNode->outstanding;
+	stats->healthy = routingNode->healthy;
+	return TRUE;
+}
+
+SQLSERVER_INTERFACE_API
+void
+sqlserverRoutingDestroy(
+	SQLSERVER_ROUTING_GROUP * group
+)
+{
+	if (group == NULL) {
+		return;
+	}
+	for (int i = 0; i < group->nodeCount; i++) {
+		if (group->nodes[i].pool) {
+			sqlserverPoolDestroy(group->nodes[i].pool);
+		}
+	}
+	mkFree(group->heapHandle, group->nodes);
+	mkFree(group->heapHandle, group);
+}
@@ -0,0 +1,132 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+#include "sqlserver-interface.h"
+#include "sqlserver-pool.h"
+
+#define SQLSERVER_ROUTING_DEFAULT_ACQUIRE_TIMEOUT	5000
+#define SQLSERVER_ROUTING_DEFAULT_RETRY_AFTER		10000
+/*	Appended to the attributes of replica connections */
+#define SQLSERVER_ROUTING_READ_ONLY_INTENT			"ApplicationIntent=ReadOnly;"
+
+typedef enum _SQLSERVER_ROUTING_BALANCE {
+	/*	replica with the fewest leases out, ties go round robin */
+	SQLSERVER_ROUTING_LEAST_OUTSTANDING = 0,
+	SQLSERVER_ROUTING_ROUND_ROBIN
+} SQLSERVER_ROUTING_BALANCE;
+
+/*	Server of a node, either as host and instance or as a complete connection string */
+typedef struct _SQLSERVER_ROUTING_NODE_OPTIONS {
+	const char				  * hostName;
+	const char				  * instanceName;
+	/*	e.g. "DSN=replica1;", see SQLSERVER_CONNECTION_OPTIONS.connectionString */
+	const char				  * connectionString;
+} SQLSERVER_ROUTING_NODE_OPTIONS;
+
+typedef struct _SQLSERVER_ROUTING_OPTIONS {
+	SQLSERVER_ROUTING_NODE_OPTIONS			primary;
+	const SQLSERVER_ROUTING_NODE_OPTIONS  * replicas;
+	int										replicaCount;
+	const char							  * databaseName;
+	const char							  * userName;
+	const char							  * password;
+	SQLSERVER_ROUTING_BALANCE				balance;
+	/*	milliseconds to wait for a connection of a node, 0 means SQLSERVER_ROUTING_DEFAULT_ACQUIRE_TIMEOUT */
+	DWORD									acquireTimeoutMs;
+	/*	milliseconds a failed replica is skipped before it is tried again, 0 means SQLSERVER_ROUTING_DEFAULT_RETRY_AFTER */
+	DWORD									retryAfterMs;
+	/*	pool of every node, may be NULL. Replicas get SQLSERVER_ROUTING_READ_ONLY_INTENT added to the attributes */
+	const SQLSERVER_POOL_OPTIONS		  * poolOptions;
+} SQLSERVER_ROUTING_OPTIONS;
+
+typedef struct _SQLSERVER_ROUTING_NODE_STATS {
+	unsigned long long	leases;
+	/*	leases released as failed and connections that could not be acquired */
+	unsigned long long	failures;
+	/*	read-only leases given to the primary because no replica was healthy, primary only */
+	unsigned long long	fallbacks;
+	/*	microseconds from acquire to release */
+	unsigned long long	totalLatency;
+	unsigned long long	maxLatency;
+	LONG				outstanding;
+	BOOL				healthy;
+} SQLSERVER_ROUTING_NODE_STATS;
+
+typedef struct _SQLSERVER_ROUTING_NODE {
+	SQLSERVER_POOL			  * pool;
+	volatile LONG				outstanding;
+	volatile LONG				healthy;
+	/*	GetTickCount64 of the last failure */
+	volatile LONG64				failedAt;
+	SQLSERVER_ROUTING_NODE_STATS stats;
+} SQLSERVER_ROUTING_NODE;
+
+/*	Node 0 is the primary, the others are replicas */
+typedef struct _SQLSERVER_ROUTING_GROUP {
+	HANDLE						heapHandle;
+	SQLSERVER_ROUTING_NODE	  * nodes;
+	int							nodeCount;
+	SQLSERVER_ROUTING_BALANCE	balance;
+	DWORD						acquireTimeoutMs;
+	DWORD						retryAfterMs;
+	volatile LONG				nextReplica;
+} SQLSERVER_ROUTING_GROUP;
+
+/*	A connection handed out by sqlserverRoutingAcquire */
+typedef struct _SQLSERVER_ROUTING_LEASE {
+	DBInt_Connection		  * conn;
+	int							node;
+	LARGE_INTEGER				acquiredAt;
+} SQLSERVER_ROUTING_LEASE;
+
+/* DDL's PRIVATE FUNCTIONS  */
+SQLSERVER_ROUTING_GROUP   * _RoutingNewGroup(HANDLE heapHandle, const SQLSERVER_ROUTING_OPTIONS* options);
+BOOL						_RoutingIsAvailable(SQLSERVER_ROUTING_GROUP* group, int node);
+int							_RoutingChoose(SQLSERVER_ROUTING_GROUP* group, BOOL readOnly);
+void						_RoutingMarkFailed(SQLSERVER_ROUTING_GROUP* group, int node);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Creates a pool for the primary and one for each replica. Replica connections are opened with
+	ApplicationIntent=ReadOnly. Returns NULL when a pool cannot be created */
+SQLSERVER_INTERFACE_API
+SQLSERVER_ROUTING_GROUP *
+sqlserverRoutingCreate(
+	HANDLE heapHandle,
+	DBInt_SupportedDatabaseType dbType,
+	const SQLSERVER_ROUTING_OPTIONS* options);
+
+/*	Hands out a connection of the primary, or of a healthy replica when "readOnly" is set. Falls back to the
+	primary when no replica can give one. Returns FALSE when no connection could be acquired */
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverRoutingAcquire(
+	SQLSERVER_ROUTING_GROUP* group,
+	BOOL readOnly,
+	SQLSERVER_ROUTING_LEASE* lease);
+
+/*	Gives the connection back. "failed" reports an error of the caller's work: a replica whose connection turns
+	out to be broken is then skipped for options.retryAfterMs */
+SQLSERVER_INTERFACE_API void					sqlserverRoutingRelease(SQLSERVER_ROUTING_GROUP* group, SQLSERVER_ROUTING_LEASE* lease, BOOL failed);
+
+/*	Marks a node healthy or failed, e.g. from an external availability group monitor */
+SQLSERVER_INTERFACE_API void					sqlserverRoutingSetNodeHealth(SQLSERVER_ROUTING_GROUP* group, int node, BOOL healthy);
+
+/*	"node" 0 is the primary. Returns FALSE for an unknown node */
+SQLSERVER_INTERFACE_API BOOL					sqlserverRoutingGetNodeStats(SQLSERVER_ROUTING_GROUP* group, int node, SQLSERVER_ROUTING_NODE_STATS* stats);
+
+/*	All leases must have been released */
+SQLSERVER_INTERFACE_API void					sqlserverRoutingDestroy(SQLSERVER_ROUTING_GROUP* group);
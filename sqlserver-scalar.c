@@ -0,0 +1,168 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+#include "sqlserver-direct.h"
+#include "sqlserver-retry.h"
+#include "sqlserver-scalar.h"
+
+
+/*	Reads the value once the statement has been executed, then closes the cursor */
+SQLSERVER_SCALAR_STATUS
+_ScalarRead(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLSMALLINT cType,
+	void * buffer,
+	SQLLEN bufferLength,
+	SQLLEN * indicator
+)
+{
+	SQLHSTMT				hStmt = *stm->statement.sqlserver.hStmt;
+	SQLSERVER_SCALAR_STATUS	status = SQLSERVER_SCALAR_NO_ROW;
+	SQLSMALLINT				colCount = 0;
+	SQLLEN					length = SQL_NULL_DATA;
+	RETCODE					RetCode;
+
+	// statements returning no result set come first in the batch
+	for (;;) {
+		TRYODBC_STM(stm,
+			SQLNumResultCols(hStmt, &colCount));
+		if (colCount > 0) {
+			break;
+		}
+		TRYODBC_STM(stm,
+			RetCode = SQLMoreResults(hStmt));
+		if (RetCode == SQL_NO_DATA) {
+			goto Exit;
+		}
+	}
+
+	TRYODBC_STM(stm,
+		RetCode = SQLFetch(hStmt));
+	if (RetCode == SQL_NO_DATA) {
+		goto Exit;
+	}
+
+	TRYODBC_STM(stm,
+		SQLGetData(hStmt, 1, cType, buffer, bufferLength, &length));
+	status = (length == SQL_NULL_DATA) ? SQLSERVER_SCALAR_NULL : SQLSERVER_SCALAR_VALUE;
+
+Exit:
+	SQLFreeStmt(hStmt, SQL_CLOSE);
+	stm->statement.sqlserver.isEof = TRUE;
+
+	if (indicator) {
+		*indicator = length;
+	}
+	return SQLSERVER_STATEMENT_OF(stm)->lastError.hasError ? SQLSERVER_SCALAR_ERROR : status;
+}
+
+SQLSERVER_INTERFACE_API
+SQLSERVER_SCALAR_STATUS
+sqlserverExecuteScalar(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql,
+	SQLSMALLINT cType,
+	void * buffer,
+	SQLLEN bufferLength,
+	SQLLEN * indicator
+)
+{
+	SQLSERVER_STATEMENT	  * state = SQLSERVER_STATEMENT_OF(stm);
+	SQLSERVER_SCALAR_STATUS	status = SQLSERVER_SCALAR_ERROR;
+	RETCODE					RetCode;
+
+	_ResetError(conn, stm);
+	stm->statement.sqlserver.cRowCount = -1;
+
+	if (!_EnsurePrepared(conn, stm, sql)) {
+		return SQLSERVER_SCALAR_ERROR;
+	}
+
+	// columns bound by an earlier execution would make SQLGetData fail on column 1
+	_FreeResultSet(conn, stm);
+	stm->statement.sqlserver.cColCount = 0;
+
+	for (int attempt = 1; ; attempt++) {
+		RetCode = _BeginExecute(conn, stm);
+
+		if (RetCode == SQL_SUCCESS_WITH_INFO) {
+			_HandleDiagnosticRecord(state->hStmt, SQL_HANDLE_STMT, RetCode, stm);
+		}
+		if (RetCode == SQL_ERROR) {
+			_HandleDiagnosticRecord(state->hStmt, SQL_HANDLE_STMT, RetCode, stm);
+			_SetError(conn, stm);
+		}
+		else if (RetCode == SQL_NO_DATA) {
+			// e.g. a searched UPDATE that matched no row
+			status = SQLSERVER_SCALAR_NO_ROW;
+		}
+		else {
+			status = _ScalarRead(conn, stm, cType, buffer, bufferLength, indicator);
+		}
+
+		if (!_RetryBeforeNextAttempt(conn, stm, attempt)) {
+			break;
+		}
+	}
+	return state->lastError.hasError ? SQLSERVER_SCALAR_ERROR : status;
+}
+
+SQLSERVER_INTERFACE_API
+SQLSERVER_SCALAR_STATUS
+sqlserverExecuteScalarInt64(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql,
+	long long * value
+)
+{
+	return sqlserverExecuteScalar(conn, stm, sql, SQL_C_SBIGINT, value, sizeof(long long), NULL);
+}
+
+SQLSERVER_INTERFACE_API
+SQLSERVER_SCALAR_STATUS
+sqlserverExecuteScalarDouble(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql,
+	double * value
+)
+{
+	return sqlserverExecuteScalar(conn, stm, sql, SQL_C_DOUBLE, value, sizeof(double), NULL);
+}
+
+SQLSERVER_INTERFACE_API
+SQLSERVER_SCALAR_STATUS
+sqlserverExecuteScalarText(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	const char * sql,
+	char * value,
+	size_t size
+)
+{
+	if (size > 0) {
+		value[0] = '\0';
+	}
+	// SQLGetData truncates and terminates, the SQL_SUCCESS_WITH_INFO 01004 is kept as a diagnostic
+	return sqlserverExecuteScalar(conn, stm, sql, SQL_C_CHAR, value, (SQLLEN)size, NULL);
+}
@@ -0,0 +1,52 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+#include "sqlserver-interface.h"
+
+typedef enum _SQLSERVER_SCALAR_STATUS {
+	/*	details are in sqlserverGetStatementError */
+	SQLSERVER_SCALAR_ERROR = -1,
+	/*	the query returned no row */
+	SQLSERVER_SCALAR_NO_ROW = 0,
+	SQLSERVER_SCALAR_NULL,
+	SQLSERVER_SCALAR_VALUE
+} SQLSERVER_SCALAR_STATUS;
+
+/* DDL's PRIVATE FUNCTIONS  */
+SQLSERVER_SCALAR_STATUS	_ScalarRead(DBInt_Connection* conn, DBInt_Statement* stm, SQLSMALLINT cType, void* buffer, SQLLEN bufferLength, SQLLEN* indicator);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Executes the statement and reads the first column of the first row with SQLGetData into "buffer", converted to
+	"cType". No column is bound and the cursor is closed before returning, other rows and columns are discarded.
+	Row counts of statements before the first result set are skipped, e.g. "INSERT ...; SELECT SCOPE_IDENTITY()".
+	"indicator" (may be NULL) receives the byte length as in SQLGetData */
+SQLSERVER_INTERFACE_API
+SQLSERVER_SCALAR_STATUS
+sqlserverExecuteScalar(
+	DBInt_Connection* conn,
+	DBInt_Statement* stm,
+	const char* sql,
+	SQLSMALLINT cType,
+	void* buffer,
+	SQLLEN bufferLength,
+	SQLLEN* indicator);
+
+SQLSERVER_INTERFACE_API SQLSERVER_SCALAR_STATUS	sqlserverExecuteScalarInt64(DBInt_Connection* conn, DBInt_Statement* stm, const char* sql, long long* value);
+SQLSERVER_INTERFACE_API SQLSERVER_SCALAR_STATUS	sqlserverExecuteScalarDouble(DBInt_Connection* conn, DBInt_Statement* stm, const char* sql, double* value);
+
+/*	Text is null terminated and truncated to "size" - 1 characters */
+SQLSERVER_INTERFACE_API SQLSERVER_SCALAR_STATUS	sqlserverExecuteScalarText(DBInt_Connection* conn, DBInt_Statement* stm, const char* sql, char* value, size_t size);
@@ -0,0 +1,196 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#include "pch.h"
+
+#include "..\DBInt\db-interface.h"
+
+#include "sqlserver-interface.h"
+#include "sqlserver-odbc-private.h"
+#include "sqlserver-tvp.h"
+
+
+/*	Returns the binding of "paramIndex", creating it on first use. Indicators of an earlier bind are released */
+SQLSERVER_TVP_BINDING *
+_TvpGetBinding(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex
+)
+{
+	SQLSERVER_STATEMENT	  * state = SQLSERVER_STATEMENT_OF(stm);
+	SQLSERVER_TVP_BINDING * binding = state->tableParameters;
+
+	while (binding && binding->paramIndex != paramIndex) {
+		binding = binding->next;
+	}
+
+	if (binding == NULL) {
+		binding = _StatementMalloc(conn, stm, sizeof(SQLSERVER_TVP_BINDING), __FILE__, __LINE__);
+		memset(binding, 0, sizeof(SQLSERVER_TVP_BINDING));
+		binding->paramIndex = paramIndex;
+		binding->next = state->tableParameters;
+		state->tableParameters = binding;
+		return binding;
+	}
+
+	if (binding->defaultIndicators) {
+		for (SQLSMALLINT iCol = 0; iCol < binding->columnCount; iCol++) {
+			_StatementFree(conn, stm, binding->defaultIndicators[iCol]);
+		}
+		_StatementFree(conn, stm, binding->defaultIndicators);
+		binding->defaultIndicators = NULL;
+	}
+	_StatementFree(conn, stm, binding->typeName);
+	binding->typeName = NULL;
+	binding->columnCount = 0;
+	return binding;
+}
+
+void
+_TvpFreeBinding(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLSERVER_TVP_BINDING * binding
+)
+{
+	if (binding->defaultIndicators) {
+		for (SQLSMALLINT iCol = 0; iCol < binding->columnCount; iCol++) {
+			_StatementFree(conn, stm, binding->defaultIndicators[iCol]);
+		}
+		_StatementFree(conn, stm, binding->defaultIndicators);
+	}
+	_StatementFree(conn, stm, binding->typeName);
+	_StatementFree(conn, stm, binding);
+}
+
+void
+_TvpFreeStatement(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLSERVER_STATEMENT	  * state = SQLSERVER_STATEMENT_OF(stm);
+	SQLSERVER_TVP_BINDING * binding = state->tableParameters;
+
+	while (binding) {
+		SQLSERVER_TVP_BINDING * next = binding->next;
+		_TvpFreeBinding(conn, stm, binding);
+		binding = next;
+	}
+	state->tableParameters = NULL;
+}
+
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverBindTableParameter(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	SQLUSMALLINT paramIndex,
+	const char * typeName,
+	SQLSERVER_TVP_COLUMN * columns,
+	SQLSMALLINT columnCount,
+	SQLLEN rowCount
+)
+{
+	SQLSERVER_TVP_BINDING * binding;
+	BOOL					focused = FALSE;
+
+	_ResetError(conn, stm);
+
+	if (paramIndex < 1) {
+		_SetErrorText(conn, stm, "Invalid parameter index");
+		return FALSE;
+	}
+	if (rowCount > 0 && (columns == NULL || columnCount <= 0)) {
+		_SetErrorText(conn, stm, "A table-valued parameter with rows needs at least one column");
+		return FALSE;
+	}
+
+	binding = _TvpGetBinding(conn, stm, paramIndex);
+	binding->rowCount = (rowCount > 0) ? rowCount : SQL_DEFAULT_PARAM;
+
+	if (typeName) {
+		size_t length = strlen(typeName);
+		binding->typeName = _StatementMalloc(conn, stm, (length + 1) * sizeof(SQLWCHAR), __FILE__, __LINE__);
+		mbstowcs_s(NULL, binding->typeName, length + 1, typeName, length);
+	}
+
+	if (paramIndex <= stm->statement.sqlserver.ParameterCount) {
+		// keeps the scalar binding code and the result cache away from this parameter
+		stm->statement.sqlserver.bindVariables[paramIndex - 1].fCType = SQL_C_DEFAULT;
+	}
+
+	// ColumnSize is the array size of the table, the indicator the number of rows in use
+	TRYODBC_STM(stm,
+		SQLBindParameter(
+			*stm->statement.sqlserver.hStmt,
+			paramIndex,
+			SQL_PARAM_INPUT,
+			SQL_C_DEFAULT,
+			SQL_SS_TABLE,
+			(rowCount > 0) ? rowCount : 1,
+			0,
+			binding->typeName,
+			binding->typeName ? SQL_NTS : 0,
+			&binding->rowCount));
+
+	if (rowCount <= 0) {
+		// empty table, columns are not bound
+		goto Exit;
+	}
+
+	binding->columnCount = columnCount;
+	binding->defaultIndicators = _StatementMalloc(conn, stm, columnCount * sizeof(SQLLEN*), __FILE__, __LINE__);
+	memset(binding->defaultIndicators, 0, columnCount * sizeof(SQLLEN*));
+
+	// following SQLBindParameter calls describe the columns of the table
+	TRYODBC_STM(stm,
+		SQLSetStmtAttr(*stm->statement.sqlserver.hStmt, SQL_SOPT_SS_PARAM_FOCUS, (SQLPOINTER)(ULONG_PTR)paramIndex, SQL_IS_INTEGER));
+	focused = TRUE;
+
+	for (SQLSMALLINT iCol = 0; iCol < columnCount; iCol++) {
+		SQLSERVER_TVP_COLUMN  * column = &columns[iCol];
+		SQLLEN				  * indicators = column->indicators;
+
+		if (indicators == NULL) {
+			BOOL isText = (column->cType == SQL_C_WCHAR || column->cType == SQL_C_CHAR);
+			indicators = _StatementMalloc(conn, stm, rowCount * sizeof(SQLLEN), __FILE__, __LINE__);
+			for (SQLLEN iRow = 0; iRow < rowCount; iRow++) {
+				indicators[iRow] = isText ? SQL_NTS : column->elementSize;
+			}
+			binding->defaultIndicators[iCol] = indicators;
+		}
+
+		TRYODBC_STM(stm,
+			SQLBindParameter(
+				*stm->statement.sqlserver.hStmt,
+				iCol + 1,
+				SQL_PARAM_INPUT,
+				column->cType,
+				column->sqlType,
+				column->columnSize,
+				column->decimalDigits,
+				column->values,
+				column->elementSize,
+				indicators));
+	}
+
+Exit:
+	if (focused) {
+		// back to the statement's own parameters
+		SQLSetStmtAttr(*stm->statement.sqlserver.hStmt, SQL_SOPT_SS_PARAM_FOCUS, (SQLPOINTER)0, SQL_IS_INTEGER);
+	}
+	return !SQLSERVER_STATEMENT_OF(stm)->lastError.hasError;
+}
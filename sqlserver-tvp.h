@@ -0,0 +1,77 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+#include "sqlserver-interface.h"
+
+/*	From msodbcsql.h. Table-valued parameters need "ODBC Driver xx for SQL Server" or SQL Server Native Client,
+	the legacy "SQL Server" driver rejects them */
+#ifndef SQL_SS_TABLE
+#define SQL_SS_TABLE					(-153)
+#endif
+#ifndef SQL_SOPT_SS_PARAM_FOCUS
+#define SQL_SOPT_SS_PARAM_FOCUS			1236
+#endif
+
+/*	One column of a table-valued parameter. Values are column-wise arrays owned by the caller and must stay valid
+	until the statement is executed */
+typedef struct _SQLSERVER_TVP_COLUMN {
+	/*	C type of "values", e.g. SQL_C_SBIGINT, SQL_C_LONG, SQL_C_DOUBLE, SQL_C_WCHAR */
+	SQLSMALLINT			cType;
+	/*	SQL type of the column in the table type, e.g. SQL_BIGINT, SQL_INTEGER, SQL_WVARCHAR */
+	SQLSMALLINT			sqlType;
+	/*	characters for text, precision for decimals, 0 for fixed size types */
+	SQLULEN				columnSize;
+	SQLSMALLINT			decimalDigits;
+	/*	"rowCount" elements, "elementSize" bytes apart */
+	void			  * values;
+	SQLLEN				elementSize;
+	/*	optional, per row length or SQL_NULL_DATA. When NULL text values are null terminated and none is NULL */
+	SQLLEN			  * indicators;
+} SQLSERVER_TVP_COLUMN;
+
+/*	A table-valued parameter bound to a statement */
+typedef struct _SQLSERVER_TVP_BINDING {
+	struct _SQLSERVER_TVP_BINDING * next;
+	SQLUSMALLINT		paramIndex;
+	/*	row count given to the driver, SQL_DEFAULT_PARAM for an empty table */
+	SQLLEN				rowCount;
+	SQLWCHAR		  * typeName;
+	/*	indicators generated for the columns the caller passed none for */
+	SQLSMALLINT			columnCount;
+	SQLLEN			 ** defaultIndicators;
+} SQLSERVER_TVP_BINDING;
+
+/* DDL's PRIVATE FUNCTIONS  */
+SQLSERVER_TVP_BINDING * _TvpGetBinding(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT paramIndex);
+void					_TvpFreeBinding(DBInt_Connection* conn, DBInt_Statement* stm, SQLSERVER_TVP_BINDING* binding);
+void					_TvpFreeStatement(DBInt_Connection* conn, DBInt_Statement* stm);
+
+/* DDL's PUBLIC FUNCTIONS  */
+
+/*	Binds "rowCount" rows of "columns" to parameter "paramIndex" (1 based), which must be a table-valued parameter
+	of user defined table type "typeName" (e.g. "dbo.IdList"). "typeName" may be NULL when the parameter belongs to a
+	stored procedure call. The whole table is sent in the single round trip of the next execution. A table with
+	rows needs at least one column, "rowCount" 0 sends an empty table and ignores "columns". */
+SQLSERVER_INTERFACE_API
+BOOL
+sqlserverBindTableParameter(
+	DBInt_Connection* conn,
+	DBInt_Statement* stm,
+	SQLUSMALLINT paramIndex,
+	const char* typeName,
+	SQLSERVER_TVP_COLUMN* columns,
+	SQLSMALLINT columnCount,
+	SQLLEN rowCount);
@@ -0,0 +1,587 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+#pragma once
+
+/*	Typed queries for C++17 callers. The row type of a query is a std::tuple or an aggregate; its member types
+	pick the ODBC C type of every result column at compile time and rows are fetched in blocks straight into
+	typed buffers with sqlserverExecuteBound, so no value goes through text and no column is looked up by name.
+
+		struct Order { long long id; std::string customer; double total; std::optional<SQL_DATE_STRUCT> shipped; };
+
+		sqlserver::query<Order> orders(conn, "SELECT id, customer, total, shipped FROM orders WHERE total > ?");
+		for (const Order& order : orders.execute(100.0)) {
+			...
+		}
+
+	Result columns are matched to members by position. A NULL in a member that is not a std::optional throws
+	sqlserver::error. Text members are truncated to their capacity: SQLSERVER_TYPED_TEXT_LENGTH characters for
+	std::string and std::wstring, N for sqlserver::text<N>. sqlserver::text<N> decodes to a std::string_view into
+	the fetch block, valid until the iterator moves past the current block */
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <sql.h>
+#include <sqlext.h>
+
+extern "C" {
+#include "sqlserver-interface.h"
+#include "sqlserver-bound.h"
+}
+
+#ifndef SQLSERVER_TYPED_TEXT_LENGTH
+#define SQLSERVER_TYPED_TEXT_LENGTH		256
+#endif
+
+#ifndef SQLSERVER_TYPED_BLOCK_ROWS
+#define SQLSERVER_TYPED_BLOCK_ROWS		256
+#endif
+
+namespace sqlserver {
+
+	/*	Failure of a library call, with the statement's error details */
+	class error : public std::runtime_error {
+	public:
+		explicit error(const SQLSERVER_ERROR& detail)
+			: std::runtime_error(detail.message), detail(detail) {}
+
+		explicit error(const char* message)
+			: std::runtime_error(message), detail() {}
+
+		static error of(DBInt_Statement* stm) {
+			SQLSERVER_ERROR detail = {};
+			if (stm && sqlserverGetStatementError(stm, &detail) && detail.hasError) {
+				return error(detail);
+			}
+			return error("SQL Server call failed");
+		}
+
+		SQLSERVER_ERROR detail;
+	};
+
+	/*	Fixed capacity text column decoded without copying */
+	template <std::size_t N>
+	struct text {
+		static_assert(N > 0, "text<N> needs a capacity");
+		std::string_view value;
+
+		operator std::string_view() const noexcept { return value; }
+	};
+
+	/*	column<T> describes how a member of type T is fetched: the buffer type bound for it ("storage"), the ODBC C
+		type and a decode from the buffer and its indicator. Other member types can be added by specializing it */
+	template <typename T, typename = void>
+	struct column {
+		static_assert(!std::is_same_v<T, T>, "unsupported row member type: use an integer, floating point, bool, "
+			"SQL_DATE_STRUCT, SQL_TIME_STRUCT, SQL_TIMESTAMP_STRUCT, SQLGUID, std::string, std::wstring or "
+			"sqlserver::text<N> member, a std::optional of one of them, or specialize sqlserver::column<T>");
+	};
+
+	template <typename T, SQLSMALLINT CType>
+	struct fixed_column {
+		using storage = T;
+		static constexpr SQLSMALLINT cType = CType;
+
+		static T decode(const storage& value, SQLLEN) noexcept { return value; }
+	};
+
+	/*	Integer C type of the same size and signedness. Covers long and the Windows typedefs (DWORD, LONG, ULONG64,
+		...), whatever their underlying type */
+	template <typename T>
+	constexpr SQLSMALLINT integer_c_type() {
+		static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8, "unsupported integer size");
+		if constexpr (sizeof(T) == 1) {
+			return std::is_signed_v<T> ? SQL_C_STINYINT : SQL_C_UTINYINT;
+		}
+		else if constexpr (sizeof(T) == 2) {
+			return std::is_signed_v<T> ? SQL_C_SSHORT : SQL_C_USHORT;
+		}
+		else if constexpr (sizeof(T) == 4) {
+			return std::is_signed_v<T> ? SQL_C_SLONG : SQL_C_ULONG;
+		}
+		else {
+			return std::is_signed_v<T> ? SQL_C_SBIGINT : SQL_C_UBIGINT;
+		}
+	}
+
+	/*	Character types are text, not numbers: a plain char or wchar_t member is rejected */
+	template <typename T>
+	constexpr bool is_integer_member_v = std::is_integral_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, char>
+		&& !std::is_same_v<T, wchar_t> && !std::is_same_v<T, char16_t> && !std::is_same_v<T, char32_t>;
+
+	template <typename T>
+	struct column<T, std::enable_if_t<is_integer_member_v<T>>> : fixed_column<T, integer_c_type<T>()> {};
+
+	template <> struct column<double>				: fixed_column<double, SQL_C_DOUBLE> {};
+	template <> struct column<float>				: fixed_column<float, SQL_C_FLOAT> {};
+	template <> struct column<SQL_DATE_STRUCT>		: fixed_column<SQL_DATE_STRUCT, SQL_C_TYPE_DATE> {};
+	template <> struct column<SQL_TIME_STRUCT>		: fixed_column<SQL_TIME_STRUCT, SQL_C_TYPE_TIME> {};
+	template <> struct column<SQL_TIMESTAMP_STRUCT>	: fixed_column<SQL_TIMESTAMP_STRUCT, SQL_C_TYPE_TIMESTAMP> {};
+	template <> struct column<SQLGUID>				: fixed_column<SQLGUID, SQL_C_GUID> {};
+
+	template <>
+	struct column<bool> {
+		using storage = unsigned char;
+		static constexpr SQLSMALLINT cType = SQL_C_BIT;
+
+		static bool decode(const storage& value, SQLLEN) noexcept { return value != 0; }
+	};
+
+	template <typename Char, std::size_t N, SQLSMALLINT CType>
+	struct text_column {
+		struct storage { Char data[N + 1]; };
+		static constexpr SQLSMALLINT cType = CType;
+
+		static std::basic_string_view<Char> view(const storage& value, SQLLEN indicator) noexcept {
+			// SQL_NO_TOTAL or a length beyond the buffer means the value was truncated
+			std::size_t length = (indicator < 0 || static_cast<std::size_t>(indicator) / sizeof(Char) > N) ?
+				N : static_cast<std::size_t>(indicator) / sizeof(Char);
+			return std::basic_string_view<Char>(value.data, length);
+		}
+	};
+
+	template <>
+	struct column<std::string> : text_column<char, SQLSERVER_TYPED_TEXT_LENGTH, SQL_C_CHAR> {
+		static std::string decode(const storage& value, SQLLEN indicator) { return std::string(view(value, indicator)); }
+	};
+
+	template <>
+	struct column<std::wstring> : text_column<wchar_t, SQLSERVER_TYPED_TEXT_LENGTH, SQL_C_WCHAR> {
+		static std::wstring decode(const storage& value, SQLLEN indicator) { return std::wstring(view(value, indicator)); }
+	};
+
+	template <std::size_t N>
+	struct column<text<N>> : text_column<char, N, SQL_C_CHAR> {
+		using base = text_column<char, N, SQL_C_CHAR>;
+
+		static text<N> decode(const typename base::storage& value, SQLLEN indicator) noexcept { return text<N>{ base::view(value, indicator) }; }
+	};
+
+	template <typename T>
+	struct column<std::optional<T>> {
+		using storage = typename column<T>::storage;
+		static constexpr SQLSMALLINT cType = column<T>::cType;
+
+		static std::optional<T> decode(const storage& value, SQLLEN indicator) {
+			if (indicator == SQL_NULL_DATA) {
+				return std::nullopt;
+			}
+			return column<T>::decode(value, indicator);
+		}
+	};
+
+	namespace detail {
+
+		template <typename T>
+		struct is_optional : std::false_type {};
+
+		template <typename T>
+		struct is_optional<std::optional<T>> : std::true_type {};
+
+		template <typename T>
+		struct is_tuple : std::false_type {};
+
+		template <typename... Ts>
+		struct is_tuple<std::tuple<Ts...>> : std::true_type {};
+
+		/*	Stands for any member in the aggregate field count probe. std::optional members are reached through
+			their converting constructor, a conversion to them as well would be ambiguous */
+		struct any_member {
+			template <typename T, typename = std::enable_if_t<!is_optional<T>::value>>
+			operator T() const;
+		};
+
+		template <typename Row, typename Indices, typename = void>
+		struct accepts : std::false_type {};
+
+		template <typename Row, std::size_t... I>
+		struct accepts<Row, std::index_sequence<I...>, std::void_t<decltype(Row{ (static_cast<void>(I), any_member{})... })>>
+			: std::true_type {};
+
+		/*	Number of members of an aggregate: the largest initializer count it accepts */
+		template <typename Row, std::size_t N = 16>
+		constexpr std::size_t member_count() {
+			if constexpr (N == 0) {
+				return 0;
+			}
+			else if constexpr (accepts<Row, std::make_index_sequence<N>>::value) {
+				return N;
+			}
+			else {
+				return member_count<Row, N - 1>();
+			}
+		}
+
+		template <typename... Ts>
+		struct types {
+			using tuple = std::tuple<Ts...>;
+		};
+
+		template <typename... Ts>
+		types<std::remove_cv_t<Ts>...> types_of(Ts&...);
+
+		/*	Member types of an aggregate, read from a structured binding. Only used in unevaluated context */
+		template <typename Row>
+		auto members(Row& row, std::integral_constant<std::size_t, 1>) { auto& [a] = row; return types_of(a); }
+		template <typename Row>
+		auto members(Row& row, std::integral_constant<std::size_t, 2>) { auto& [a, b] = row; return types_of(a, b); }
+		template <typename Row>
+		auto members(Row& row, std::integral_constant<std::size_t, 3>) { auto& [a, b, c] = row; return types_of(a, b, c); }
+		template <typename Row>
+		auto members(Row& row, std::integral_constant<std::size_t, 4>) { auto& [a, b, c, d] = row; return types_of(a, b, c, d); }
+		template <typename Row>
+		auto members(Row& row, std::integral_constant<std::size_t, 5>) { auto& [a, b, c, d, e] = row; return types_of(a, b, c, d, e); }
+		template <typename Row>
+		auto members(Row& row, std::integral_constant<std::size_t, 6>) { auto& [a, b, c, d, e, f] = row; return types_of(a, b, c, d, e, f); }
+		template <typename Row>
+		auto members(Row& row, std::integral_constant<std::size_t, 7>) { auto& [a, b, c, d, e, f, g] = row; return types_of(a, b, c, d, e, f, g); }
+		template <typename Row>
+		auto members(Row& row, std::integral_constant<std::size_t, 8>) { auto& [a, b, c, d, e, f, g, h] = row; return types_of(a, b, c, d, e, f, g, h); }
+		template <typename Row>
+		auto members(Row& row, std::integral_constant<std::size_t, 9>) { auto& [a, b, c, d, e, f, g, h, i] = row; return types_of(a, b, c, d, e, f, g, h, i); }
+		template <typename Row>
+		auto members(Row& row, std::integral_constant<std::size_t, 10>) { auto& [a, b, c, d, e, f, g, h, i, j] = row; return types_of(a, b, c, d, e, f, g, h, i, j); }
+		template <typename Row>
+		auto members(Row& row, std::integral_constant<std::size_t, 11>) { auto& [a, b, c, d, e, f, g, h, i, j, k] = row; return types_of(a, b, c, d, e, f, g, h, i, j, k); }
+		template <typename Row>
+		auto members(Row& row, std::integral_constant<std::size_t, 12>) { auto& [a, b, c, d, e, f, g, h, i, j, k, l] = row; return types_of(a, b, c, d, e, f, g, h, i, j, k, l); }
+		template <typename Row>
+		auto members(Row& row, std::integral_constant<std::size_t, 13>) { auto& [a, b, c, d, e, f, g, h, i, j, k, l, m] = row; return types_of(a, b, c, d, e, f, g, h, i, j, k, l, m); }
+		template <typename Row>
+		auto members(Row& row, std::integral_constant<std::size_t, 14>) { auto& [a, b, c, d, e, f, g, h, i, j, k, l, m, n] = row; return types_of(a, b, c, d, e, f, g, h, i, j, k, l, m, n); }
+		template <typename Row>
+		auto members(Row& row, std::integral_constant<std::size_t, 15>) { auto& [a, b, c, d, e, f, g, h, i, j, k, l, m, n, o] = row; return types_of(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o); }
+		template <typename Row>
+		auto members(Row& row, std::integral_constant<std::size_t, 16>) { auto& [a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p] = row; return types_of(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p); }
+
+		/*	std::tuple<column member types...> of a row type */
+		template <typename Row, typename = void>
+		struct row_columns {
+			static_assert(std::is_aggregate_v<Row>, "row type must be a std::tuple or an aggregate");
+			static_assert(member_count<Row>() > 0, "row type has no members or more than 16");
+
+			using type = typename decltype(members(std::declval<Row&>(), std::integral_constant<std::size_t, member_count<Row>()>()))::tuple;
+		};
+
+		template <typename Row>
+		struct row_columns<Row, std::enable_if_t<is_tuple<Row>::value>> {
+			using type = Row;
+		};
+
+		/*	Fetch buffer of one column in a row of the block */
+		template <typename T>
+		struct slot {
+			typename column<T>::storage value;
+			SQLLEN						indicator;
+		};
+
+		template <typename Columns>
+		struct block_row;
+
+		template <typename... Ts>
+		struct block_row<std::tuple<Ts...>> {
+			using type = std::tuple<slot<Ts>...>;
+		};
+
+		template <typename T>
+		T decode(const slot<T>& fetched) {
+			if constexpr (!is_optional<T>::value) {
+				if (fetched.indicator == SQL_NULL_DATA) {
+					throw error("NULL value fetched into a member that is not a std::optional");
+				}
+			}
+			return column<T>::decode(fetched.value, fetched.indicator);
+		}
+
+		inline void check(BOOL ok, DBInt_Statement* stm) {
+			if (!ok) {
+				throw error::of(stm);
+			}
+		}
+
+		/*	Parameter binds, chosen by overload on the argument type. "index" is 1 based */
+		template <typename T>
+		std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>
+		bind(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT index, T value) {
+			check(sqlserverBindInt64(conn, stm, index, static_cast<long long>(value)), stm);
+		}
+
+		template <typename T>
+		std::enable_if_t<std::is_floating_point_v<T>>
+		bind(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT index, T value) {
+			check(sqlserverBindDouble(conn, stm, index, static_cast<double>(value)), stm);
+		}
+
+		inline void bind(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT index, bool value) {
+			check(sqlserverBindBit(conn, stm, index, value ? TRUE : FALSE), stm);
+		}
+
+		inline void bind(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT index, std::string_view value) {
+			check(sqlserverBindText(conn, stm, index, value.data(), value.size()), stm);
+		}
+
+		inline void bind(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT index, const std::string& value) {
+			bind(conn, stm, index, std::string_view(value));
+		}
+
+		inline void bind(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT index, const char* value) {
+			if (value == nullptr) {
+				check(sqlserverBindNull(conn, stm, index), stm);
+				return;
+			}
+			bind(conn, stm, index, std::string_view(value));
+		}
+
+		inline void bind(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT index, const SQL_NUMERIC_STRUCT& value) {
+			check(sqlserverBindDecimal(conn, stm, index, &value), stm);
+		}
+
+		inline void bind(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT index, const SQL_TIMESTAMP_STRUCT& value) {
+			check(sqlserverBindTimestamp(conn, stm, index, &value), stm);
+		}
+
+		inline void bind(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT index, const SQL_DATE_STRUCT& value) {
+			check(sqlserverBindDate(conn, stm, index, &value), stm);
+		}
+
+		inline void bind(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT index, const SQLGUID& value) {
+			check(sqlserverBindGuid(conn, stm, index, &value), stm);
+		}
+
+		inline void bind(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT index, std::nullptr_t) {
+			check(sqlserverBindNull(conn, stm, index), stm);
+		}
+
+		inline void bind(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT index, std::nullopt_t) {
+			check(sqlserverBindNull(conn, stm, index), stm);
+		}
+
+		template <typename T>
+		void bind(DBInt_Connection* conn, DBInt_Statement* stm, SQLUSMALLINT index, const std::optional<T>& value) {
+			if (value) {
+				bind(conn, stm, index, *value);
+			}
+			else {
+				check(sqlserverBindNull(conn, stm, index), stm);
+			}
+		}
+
+		/*	Binds "args" to parameters 1 to sizeof...(args) */
+		template <std::size_t... I, typename... Args>
+		void bind_all([[maybe_unused]] DBInt_Connection* conn, [[maybe_unused]] DBInt_Statement* stm, std::index_sequence<I...>, const Args&... args) {
+			(bind(conn, stm, static_cast<SQLUSMALLINT>(I + 1), args), ...);
+		}
+
+		/*	New statement prepared with "sql". Throws on failure */
+		inline DBInt_Statement* prepare(DBInt_Connection* conn, const char* sql) {
+			DBInt_Statement* stm = sqlserverCreateStatement(conn);
+			if (stm == nullptr) {
+				throw error("Unable to create statement");
+			}
+			sqlserverPrepare(conn, stm, sql);
+			SQLSERVER_ERROR detail = {};
+			if (sqlserverGetStatementError(stm, &detail) && detail.hasError) {
+				sqlserverFreeStatement(conn, stm);
+				throw error(detail);
+			}
+			return stm;
+		}
+
+		/*	Fetch buffers of "BlockRows" rows of "Row" and the column descriptions handed to the library. The
+			descriptions point into the first row, so a block is never copied */
+		template <typename Row, std::size_t BlockRows>
+		class fetch_block {
+		public:
+			static_assert(BlockRows > 0, "BlockRows must be at least 1");
+
+			using columns_type = typename row_columns<Row>::type;
+			using row_type = typename block_row<columns_type>::type;
+
+			static constexpr std::size_t column_count = std::tuple_size_v<columns_type>;
+
+			fetch_block() : rows(BlockRows) { attach(std::make_index_sequence<column_count>()); }
+
+			fetch_block(const fetch_block&) = delete;
+			fetch_block& operator=(const fetch_block&) = delete;
+
+			const SQLSERVER_BOUND_COLUMN* columns() const noexcept { return descriptions.data(); }
+
+			Row decode(std::size_t row) const { return decode(row, std::make_index_sequence<column_count>()); }
+
+		private:
+			template <std::size_t... I>
+			void attach(std::index_sequence<I...>) {
+				row_type& first = rows[0];
+				descriptions = { SQLSERVER_BOUND_COLUMN{
+					column<std::tuple_element_t<I, columns_type>>::cType,
+					&std::get<I>(first).value,
+					static_cast<SQLLEN>(sizeof(std::get<I>(first).value)),
+					&std::get<I>(first).indicator }... };
+			}
+
+			template <std::size_t... I>
+			Row decode(std::size_t row, std::index_sequence<I...>) const {
+				const row_type& slots = rows[row];
+				return Row{ detail::decode(std::get<I>(slots))... };
+			}
+
+			std::vector<row_type>				rows;
+			std::vector<SQLSERVER_BOUND_COLUMN>	descriptions;
+		};
+
+	}
+
+	template <typename Row, std::size_t BlockRows>
+	class query;
+
+	/*	Rows of one execution. Single pass: iterating again continues where the previous pass stopped */
+	template <typename Row, std::size_t BlockRows = SQLSERVER_TYPED_BLOCK_ROWS>
+	class result {
+	public:
+		class iterator {
+		public:
+			using iterator_category = std::input_iterator_tag;
+			using value_type = Row;
+			using difference_type = std::ptrdiff_t;
+			using pointer = const Row*;
+			using reference = const Row&;
+
+			iterator() noexcept : owner(nullptr) {}
+			explicit iterator(result* owner) : owner(owner) { load(); }
+
+			reference operator*() const { return current; }
+			pointer operator->() const { return &current; }
+
+			iterator& operator++() {
+				owner->position++;
+				load();
+				return *this;
+			}
+
+			void operator++(int) { ++*this; }
+
+			bool operator==(const iterator& other) const noexcept { return owner == other.owner; }
+			bool operator!=(const iterator& other) const noexcept { return owner != other.owner; }
+
+		private:
+			void load() {
+				if (!owner->next()) {
+					owner = nullptr;
+					return;
+				}
+				current = owner->owner->block.decode(owner->position);
+			}
+
+			result* owner;
+			Row		current;
+		};
+
+		result(const result&) = delete;
+		result& operator=(const result&) = delete;
+
+		result(result&& other) noexcept
+			: owner(other.owner), position(other.position), rowsInBlock(other.rowsInBlock), finished(other.finished) {
+			other.owner = nullptr;
+		}
+
+		~result() {
+			if (owner) {
+				sqlserverCloseBound(owner->conn, owner->stm);
+			}
+		}
+
+		iterator begin() { return iterator(this); }
+		iterator end() noexcept { return iterator(); }
+
+	private:
+		friend class query<Row, BlockRows>;
+
+		explicit result(query<Row, BlockRows>* owner) noexcept
+			: owner(owner), position(0), rowsInBlock(0), finished(false) {}
+
+		/*	Makes "position" a row of the block, fetching the next block when the current one is used up */
+		bool next() {
+			if (owner == nullptr || finished) {
+				return false;
+			}
+			if (position < rowsInBlock) {
+				return true;
+			}
+			long long count = sqlserverFetchBound(owner->conn, owner->stm);
+			if (count < 0) {
+				throw error::of(owner->stm);
+			}
+			position = 0;
+			rowsInBlock = static_cast<std::size_t>(count);
+			finished = (count == 0);
+			return !finished;
+		}
+
+		query<Row, BlockRows>  * owner;
+		std::size_t				position;
+		std::size_t				rowsInBlock;
+		bool					finished;
+	};
+
+	/*	Prepared statement with a typed result. Owns its DBInt_Statement and fetch block, one result may be open
+		at a time. The connection must outlive the query */
+	template <typename Row, std::size_t BlockRows = SQLSERVER_TYPED_BLOCK_ROWS>
+	class query {
+	public:
+		query(DBInt_Connection* conn, const char* sql)
+			: conn(conn), stm(detail::prepare(conn, sql)), sql(sql) {}
+
+		query(const query&) = delete;
+		query& operator=(const query&) = delete;
+
+		~query() {
+			sqlserverFreeStatement(conn, stm);
+		}
+
+		/*	Binds "args" to parameters 1 to sizeof...(args) and executes. The previous result must be gone */
+		template <typename... Args>
+		result<Row, BlockRows> execute(const Args&... args) {
+			detail::bind_all(conn, stm, std::index_sequence_for<Args...>(), args...);
+			if (!sqlserverExecuteBound(conn, stm, sql.c_str(), block.columns(), static_cast<SQLSMALLINT>(block.column_count),
+				sizeof(typename detail::fetch_block<Row, BlockRows>::row_type), BlockRows)) {
+				throw error::of(stm);
+			}
+			return result<Row, BlockRows>(this);
+		}
+
+		DBInt_Statement* statement() const noexcept { return stm; }
+
+	private:
+		friend class result<Row, BlockRows>;
+
+		DBInt_Connection					  * conn;
+		DBInt_Statement						  * stm;
+		std::string								sql;
+		detail::fetch_block<Row, BlockRows>		block;
+	};
+
+}
@@ -0,0 +1,345 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright © 2020 Murad Karakaş <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+
+
+/*	Runs async_query coroutines on an event_loop against the stub driver, which answers every asynchronous
+	prepare, execution and fetch with SQL_STILL_EXECUTING ASYNC_CHECK_POLLS times, and checks that the loop
+	suspends them, polls them and resumes them with the right rows or error. Exits with the number of failed
+	checks */
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "sqlserver-async.hpp"
+
+extern "C" {
+#include "sqlserver-direct.h"
+#include "sqlserver-stub-odbc.h"
+}
+
+#define ASYNC_CHECK_POLLS			5
+#define ASYNC_CHECK_ROW_COUNT		3
+#define ASYNC_CHECK_QUERY_COUNT		8
+
+struct Row {
+	long long		id;
+	std::string		name;
+};
+
+/*	What the coroutines did, in the order they did it */
+struct AsyncEvent {
+	enum Kind { STARTED, EXECUTED, FINISHED }	kind;
+	int											query;
+};
+
+/*	Executes "sql" with the parameters, reads every block into "rows" and logs each step */
+template <typename... Args>
+sqlserver::task<>
+_ReadQuery(
+	sqlserver::event_loop& loop,
+	DBInt_Connection* conn,
+	const char* sql,
+	int query,
+	std::vector<AsyncEvent>& events,
+	std::vector<Row>& rows,
+	const Args&... args
+)
+{
+	sqlserver::async_query<Row> statement(loop, conn, sql);
+
+	events.push_back({ AsyncEvent::STARTED, query });
+	auto result = co_await statement.execute(args...);
+	events.push_back({ AsyncEvent::EXECUTED, query });
+
+	while (auto block = co_await result.next()) {
+		for (const Row& row : block) {
+			rows.push_back(row);
+		}
+	}
+	events.push_back({ AsyncEvent::FINISHED, query });
+}
+
+bool
+_HasStubRows(
+	const std::vector<Row>& rows
+)
+{
+	if (rows.size() != ASYNC_CHECK_ROW_COUNT) {
+		return false;
+	}
+	for (std::size_t i = 0; i < rows.size(); i++) {
+		if (rows[i].id != (long long)i + 1 || rows[i].name != "row " + std::to_string(i + 1)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*	Every query suspends on its execution, so all of them are started before the first one is resumed */
+void
+_CheckQueriesInterleave(
+	DBInt_Connection* conn
+)
+{
+	sqlserver::event_loop		loop;
+	std::vector<AsyncEvent>		events;
+	std::vector<std::vector<Row>> rows(ASYNC_CHECK_QUERY_COUNT);
+	STUB_ODBC_COUNTERS			before, after;
+
+	stubOdbcGetCounters(&before);
+	for (int query = 0; query < ASYNC_CHECK_QUERY_COUNT; query++) {
+		loop.spawn(_ReadQuery(loop, conn, "SELECT id, name FROM stub WHERE id > ?", query, events, rows[query], 0LL));
+	}
+	loop.run();
+	stubOdbcGetCounters(&after);
+
+	std::size_t lastStarted = 0, firstExecuted = events.size(), finished = 0;
+	for (std::size_t i = 0; i < events.size(); i++) {
+		if (events[i].kind == AsyncEvent::STARTED) {
+			lastStarted = i;
+		}
+		else if (events[i].kind == AsyncEvent::EXECUTED && i < firstExecuted) {
+			firstExecuted = i;
+		}
+		else if (events[i].kind == AsyncEvent::FINISHED) {
+			finished++;
+		}
+	}
+	STUB_CHECK(lastStarted < firstExecuted);
+	STUB_CHECK(finished == ASYNC_CHECK_QUERY_COUNT);
+	for (int query = 0; query < ASYNC_CHECK_QUERY_COUNT; query++) {
+		STUB_CHECK(_HasStubRows(rows[query]));
+	}
+
+	// the execution, the fetch of the rows and the fetch that finds the end
+	STUB_CHECK(after.stillExecuting - before.stillExecuting == ASYNC_CHECK_QUERY_COUNT * 3 * ASYNC_CHECK_POLLS);
+	STUB_CHECK(after.executions - before.executions == ASYNC_CHECK_QUERY_COUNT);
+	STUB_CHECK(after.fetches - before.fetches == ASYNC_CHECK_QUERY_COUNT * 2);
+	STUB_CHECK(after.liveStatements == 0);
+}
+
+/*	A text without parameters runs direct the first time. The second execution prepares it while the statement
+	is asynchronous, the coroutine is suspended on the pending prepare and then on the execution */
+sqlserver::task<>
+_ExecuteTwice(
+	sqlserver::event_loop& loop,
+	DBInt_Connection* conn,
+	std::vector<Row>& firstRows,
+	std::vector<Row>& secondRows,
+	STUB_ODBC_COUNTERS& afterFirst
+)
+{
+	sqlserver::async_query<Row> statement(loop, conn, "SELECT id, name FROM stub ORDER BY id");
+
+	{
+		auto result = co_await statement.execute();
+		while (auto block = co_await result.next()) {
+			firstRows.insert(firstRows.end(), block.begin(), block.end());
+		}
+	}
+	stubOdbcGetCounters(&afterFirst);
+
+	auto result = co_await statement.execute();
+	while (auto block = co_await result.next()) {
+		secondRows.insert(secondRows.end(), block.begin(), block.end());
+	}
+}
+
+void
+_CheckPromotionUnderAsync(
+	DBInt_Connection* conn
+)
+{
+	sqlserver::event_loop	loop;
+	std::vector<Row>		firstRows, secondRows;
+	STUB_ODBC_COUNTERS		before, afterFirst, after;
+	SQLSERVER_DIRECT_STATS	statsBefore, stats;
+
+	stubOdbcGetCounters(&before);
+	sqlserverGetDirectExecuteStats(&statsBefore);
+	loop.spawn(_ExecuteTwice(loop, conn, firstRows, secondRows, afterFirst));
+	loop.run();
+	stubOdbcGetCounters(&after);
+	sqlserverGetDirectExecuteStats(&stats);
+
+	STUB_CHECK(_HasStubRows(firstRows));
+	STUB_CHECK(_HasStubRows(secondRows));
+	STUB_CHECK(stats.directExecutions - statsBefore.directExecutions == 1);
+	STUB_CHECK(stats.promotions - statsBefore.promotions == 1);
+	STUB_CHECK(stats.preparedExecutions - statsBefore.preparedExecutions == 1);
+
+	STUB_CHECK(afterFirst.prepares - before.prepares == 0);
+	STUB_CHECK(afterFirst.stillExecuting - before.stillExecuting == 3 * ASYNC_CHECK_POLLS);
+	// the prepare as well this time
+	STUB_CHECK(after.prepares - afterFirst.prepares == 1);
+	STUB_CHECK(after.stillExecuting - afterFirst.stillExecuting == 4 * ASYNC_CHECK_POLLS);
+	STUB_CHECK(after.liveStatements == 0);
+}
+
+/*	Runs "sql" asynchronously to its end and closes the cursor. Returns the number of polls it took */
+int
+_ExecuteToEnd(
+	DBInt_Connection* conn,
+	DBInt_Statement* stm,
+	const char* sql
+)
+{
+	int polls = 0;
+
+	SQLSERVER_ASYNC_STATUS status = sqlserverAsyncExecute(conn, stm, sql);
+	while (status == SQLSERVER_ASYNC_PENDING) {
+		status = sqlserverAsyncPollExecute(conn, stm);
+		polls++;
+	}
+	STUB_CHECK(status == SQLSERVER_ASYNC_DONE);
+	sqlserverAsyncClose(conn, stm);
+	return polls;
+}
+
+/*	sqlserverAsyncExecute returns as soon as the promotion prepare is pending, the caller's polls finish it and
+	then the execution. Closed while the prepare is pending, the execution is never started */
+void
+_CheckPromotionDoesNotBlock(
+	DBInt_Connection* conn
+)
+{
+	const char			  * sql = "SELECT id, name FROM stub WHERE id < 100";
+	DBInt_Statement		  * stm = sqlserverCreateStatement(conn);
+	STUB_ODBC_COUNTERS		before, started, after;
+	SQLSERVER_DIRECT_STATS	statsBefore, stats;
+
+	sqlserverGetDirectExecuteStats(&statsBefore);
+	_ExecuteToEnd(conn, stm, sql);
+
+	stubOdbcGetCounters(&before);
+	SQLSERVER_ASYNC_STATUS status = sqlserverAsyncExecute(conn, stm, sql);
+	stubOdbcGetCounters(&started);
+	STUB_CHECK(status == SQLSERVER_ASYNC_PENDING);
+	STUB_CHECK(started.stillExecuting - before.stillExecuting == 1);
+	STUB_CHECK(started.prepares == before.prepares);
+
+	int polls = 0;
+	while (status == SQLSERVER_ASYNC_PENDING) {
+		status = sqlserverAsyncPollExecute(conn, stm);
+		polls++;
+	}
+	stubOdbcGetCounters(&after);
+	sqlserverGetDirectExecuteStats(&stats);
+	STUB_CHECK(status == SQLSERVER_ASYNC_DONE);
+	// the rest of the prepare, then the execution
+	STUB_CHECK(polls == 2 * ASYNC_CHECK_POLLS);
+	STUB_CHECK(after.prepares - before.prepares == 1);
+	STUB_CHECK(after.executions - before.executions == 1);
+	STUB_CHECK(stats.promotions - statsBefore.promotions == 1);
+	STUB_CHECK(stats.directExecutions - statsBefore.directExecutions == 1);
+	STUB_CHECK(stats.preparedExecutions - statsBefore.preparedExecutions == 1);
+	sqlserverAsyncClose(conn, stm);
+	sqlserverFreeStatement(conn, stm);
+
+	stm = sqlserverCreateStatement(conn);
+	sql = "SELECT id, name FROM stub WHERE id < 200";
+	_ExecuteToEnd(conn, stm, sql);
+
+	stubOdbcGetCounters(&before);
+	sqlserverGetDirectExecuteStats(&statsBefore);
+	STUB_CHECK(sqlserverAsyncExecute(conn, stm, sql) == SQLSERVER_ASYNC_PENDING);
+	sqlserverAsyncClose(conn, stm);
+	stubOdbcGetCounters(&after);
+	sqlserverGetDirectExecuteStats(&stats);
+	STUB_CHECK(after.executions == before.executions);
+	STUB_CHECK(stats.promotions == statsBefore.promotions);
+
+	// still direct, the next execution tries the promotion again
+	STUB_CHECK(_ExecuteToEnd(conn, stm, sql) == 2 * ASYNC_CHECK_POLLS);
+	sqlserverGetDirectExecuteStats(&stats);
+	STUB_CHECK(stats.promotions - statsBefore.promotions == 1);
+	sqlserverFreeStatement(conn, stm);
+
+	stubOdbcGetCounters(&after);
+	STUB_CHECK(after.liveStatements == 0);
+}
+
+/*	An execution that fails after its polls resumes the coroutine with sqlserver::error */
+sqlserver::task<>
+_ExecuteFailing(
+	sqlserver::event_loop& loop,
+	DBInt_Connection* conn,
+	SQLINTEGER& nativeError,
+	bool& resumed
+)
+{
+	sqlserver::async_query<Row> statement(loop, conn, "SELECT id, name FROM missing WHERE id > ?");
+
+	try {
+		auto result = co_await statement.execute(0LL);
+		resumed = true;
+	}
+	catch (const sqlserver::error& failure) {
+		nativeError = failure.detail.nativeError;
+	}
+}
+
+void
+_CheckErrorResumes(
+	DBInt_Connection* conn
+)
+{
+	sqlserver::event_loop	loop;
+	SQLINTEGER				nativeError = 0;
+	bool					resumed = false;
+	STUB_ODBC_COUNTERS		before, after;
+
+	stubOdbcGetCounters(&before);
+	stubOdbcFailExecutions(1, 208, "42S02", FALSE);
+	loop.spawn(_ExecuteFailing(loop, conn, nativeError, resumed));
+	loop.run();
+	stubOdbcGetCounters(&after);
+
+	STUB_CHECK(!resumed);
+	STUB_CHECK(nativeError == 208);
+	STUB_CHECK(after.stillExecuting - before.stillExecuting == ASYNC_CHECK_POLLS);
+	STUB_CHECK(after.executions - before.executions == 1);
+	STUB_CHECK(after.liveStatements == 0);
+}
+
+int
+main(
+	void
+)
+{
+	HANDLE heap = HeapCreate(0, 0, 0);
+
+	stubOdbcInstall();
+	stubOdbcSetRowCount(ASYNC_CHECK_ROW_COUNT);
+	stubOdbcSetPendingPolls(ASYNC_CHECK_POLLS);
+
+	DBInt_Connection * conn = sqlserverCreateConnection(heap, SODIUM_SQLSERVER_SUPPORT, "stub", "", "stub", "stub", "stub");
+	if (conn->err) {
+		std::fprintf(stderr, "Unable to connect to the stub driver\n");
+		return 2;
+	}
+
+	_CheckQueriesInterleave(conn);
+	_CheckPromotionUnderAsync(conn);
+	_CheckPromotionDoesNotBlock(conn);
+	_CheckErrorResumes(conn);
+
+	sqlserverDestroyConnection(conn);
+	HeapDestroy(heap);
+
+	std::printf("async check: %d failed\n", stubFailures);
+	return stubFailures;
+}
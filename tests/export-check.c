@@ -0,0 +1,270 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+/*	Exports result sets of the stub driver to temporary files in every format and compares the files byte for
+	byte with what sqlserver-export.h describes, for quoted and escaped names and values and for values too long
+	for the write buffer. Exits with the number of failed checks */
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <io.h>
+
+#include "sqlserver-interface.h"
+#include "sqlserver-export.h"
+#include "sqlserver-stub-odbc.h"
+
+#define EXPORT_CHECK_QUERY			"SELECT id, name FROM stub"
+/*	longer than the write buffer takes in any format, with a surrogate pair across the first chunk boundary */
+#define EXPORT_CHECK_LONG_LENGTH	(SQLSERVER_EXPORT_CHUNK_LENGTH * 2 + 10)
+
+/*	Expected file content, grown as it is written */
+typedef struct _EXPORT_EXPECTED {
+	char			  * bytes;
+	size_t				size;
+	size_t				capacity;
+} EXPORT_EXPECTED;
+
+void
+_Append(
+	EXPORT_EXPECTED * expected,
+	const void * bytes,
+	size_t size
+)
+{
+	if (expected->size + size > expected->capacity) {
+		expected->capacity = (expected->size + size) * 2;
+		expected->bytes = realloc(expected->bytes, expected->capacity);
+	}
+	memcpy(expected->bytes + expected->size, bytes, size);
+	expected->size += size;
+}
+
+void
+_AppendText(
+	EXPORT_EXPECTED * expected,
+	const char * text
+)
+{
+	_Append(expected, text, strlen(text));
+}
+
+void
+_AppendInt32(
+	EXPORT_EXPECTED * expected,
+	INT32 value
+)
+{
+	_Append(expected, &value, sizeof(INT32));
+}
+
+/*	Binary header of the two stub columns, the second one called "name" */
+void
+_AppendBinaryHeader(
+	EXPORT_EXPECTED * expected,
+	const char * name
+)
+{
+	UINT16 version = SQLSERVER_EXPORT_BINARY_VERSION;
+	UINT16 count = 2;
+	UINT16 length;
+	char   type;
+
+	_Append(expected, SQLSERVER_EXPORT_BINARY_MAGIC, 4);
+	_Append(expected, &version, sizeof(UINT16));
+	_Append(expected, &count, sizeof(UINT16));
+
+	type = (char)_GetColumnDataType(SQL_INTEGER);
+	length = 2;
+	_Append(expected, &type, 1);
+	_Append(expected, &length, sizeof(UINT16));
+	_Append(expected, "id", 2);
+
+	type = (char)_GetColumnDataType(SQL_WVARCHAR);
+	length = (UINT16)strlen(name);
+	_Append(expected, &type, 1);
+	_Append(expected, &length, sizeof(UINT16));
+	_Append(expected, name, length);
+}
+
+/*	Exports EXPORT_CHECK_QUERY in "format" to a temporary file and checks that it holds exactly "expected" */
+void
+_CheckExport(
+	DBInt_Connection * conn,
+	SQLSERVER_EXPORT_FORMAT format,
+	EXPORT_EXPECTED * expected,
+	unsigned long long rowCount
+)
+{
+	DBInt_Statement		  * stm = sqlserverCreateStatement(conn);
+	SQLSERVER_EXPORT_STATS	stats;
+	FILE				  * file = NULL;
+
+	if (!STUB_CHECK(tmpfile_s(&file) == 0)) {
+		return;
+	}
+	STUB_CHECK(sqlserverExportResultSet(conn, stm, EXPORT_CHECK_QUERY, _fileno(file), format, &stats));
+	STUB_CHECK(stats.rowCount == rowCount);
+	STUB_CHECK(stats.byteCount == expected->size);
+
+	char * written = malloc(expected->size + 1);
+	fseek(file, 0, SEEK_SET);
+	size_t size = fread(written, 1, expected->size + 1, file);
+	STUB_CHECK(size == expected->size && memcmp(written, expected->bytes, size) == 0);
+
+	free(written);
+	fclose(file);
+	sqlserverFreeStatement(conn, stm);
+
+	free(expected->bytes);
+	memset(expected, 0, sizeof(EXPORT_EXPECTED));
+}
+
+void
+_CheckPlainRows(
+	DBInt_Connection * conn
+)
+{
+	EXPORT_EXPECTED expected = { 0 };
+
+	stubOdbcSetRowCount(2);
+
+	_AppendText(&expected, "id,name\r\n1,row 1\r\n2,row 2\r\n");
+	_CheckExport(conn, SQLSERVER_EXPORT_CSV, &expected, 2);
+
+	_AppendText(&expected, "id\tname\r\n1\trow 1\r\n2\trow 2\r\n");
+	_CheckExport(conn, SQLSERVER_EXPORT_TSV, &expected, 2);
+
+	_AppendBinaryHeader(&expected, "name");
+	for (int row = 1; row <= 2; row++) {
+		char text[8];
+		sprintf_s(text, sizeof(text), "%d", row);
+		_AppendInt32(&expected, 1);
+		_AppendText(&expected, text);
+		sprintf_s(text, sizeof(text), "row %d", row);
+		_AppendInt32(&expected, 5);
+		_AppendText(&expected, text);
+	}
+	_CheckExport(conn, SQLSERVER_EXPORT_BINARY, &expected, 2);
+}
+
+/*	Names are quoted and escaped like the values */
+void
+_CheckEscaping(
+	DBInt_Connection * conn
+)
+{
+	EXPORT_EXPECTED expected = { 0 };
+
+	stubOdbcSetRowCount(1);
+	stubOdbcSetText(L"say \"hi\", all", L"a,\"b\"\tc\\d\r\n");
+
+	_AppendText(&expected, "id,\"say \"\"hi\"\", all\"\r\n1,\"a,\"\"b\"\"\tc\\d\r\n\"\r\n");
+	_CheckExport(conn, SQLSERVER_EXPORT_CSV, &expected, 1);
+
+	_AppendText(&expected, "id\tsay \"hi\", all\r\n1\ta,\"b\"\\tc\\\\d\\r\\n\r\n");
+	_CheckExport(conn, SQLSERVER_EXPORT_TSV, &expected, 1);
+
+	stubOdbcSetText(NULL, L"");
+	_AppendText(&expected, "id,name\r\n1,\"\"\r\n");
+	_CheckExport(conn, SQLSERVER_EXPORT_CSV, &expected, 1);
+
+	stubOdbcSetText(NULL, NULL);
+}
+
+/*	A value whose worst case size exceeds SQLSERVER_EXPORT_BUFFER_SIZE is written in chunks */
+void
+_CheckLongValue(
+	DBInt_Connection * conn
+)
+{
+	SQLWCHAR	  * value = malloc((EXPORT_CHECK_LONG_LENGTH + 1) * sizeof(SQLWCHAR));
+	EXPORT_EXPECTED body = { 0 };
+	EXPORT_EXPECTED expected = { 0 };
+
+	for (int i = 0; i < EXPORT_CHECK_LONG_LENGTH; i++) {
+		if (i == SQLSERVER_EXPORT_CHUNK_LENGTH - 1) {
+			// U+1F600
+			value[i++] = 0xD83D;
+			value[i] = 0xDE00;
+			_AppendText(&body, "\xF0\x9F\x98\x80");
+		}
+		else if (i % 13 == 0) {
+			value[i] = L'"';
+			_AppendText(&body, "\"");
+		}
+		else if (i % 7 == 0) {
+			// U+00E9
+			value[i] = 0xE9;
+			_AppendText(&body, "\xC3\xA9");
+		}
+		else {
+			value[i] = L'x';
+			_AppendText(&body, "x");
+		}
+	}
+	value[EXPORT_CHECK_LONG_LENGTH] = L'\0';
+
+	stubOdbcSetRowCount(1);
+	stubOdbcSetText(NULL, value);
+
+	// CSV doubles the quotes
+	_AppendText(&expected, "id,name\r\n1,\"");
+	for (size_t i = 0; i < body.size; i++) {
+		_Append(&expected, &body.bytes[i], 1);
+		if (body.bytes[i] == '"') {
+			_Append(&expected, "\"", 1);
+		}
+	}
+	_AppendText(&expected, "\"\r\n");
+	_CheckExport(conn, SQLSERVER_EXPORT_CSV, &expected, 1);
+
+	_AppendBinaryHeader(&expected, "name");
+	_AppendInt32(&expected, 1);
+	_AppendText(&expected, "1");
+	_AppendInt32(&expected, (INT32)body.size);
+	_Append(&expected, body.bytes, body.size);
+	_CheckExport(conn, SQLSERVER_EXPORT_BINARY, &expected, 1);
+
+	stubOdbcSetText(NULL, NULL);
+	free(body.bytes);
+	free(value);
+}
+
+int
+main(
+	void
+)
+{
+	HANDLE heap = HeapCreate(0, 0, 0);
+
+	stubOdbcInstall();
+
+	DBInt_Connection * conn = sqlserverCreateConnection(heap, SODIUM_SQLSERVER_SUPPORT, "stub", "", "stub", "stub", "stub");
+	if (conn->err) {
+		fprintf(stderr, "Unable to connect to the stub driver\n");
+		return 2;
+	}
+
+	_CheckPlainRows(conn);
+	_CheckEscaping(conn);
+	_CheckLongValue(conn);
+
+	sqlserverDestroyConnection(conn);
+	HeapDestroy(heap);
+
+	printf("export check: %d failed\n", stubFailures);
+	return stubFailures;
+}
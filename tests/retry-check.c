@@ -0,0 +1,359 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+
+/*	Runs executions against the stub driver that fail with injected errors and checks that they are retried,
+	backed off and counted as sqlserverSetRetryPolicy and sqlserverGetRetryStats describe. Exits with the number
+	of failed checks */
+
+#include <windows.h>
+#include <stdio.h>
+
+#include "sqlserver-interface.h"
+#include "sqlserver-retry.h"
+#include "sqlserver-stub-odbc.h"
+
+#define RETRY_CHECK_QUERY		"SELECT id, name FROM stub WHERE id > ?"
+
+typedef struct _RETRY_RUN {
+	SQLINTEGER				nativeError;
+	double					elapsedMs;
+	SQLSERVER_RETRY_STATS	stats;
+	STUB_ODBC_COUNTERS		counters;
+} RETRY_RUN;
+
+void
+_SetPolicy(
+	int maxAttempts,
+	DWORD baseDelayMs,
+	DWORD maxDelayMs
+)
+{
+	SQLSERVER_RETRY_POLICY policy;
+
+	policy.maxAttempts = maxAttempts;
+	policy.baseDelayMs = baseDelayMs;
+	policy.maxDelayMs = maxDelayMs;
+	policy.reconnect = TRUE;
+	sqlserverSetRetryPolicy(&policy);
+}
+
+/*	Executes RETRY_CHECK_QUERY on "stm" and records the outcome, with the statistics and stub counters as
+	differences to their values before the execution */
+void
+_Execute(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	RETRY_RUN * run
+)
+{
+	SQLSERVER_RETRY_STATS	statsBefore;
+	STUB_ODBC_COUNTERS		countersBefore;
+	SQLSERVER_ERROR			error;
+	LARGE_INTEGER			frequency, started, ended;
+
+	sqlserverGetRetryStats(&statsBefore);
+	stubOdbcGetCounters(&countersBefore);
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&started);
+	sqlserverExecuteSelectStatement(conn, stm, NULL);
+	QueryPerformanceCounter(&ended);
+
+	run->elapsedMs = (ended.QuadPart - started.QuadPart) * 1000.0 / frequency.QuadPart;
+	run->nativeError = sqlserverGetStatementError(stm, &error) && error.hasError ? error.nativeError : 0;
+
+	sqlserverGetRetryStats(&run->stats);
+	run->stats.retries -= statsBefore.retries;
+	run->stats.recovered -= statsBefore.recovered;
+	run->stats.exhausted -= statsBefore.exhausted;
+	run->stats.reconnects -= statsBefore.reconnects;
+	run->stats.rejectedErrors -= statsBefore.rejectedErrors;
+	run->stats.transientErrors -= statsBefore.transientErrors;
+	run->stats.connectionErrors -= statsBefore.connectionErrors;
+
+	stubOdbcGetCounters(&run->counters);
+	run->counters.connects -= countersBefore.connects;
+	run->counters.disconnects -= countersBefore.disconnects;
+	run->counters.prepares -= countersBefore.prepares;
+	run->counters.executions -= countersBefore.executions;
+	run->counters.fetches -= countersBefore.fetches;
+}
+
+/*	New statement prepared with RETRY_CHECK_QUERY and its parameter bound */
+DBInt_Statement *
+_CreateStatement(
+	DBInt_Connection * conn,
+	BOOL retryable
+)
+{
+	DBInt_Statement * stm = sqlserverCreateStatement(conn);
+
+	sqlserverPrepare(conn, stm, RETRY_CHECK_QUERY);
+	STUB_CHECK(sqlserverBindInt64(conn, stm, 1, 0));
+	sqlserverSetStatementRetryable(conn, stm, retryable);
+	return stm;
+}
+
+void
+_CheckRejectedIsRetried(
+	DBInt_Connection * conn
+)
+{
+	DBInt_Statement   * stm = _CreateStatement(conn, FALSE);
+	RETRY_RUN			run;
+
+	_SetPolicy(4, 20, 80);
+	// service busy, retried without sqlserverSetStatementRetryable
+	stubOdbcFailExecutions(2, 40501, "HY000", FALSE);
+	_Execute(conn, stm, &run);
+
+	STUB_CHECK(run.nativeError == 0);
+	STUB_CHECK(run.counters.executions == 3);
+	STUB_CHECK(run.stats.rejectedErrors == 2);
+	STUB_CHECK(run.stats.retries == 2);
+	STUB_CHECK(run.stats.recovered == 1);
+	STUB_CHECK(run.stats.exhausted == 0);
+	// 20ms then 40ms, less up to half of each
+	STUB_CHECK(run.elapsedMs >= 30);
+	STUB_CHECK(strcmp(sqlserverGetColumnValueByColumnName(conn, stm, "name"), "row 1") == 0);
+
+	sqlserverFreeStatement(conn, stm);
+}
+
+void
+_CheckTransientNeedsRetryable(
+	DBInt_Connection * conn
+)
+{
+	DBInt_Statement   * stm = _CreateStatement(conn, FALSE);
+	RETRY_RUN			run;
+
+	_SetPolicy(4, 20, 80);
+	// deadlock victim
+	stubOdbcFailExecutions(1, 1205, "40001", FALSE);
+	_Execute(conn, stm, &run);
+
+	STUB_CHECK(run.nativeError == 1205);
+	STUB_CHECK(run.counters.executions == 1);
+	STUB_CHECK(run.stats.transientErrors == 1);
+	STUB_CHECK(run.stats.retries == 0);
+	STUB_CHECK(run.stats.exhausted == 0);
+	sqlserverFreeStatement(conn, stm);
+
+	stm = _CreateStatement(conn, TRUE);
+	stubOdbcFailExecutions(1, 1205, "40001", FALSE);
+	_Execute(conn, stm, &run);
+
+	STUB_CHECK(run.nativeError == 0);
+	STUB_CHECK(run.counters.executions == 2);
+	STUB_CHECK(run.stats.transientErrors == 1);
+	STUB_CHECK(run.stats.retries == 1);
+	STUB_CHECK(run.stats.recovered == 1);
+	STUB_CHECK(run.elapsedMs >= 10);
+	sqlserverFreeStatement(conn, stm);
+}
+
+void
+_CheckPermanentIsNotRetried(
+	DBInt_Connection * conn
+)
+{
+	DBInt_Statement   * stm = _CreateStatement(conn, TRUE);
+	RETRY_RUN			run;
+
+	_SetPolicy(4, 20, 80);
+	// invalid object name
+	stubOdbcFailExecutions(1, 208, "42S02", FALSE);
+	_Execute(conn, stm, &run);
+
+	STUB_CHECK(run.nativeError == 208);
+	STUB_CHECK(run.counters.executions == 1);
+	STUB_CHECK(run.stats.retries == 0);
+	STUB_CHECK(run.stats.rejectedErrors + run.stats.transientErrors + run.stats.connectionErrors == 0);
+	STUB_CHECK(run.stats.exhausted == 0);
+	sqlserverFreeStatement(conn, stm);
+}
+
+void
+_CheckAttemptsAreLimited(
+	DBInt_Connection * conn
+)
+{
+	DBInt_Statement   * stm = _CreateStatement(conn, TRUE);
+	RETRY_RUN			run;
+
+	_SetPolicy(3, 20, 80);
+	stubOdbcFailExecutions(10, 40501, "HY000", FALSE);
+	_Execute(conn, stm, &run);
+	stubOdbcFailExecutions(0, 0, "", FALSE);
+
+	STUB_CHECK(run.nativeError == 40501);
+	STUB_CHECK(run.counters.executions == 3);
+	STUB_CHECK(run.stats.rejectedErrors == 3);
+	STUB_CHECK(run.stats.retries == 2);
+	STUB_CHECK(run.stats.exhausted == 1);
+	STUB_CHECK(run.stats.recovered == 0);
+	sqlserverFreeStatement(conn, stm);
+
+	// a single attempt is no retry policy, nothing is exhausted
+	stm = _CreateStatement(conn, TRUE);
+	_SetPolicy(1, 20, 80);
+	stubOdbcFailExecutions(1, 40501, "HY000", FALSE);
+	_Execute(conn, stm, &run);
+
+	STUB_CHECK(run.nativeError == 40501);
+	STUB_CHECK(run.counters.executions == 1);
+	STUB_CHECK(run.stats.retries == 0);
+	STUB_CHECK(run.stats.exhausted == 0);
+	sqlserverFreeStatement(conn, stm);
+}
+
+void
+_CheckBackoff(
+	DBInt_Connection * conn
+)
+{
+	DBInt_Statement   * stm = _CreateStatement(conn, TRUE);
+	RETRY_RUN			run;
+
+	// doubling: 50, 100, 200 and 400ms less up to half of each, at least 375ms
+	_SetPolicy(5, 50, 1000);
+	stubOdbcFailExecutions(4, 40501, "HY000", FALSE);
+	_Execute(conn, stm, &run);
+
+	STUB_CHECK(run.nativeError == 0);
+	STUB_CHECK(run.stats.retries == 4);
+	STUB_CHECK(run.elapsedMs >= 375);
+	sqlserverFreeStatement(conn, stm);
+
+	// capped at 50ms: between 100 and 200ms plus the timer granularity
+	stm = _CreateStatement(conn, TRUE);
+	_SetPolicy(5, 50, 50);
+	stubOdbcFailExecutions(4, 40501, "HY000", FALSE);
+	_Execute(conn, stm, &run);
+
+	STUB_CHECK(run.nativeError == 0);
+	STUB_CHECK(run.stats.retries == 4);
+	STUB_CHECK(run.elapsedMs >= 100);
+	STUB_CHECK(run.elapsedMs < 350);
+	sqlserverFreeStatement(conn, stm);
+}
+
+void
+_CheckReconnect(
+	DBInt_Connection * conn
+)
+{
+	DBInt_Statement   * stm = _CreateStatement(conn, TRUE);
+	RETRY_RUN			run;
+
+	_SetPolicy(3, 20, 80);
+	// the query has a parameter, so it is prepared: the new handle needs the prepare and the parameter again
+	stubOdbcFailExecutions(1, 10054, "08S01", TRUE);
+	_Execute(conn, stm, &run);
+
+	STUB_CHECK(run.nativeError == 0);
+	STUB_CHECK(run.stats.connectionErrors == 1);
+	STUB_CHECK(run.stats.reconnects == 1);
+	STUB_CHECK(run.stats.retries == 1);
+	STUB_CHECK(run.stats.recovered == 1);
+	STUB_CHECK(run.counters.disconnects == 1);
+	STUB_CHECK(run.counters.connects == 1);
+	STUB_CHECK(run.counters.prepares == 1);
+	STUB_CHECK(run.counters.executions == 2);
+	STUB_CHECK(run.counters.liveStatements == 1);
+	STUB_CHECK(sqlserverIsConnectionOpen(conn));
+	STUB_CHECK(strcmp(sqlserverGetColumnValueByColumnName(conn, stm, "id"), "1") == 0);
+	sqlserverFreeStatement(conn, stm);
+
+	// not retryable, the outcome of the lost execution is unknown
+	stm = _CreateStatement(conn, FALSE);
+	stubOdbcFailExecutions(1, 10054, "08S01", TRUE);
+	_Execute(conn, stm, &run);
+
+	STUB_CHECK(run.nativeError == 10054);
+	STUB_CHECK(run.stats.connectionErrors == 1);
+	STUB_CHECK(run.stats.reconnects == 0);
+	STUB_CHECK(run.counters.connects == 0);
+	STUB_CHECK(!sqlserverIsConnectionOpen(conn));
+	sqlserverFreeStatement(conn, stm);
+}
+
+/*	Leaves the connection broken */
+void
+_CheckNoReconnectUnderOtherStatements(
+	DBInt_Connection * conn
+)
+{
+	DBInt_Statement   * other = sqlserverCreateStatement(conn);
+	DBInt_Statement   * stm = _CreateStatement(conn, TRUE);
+	RETRY_RUN			run;
+
+	_SetPolicy(3, 20, 80);
+	stubOdbcFailExecutions(1, 10054, "08S01", TRUE);
+	_Execute(conn, stm, &run);
+
+	STUB_CHECK(run.nativeError == 10054);
+	STUB_CHECK(run.stats.connectionErrors == 1);
+	STUB_CHECK(run.stats.reconnects == 0);
+	STUB_CHECK(run.counters.connects == 0);
+	STUB_CHECK(run.counters.disconnects == 0);
+	STUB_CHECK(run.counters.liveStatements == 2);
+
+	sqlserverFreeStatement(conn, stm);
+	sqlserverFreeStatement(conn, other);
+}
+
+DBInt_Connection *
+_Connect(
+	HANDLE heap
+)
+{
+	DBInt_Connection * conn = sqlserverCreateConnection(heap, SODIUM_SQLSERVER_SUPPORT, "stub", "", "stub", "stub", "stub");
+
+	if (conn->err) {
+		fprintf(stderr, "Unable to connect to the stub driver\n");
+		exit(2);
+	}
+	return conn;
+}
+
+int
+main(
+	void
+)
+{
+	HANDLE heap = HeapCreate(0, 0, 0);
+
+	stubOdbcInstall();
+
+	DBInt_Connection * conn = _Connect(heap);
+	_CheckRejectedIsRetried(conn);
+	_CheckTransientNeedsRetryable(conn);
+	_CheckPermanentIsNotRetried(conn);
+	_CheckAttemptsAreLimited(conn);
+	_CheckBackoff(conn);
+	_CheckReconnect(conn);
+	sqlserverDestroyConnection(conn);
+
+	conn = _Connect(heap);
+	_CheckNoReconnectUnderOtherStatements(conn);
+	sqlserverDestroyConnection(conn);
+
+	HeapDestroy(heap);
+
+	printf("retry check: %d failed\n", stubFailures);
+	return stubFailures;
+}
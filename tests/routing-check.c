@@ -0,0 +1,208 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+/*	Routes leases of a group of one primary and three replicas, all of them stub driver DSNs, and checks the
+	least outstanding and round robin balancing, the fallback to the primary when the replicas refuse
+	connections and the retryAfterMs pause before a failed replica is tried again. Exits with the number of
+	failed checks */
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sqlserver-interface.h"
+#include "sqlserver-routing.h"
+#include "sqlserver-stub-odbc.h"
+
+#define ROUTING_CHECK_REPLICA_COUNT		3
+#define ROUTING_CHECK_RETRY_AFTER		200
+
+const char * replicaDsns[ROUTING_CHECK_REPLICA_COUNT] = { "replica1", "replica2", "replica3" };
+
+SQLSERVER_ROUTING_GROUP *
+_CreateGroup(
+	HANDLE heap,
+	SQLSERVER_ROUTING_BALANCE balance
+)
+{
+	SQLSERVER_ROUTING_NODE_OPTIONS	replicas[ROUTING_CHECK_REPLICA_COUNT];
+	SQLSERVER_ROUTING_OPTIONS		options;
+
+	memset(replicas, 0, sizeof(replicas));
+	replicas[0].connectionString = "DSN=replica1;";
+	replicas[1].connectionString = "DSN=replica2;";
+	replicas[2].connectionString = "DSN=replica3;";
+
+	memset(&options, 0, sizeof(options));
+	options.primary.connectionString = "DSN=primary;";
+	options.replicas = replicas;
+	options.replicaCount = ROUTING_CHECK_REPLICA_COUNT;
+	options.balance = balance;
+	options.acquireTimeoutMs = 100;
+	options.retryAfterMs = ROUTING_CHECK_RETRY_AFTER;
+
+	SQLSERVER_ROUTING_GROUP * group = sqlserverRoutingCreate(heap, SODIUM_SQLSERVER_SUPPORT, &options);
+	if (group == NULL) {
+		fprintf(stderr, "Unable to create the routing group\n");
+		exit(2);
+	}
+	return group;
+}
+
+/*	Acquires a lease and returns its node, -1 when none could be acquired */
+int
+_Acquire(
+	SQLSERVER_ROUTING_GROUP * group,
+	BOOL readOnly,
+	SQLSERVER_ROUTING_LEASE * lease
+)
+{
+	if (!STUB_CHECK(sqlserverRoutingAcquire(group, readOnly, lease))) {
+		return -1;
+	}
+	STUB_CHECK(lease->conn != NULL && sqlserverIsConnectionOpen(lease->conn));
+	return lease->node;
+}
+
+void
+_CheckLeastOutstanding(
+	HANDLE heap
+)
+{
+	SQLSERVER_ROUTING_GROUP		  * group = _CreateGroup(heap, SQLSERVER_ROUTING_LEAST_OUTSTANDING);
+	SQLSERVER_ROUTING_LEASE			leases[ROUTING_CHECK_REPLICA_COUNT], write;
+	SQLSERVER_ROUTING_NODE_STATS	stats;
+	int								seen = 0;
+
+	STUB_CHECK(_Acquire(group, FALSE, &write) == 0);
+
+	// each held lease leaves another replica with the fewest
+	for (int i = 0; i < ROUTING_CHECK_REPLICA_COUNT; i++) {
+		int node = _Acquire(group, TRUE, &leases[i]);
+		STUB_CHECK(node >= 1 && node <= ROUTING_CHECK_REPLICA_COUNT);
+		seen |= 1 << node;
+	}
+	STUB_CHECK(seen == 0xE);
+
+	int freed = leases[1].node;
+	sqlserverRoutingRelease(group, &leases[1], FALSE);
+	STUB_CHECK(_Acquire(group, TRUE, &leases[1]) == freed);
+
+	for (int i = 0; i < ROUTING_CHECK_REPLICA_COUNT; i++) {
+		sqlserverRoutingRelease(group, &leases[i], FALSE);
+	}
+	sqlserverRoutingRelease(group, &write, FALSE);
+
+	for (int node = 0; node <= ROUTING_CHECK_REPLICA_COUNT; node++) {
+		STUB_CHECK(sqlserverRoutingGetNodeStats(group, node, &stats));
+		STUB_CHECK(stats.outstanding == 0);
+		STUB_CHECK(stats.leases == (node == 0 ? 1 : (node == freed ? 2 : 1)));
+	}
+	sqlserverRoutingDestroy(group);
+}
+
+void
+_CheckRoundRobin(
+	HANDLE heap
+)
+{
+	SQLSERVER_ROUTING_GROUP	  * group = _CreateGroup(heap, SQLSERVER_ROUTING_ROUND_ROBIN);
+	SQLSERVER_ROUTING_LEASE		lease;
+	int							previous = _Acquire(group, TRUE, &lease);
+
+	sqlserverRoutingRelease(group, &lease, FALSE);
+	for (int i = 0; i < 2 * ROUTING_CHECK_REPLICA_COUNT; i++) {
+		int node = _Acquire(group, TRUE, &lease);
+		STUB_CHECK(node == previous % ROUTING_CHECK_REPLICA_COUNT + 1);
+		sqlserverRoutingRelease(group, &lease, FALSE);
+		previous = node;
+	}
+	sqlserverRoutingDestroy(group);
+}
+
+/*	Replicas that refuse connections send read-only leases to the primary, and are not tried again before
+	retryAfterMs has passed */
+void
+_CheckFallbackAndRetryAfter(
+	HANDLE heap
+)
+{
+	SQLSERVER_ROUTING_GROUP		  * group = _CreateGroup(heap, SQLSERVER_ROUTING_LEAST_OUTSTANDING);
+	SQLSERVER_ROUTING_LEASE			lease;
+	SQLSERVER_ROUTING_NODE_STATS	stats;
+	STUB_ODBC_COUNTERS				before, after;
+
+	for (int i = 0; i < ROUTING_CHECK_REPLICA_COUNT; i++) {
+		stubOdbcSetDsnDown(replicaDsns[i], TRUE);
+	}
+	stubOdbcGetCounters(&before);
+	STUB_CHECK(_Acquire(group, TRUE, &lease) == 0);
+	sqlserverRoutingRelease(group, &lease, FALSE);
+	stubOdbcGetCounters(&after);
+	STUB_CHECK(after.refusedConnects - before.refusedConnects == ROUTING_CHECK_REPLICA_COUNT);
+
+	STUB_CHECK(sqlserverRoutingGetNodeStats(group, 0, &stats));
+	STUB_CHECK(stats.fallbacks == 1);
+	for (int node = 1; node <= ROUTING_CHECK_REPLICA_COUNT; node++) {
+		STUB_CHECK(sqlserverRoutingGetNodeStats(group, node, &stats));
+		STUB_CHECK(stats.failures == 1);
+		STUB_CHECK(!stats.healthy);
+	}
+
+	// back up, but still skipped without a connection attempt
+	for (int i = 0; i < ROUTING_CHECK_REPLICA_COUNT; i++) {
+		stubOdbcSetDsnDown(replicaDsns[i], FALSE);
+	}
+	stubOdbcGetCounters(&before);
+	STUB_CHECK(_Acquire(group, TRUE, &lease) == 0);
+	sqlserverRoutingRelease(group, &lease, FALSE);
+	stubOdbcGetCounters(&after);
+	STUB_CHECK(after.connects == before.connects);
+	STUB_CHECK(after.refusedConnects == before.refusedConnects);
+	STUB_CHECK(sqlserverRoutingGetNodeStats(group, 0, &stats));
+	STUB_CHECK(stats.fallbacks == 2);
+
+	Sleep(ROUTING_CHECK_RETRY_AFTER + 50);
+	int node = _Acquire(group, TRUE, &lease);
+	STUB_CHECK(node >= 1 && node <= ROUTING_CHECK_REPLICA_COUNT);
+	sqlserverRoutingRelease(group, &lease, FALSE);
+	STUB_CHECK(sqlserverRoutingGetNodeStats(group, node, &stats));
+	STUB_CHECK(stats.healthy);
+	STUB_CHECK(stats.leases == 1);
+
+	sqlserverRoutingDestroy(group);
+}
+
+int
+main(
+	void
+)
+{
+	HANDLE heap = HeapCreate(0, 0, 0);
+
+	stubOdbcInstall();
+
+	_CheckLeastOutstanding(heap);
+	_CheckRoundRobin(heap);
+	_CheckFallbackAndRetryAfter(heap);
+
+	STUB_ODBC_COUNTERS counters;
+	stubOdbcGetCounters(&counters);
+	STUB_CHECK(counters.liveStatements == 0);
+
+	HeapDestroy(heap);
+
+	printf("routing check: %d failed\n", stubFailures);
+	return stubFailures;
+}
@@ -0,0 +1,182 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+
+
+/*	Creates, executes, reads and frees statements against the stub driver for a number of cycles (the first
+	argument, SOAK_DEFAULT_CYCLES by default) and checks that memory stays flat: no statement block is left once a
+	statement is freed and, after the caches filled during the warm-up, the busy bytes of the process heaps do not
+	grow. Exits with the number of failed checks */
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sqlserver-interface.h"
+#include "sqlserver-cache.h"
+#include "sqlserver-stub-odbc.h"
+
+#define SOAK_DEFAULT_CYCLES		1000000
+#define SOAK_WARMUP_CYCLES		10000
+#define SOAK_SAMPLES			10
+/*	room for heap bookkeeping that is not per cycle, far below what a leak of one block per cycle adds */
+#define SOAK_HEAP_SLACK			(64 * 1024)
+#define SOAK_ROW_COUNT			3
+
+typedef struct _SOAK_QUERY {
+	const char	  * sql;
+	BOOL			hasParameter;
+	BOOL			returnsRows;
+} SOAK_QUERY;
+
+/*	A fixed set, so the parameter, describe, direct and result caches stop growing once every text was seen */
+static const SOAK_QUERY soakQueries[] = {
+	{ "SELECT id, name FROM stub", FALSE, TRUE },
+	{ "SELECT id, name FROM stub WHERE id > ?", TRUE, TRUE },
+	{ "UPDATE stub SET name = 'soak' WHERE id = ?", TRUE, FALSE }
+};
+
+/*	Sum of the busy blocks of every heap of the process, the library's own heaps included */
+long long
+_HeapBusyBytes(
+	void
+)
+{
+	HANDLE				heaps[256];
+	PROCESS_HEAP_ENTRY	entry;
+	long long			busyBytes = 0;
+	DWORD				heapCount = GetProcessHeaps(256, heaps);
+
+	if (heapCount > 256) {
+		heapCount = 256;
+	}
+	for (DWORD i = 0; i < heapCount; i++) {
+		if (!HeapLock(heaps[i])) {
+			continue;
+		}
+		entry.lpData = NULL;
+		while (HeapWalk(heaps[i], &entry)) {
+			if (entry.wFlags & PROCESS_HEAP_ENTRY_BUSY) {
+				busyBytes += entry.cbData;
+			}
+		}
+		HeapUnlock(heaps[i]);
+	}
+	return busyBytes;
+}
+
+/*	One statement from creation to free. Returns FALSE if a check failed */
+BOOL
+_RunCycle(
+	DBInt_Connection * conn,
+	long long cycle
+)
+{
+	const SOAK_QUERY  * query = &soakQueries[cycle % (sizeof(soakQueries) / sizeof(soakQueries[0]))];
+	DBInt_Statement   * stm = sqlserverCreateStatement(conn);
+	SQLSERVER_ERROR		error;
+	STUB_ODBC_COUNTERS	counters;
+	BOOL				passed = TRUE;
+	// an execution that fails now and then, its error path must release what the statement allocated
+	BOOL				fails = (cycle % 97) == 0;
+
+	sqlserverPrepare(conn, stm, query->sql);
+	if (query->hasParameter) {
+		passed &= STUB_CHECK(sqlserverBindInt64(conn, stm, 1, cycle % 4));
+	}
+	if (query->returnsRows && (cycle % 5) == 0) {
+		sqlserverEnableResultCache(conn, stm, 60000, "stub");
+	}
+	if (fails) {
+		stubOdbcFailExecutions(1, 208, "42S02", FALSE);
+	}
+
+	sqlserverExecuteSelectStatement(conn, stm, NULL);
+
+	if (fails) {
+		// served from the cache when an earlier cycle cached the same text and value
+		passed &= STUB_CHECK(!sqlserverGetStatementError(stm, &error) || error.nativeError == 208);
+		stubOdbcFailExecutions(0, 0, "", FALSE);
+	}
+	else {
+		passed &= STUB_CHECK(!sqlserverGetStatementError(stm, &error));
+		if (query->returnsRows) {
+			int rowCount = 0;
+			while (!sqlserverIsEof(conn, stm)) {
+				rowCount++;
+				passed &= STUB_CHECK(atoi(sqlserverGetColumnValueByColumnName(conn, stm, "id")) == rowCount);
+				sqlserverNext(conn, stm);
+			}
+			passed &= STUB_CHECK(rowCount == SOAK_ROW_COUNT);
+		}
+	}
+
+	sqlserverFreeStatement(conn, stm);
+
+	// -1 in release builds
+	passed &= STUB_CHECK(sqlserverGetLiveBlockCount(conn, NULL) <= 0);
+	stubOdbcGetCounters(&counters);
+	passed &= STUB_CHECK(counters.liveStatements == 0);
+	return passed;
+}
+
+int
+main(
+	int argc,
+	char * argv[]
+)
+{
+	long long	cycles = argc > 1 ? _atoi64(argv[1]) : SOAK_DEFAULT_CYCLES;
+	long long	sampleInterval = cycles / SOAK_SAMPLES > 0 ? cycles / SOAK_SAMPLES : 1;
+	long long	baselineBytes = -1, peakBytes = -1, busyBytes;
+	HANDLE		heap = HeapCreate(0, 0, 0);
+
+	// stdio allocates its buffers on first use, before the baseline
+	printf("soak: %lld cycles\n", cycles);
+
+	stubOdbcInstall();
+	stubOdbcSetRowCount(SOAK_ROW_COUNT);
+
+	DBInt_Connection * conn = sqlserverCreateConnection(heap, SODIUM_SQLSERVER_SUPPORT, "stub", "", "stub", "stub", "stub");
+	if (conn->err) {
+		fprintf(stderr, "Unable to connect to the stub driver\n");
+		return 2;
+	}
+
+	for (long long cycle = 0; cycle < cycles; cycle++) {
+		if (!_RunCycle(conn, cycle)) {
+			fprintf(stderr, "soak: stopped at cycle %lld\n", cycle);
+			break;
+		}
+		if (cycle + 1 == SOAK_WARMUP_CYCLES || (cycle + 1 < SOAK_WARMUP_CYCLES && cycle + 1 == cycles)) {
+			baselineBytes = peakBytes = _HeapBusyBytes();
+		}
+		else if (baselineBytes >= 0 && ((cycle + 1) % sampleInterval == 0 || cycle + 1 == cycles)) {
+			busyBytes = _HeapBusyBytes();
+			if (busyBytes > peakBytes) {
+				peakBytes = busyBytes;
+			}
+			if (!STUB_CHECK(busyBytes <= baselineBytes + SOAK_HEAP_SLACK)) {
+				fprintf(stderr, "soak: %lld busy bytes after %lld cycles, %lld after the warm-up\n", busyBytes, cycle + 1, baselineBytes);
+				break;
+			}
+		}
+	}
+
+	sqlserverDestroyConnection(conn);
+	HeapDestroy(heap);
+
+	printf("soak: heap %lld bytes after the warm-up, peak %lld, %d failed\n", baselineBytes, peakBytes, stubFailures);
+	return stubFailures;
+}
@@ -0,0 +1,1421 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+
+#include <windows.h>
+#include <stdio.h>
+
+#include "sqlserver-interface.h"
+#include "sqlserver-tvp.h"
+#include "sqlserver-stub-odbc.h"
+
+#define STUB_COLUMN_COUNT			2
+#define STUB_MESSAGE_LENGTH			128
+/*	table-valued parameters are supported among the first STUB_TABLE_COUNT parameters */
+#define STUB_TABLE_COUNT			4
+#define STUB_TABLE_COLUMN_COUNT		8
+#define STUB_DSN_COUNT				8
+#define STUB_DSN_LENGTH				64
+
+typedef enum _STUB_OPERATION {
+	STUB_OPERATION_NONE = 0,
+	STUB_OPERATION_PREPARE,
+	STUB_OPERATION_EXECUTE,
+	STUB_OPERATION_FETCH
+} STUB_OPERATION;
+
+typedef struct _STUB_BINDING {
+	SQLSMALLINT			cType;
+	SQLPOINTER			value;
+	SQLLEN				length;
+	SQLLEN			  * indicator;
+} STUB_BINDING;
+
+/*	Table-valued parameter, bound with SQL_SS_TABLE and its columns under SQL_SOPT_SS_PARAM_FOCUS */
+typedef struct _STUB_TABLE {
+	SQLWCHAR				typeName[STUB_ODBC_TYPE_NAME_LENGTH];
+	SQLULEN					arraySize;
+	/*	rows in use or SQL_DEFAULT_PARAM */
+	SQLLEN				  * rowCount;
+	/*	highest column bound */
+	SQLSMALLINT				columnCount;
+	STUB_BINDING			columns[STUB_TABLE_COLUMN_COUNT];
+} STUB_TABLE;
+
+/*	Environment, connection and statement handles */
+typedef struct _STUB_HANDLE {
+	SQLSMALLINT				type;
+	struct _STUB_HANDLE	  * parent;
+	/*	every live handle, see _StubIsLive */
+	struct _STUB_HANDLE	  * next;
+
+	/*	diagnostic record of the last call */
+	BOOL					hasDiagnostic;
+	SQLINTEGER				nativeError;
+	SQLWCHAR				sqlState[SQL_SQLSTATE_SIZE + 1];
+	SQLWCHAR				message[STUB_MESSAGE_LENGTH];
+
+	/*	connection */
+	BOOL					connected;
+	BOOL					dead;
+
+	/*	statement */
+	SQLWCHAR			  * text;
+	BOOL					isSelect;
+	SQLSMALLINT				parameterCount;
+	/*	bit n - 1 is set once parameter n is bound */
+	ULONGLONG				boundParameters;
+	/*	bit n - 1 is set when parameter n follows FROM, see _StubSetText */
+	ULONGLONG				tableParameters;
+	/*	bit n - 1 is set once parameter n is bound as SQL_SS_TABLE */
+	ULONGLONG				boundTables;
+	STUB_TABLE				tables[STUB_TABLE_COUNT];
+	/*	table-valued parameter whose columns SQLBindParameter binds, 0 for the statement's own parameters */
+	SQLUSMALLINT			paramFocus;
+	BOOL					cursorOpen;
+	int						nextRow;
+	STUB_BINDING			bindings[STUB_COLUMN_COUNT];
+	SQLULEN					rowArraySize;
+	SQLULEN					rowBindType;
+	SQLULEN				  * rowsFetched;
+	BOOL					async;
+	STUB_OPERATION			pendingOperation;
+	int						pendingPolls;
+	BOOL					canceled;
+} STUB_HANDLE;
+
+SRWLOCK						stubLock = SRWLOCK_INIT;
+STUB_HANDLE				  * stubHandles;
+STUB_ODBC_COUNTERS			stubCounters;
+int							stubRowCount = 3;
+/*	second column, see stubOdbcSetText. NULL keeps "name" and "row 1", "row 2", ... */
+const SQLWCHAR			  * stubTextName;
+const SQLWCHAR			  * stubTextValue;
+int							stubPendingPolls;
+int							stubFailCount;
+SQLINTEGER					stubFailNativeError;
+SQLWCHAR					stubFailSqlState[SQL_SQLSTATE_SIZE + 1];
+BOOL						stubFailConnectionLost;
+
+/*	"DSN=name;" of the servers that refuse connections, see stubOdbcSetDsnDown */
+SQLWCHAR					stubDownDsns[STUB_DSN_COUNT][STUB_DSN_LENGTH];
+
+/*	what the last execution received in its table-valued parameters */
+STUB_ODBC_TABLE				stubTables[STUB_TABLE_COUNT];
+ULONGLONG					stubTablesReceived;
+
+int							stubFailures;
+
+BOOL
+stubCheck(
+	BOOL passed,
+	const char * condition,
+	const char * file,
+	int line
+)
+{
+	if (!passed) {
+		fprintf(stderr, "%s(%d): check failed: %s\n", file, line, condition);
+		stubFailures++;
+	}
+	return passed;
+}
+
+/*	Freed handles may be passed back by mistake, they must not be touched */
+BOOL
+_StubIsLive(
+	SQLHANDLE handle,
+	SQLSMALLINT type
+)
+{
+	for (STUB_HANDLE * live = stubHandles; live; live = live->next) {
+		if (live == handle) {
+			return live->type == type;
+		}
+	}
+	return FALSE;
+}
+
+/*	Diagnostic records only describe the last call made on the handle */
+void
+_StubBegin(
+	STUB_HANDLE * handle
+)
+{
+	handle->hasDiagnostic = FALSE;
+}
+
+SQLRETURN
+_StubError(
+	STUB_HANDLE * handle,
+	const SQLWCHAR * sqlState,
+	SQLINTEGER nativeError,
+	const SQLWCHAR * message
+)
+{
+	handle->hasDiagnostic = TRUE;
+	handle->nativeError = nativeError;
+	wcscpy_s(handle->sqlState, SQL_SQLSTATE_SIZE + 1, sqlState);
+	wcscpy_s(handle->message, STUB_MESSAGE_LENGTH, message);
+	return SQL_ERROR;
+}
+
+void
+_StubReleaseHandle(
+	STUB_HANDLE * handle
+)
+{
+	for (STUB_HANDLE ** link = &stubHandles; *link; link = &(*link)->next) {
+		if (*link == handle) {
+			*link = handle->next;
+			break;
+		}
+	}
+	if (handle->type == SQL_HANDLE_STMT) {
+		stubCounters.liveStatements--;
+	}
+	free(handle->text);
+	free(handle);
+}
+
+/*	SQLDisconnect releases the statements of the connection */
+void
+_StubReleaseStatements(
+	STUB_HANDLE * dbc
+)
+{
+	STUB_HANDLE * handle = stubHandles;
+
+	while (handle) {
+		STUB_HANDLE * next = handle->next;
+		if (handle->type == SQL_HANDLE_STMT && handle->parent == dbc) {
+			_StubReleaseHandle(handle);
+		}
+		handle = next;
+	}
+}
+
+/*	Asynchronous statements answer SQL_STILL_EXECUTING until the operation has been polled often enough. Returns
+	SQL_SUCCESS when the operation is to run now */
+SQLRETURN
+_StubPoll(
+	STUB_HANDLE * stmt,
+	STUB_OPERATION operation
+)
+{
+	if (!stmt->async) {
+		return SQL_SUCCESS;
+	}
+	if (stmt->pendingOperation == STUB_OPERATION_NONE) {
+		stmt->pendingOperation = operation;
+		stmt->pendingPolls = stubPendingPolls;
+	}
+	else if (stmt->pendingOperation != operation) {
+		return _StubError(stmt, L"HY010", 0, L"Function sequence error");
+	}
+	if (stmt->pendingPolls > 0 && !stmt->canceled) {
+		stmt->pendingPolls--;
+		stubCounters.stillExecuting++;
+		return SQL_STILL_EXECUTING;
+	}
+	stmt->pendingOperation = STUB_OPERATION_NONE;
+	if (stmt->canceled) {
+		stmt->canceled = FALSE;
+		return _StubError(stmt, L"HY008", 0, L"Operation canceled");
+	}
+	return SQL_SUCCESS;
+}
+
+void
+_StubSetText(
+	STUB_HANDLE * stmt,
+	const SQLWCHAR * text,
+	SQLINTEGER length
+)
+{
+	const SQLWCHAR * start = text;
+
+	if (length == SQL_NTS) {
+		length = (SQLINTEGER)wcslen(text);
+	}
+	free(stmt->text);
+	stmt->text = malloc((length + 1) * sizeof(SQLWCHAR));
+	memcpy(stmt->text, text, length * sizeof(SQLWCHAR));
+	stmt->text[length] = L'\0';
+
+	while (*start == L' ' || *start == L'\t' || *start == L'\n' || *start == L'\r') {
+		start++;
+	}
+	stmt->isSelect = (_wcsnicmp(start, L"SELECT", 6) == 0);
+	stmt->parameterCount = 0;
+	stmt->tableParameters = 0;
+	for (const SQLWCHAR * c = stmt->text; *c; c++) {
+		if (*c == L'?') {
+			if (c - stmt->text >= 5 && _wcsnicmp(c - 5, L"FROM ", 5) == 0 && stmt->parameterCount < 64) {
+				stmt->tableParameters |= 1ULL << stmt->parameterCount;
+			}
+			stmt->parameterCount++;
+		}
+	}
+}
+
+/*	Reads the rows of the table-valued parameters as the server would receive them */
+SQLRETURN
+_StubReceiveTables(
+	STUB_HANDLE * stmt
+)
+{
+	stubTablesReceived = 0;
+	for (int iParam = 0; iParam < STUB_TABLE_COUNT; iParam++) {
+		STUB_TABLE		* table = &stmt->tables[iParam];
+		STUB_ODBC_TABLE * received = &stubTables[iParam];
+
+		if ((stmt->boundTables & (1ULL << iParam)) == 0) {
+			continue;
+		}
+		SQLLEN rowCount = (table->rowCount == NULL || *table->rowCount == SQL_DEFAULT_PARAM) ? 0 : *table->rowCount;
+		if (rowCount < 0 || (SQLULEN)rowCount > table->arraySize) {
+			return _StubError(stmt, L"HY104", 0, L"Invalid precision or scale value");
+		}
+		if (rowCount > 0 && table->columnCount == 0) {
+			return _StubError(stmt, L"07002", 0, L"COUNT field incorrect");
+		}
+
+		memset(received, 0, sizeof(STUB_ODBC_TABLE));
+		wcscpy_s(received->typeName, STUB_ODBC_TYPE_NAME_LENGTH, table->typeName);
+		received->rowCount = rowCount;
+		received->columnCount = rowCount > 0 ? table->columnCount : 0;
+		for (SQLSMALLINT iCol = 0; iCol < received->columnCount; iCol++) {
+			STUB_BINDING * column = &table->columns[iCol];
+			if (column->value == NULL) {
+				return _StubError(stmt, L"07002", 0, L"COUNT field incorrect");
+			}
+			for (SQLLEN iRow = 0; iRow < rowCount; iRow++) {
+				if (column->indicator && column->indicator[iRow] == SQL_NULL_DATA) {
+					received->nullCount++;
+				}
+				else if (iCol == 0 && column->cType == SQL_C_SBIGINT) {
+					received->firstColumnSum += *(SQLBIGINT*)((char*)column->value + iRow * column->length);
+				}
+			}
+		}
+		stubTablesReceived |= 1ULL << iParam;
+	}
+	return SQL_SUCCESS;
+}
+
+SQLRETURN
+_StubRun(
+	STUB_HANDLE * stmt
+)
+{
+	for (SQLSMALLINT iParam = 0; iParam < stmt->parameterCount; iParam++) {
+		if (iParam >= 64 || (stmt->boundParameters & (1ULL << iParam)) == 0) {
+			return _StubError(stmt, L"07002", 0, L"COUNT field incorrect");
+		}
+	}
+	if (stmt->paramFocus != 0) {
+		return _StubError(stmt, L"HY010", 0, L"Function sequence error");
+	}
+	SQLRETURN RetCode = _StubReceiveTables(stmt);
+	if (RetCode != SQL_SUCCESS) {
+		return RetCode;
+	}
+	stubCounters.executions++;
+	if (stubFailCount > 0) {
+		stubFailCount--;
+		if (stubFailConnectionLost) {
+			stmt->parent->dead = TRUE;
+		}
+		return _StubError(stmt, stubFailSqlState, stubFailNativeError, L"Injected failure");
+	}
+	if (stmt->parent->dead) {
+		return _StubError(stmt, L"08S01", 10054, L"Communication link failure");
+	}
+	stmt->cursorOpen = stmt->isSelect;
+	stmt->nextRow = 0;
+	return SQL_SUCCESS;
+}
+
+const SQLWCHAR *
+_StubColumnName(
+	SQLUSMALLINT column
+)
+{
+	if (column == 1) {
+		return L"id";
+	}
+	return stubTextName ? stubTextName : L"name";
+}
+
+/*	Display size and column size of a column */
+SQLULEN
+_StubColumnSize(
+	SQLUSMALLINT column
+)
+{
+	if (column == 1) {
+		return 10;
+	}
+	return stubTextValue ? wcslen(stubTextValue) : 32;
+}
+
+/*	Converts column "column" of row "row" (both from 0) into the caller's buffer */
+SQLRETURN
+_StubWriteValue(
+	STUB_HANDLE * stmt,
+	const STUB_BINDING * binding,
+	SQLPOINTER value,
+	SQLLEN * indicator,
+	int column,
+	int row
+)
+{
+	char text[32];
+
+	if (column == 0) {
+		sprintf_s(text, sizeof(text), "%d", row + 1);
+	}
+	else {
+		sprintf_s(text, sizeof(text), "row %d", row + 1);
+	}
+
+	switch (binding->cType) {
+		case SQL_C_SBIGINT:
+			if (column != 0) {
+				break;
+			}
+			*(SQLBIGINT*)value = row + 1;
+			*indicator = sizeof(SQLBIGINT);
+			return SQL_SUCCESS;
+		case SQL_C_LONG:
+		case SQL_C_SLONG:
+			if (column != 0) {
+				break;
+			}
+			*(SQLINTEGER*)value = row + 1;
+			*indicator = sizeof(SQLINTEGER);
+			return SQL_SUCCESS;
+		case SQL_C_DOUBLE:
+			if (column != 0) {
+				break;
+			}
+			*(SQLDOUBLE*)value = row + 1;
+			*indicator = sizeof(SQLDOUBLE);
+			return SQL_SUCCESS;
+		case SQL_C_CHAR:
+			strncpy_s(value, binding->length, text, _TRUNCATE);
+			*indicator = strlen(text);
+			return SQL_SUCCESS;
+		case SQL_C_WCHAR: {
+			size_t length = (column != 0 && stubTextValue) ? wcslen(stubTextValue) : strlen(text);
+			size_t capacity = binding->length / sizeof(SQLWCHAR);
+			for (size_t i = 0; i < length && i + 1 < capacity; i++) {
+				((SQLWCHAR*)value)[i] = (column != 0 && stubTextValue) ? stubTextValue[i] : (SQLWCHAR)text[i];
+			}
+			if (capacity > 0) {
+				((SQLWCHAR*)value)[min(length, capacity - 1)] = L'\0';
+			}
+			*indicator = length * sizeof(SQLWCHAR);
+			return SQL_SUCCESS;
+		}
+	}
+	return _StubError(stmt, L"07006", 0, L"Restricted data type attribute violation");
+}
+
+SQLRETURN SQL_API
+_StubAllocHandle(
+	SQLSMALLINT HandleType,
+	SQLHANDLE InputHandle,
+	SQLHANDLE * OutputHandle
+)
+{
+	SQLRETURN RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (HandleType == SQL_HANDLE_DBC && !_StubIsLive(InputHandle, SQL_HANDLE_ENV)
+		|| HandleType == SQL_HANDLE_STMT && !_StubIsLive(InputHandle, SQL_HANDLE_DBC)) {
+		RetCode = SQL_INVALID_HANDLE;
+		goto Exit;
+	}
+	if (HandleType == SQL_HANDLE_STMT && !((STUB_HANDLE*)InputHandle)->connected) {
+		RetCode = _StubError(InputHandle, L"08003", 0, L"Connection not open");
+		goto Exit;
+	}
+
+	STUB_HANDLE * handle = calloc(1, sizeof(STUB_HANDLE));
+	handle->type = HandleType;
+	handle->parent = InputHandle;
+	handle->rowArraySize = 1;
+	handle->next = stubHandles;
+	stubHandles = handle;
+	if (HandleType == SQL_HANDLE_STMT) {
+		stubCounters.liveStatements++;
+	}
+	*OutputHandle = handle;
+
+Exit:
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubFreeHandle(
+	SQLSMALLINT HandleType,
+	SQLHANDLE Handle
+)
+{
+	SQLRETURN RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(Handle, HandleType)) {
+		RetCode = SQL_INVALID_HANDLE;
+	}
+	else {
+		if (HandleType == SQL_HANDLE_DBC) {
+			_StubReleaseStatements(Handle);
+		}
+		_StubReleaseHandle(Handle);
+	}
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubSetEnvAttr(
+	SQLHENV EnvironmentHandle,
+	SQLINTEGER Attribute,
+	SQLPOINTER Value,
+	SQLINTEGER StringLength
+)
+{
+	return SQL_SUCCESS;
+}
+
+BOOL
+_StubIsDsnDown(
+	const SQLWCHAR * connectionString,
+	SQLSMALLINT length
+)
+{
+	SQLWCHAR text[512];
+
+	wcsncpy_s(text, 512, connectionString, (length == SQL_NTS || length >= 512) ? _TRUNCATE : length);
+	for (int i = 0; i < STUB_DSN_COUNT; i++) {
+		if (stubDownDsns[i][0] && wcsstr(text, stubDownDsns[i])) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+SQLRETURN SQL_API
+_StubDriverConnect(
+	SQLHDBC ConnectionHandle,
+	SQLHWND WindowHandle,
+	SQLWCHAR * InConnectionString,
+	SQLSMALLINT StringLength1,
+	SQLWCHAR * OutConnectionString,
+	SQLSMALLINT BufferLength,
+	SQLSMALLINT * StringLength2Ptr,
+	SQLUSMALLINT DriverCompletion
+)
+{
+	STUB_HANDLE * dbc = ConnectionHandle;
+	SQLRETURN	  RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(dbc, SQL_HANDLE_DBC)) {
+		RetCode = SQL_INVALID_HANDLE;
+	}
+	else if (dbc->connected) {
+		RetCode = _StubError(dbc, L"08002", 0, L"Connection name in use");
+	}
+	else if (_StubIsDsnDown(InConnectionString, StringLength1)) {
+		stubCounters.refusedConnects++;
+		RetCode = _StubError(dbc, L"08001", 53, L"Server does not exist or access denied");
+	}
+	else {
+		_StubBegin(dbc);
+		dbc->connected = TRUE;
+		dbc->dead = FALSE;
+		stubCounters.connects++;
+	}
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubDisconnect(
+	SQLHDBC ConnectionHandle
+)
+{
+	STUB_HANDLE * dbc = ConnectionHandle;
+	SQLRETURN	  RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(dbc, SQL_HANDLE_DBC)) {
+		RetCode = SQL_INVALID_HANDLE;
+	}
+	else if (!dbc->connected) {
+		RetCode = _StubError(dbc, L"08003", 0, L"Connection not open");
+	}
+	else {
+		_StubBegin(dbc);
+		_StubReleaseStatements(dbc);
+		dbc->connected = FALSE;
+		dbc->dead = FALSE;
+		stubCounters.disconnects++;
+	}
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubGetConnectAttr(
+	SQLHDBC ConnectionHandle,
+	SQLINTEGER Attribute,
+	SQLPOINTER Value,
+	SQLINTEGER BufferLength,
+	SQLINTEGER * StringLength
+)
+{
+	STUB_HANDLE * dbc = ConnectionHandle;
+	SQLRETURN	  RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(dbc, SQL_HANDLE_DBC)) {
+		RetCode = SQL_INVALID_HANDLE;
+		goto Exit;
+	}
+	_StubBegin(dbc);
+	switch (Attribute) {
+		case SQL_ATTR_CONNECTION_DEAD:
+			if (!dbc->connected) {
+				RetCode = _StubError(dbc, L"08003", 0, L"Connection not open");
+				break;
+			}
+			*(SQLUINTEGER*)Value = dbc->dead ? SQL_CD_TRUE : SQL_CD_FALSE;
+			break;
+		case SQL_ATTR_AUTOCOMMIT:
+			*(SQLUINTEGER*)Value = SQL_AUTOCOMMIT_ON;
+			break;
+		case SQL_COPT_SS_MARS_ENABLED:
+			*(SQLUINTEGER*)Value = SQL_MARS_ENABLED_YES;
+			break;
+		default:
+			RetCode = _StubError(dbc, L"HY092", 0, L"Invalid attribute");
+	}
+
+Exit:
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubSetConnectAttr(
+	SQLHDBC ConnectionHandle,
+	SQLINTEGER Attribute,
+	SQLPOINTER Value,
+	SQLINTEGER StringLength
+)
+{
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQL_API
+_StubGetDiagRec(
+	SQLSMALLINT HandleType,
+	SQLHANDLE Handle,
+	SQLSMALLINT RecNumber,
+	SQLWCHAR * Sqlstate,
+	SQLINTEGER * NativeError,
+	SQLWCHAR * MessageText,
+	SQLSMALLINT BufferLength,
+	SQLSMALLINT * TextLength
+)
+{
+	STUB_HANDLE * handle = Handle;
+	SQLRETURN	  RetCode = SQL_NO_DATA;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(handle, HandleType)) {
+		RetCode = SQL_INVALID_HANDLE;
+	}
+	else if (RecNumber == 1 && handle->hasDiagnostic) {
+		wcscpy_s(Sqlstate, SQL_SQLSTATE_SIZE + 1, handle->sqlState);
+		*NativeError = handle->nativeError;
+		wcsncpy_s(MessageText, BufferLength, handle->message, _TRUNCATE);
+		if (TextLength) {
+			*TextLength = (SQLSMALLINT)wcslen(handle->message);
+		}
+		RetCode = SQL_SUCCESS;
+	}
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubSetStmtAttr(
+	SQLHSTMT StatementHandle,
+	SQLINTEGER Attribute,
+	SQLPOINTER Value,
+	SQLINTEGER StringLength
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+		goto Exit;
+	}
+	_StubBegin(stmt);
+	if (stmt->pendingOperation != STUB_OPERATION_NONE) {
+		RetCode = _StubError(stmt, L"HY010", 0, L"Function sequence error");
+		goto Exit;
+	}
+	switch (Attribute) {
+		case SQL_ATTR_ASYNC_ENABLE:
+			stmt->async = ((SQLULEN)Value == SQL_ASYNC_ENABLE_ON);
+			break;
+		case SQL_ATTR_ROW_ARRAY_SIZE:
+			stmt->rowArraySize = (SQLULEN)Value;
+			break;
+		case SQL_ATTR_ROW_BIND_TYPE:
+			stmt->rowBindType = (SQLULEN)Value;
+			break;
+		case SQL_ATTR_ROWS_FETCHED_PTR:
+			stmt->rowsFetched = Value;
+			break;
+		case SQL_SOPT_SS_PARAM_FOCUS: {
+			SQLUSMALLINT focus = (SQLUSMALLINT)(ULONG_PTR)Value;
+			if (focus != 0 && (focus > STUB_TABLE_COUNT || (stmt->boundTables & (1ULL << (focus - 1))) == 0)) {
+				RetCode = _StubError(stmt, L"IM020", 0, L"Parameter focus does not refer to a table-valued parameter");
+				break;
+			}
+			stmt->paramFocus = focus;
+			break;
+		}
+	}
+
+Exit:
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubGetStmtAttr(
+	SQLHSTMT StatementHandle,
+	SQLINTEGER Attribute,
+	SQLPOINTER Value,
+	SQLINTEGER BufferLength,
+	SQLINTEGER * StringLength
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+		goto Exit;
+	}
+	_StubBegin(stmt);
+	switch (Attribute) {
+		case SQL_ATTR_ASYNC_ENABLE:
+			*(SQLULEN*)Value = stmt->async ? SQL_ASYNC_ENABLE_ON : SQL_ASYNC_ENABLE_OFF;
+			break;
+		case SQL_ATTR_ROW_ARRAY_SIZE:
+			*(SQLULEN*)Value = stmt->rowArraySize;
+			break;
+		default:
+			RetCode = _StubError(stmt, L"HY092", 0, L"Invalid attribute");
+	}
+
+Exit:
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubPrepare(
+	SQLHSTMT StatementHandle,
+	SQLWCHAR * StatementText,
+	SQLINTEGER TextLength
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+		goto Exit;
+	}
+	_StubBegin(stmt);
+	RetCode = _StubPoll(stmt, STUB_OPERATION_PREPARE);
+	if (RetCode != SQL_SUCCESS) {
+		goto Exit;
+	}
+	if (stmt->cursorOpen) {
+		RetCode = _StubError(stmt, L"24000", 0, L"Invalid cursor state");
+		goto Exit;
+	}
+	_StubSetText(stmt, StatementText, TextLength);
+	stubCounters.prepares++;
+
+Exit:
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubExecute(
+	SQLHSTMT StatementHandle
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+		goto Exit;
+	}
+	_StubBegin(stmt);
+	if (stmt->text == NULL) {
+		RetCode = _StubError(stmt, L"HY010", 0, L"Function sequence error");
+		goto Exit;
+	}
+	RetCode = _StubPoll(stmt, STUB_OPERATION_EXECUTE);
+	if (RetCode != SQL_SUCCESS) {
+		goto Exit;
+	}
+	if (stmt->cursorOpen) {
+		RetCode = _StubError(stmt, L"24000", 0, L"Invalid cursor state");
+		goto Exit;
+	}
+	RetCode = _StubRun(stmt);
+
+Exit:
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubExecDirect(
+	SQLHSTMT StatementHandle,
+	SQLWCHAR * StatementText,
+	SQLINTEGER TextLength
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+		goto Exit;
+	}
+	_StubBegin(stmt);
+	RetCode = _StubPoll(stmt, STUB_OPERATION_EXECUTE);
+	if (RetCode != SQL_SUCCESS) {
+		goto Exit;
+	}
+	if (stmt->cursorOpen) {
+		RetCode = _StubError(stmt, L"24000", 0, L"Invalid cursor state");
+		goto Exit;
+	}
+	_StubSetText(stmt, StatementText, TextLength);
+	RetCode = _StubRun(stmt);
+
+Exit:
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubFetch(
+	SQLHSTMT StatementHandle
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode;
+	SQLULEN		  rows = 0;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+		goto Exit;
+	}
+	_StubBegin(stmt);
+	if (!stmt->cursorOpen) {
+		RetCode = _StubError(stmt, L"24000", 0, L"Invalid cursor state");
+		goto Exit;
+	}
+	RetCode = _StubPoll(stmt, STUB_OPERATION_FETCH);
+	if (RetCode != SQL_SUCCESS) {
+		goto Exit;
+	}
+	stubCounters.fetches++;
+
+	for (; rows < stmt->rowArraySize && stmt->nextRow < stubRowCount; rows++, stmt->nextRow++) {
+		for (int iCol = 0; iCol < STUB_COLUMN_COUNT; iCol++) {
+			STUB_BINDING * binding = &stmt->bindings[iCol];
+			if (binding->value == NULL) {
+				continue;
+			}
+			// row-wise binding puts rows "rowBindType" bytes apart, column-wise binding packs each column
+			SQLPOINTER	value = (char*)binding->value + rows * (stmt->rowBindType ? stmt->rowBindType : binding->length);
+			SQLLEN	  * indicator = stmt->rowBindType ? (SQLLEN*)((char*)binding->indicator + rows * stmt->rowBindType) : binding->indicator + rows;
+			RetCode = _StubWriteValue(stmt, binding, value, indicator, iCol, stmt->nextRow);
+			if (RetCode != SQL_SUCCESS) {
+				goto Exit;
+			}
+		}
+	}
+	if (stmt->rowsFetched) {
+		*stmt->rowsFetched = rows;
+	}
+	RetCode = rows > 0 ? SQL_SUCCESS : SQL_NO_DATA;
+
+Exit:
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubCancel(
+	SQLHSTMT StatementHandle
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+	}
+	else if (stmt->pendingOperation != STUB_OPERATION_NONE) {
+		// the next poll ends the operation with HY008
+		stmt->canceled = TRUE;
+		stubCounters.cancels++;
+	}
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubFreeStmt(
+	SQLHSTMT StatementHandle,
+	SQLUSMALLINT Option
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+		goto Exit;
+	}
+	_StubBegin(stmt);
+	if (stmt->pendingOperation != STUB_OPERATION_NONE) {
+		RetCode = _StubError(stmt, L"HY010", 0, L"Function sequence error");
+		goto Exit;
+	}
+	if (Option == SQL_CLOSE) {
+		stmt->cursorOpen = FALSE;
+	}
+	else if (Option == SQL_UNBIND) {
+		memset(stmt->bindings, 0, sizeof(stmt->bindings));
+	}
+	else if (Option == SQL_RESET_PARAMS) {
+		stmt->boundParameters = 0;
+	}
+
+Exit:
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubMoreResults(
+	SQLHSTMT StatementHandle
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode = SQL_NO_DATA;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+	}
+	else {
+		_StubBegin(stmt);
+		// a single result per statement
+		stmt->cursorOpen = FALSE;
+	}
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubNumResultCols(
+	SQLHSTMT StatementHandle,
+	SQLSMALLINT * ColumnCount
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+	}
+	else {
+		_StubBegin(stmt);
+		// a prepared SELECT is described before it runs
+		*ColumnCount = (stmt->cursorOpen || (stmt->text && stmt->isSelect)) ? STUB_COLUMN_COUNT : 0;
+	}
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubRowCount(
+	SQLHSTMT StatementHandle,
+	SQLLEN * RowCount
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+	}
+	else {
+		_StubBegin(stmt);
+		*RowCount = stmt->isSelect ? -1 : 1;
+	}
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubColAttribute(
+	SQLHSTMT StatementHandle,
+	SQLUSMALLINT ColumnNumber,
+	SQLUSMALLINT FieldIdentifier,
+	SQLPOINTER CharacterAttribute,
+	SQLSMALLINT BufferLength,
+	SQLSMALLINT * StringLength,
+	SQLLEN * NumericAttribute
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+		goto Exit;
+	}
+	_StubBegin(stmt);
+	if (ColumnNumber < 1 || ColumnNumber > STUB_COLUMN_COUNT) {
+		RetCode = _StubError(stmt, L"07009", 0, L"Invalid descriptor index");
+		goto Exit;
+	}
+	switch (FieldIdentifier) {
+		case SQL_DESC_DISPLAY_SIZE:
+			*NumericAttribute = ColumnNumber == 1 ? 11 : _StubColumnSize(ColumnNumber);
+			break;
+		case SQL_DESC_CONCISE_TYPE:
+			*NumericAttribute = ColumnNumber == 1 ? SQL_INTEGER : SQL_WVARCHAR;
+			break;
+		case SQL_DESC_NAME: {
+			const SQLWCHAR * name = _StubColumnName(ColumnNumber);
+			wcsncpy_s(CharacterAttribute, BufferLength / sizeof(SQLWCHAR), name, _TRUNCATE);
+			if (StringLength) {
+				*StringLength = (SQLSMALLINT)(wcslen(name) * sizeof(SQLWCHAR));
+			}
+			break;
+		}
+		default:
+			RetCode = _StubError(stmt, L"HY091", 0, L"Invalid descriptor field identifier");
+	}
+
+Exit:
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubDescribeCol(
+	SQLHSTMT StatementHandle,
+	SQLUSMALLINT ColumnNumber,
+	SQLWCHAR * ColumnName,
+	SQLSMALLINT BufferLength,
+	SQLSMALLINT * NameLength,
+	SQLSMALLINT * DataType,
+	SQLULEN * ColumnSize,
+	SQLSMALLINT * DecimalDigits,
+	SQLSMALLINT * Nullable
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+		goto Exit;
+	}
+	_StubBegin(stmt);
+	if (ColumnNumber < 1 || ColumnNumber > STUB_COLUMN_COUNT) {
+		RetCode = _StubError(stmt, L"07009", 0, L"Invalid descriptor index");
+		goto Exit;
+	}
+	const SQLWCHAR * name = _StubColumnName(ColumnNumber);
+	if (ColumnName) {
+		wcsncpy_s(ColumnName, BufferLength, name, _TRUNCATE);
+	}
+	if (NameLength) {
+		*NameLength = (SQLSMALLINT)wcslen(name);
+	}
+	if (DataType) {
+		*DataType = ColumnNumber == 1 ? SQL_INTEGER : SQL_WVARCHAR;
+	}
+	if (ColumnSize) {
+		*ColumnSize = _StubColumnSize(ColumnNumber);
+	}
+	if (DecimalDigits) {
+		*DecimalDigits = 0;
+	}
+	if (Nullable) {
+		*Nullable = SQL_NO_NULLS;
+	}
+
+Exit:
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubBindCol(
+	SQLHSTMT StatementHandle,
+	SQLUSMALLINT ColumnNumber,
+	SQLSMALLINT TargetType,
+	SQLPOINTER TargetValue,
+	SQLLEN BufferLength,
+	SQLLEN * StrLen_or_Ind
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+		goto Exit;
+	}
+	_StubBegin(stmt);
+	if (ColumnNumber < 1 || ColumnNumber > STUB_COLUMN_COUNT) {
+		RetCode = _StubError(stmt, L"07009", 0, L"Invalid descriptor index");
+		goto Exit;
+	}
+	STUB_BINDING * binding = &stmt->bindings[ColumnNumber - 1];
+	binding->cType = TargetType;
+	binding->value = TargetValue;
+	binding->length = BufferLength;
+	binding->indicator = StrLen_or_Ind;
+
+Exit:
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubNumParams(
+	SQLHSTMT StatementHandle,
+	SQLSMALLINT * ParameterCount
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+	}
+	else {
+		_StubBegin(stmt);
+		*ParameterCount = stmt->parameterCount;
+	}
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubDescribeParam(
+	SQLHSTMT StatementHandle,
+	SQLUSMALLINT ParameterNumber,
+	SQLSMALLINT * DataType,
+	SQLULEN * ParameterSize,
+	SQLSMALLINT * DecimalDigits,
+	SQLSMALLINT * Nullable
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+		goto Exit;
+	}
+	_StubBegin(stmt);
+	if (ParameterNumber < 1 || ParameterNumber > stmt->parameterCount) {
+		RetCode = _StubError(stmt, L"07009", 0, L"Invalid descriptor index");
+		goto Exit;
+	}
+	if (stmt->tableParameters & (1ULL << (ParameterNumber - 1))) {
+		*DataType = SQL_SS_TABLE;
+		*ParameterSize = 0;
+	}
+	else {
+		*DataType = SQL_INTEGER;
+		*ParameterSize = 10;
+	}
+	*DecimalDigits = 0;
+	*Nullable = SQL_NULLABLE;
+
+Exit:
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+SQLRETURN SQL_API
+_StubBindParameter(
+	SQLHSTMT StatementHandle,
+	SQLUSMALLINT ParameterNumber,
+	SQLSMALLINT InputOutputType,
+	SQLSMALLINT ValueType,
+	SQLSMALLINT ParameterType,
+	SQLULEN ColumnSize,
+	SQLSMALLINT DecimalDigits,
+	SQLPOINTER ParameterValue,
+	SQLLEN BufferLength,
+	SQLLEN * StrLen_or_Ind
+)
+{
+	STUB_HANDLE * stmt = StatementHandle;
+	SQLRETURN	  RetCode = SQL_SUCCESS;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (!_StubIsLive(stmt, SQL_HANDLE_STMT)) {
+		RetCode = SQL_INVALID_HANDLE;
+		goto Exit;
+	}
+	_StubBegin(stmt);
+	if (stmt->paramFocus != 0) {
+		// a column of the focused table-valued parameter, "ParameterValue" is its column-wise array
+		STUB_TABLE * table = &stmt->tables[stmt->paramFocus - 1];
+		if (ParameterNumber < 1 || ParameterNumber > STUB_TABLE_COLUMN_COUNT) {
+			RetCode = _StubError(stmt, L"07009", 0, L"Invalid descriptor index");
+			goto Exit;
+		}
+		STUB_BINDING * column = &table->columns[ParameterNumber - 1];
+		column->cType = ValueType;
+		column->value = ParameterValue;
+		column->length = BufferLength;
+		column->indicator = StrLen_or_Ind;
+		table->columnCount = max(table->columnCount, (SQLSMALLINT)ParameterNumber);
+		goto Exit;
+	}
+	if (ParameterNumber < 1 || ParameterNumber > 64) {
+		RetCode = _StubError(stmt, L"07009", 0, L"Invalid descriptor index");
+		goto Exit;
+	}
+	if (ParameterType == SQL_SS_TABLE) {
+		if (ParameterNumber > STUB_TABLE_COUNT) {
+			RetCode = _StubError(stmt, L"07009", 0, L"Invalid descriptor index");
+			goto Exit;
+		}
+		// "ColumnSize" is the array size, "ParameterValue" the type name and the indicator the rows in use
+		STUB_TABLE * table = &stmt->tables[ParameterNumber - 1];
+		memset(table, 0, sizeof(STUB_TABLE));
+		if (ParameterValue) {
+			wcsncpy_s(table->typeName, STUB_ODBC_TYPE_NAME_LENGTH, ParameterValue, _TRUNCATE);
+		}
+		table->arraySize = ColumnSize;
+		table->rowCount = StrLen_or_Ind;
+		stmt->boundTables |= 1ULL << (ParameterNumber - 1);
+	}
+	else {
+		stmt->boundTables &= ~(1ULL << (ParameterNumber - 1));
+	}
+	stmt->boundParameters |= 1ULL << (ParameterNumber - 1);
+
+Exit:
+	ReleaseSRWLockExclusive(&stubLock);
+	return RetCode;
+}
+
+void
+stubOdbcInstall(
+	void
+)
+{
+	SQLSERVER_ODBC functions;
+
+	// functions left NULL become stubs that fail
+	memset(&functions, 0, sizeof(SQLSERVER_ODBC));
+	functions.AllocHandle = _StubAllocHandle;
+	functions.BindCol = _StubBindCol;
+	functions.BindParameter = _StubBindParameter;
+	functions.Cancel = _StubCancel;
+	functions.ColAttribute = _StubColAttribute;
+	functions.DescribeCol = _StubDescribeCol;
+	functions.DescribeParam = _StubDescribeParam;
+	functions.Disconnect = _StubDisconnect;
+	functions.DriverConnect = _StubDriverConnect;
+	functions.ExecDirect = _StubExecDirect;
+	functions.Execute = _StubExecute;
+	functions.Fetch = _StubFetch;
+	functions.FreeHandle = _StubFreeHandle;
+	functions.FreeStmt = _StubFreeStmt;
+	functions.GetConnectAttr = _StubGetConnectAttr;
+	functions.GetDiagRec = _StubGetDiagRec;
+	functions.GetStmtAttr = _StubGetStmtAttr;
+	functions.MoreResults = _StubMoreResults;
+	functions.NumParams = _StubNumParams;
+	functions.NumResultCols = _StubNumResultCols;
+	functions.Prepare = _StubPrepare;
+	functions.RowCount = _StubRowCount;
+	functions.SetConnectAttr = _StubSetConnectAttr;
+	functions.SetEnvAttr = _StubSetEnvAttr;
+	functions.SetStmtAttr = _StubSetStmtAttr;
+
+	if (!sqlserverInstallOdbcFunctions(&functions)) {
+		fprintf(stderr, "ODBC functions were resolved before the stub driver was installed\n");
+		exit(2);
+	}
+}
+
+void
+stubOdbcSetRowCount(
+	int rowCount
+)
+{
+	AcquireSRWLockExclusive(&stubLock);
+	stubRowCount = rowCount;
+	ReleaseSRWLockExclusive(&stubLock);
+}
+
+void
+stubOdbcSetDsnDown(
+	const char * dsn,
+	BOOL down
+)
+{
+	SQLWCHAR pattern[STUB_DSN_LENGTH] = L"DSN=";
+	SQLWCHAR name[STUB_DSN_LENGTH];
+
+	mbstowcs_s(NULL, name, STUB_DSN_LENGTH, dsn, _TRUNCATE);
+	wcscat_s(pattern, STUB_DSN_LENGTH, name);
+	wcscat_s(pattern, STUB_DSN_LENGTH, L";");
+
+	AcquireSRWLockExclusive(&stubLock);
+	for (int i = 0; i < STUB_DSN_COUNT; i++) {
+		if (wcscmp(stubDownDsns[i], pattern) == 0) {
+			stubDownDsns[i][0] = L'\0';
+		}
+	}
+	for (int i = 0; i < STUB_DSN_COUNT && down; i++) {
+		if (stubDownDsns[i][0] == L'\0') {
+			wcscpy_s(stubDownDsns[i], STUB_DSN_LENGTH, pattern);
+			break;
+		}
+	}
+	ReleaseSRWLockExclusive(&stubLock);
+}
+
+BOOL
+stubOdbcGetTable(
+	SQLUSMALLINT paramIndex,
+	STUB_ODBC_TABLE * table
+)
+{
+	BOOL received = FALSE;
+
+	AcquireSRWLockExclusive(&stubLock);
+	if (paramIndex >= 1 && paramIndex <= STUB_TABLE_COUNT && (stubTablesReceived & (1ULL << (paramIndex - 1)))) {
+		*table = stubTables[paramIndex - 1];
+		received = TRUE;
+	}
+	ReleaseSRWLockExclusive(&stubLock);
+	return received;
+}
+
+void
+stubOdbcSetText(
+	const SQLWCHAR * name,
+	const SQLWCHAR * value
+)
+{
+	AcquireSRWLockExclusive(&stubLock);
+	stubTextName = name;
+	stubTextValue = value;
+	ReleaseSRWLockExclusive(&stubLock);
+}
+
+void
+stubOdbcFailExecutions(
+	int count,
+	SQLINTEGER nativeError,
+	const char * sqlState,
+	BOOL connectionLost
+)
+{
+	AcquireSRWLockExclusive(&stubLock);
+	stubFailCount = count;
+	stubFailNativeError = nativeError;
+	mbstowcs_s(NULL, stubFailSqlState, SQL_SQLSTATE_SIZE + 1, sqlState, SQL_SQLSTATE_SIZE);
+	stubFailConnectionLost = connectionLost;
+	ReleaseSRWLockExclusive(&stubLock);
+}
+
+void
+stubOdbcSetPendingPolls(
+	int polls
+)
+{
+	AcquireSRWLockExclusive(&stubLock);
+	stubPendingPolls = polls;
+	ReleaseSRWLockExclusive(&stubLock);
+}
+
+void
+stubOdbcGetCounters(
+	STUB_ODBC_COUNTERS * counters
+)
+{
+	AcquireSRWLockShared(&stubLock);
+	*counters = stubCounters;
+	ReleaseSRWLockShared(&stubLock);
+}
@@ -0,0 +1,86 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+
+#pragma once
+
+#include <windows.h>
+
+#include "sqlserver-interface.h"
+
+/*	In-process ODBC driver for the checks of this directory, installed with sqlserverInstallOdbcFunctions before
+	the first connection. Every SELECT returns stubOdbcSetRowCount rows of two columns, "id" (1, 2, ...) and "name"
+	("row 1", "row 2", ...). Other statements return no result set and report one affected row */
+
+typedef struct _STUB_ODBC_COUNTERS {
+	LONG			connects;
+	/*	connections refused because their DSN is down, see stubOdbcSetDsnDown */
+	LONG			refusedConnects;
+	LONG			disconnects;
+	LONG			prepares;
+	/*	SQLExecute and SQLExecDirect calls that ran, failed ones included */
+	LONG			executions;
+	LONG			fetches;
+	/*	calls answered with SQL_STILL_EXECUTING */
+	LONG			stillExecuting;
+	LONG			cancels;
+	/*	statement handles not released yet by SQLFreeHandle or SQLDisconnect */
+	LONG			liveStatements;
+} STUB_ODBC_COUNTERS;
+
+#define STUB_ODBC_TYPE_NAME_LENGTH	64
+
+/*	What the last execution received in a table-valued parameter */
+typedef struct _STUB_ODBC_TABLE {
+	SQLWCHAR		typeName[STUB_ODBC_TYPE_NAME_LENGTH];
+	/*	rows in use, 0 for SQL_DEFAULT_PARAM */
+	SQLLEN			rowCount;
+	/*	columns bound, 0 for an empty table */
+	SQLSMALLINT		columnCount;
+	/*	sum of the first column when it is bound as SQL_C_SBIGINT, NULLs left out */
+	LONGLONG		firstColumnSum;
+	/*	values sent as SQL_NULL_DATA */
+	LONG			nullCount;
+} STUB_ODBC_TABLE;
+
+/*	Counts failed checks, the exit code of a check */
+extern int			stubFailures;
+
+#define STUB_CHECK(condition)		stubCheck((condition), #condition, __FILE__, __LINE__)
+
+BOOL				stubCheck(BOOL passed, const char* condition, const char* file, int line);
+
+void				stubOdbcInstall(void);
+void				stubOdbcSetRowCount(int rowCount);
+
+/*	The second column of later result sets is called "name" and holds "value" in every row, wide character
+	bindings only. Both are used as is until the next call, NULL restores "name" and "row 1", "row 2", ... */
+void				stubOdbcSetText(const SQLWCHAR* name, const SQLWCHAR* value);
+
+/*	The next "count" executions fail with "nativeError" and "sqlState". With "connectionLost" the connection is
+	reported dead (SQL_ATTR_CONNECTION_DEAD) until it is connected again */
+void				stubOdbcFailExecutions(int count, SQLINTEGER nativeError, const char* sqlState, BOOL connectionLost);
+
+/*	Connection strings naming "DSN=<dsn>;" are refused with 08001 while "down" is set. Up to 8 DSNs are down at once */
+void				stubOdbcSetDsnDown(const char* dsn, BOOL down);
+
+/*	Prepares, executions and fetches of statements with SQL_ATTR_ASYNC_ENABLE return SQL_STILL_EXECUTING
+	"polls" times before they run */
+void				stubOdbcSetPendingPolls(int polls);
+
+void				stubOdbcGetCounters(STUB_ODBC_COUNTERS* counters);
+
+/*	A parameter right after FROM, as in "INSERT INTO t SELECT id FROM ?", is described as SQL_SS_TABLE. Returns FALSE
+	unless the last execution received parameter "paramIndex" as a table */
+BOOL				stubOdbcGetTable(SQLUSMALLINT paramIndex, STUB_ODBC_TABLE* table);
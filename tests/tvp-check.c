@@ -0,0 +1,166 @@
+/**
+ * This file is part of Sodium Language project
+ *
+ * Copyright  2020 Murad Karaka <muradkarakas@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License v3.0
+ * as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ *	https://choosealicense.com/licenses/gpl-3.0/
+ */
+
+
+/*	Binds table-valued parameters with sqlserverBindTableParameter against the stub driver and checks what the
+	execution sends: the type name, the rows in use, the columns and their NULLs. Also checks that invalid
+	bindings are rejected before they reach the driver. Exits with the number of failed checks */
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sqlserver-interface.h"
+#include "sqlserver-tvp.h"
+#include "sqlserver-stub-odbc.h"
+
+#define TVP_CHECK_QUERY			"INSERT INTO stub (id, name) SELECT id, name FROM ?"
+#define TVP_CHECK_ROW_COUNT		3
+
+/*	Executes the prepared TVP_CHECK_QUERY and returns what the stub received in its table-valued parameter */
+BOOL
+_Execute(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm,
+	STUB_ODBC_TABLE * table
+)
+{
+	SQLSERVER_ERROR error;
+
+	sqlserverExecuteUpdateStatement(conn, stm, NULL);
+	if (!STUB_CHECK(!sqlserverGetStatementError(stm, &error))) {
+		fprintf(stderr, "%s\n", error.message);
+		return FALSE;
+	}
+	return STUB_CHECK(stubOdbcGetTable(1, table));
+}
+
+void
+_CheckRowsAreSent(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLBIGINT				ids[TVP_CHECK_ROW_COUNT] = { 1, 2, 3 };
+	SQLLEN					idIndicators[TVP_CHECK_ROW_COUNT] = { sizeof(SQLBIGINT), SQL_NULL_DATA, sizeof(SQLBIGINT) };
+	SQLWCHAR				names[TVP_CHECK_ROW_COUNT][16] = { L"one", L"two", L"three" };
+	SQLSERVER_TVP_COLUMN	columns[2];
+	STUB_ODBC_TABLE			table;
+
+	memset(columns, 0, sizeof(columns));
+	columns[0].cType = SQL_C_SBIGINT;
+	columns[0].sqlType = SQL_BIGINT;
+	columns[0].values = ids;
+	columns[0].elementSize = sizeof(SQLBIGINT);
+	columns[0].indicators = idIndicators;
+	// null terminated, the indicators are generated
+	columns[1].cType = SQL_C_WCHAR;
+	columns[1].sqlType = SQL_WVARCHAR;
+	columns[1].columnSize = 15;
+	columns[1].values = names;
+	columns[1].elementSize = sizeof(names[0]);
+
+	STUB_CHECK(sqlserverBindTableParameter(conn, stm, 1, "dbo.StubRows", columns, 2, TVP_CHECK_ROW_COUNT));
+	if (_Execute(conn, stm, &table)) {
+		STUB_CHECK(wcscmp(table.typeName, L"dbo.StubRows") == 0);
+		STUB_CHECK(table.rowCount == TVP_CHECK_ROW_COUNT);
+		STUB_CHECK(table.columnCount == 2);
+		STUB_CHECK(table.firstColumnSum == 4);
+		STUB_CHECK(table.nullCount == 1);
+	}
+
+	// bound again with fewer rows, the same arrays
+	STUB_CHECK(sqlserverBindTableParameter(conn, stm, 1, "dbo.StubRows", columns, 2, 1));
+	if (_Execute(conn, stm, &table)) {
+		STUB_CHECK(table.rowCount == 1);
+		STUB_CHECK(table.firstColumnSum == 1);
+		STUB_CHECK(table.nullCount == 0);
+	}
+}
+
+void
+_CheckEmptyTable(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	STUB_ODBC_TABLE table;
+
+	STUB_CHECK(sqlserverBindTableParameter(conn, stm, 1, "dbo.StubRows", NULL, 0, 0));
+	if (_Execute(conn, stm, &table)) {
+		STUB_CHECK(wcscmp(table.typeName, L"dbo.StubRows") == 0);
+		STUB_CHECK(table.rowCount == 0);
+		STUB_CHECK(table.columnCount == 0);
+	}
+}
+
+/*	Rejected bindings leave the last valid one in place */
+void
+_CheckInvalidBindings(
+	DBInt_Connection * conn,
+	DBInt_Statement * stm
+)
+{
+	SQLBIGINT				ids[1] = { 7 };
+	SQLSERVER_TVP_COLUMN	column;
+	SQLSERVER_ERROR			error;
+	STUB_ODBC_TABLE			table;
+
+	memset(&column, 0, sizeof(column));
+	column.cType = SQL_C_SBIGINT;
+	column.sqlType = SQL_BIGINT;
+	column.values = ids;
+	column.elementSize = sizeof(SQLBIGINT);
+
+	STUB_CHECK(!sqlserverBindTableParameter(conn, stm, 0, "dbo.StubRows", &column, 1, 1));
+	STUB_CHECK(sqlserverGetStatementError(stm, &error) && strcmp(error.message, "Invalid parameter index") == 0);
+
+	STUB_CHECK(!sqlserverBindTableParameter(conn, stm, 1, "dbo.StubRows", &column, 0, 1));
+	STUB_CHECK(sqlserverGetStatementError(stm, &error));
+	STUB_CHECK(!sqlserverBindTableParameter(conn, stm, 1, "dbo.StubRows", NULL, 1, 1));
+	STUB_CHECK(sqlserverGetStatementError(stm, &error));
+
+	if (_Execute(conn, stm, &table)) {
+		STUB_CHECK(table.rowCount == 0);
+	}
+}
+
+int
+main(
+	void
+)
+{
+	HANDLE heap = HeapCreate(0, 0, 0);
+
+	stubOdbcInstall();
+
+	DBInt_Connection * conn = sqlserverCreateConnection(heap, SODIUM_SQLSERVER_SUPPORT, "stub", "", "stub", "stub", "stub");
+	if (conn->err) {
+		fprintf(stderr, "Unable to connect to the stub driver\n");
+		return 2;
+	}
+
+	DBInt_Statement * stm = sqlserverCreateStatement(conn);
+	sqlserverPrepare(conn, stm, TVP_CHECK_QUERY);
+
+	_CheckRowsAreSent(conn, stm);
+	_CheckEmptyTable(conn, stm);
+	_CheckInvalidBindings(conn, stm);
+
+	sqlserverFreeStatement(conn, stm);
+	sqlserverDestroyConnection(conn);
+	HeapDestroy(heap);
+
+	printf("tvp check: %d failed\n", stubFailures);
+	return stubFailures;
+}